@@ -0,0 +1,91 @@
+/** @file
+  Extra interface of the DebugToConsoleLib DebugLib instance.
+  
+  Copyright (c) 2016, Matthew Lazarowitz. All rights reserved.<BR>
+  This program and the accompanying materials are licensed and made available under
+  the terms and conditions of the MIT License that accompanies this distribution.
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+**/
+#ifndef _DEBUG_TO_CONSOLE_LIB_H_
+#define _DEBUG_TO_CONSOLE_LIB_H_
+
+#include <Protocol/SimpleFileSystem.h>
+
+/**
+  Write any debug output that has been gathered but not yet sent to the console.
+
+  DebugToConsoleLib sends its output a line or a block at a time. Call this before printing
+  to the console some other way, such as with AsciiPrint, when the order of the two matters.
+**/
+VOID
+EFIAPI
+DebugToConsoleFlush (
+  VOID
+  );
+
+/**
+  Send debug output to a ring buffer in memory instead of the console.
+
+  Console output is slow enough to change the timing of whatever is being debugged.
+  Once the ring is started, DEBUG output only costs the formatting, and the ring
+  can be dumped with DebugToConsoleDumpRing when the timing no longer matters.
+  When the ring fills, the oldest output is overwritten.
+
+  @param[in] Size  The size of the ring in bytes.
+
+  @retval EFI_SUCCESS            The ring was started.
+  @retval EFI_INVALID_PARAMETER  Size is 0.
+  @retval EFI_ALREADY_STARTED    A ring has already been started.
+  @retval EFI_OUT_OF_RESOURCES   The ring could not be allocated.
+**/
+EFI_STATUS
+EFIAPI
+DebugToConsoleStartRing (
+  IN UINTN Size
+  );
+
+/**
+  Write the contents of the ring, oldest first, to a file or to the console.
+  The ring keeps collecting output afterwards, and is not emptied.
+
+  @param[in] File  The file to write to, such as one from CreateFileFromArgument, or NULL for the console.
+
+  @retval EFI_SUCCESS      The ring was written.
+  @retval EFI_NOT_STARTED  No ring has been started.
+  @return Errors from the file protocol Write.
+**/
+EFI_STATUS
+EFIAPI
+DebugToConsoleDumpRing (
+  IN EFI_FILE_PROTOCOL* File OPTIONAL
+  );
+
+/**
+  Stop sending debug output to the ring, and free it. Output goes to the console again.
+  Whatever the ring held is discarded, so dump it first if it is wanted.
+
+  @param[out] Total  Optionally returns how many characters were written to the ring,
+                     including any that were overwritten.
+**/
+VOID
+EFIAPI
+DebugToConsoleStopRing (
+  OUT UINT64* Total OPTIONAL
+  );
+#endif
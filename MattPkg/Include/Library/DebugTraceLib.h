@@ -0,0 +1,143 @@
+/** @file
+  Library interface for DebugTraceLib, a binary trace that leaves the formatting for later.
+  
+  Copyright (c) 2016, Matthew Lazarowitz. All rights reserved.<BR>
+  This program and the accompanying materials are licensed and made available under
+  the terms and conditions of the MIT License that accompanies this distribution.
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+**/
+#ifndef _DEBUG_TRACE_LIB_H_
+#define _DEBUG_TRACE_LIB_H_
+
+#include <Protocol/SimpleFileSystem.h>
+
+//
+// A trace file is a DEBUG_TRACE_HEADER followed by RecordCount DEBUG_TRACE_RECORDs, oldest first.
+// Format is the address of the format string in the running image, so ImageBase turns it into
+// an offset the decoder can look up in the built .efi. Ticks is the raw performance counter;
+// CounterStart, CounterEnd and Frequency come from GetPerformanceCounterProperties.
+// TotalRecords counts every record traced, so TotalRecords - RecordCount were overwritten.
+// Scripts/DecodeDebugTrace.py formats a trace file against the image it came from.
+//
+#define DEBUG_TRACE_SIGNATURE  SIGNATURE_32 ('X', 'T', 'R', 'C')
+#define DEBUG_TRACE_VERSION    1
+
+//
+// The most argument words a record holds.
+//
+#define DEBUG_TRACE_MAX_ARGUMENTS  3
+
+typedef struct _DEBUG_TRACE_HEADER {
+  UINT32 Signature;
+  UINT32 Version;
+  UINT64 ImageBase;
+  UINT64 ImageSize;
+  UINT64 Frequency;
+  UINT64 CounterStart;
+  UINT64 CounterEnd;
+  UINT64 RecordCount;
+  UINT64 TotalRecords;
+} DEBUG_TRACE_HEADER;
+
+typedef struct _DEBUG_TRACE_RECORD {
+  UINT64 Ticks;
+  UINT64 Format;
+  UINT64 Arguments[DEBUG_TRACE_MAX_ARGUMENTS];
+} DEBUG_TRACE_RECORD;
+
+/**
+  Start tracing into a ring of records in memory. Until this is called DebugTrace does nothing.
+  When the ring fills, the oldest records are overwritten.
+
+  @param[in] RecordCount  How many records the ring holds.
+
+  @retval EFI_SUCCESS            Tracing has started.
+  @retval EFI_INVALID_PARAMETER  RecordCount is 0.
+  @retval EFI_ALREADY_STARTED    Tracing has already been started.
+  @retval EFI_OUT_OF_RESOURCES   The ring could not be allocated.
+  @return Errors from looking up the loaded image of the module.
+**/
+EFI_STATUS
+EFIAPI
+DebugTraceStart (
+  IN UINTN RecordCount
+  );
+
+/**
+  Record a trace event. Only the format string address, the time and the argument words
+  are stored, so this costs a few stores. The decoder formats them later, so %a and %s
+  arguments must point to strings that are part of the image, such as string constants.
+
+  @param[in] Format     A PrintLib format string constant.
+  @param[in] Argument0  The first argument the format uses, or 0.
+  @param[in] Argument1  The second argument the format uses, or 0.
+  @param[in] Argument2  The third argument the format uses, or 0.
+**/
+VOID
+EFIAPI
+DebugTrace (
+  IN CONST CHAR8* Format,
+  IN UINT64       Argument0,
+  IN UINT64       Argument1,
+  IN UINT64       Argument2
+  );
+
+/**
+  Write the trace, oldest record first, to a file such as one from CreateFileFromArgument.
+  Tracing carries on afterwards and the ring is not emptied.
+
+  @param[in] File  The file to write to.
+
+  @retval EFI_SUCCESS            The trace was written.
+  @retval EFI_INVALID_PARAMETER  File is NULL.
+  @retval EFI_NOT_STARTED        Tracing has not been started.
+  @return Errors from the file protocol Write.
+**/
+EFI_STATUS
+EFIAPI
+DebugTraceDump (
+  IN EFI_FILE_PROTOCOL* File
+  );
+
+/**
+  Stop tracing and free the ring. Whatever it held is discarded, so dump it first if it is wanted.
+**/
+VOID
+EFIAPI
+DebugTraceStop (
+  VOID
+  );
+
+//
+// Trace macros for up to three arguments. Like DEBUG, they compile to nothing when
+// MDEPKG_NDEBUG is defined.
+//
+#if !defined (MDEPKG_NDEBUG)
+#define DEBUG_TRACE0(Format)              DebugTrace ((Format), 0, 0, 0)
+#define DEBUG_TRACE1(Format, A0)          DebugTrace ((Format), (UINT64)(A0), 0, 0)
+#define DEBUG_TRACE2(Format, A0, A1)      DebugTrace ((Format), (UINT64)(A0), (UINT64)(A1), 0)
+#define DEBUG_TRACE3(Format, A0, A1, A2)  DebugTrace ((Format), (UINT64)(A0), (UINT64)(A1), (UINT64)(A2))
+#else
+#define DEBUG_TRACE0(Format)
+#define DEBUG_TRACE1(Format, A0)
+#define DEBUG_TRACE2(Format, A0, A1)
+#define DEBUG_TRACE3(Format, A0, A1, A2)
+#endif
+
+#endif
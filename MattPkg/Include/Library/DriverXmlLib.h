@@ -26,6 +26,22 @@
 #ifndef _DRIVER_XML_LIB_H_
 #define _DRIVER_XML_LIB_H_
 
+#include <Protocol/SimpleFileSystem.h>
+
+//
+// A table of interned strings. Names and namespace URIs are given small integer ids
+// that stay the same for the life of the table so they can be compared directly.
+// Id 0 is never assigned. On a tag or attribute it means "no namespace".
+//
+typedef struct _DRIVER_XML_NAME_TABLE DRIVER_XML_NAME_TABLE;
+
+#define DRIVER_XML_NO_NAMESPACE 0
+
+//
+// A copy-on-write view of a parsed tree. See DriverXmlCreateSnapshot.
+//
+typedef struct _DRIVER_XML_SNAPSHOT DRIVER_XML_SNAPSHOT;
+
 #pragma pack(push,1)
 typedef enum _XML_DATA_TYPE {
   XmlNothing,
@@ -37,6 +53,7 @@ typedef enum _XML_DATA_TYPE {
   XmlPi,
   XmlDecl,
   XmlComment,
+  XmlDataTypeMax
 } XML_DATA_TYPE;
 
 typedef struct _LIST_ANCHOR {
@@ -57,11 +74,25 @@ typedef struct _DRIVER_XML_DATA_HEADER {
 // It may have a list of N attributes and be arranged in a tree with N branches.
 // There may also be XML character data that this tag describes how to handle.
 // That can be broken up into multiple pieces so it needs to be a list as well.
+// NamespaceId and LocalNameId are only filled out by a namespace aware parse.
+// SourceOffset and SourceLength are where the element was in the parsed document, from 
+// the '<' of the start tag through the '>' of the end tag. They are 0 on trees not made by the parser.
+// Flags records changes made since the element was parsed or last written with PrintDataIncremental.
+// Hash and LocalHash are structural hashes filled out by DriverXmlUpdateHashes. They are only
+// meaningful while DRIVER_XML_TAG_HASH_VALID is set.
 //
 typedef struct _DRIVER_XML_TAG {
   LIST_ENTRY DataLink;
   XML_DATA_TYPE XmlDataType; 
   CHAR8* TagName;
+  UINTN NamespaceId;
+  UINTN LocalNameId;
+  UINTN SourceOffset;
+  UINTN SourceLength;
+  struct _DRIVER_XML_TAG* Parent;
+  UINT32 Flags;
+  UINT64 Hash;
+  UINT64 LocalHash;
   LIST_ANCHOR TagAttributes;
   LIST_ANCHOR TagChildren;
 } DRIVER_XML_TAG;
@@ -75,6 +106,9 @@ typedef struct _DRIVER_XML_ATTRIBUTE {
   XML_DATA_TYPE XmlDataType;
   CHAR8* AttributeName;
   CHAR8* AttributeData;
+  UINTN NamespaceId;
+  UINTN LocalNameId;
+  UINT32 Flags;
 } DRIVER_XML_ATTRIBUTE;
 
 //
@@ -85,8 +119,18 @@ typedef struct _DRIVER_XML_CHAR_DATA {
   XML_DATA_TYPE XmlDataType;
   UINTN DataSize; //track size so we don't need to use AsciiStrLen on this data all the time.
   CHAR8* CharData;
+  UINT32 Flags;
 } DRIVER_XML_CHAR_DATA;
 
+//
+// DRIVER_XML_ATTRIBUTE and DRIVER_XML_CHAR_DATA Flags.
+// RAW means the value still holds its references as written because it was parsed or decoded
+// without DRIVER_XML_PARSE_EXPAND_ENTITIES. The printers keep an '&' that starts a reference in it.
+// A value without the flag is literal and every '&' in it is written as &amp;. Values set through
+// DriverXmlSetAttribute, DriverXmlSetCharData or DriverXmlAppendCharData are always literal.
+//
+#define DRIVER_XML_TEXT_RAW  BIT0
+
 typedef struct _DRIVER_XML_PROCESSING_INSTRUCTION {
   LIST_ENTRY DataLink;
   XML_DATA_TYPE XmlDataType; 
@@ -94,18 +138,314 @@ typedef struct _DRIVER_XML_PROCESSING_INSTRUCTION {
   CHAR8* PiTargetData;
 } DRIVER_XML_PROCESSING_INSTRUCTION;
 
+//
+// A destination for printed XML. Write takes each run of output as it is produced and
+// Flush pushes out anything the sink is holding. Stock sinks are below. A custom sink
+// puts this structure first in its own and casts back to it in the callbacks.
+//
+typedef struct _DRIVER_XML_OUTPUT_SINK DRIVER_XML_OUTPUT_SINK;
+
+typedef
+EFI_STATUS
+(*DRIVER_XML_SINK_WRITE) (
+  DRIVER_XML_OUTPUT_SINK* Sink,
+  CONST CHAR8*            Bytes,
+  UINTN                   Length
+);
+
+typedef
+EFI_STATUS
+(*DRIVER_XML_SINK_FLUSH) (
+  DRIVER_XML_OUTPUT_SINK* Sink
+);
+
+struct _DRIVER_XML_OUTPUT_SINK {
+  DRIVER_XML_SINK_WRITE Write;
+  DRIVER_XML_SINK_FLUSH Flush;
+};
+
 //
 // This is a housekeeping data structure used by the parser to 
 // stream through the XML document as it is extracting chunks.
 // It contains the document, the side of the document and the stream pointer OperationPtr.
+// The print functions use it for their output. Zero the whole structure for an output buffer
+// that is allocated and grown as needed, or use PrintDataToBuffer for a buffer of your own.
+// RequiredSize is the number of bytes the output needs, which is the used length when it fit.
+// When Sink is set the output goes to it instead of the buffer and RequiredSize counts what was sent.
 //
 typedef struct _XML_DOCUMENT {
   CHAR8 *XmlDocument;
   UINTN DocumentSize;
-  CHAR8 *OperationPtr; 
+  CHAR8 *OperationPtr;
+  UINT32 Flags;
+  UINTN RequiredSize;
+  DRIVER_XML_OUTPUT_SINK *Sink;
 } XML_DOCUMENT;
+
+//
+// XML_DOCUMENT Flags.
+// FIXED_SIZE means XmlDocument belongs to the caller and is never grown.
+//
+#define XML_DOCUMENT_FIXED_SIZE       BIT0
+
+//
+// A sink that collects the output in a pool buffer that grows as needed.
+// Document.XmlDocument holds the output and Document.RequiredSize its length. Free it with FreePool.
+//
+typedef struct _DRIVER_XML_MEMORY_SINK {
+  DRIVER_XML_OUTPUT_SINK Sink;
+  XML_DOCUMENT           Document;
+} DRIVER_XML_MEMORY_SINK;
+
+//
+// A sink that keeps only the last BufferSize bytes of output in a caller's buffer.
+// Next is where the next byte goes and TotalBytes is everything ever written.
+//
+typedef struct _DRIVER_XML_RING_SINK {
+  DRIVER_XML_OUTPUT_SINK Sink;
+  CHAR8*                 Buffer;
+  UINTN                  BufferSize;
+  UINTN                  Next;
+  UINT64                 TotalBytes;
+} DRIVER_XML_RING_SINK;
+
+//
+// A sink that writes to an open file in blocks of BufferSize bytes gathered in a caller's buffer.
+//
+typedef struct _DRIVER_XML_FILE_SINK {
+  DRIVER_XML_OUTPUT_SINK Sink;
+  EFI_FILE_PROTOCOL*     File;
+  CHAR8*                 Buffer;
+  UINTN                  BufferSize;
+  UINTN                  Used;
+} DRIVER_XML_FILE_SINK;
+
+//
+// A sink that prints to the system console.
+//
+typedef struct _DRIVER_XML_CONSOLE_SINK {
+  DRIVER_XML_OUTPUT_SINK Sink;
+} DRIVER_XML_CONSOLE_SINK;
+
+//
+// Writes a document straight to a sink without building a tree. Set it up with DriverXmlInitWriter.
+// The names of the open elements are kept in a buffer from the caller, innermost last and each
+// followed by a null, so a document of any size is written without allocating anything.
+// StartTagOpen means the innermost start tag can still take attributes and has no '>' yet.
+// Status holds the first error, including a bad argument or a full name stack, and every later
+// call and DriverXmlWriterFinish return it.
+//
+typedef struct _DRIVER_XML_WRITER {
+  XML_DOCUMENT Document;
+  CHAR8*       NameStack;
+  UINTN        NameStackSize;
+  UINTN        NameStackUsed;
+  UINTN        Depth;
+  BOOLEAN      StartTagOpen;
+  EFI_STATUS   Status;
+} DRIVER_XML_WRITER;
+
+//
+// Budgets for parsing untrusted documents. Each field is 0 for no limit.
+// Going over any of them stops the parse with EFI_SECURITY_VIOLATION so the caller
+// can tell a budget failure apart from malformed XML (EFI_DEVICE_ERROR).
+//
+typedef struct _DRIVER_XML_PARSE_LIMITS {
+  UINTN MaxBytes;       // Bytes allocated for the nodes and strings of the tree.
+  UINTN MaxNodes;       // Tags, char data and processing instructions in the tree.
+  UINTN MaxDepth;       // How deeply tags may be nested.
+  UINTN MaxAttributes;  // Attributes on a single tag.
+  UINTN MaxTextLength;  // Characters in a single run of char data or attribute value.
+} DRIVER_XML_PARSE_LIMITS;
+
+//
+// Options that change how the parser treats the document as it is tokenized.
+// A NULL options pointer to DriverXmlParseEx is the same as DRIVER_XML_PARSE_DEFAULT_FLAGS.
+//
+typedef struct _DRIVER_XML_PARSE_OPTIONS {
+  UINT32 Flags;
+  //
+  // Required for DRIVER_XML_PARSE_NAMESPACES. Ids in the tree come from this table.
+  //
+  DRIVER_XML_NAME_TABLE* NameTable;
+  //
+  // Limits for DRIVER_XML_PARSE_EXPAND_ENTITIES. 0 selects the DRIVER_XML_DEFAULT_* value.
+  // Depth is how many entities may be nested inside each other.
+  // Expansion is the total bytes of entity replacement text allowed for the whole document.
+  //
+  UINTN MaxEntityDepth;
+  UINTN MaxEntityExpansion;
+  DRIVER_XML_PARSE_LIMITS Limits;
+} DRIVER_XML_PARSE_OPTIONS;
 #pragma pack(pop)
 
+//
+// DRIVER_XML_TAG Flags.
+// MODIFIED means the tag's own name, attributes, char data or list of children changed.
+// CHILD_MODIFIED means something below it did. Set them with DriverXmlMarkModified.
+//
+#define DRIVER_XML_TAG_MODIFIED        BIT0
+#define DRIVER_XML_TAG_CHILD_MODIFIED  BIT1
+//
+// Hash and LocalHash are up to date. Editing a tag clears this on it and its ancestors.
+//
+#define DRIVER_XML_TAG_HASH_VALID      BIT2
+
+//
+// What DriverXmlDiffTrees or DriverXmlFindDuplicateSubtrees found.
+//
+typedef enum _DRIVER_XML_DIFF_KIND {
+  XmlDiffChanged,     // The tag's name, attributes or its own text changed
+  XmlDiffAdded,       // NewTag is only in the new tree
+  XmlDiffRemoved,     // OldTag is only in the old tree
+  XmlDiffDuplicate    // NewTag is a repeat of the branch at OldTag
+} DRIVER_XML_DIFF_KIND;
+
+typedef
+VOID
+(*DRIVER_XML_DIFF_CALLBACK) (
+  DRIVER_XML_DIFF_KIND Kind,
+  DRIVER_XML_TAG*      OldTag,
+  DRIVER_XML_TAG*      NewTag,
+  VOID*                Context
+);
+
+//
+// A handler called by the tree walker for one element. Depth is how far below the
+// starting level the element is. A pre-order handler may return DRIVER_XML_VISIT_SKIP
+// to leave the element's children out of the walk. Any handler may return
+// DRIVER_XML_VISIT_STOP to end the walk early with EFI_SUCCESS. Any error ends the
+// walk and is returned by it.
+//
+typedef
+EFI_STATUS
+(*DRIVER_XML_VISIT_HANDLER) (
+  DRIVER_XML_DATA_HEADER* Element,
+  UINTN                   Depth,
+  VOID*                   Context
+);
+
+#define DRIVER_XML_VISIT_SKIP  ENCODE_WARNING (0x1000)
+#define DRIVER_XML_VISIT_STOP  ENCODE_WARNING (0x1001)
+
+//
+// Handlers for each XML_DATA_TYPE, indexed by the type. PreOrder is called when the walk
+// reaches an element and PostOrder once everything below it has been visited, so a tag
+// gets both around its children. A NULL entry means elements of that type are passed over.
+// Attributes are not walked as children; a tag handler can reach them through TagAttributes.
+//
+typedef struct _DRIVER_XML_VISITOR {
+  DRIVER_XML_VISIT_HANDLER PreOrder[XmlDataTypeMax];
+  DRIVER_XML_VISIT_HANDLER PostOrder[XmlDataTypeMax];
+} DRIVER_XML_VISITOR;
+
+//
+// Whitespace-only char data between markup (indentation) is dropped instead of becoming a node.
+//
+#define DRIVER_XML_PARSE_DROP_WHITESPACE      BIT0
+//
+// Leading and trailing whitespace is stripped from char data as it is copied out of the document.
+//
+#define DRIVER_XML_PARSE_TRIM_CHAR_DATA       BIT1
+//
+// Char data is trimmed and every internal run of whitespace is collapsed to a single space.
+//
+#define DRIVER_XML_PARSE_NORMALIZE_CHAR_DATA  BIT2
+//
+// Resolve namespace prefixes through the xmlns declarations in scope and fill out
+// NamespaceId and LocalNameId on every tag and attribute. An unbound prefix is an error.
+//
+#define DRIVER_XML_PARSE_NAMESPACES           BIT3
+//
+// Compile the general entities in the DOCTYPE internal subset and replace entity and
+// character references in char data and attribute values. Going over an entity limit
+// fails the parse with EFI_SECURITY_VIOLATION.
+//
+#define DRIVER_XML_PARSE_EXPAND_ENTITIES      BIT4
+
+#define DRIVER_XML_PARSE_DEFAULT_FLAGS        DRIVER_XML_PARSE_DROP_WHITESPACE
+
+//
+// PrintDataCanonical flags.
+// RAW_TEXT says the tree was parsed without DRIVER_XML_PARSE_EXPAND_ENTITIES, so its text still holds
+// character references and predefined entities. The writer replaces them while it writes, in the
+// values marked DRIVER_XML_TEXT_RAW only.
+//
+#define DRIVER_XML_C14N_RAW_TEXT              BIT0
+
+//
+// PrintDataJson and DriverXmlBinaryToJson flags.
+// RAW_TEXT is the same as DRIVER_XML_C14N_RAW_TEXT: references in the text are replaced while it is written.
+//
+#define DRIVER_XML_JSON_RAW_TEXT              BIT0
+
+#define DRIVER_XML_DEFAULT_MAX_ENTITY_DEPTH      16
+#define DRIVER_XML_DEFAULT_MAX_ENTITY_EXPANSION  0x10000
+
+//
+// The binary token format from DriverXmlEncodeBinary. A stream is the 4 byte signature, a version
+// byte, then one token per node in document order. Each token starts with a DRIVER_XML_BINARY_* type
+// byte. Numbers are unsigned LEB128 varints: 7 bits per byte, low bits first, high bit set on every
+// byte but the last. A string is a varint length and that many bytes. A name is a varint index:
+// 0 means a new name follows as a string and gets the next index, starting from 1, so each distinct
+// name is only written once. A PI target or data is a varint of its length plus 1, or 0 when absent.
+//
+//   START  name, attribute count, then a name and a string for each attribute
+//   EMPTY  the same as START for an element that has no content and no END
+//   END    ends the innermost START
+//   TEXT   string
+//   PI     target, data
+//
+#define DRIVER_XML_BINARY_SIGNATURE  SIGNATURE_32 ('X', 'M', 'L', 'B')
+#define DRIVER_XML_BINARY_VERSION    1
+
+#define DRIVER_XML_BINARY_START      1
+#define DRIVER_XML_BINARY_EMPTY      2
+#define DRIVER_XML_BINARY_END        3
+#define DRIVER_XML_BINARY_TEXT       4
+#define DRIVER_XML_BINARY_PI         5
+
+//
+// Every allocation the library makes is counted under one of these types.
+//
+typedef enum _XML_ALLOC_TYPE {
+  XmlAllocTag,        // DRIVER_XML_TAG nodes
+  XmlAllocAttribute,  // DRIVER_XML_ATTRIBUTE nodes
+  XmlAllocCharData,   // DRIVER_XML_CHAR_DATA nodes
+  XmlAllocPi,         // DRIVER_XML_PROCESSING_INSTRUCTION nodes
+  XmlAllocString,     // Names and data held by the tree
+  XmlAllocScratch,    // Chunks and buffers freed before the call that made them returns
+  XmlAllocTable,      // Name, entity and namespace tables
+  XmlAllocOutput,     // Output documents handed to the caller
+  XmlAllocSnapshot,   // Snapshots and their edit lists
+  XmlAllocTypeMax
+} XML_ALLOC_TYPE;
+
+typedef struct _DRIVER_XML_ALLOC_COUNTERS {
+  UINTN Allocations;
+  UINTN Frees;
+  UINTN CurrentBytes;
+  UINTN TotalBytes;
+} DRIVER_XML_ALLOC_COUNTERS;
+
+//
+// Memory usage of the library. Byte counts are what callers asked for and do not
+// include the pool header. Output documents belong to the caller so they stay in
+// CurrentBytes.
+//
+typedef struct _DRIVER_XML_STATS {
+  DRIVER_XML_ALLOC_COUNTERS Types[XmlAllocTypeMax];
+  UINTN                     CurrentBytes;
+  UINTN                     PeakBytes;
+  //
+  // XmlAllocScratch allocations that were freed before the call that made them
+  // returned, and their bytes. This is the churn a parse or print causes on top of
+  // what it keeps. Freeing a tree or an output document does not add to it.
+  //
+  UINTN                     TransientCount;
+  UINTN                     TransientBytes;
+} DRIVER_XML_STATS;
+
 /**
   Delete an element from a list of elements. 
   This will also free all the memory associated with the element
@@ -121,6 +461,207 @@ DriverXmlDeleteElement (
   DRIVER_XML_DATA_HEADER* Element
   );
 
+/**
+  Delete a child or an attribute of a tag and mark the tag as modified.
+  This will also free all the memory associated with the element,
+  including the children and attributes of a deleted tag.
+
+  @param[in out] Parent   The tag the element belongs to.
+  @param[in]     Element  The element to delete. An attribute is taken off the tag's
+                          attributes, anything else off its children.
+
+  @retval EFI_SUCCESS            The element was deleted.
+  @retval EFI_INVALID_PARAMETER  A pointer was NULL or Parent is not a tag.
+  @retval EFI_NOT_FOUND          Element is not on the matching list of Parent.
+**/
+EFI_STATUS
+DriverXmlDeleteChild (
+  DRIVER_XML_TAG*         Parent,
+  DRIVER_XML_DATA_HEADER* Element
+  );
+
+/**
+  Free a whole tree returned by DriverXmlParse or DriverXmlParseEx, including the root.
+
+  @param[in] XmlTree  The root of the tree.
+
+  @retval EFI_SUCCESS            The tree was freed.
+  @retval EFI_INVALID_PARAMETER  XmlTree is NULL or is not a tag.
+**/
+EFI_STATUS
+DriverXmlFreeTree (
+  DRIVER_XML_DATA_HEADER* XmlTree
+  );
+
+/**
+  Record that a tag changed so PrintDataIncremental renders it instead of copying it.
+  The functions that change the tree call this; call it after changing a tag directly.
+
+  @param[in] Tag  The tag that changed. For a change to char data or a processing
+                  instruction pass the tag that holds it.
+**/
+VOID
+DriverXmlMarkModified (
+  DRIVER_XML_TAG* Tag
+  );
+
+/**
+  Set the value of an attribute, adding the attribute if the tag does not have it.
+  The value is literal and every '&' in it is escaped when the tree is written.
+
+  @param[in] Tag    The tag to change.
+  @param[in] Name   The attribute name.
+  @param[in] Value  The new value.
+
+  @retval EFI_SUCCESS            The attribute was set.
+  @retval EFI_INVALID_PARAMETER  A pointer was NULL or Tag is not a tag.
+  @retval EFI_OUT_OF_RESOURCES   There was not enough memory. The tag is unchanged.
+**/
+EFI_STATUS
+DriverXmlSetAttribute (
+  DRIVER_XML_TAG* Tag,
+  CONST CHAR8*    Name,
+  CONST CHAR8*    Value
+  );
+
+/**
+  Replace the text of a char data node.
+  The text is literal and every '&' in it is escaped when the tree is written.
+
+  @param[in] Tag       The tag the char data belongs to.
+  @param[in] CharData  The char data to change.
+  @param[in] Text      The new text.
+
+  @retval EFI_SUCCESS            The text was replaced.
+  @retval EFI_INVALID_PARAMETER  A pointer was NULL or CharData is not char data.
+  @retval EFI_OUT_OF_RESOURCES   There was not enough memory. The node is unchanged.
+**/
+EFI_STATUS
+DriverXmlSetCharData (
+  DRIVER_XML_TAG*       Tag,
+  DRIVER_XML_CHAR_DATA* CharData,
+  CONST CHAR8*          Text
+  );
+
+/**
+  Create an empty tree to build by hand. The root is the same kind the parser returns,
+  so the tree can be printed, edited and freed with DriverXmlFreeTree like a parsed one.
+
+  @param[out] XmlTree  The root of the new tree.
+
+  @retval EFI_SUCCESS            The tree was created.
+  @retval EFI_INVALID_PARAMETER  XmlTree is NULL.
+  @retval EFI_OUT_OF_RESOURCES   There was not enough memory.
+**/
+EFI_STATUS
+DriverXmlCreateTree (
+  DRIVER_XML_DATA_HEADER** XmlTree
+  );
+
+/**
+  Add a new element after the existing children of a tag and mark the tag as modified.
+
+  @param[in]  Tag       The tag to add the element to.
+  @param[in]  Name      The name of the new element. It is copied.
+  @param[in]  DataType  XmlTag for an element that can hold children, or XmlEmptyTag.
+  @param[out] NewTag    The new element.
+
+  @retval EFI_SUCCESS            The element was added.
+  @retval EFI_INVALID_PARAMETER  A pointer was NULL, Tag cannot hold children or DataType is not a tag type.
+  @retval EFI_OUT_OF_RESOURCES   There was not enough memory. The tag is unchanged.
+**/
+EFI_STATUS
+DriverXmlAppendTag (
+  DRIVER_XML_TAG*  Tag,
+  CONST CHAR8*     Name,
+  XML_DATA_TYPE    DataType,
+  DRIVER_XML_TAG** NewTag
+  );
+
+/**
+  Add text after the existing children of a tag and mark the tag as modified.
+
+  @param[in]  Tag          The tag to add the text to.
+  @param[in]  Text         The text. It is copied, and escaped when the tree is written.
+  @param[out] NewCharData  The new char data.
+
+  @retval EFI_SUCCESS            The text was added.
+  @retval EFI_INVALID_PARAMETER  A pointer was NULL or Tag cannot hold children.
+  @retval EFI_OUT_OF_RESOURCES   There was not enough memory. The tag is unchanged.
+**/
+EFI_STATUS
+DriverXmlAppendCharData (
+  DRIVER_XML_TAG*        Tag,
+  CONST CHAR8*           Text,
+  DRIVER_XML_CHAR_DATA** NewCharData
+  );
+
+/**
+  Bring the structural hashes of a tree up to date. Only branches edited since the last call are hashed.
+
+  @param[in] XmlTree  The root of the tree or of a branch.
+
+  @retval EFI_SUCCESS            Every tag in the tree has a valid hash.
+  @retval EFI_INVALID_PARAMETER  XmlTree is NULL or not a tag.
+**/
+EFI_STATUS
+DriverXmlUpdateHashes (
+  DRIVER_XML_DATA_HEADER* XmlTree
+  );
+
+/**
+  Compare two trees or branches by their structural hashes.
+
+  @param[in] First   The first tree.
+  @param[in] Second  The second tree.
+
+  @retval TRUE   The trees have the same names, attributes, text and shape.
+  @retval FALSE  The trees differ or a pointer is not a tag.
+**/
+BOOLEAN
+DriverXmlTreesEqual (
+  DRIVER_XML_DATA_HEADER* First,
+  DRIVER_XML_DATA_HEADER* Second
+  );
+
+/**
+  Report the differences between two versions of a tree, skipping branches whose hashes match.
+
+  @param[in] OldTree   The old version.
+  @param[in] NewTree   The new version.
+  @param[in] Callback  Called for each difference.
+  @param[in] Context   Passed to Callback.
+
+  @retval EFI_SUCCESS            The differences were reported.
+  @retval EFI_INVALID_PARAMETER  A tree is not a tag or Callback is NULL.
+  @retval EFI_OUT_OF_RESOURCES   There was not enough memory to keep track of the depth.
+**/
+EFI_STATUS
+DriverXmlDiffTrees (
+  DRIVER_XML_DATA_HEADER*  OldTree,
+  DRIVER_XML_DATA_HEADER*  NewTree,
+  DRIVER_XML_DIFF_CALLBACK Callback,
+  VOID*                    Context
+  );
+
+/**
+  Find branches of a tree that are repeated elsewhere in it.
+
+  @param[in] XmlTree   The root of the tree.
+  @param[in] Callback  Called with XmlDiffDuplicate, the first copy and the repeat.
+  @param[in] Context   Passed to Callback.
+
+  @retval EFI_SUCCESS            The tree was searched.
+  @retval EFI_INVALID_PARAMETER  XmlTree is not a tag or Callback is NULL.
+  @retval EFI_OUT_OF_RESOURCES   There was not enough memory for the table of hashes.
+**/
+EFI_STATUS
+DriverXmlFindDuplicateSubtrees (
+  DRIVER_XML_DATA_HEADER*  XmlTree,
+  DRIVER_XML_DIFF_CALLBACK Callback,
+  VOID*                    Context
+  );
+
 /**
   Finds the next DRIVER_XML_DATA_HEADER node in a linked list. 
   
@@ -137,6 +678,206 @@ GetNextXmlElement (
   OUT DRIVER_XML_DATA_HEADER **NextItem
   );
 
+/**
+  Find a specific attribute in the list based on its name.
+  
+  @param[in]     ElementName         The Attribute Name to look for
+  @param[in]     List        A pointer to the linked List of attributes
+  @param[in,out] Node        A pointer to the pointer to the node with matching Name
+  
+  @retval EFI_SUCCESS            A node with matching key was found
+  @retval EFI_NOT_FOUND          There is no node with matching key in List, or List is empty
+  @retval EFI_INVALID_PARAMETER  List is NULL
+**/
+EFI_STATUS
+GetXmlAttributeByName (
+  IN CHAR8*                     Name,
+  IN LIST_ANCHOR*               AttributeList,
+  IN OUT DRIVER_XML_ATTRIBUTE** Node
+  );
+
+/**
+  Looks for a tag matching the provided name in the provided list. 
+  This searches the branches below the list too, depth first, and returns the first match.
+  
+  @param[in]     TagName     The Attribute Name to look for
+  @param[in]     List        A pointer to the linked List of Elements
+  @param[in,out] Node        A pointer to the pointer to the node with matching Name
+  
+  @retval EFI_SUCCESS            A node with matching key was found
+  @retval EFI_NOT_FOUND          There is no node with matching key in List, or List is empty
+  @retval EFI_INVALID_PARAMETER  List is NULL
+**/
+EFI_STATUS
+GetXmlTagByName (
+  IN CHAR8*               TagName,
+  IN LIST_ANCHOR*         ElementList,
+  IN OUT DRIVER_XML_TAG** OutputTag
+  );
+
+/**
+  Walk an element and everything below it, calling the visitor's handlers in document order.
+  The walk does not recurse so it runs in the same stack space whatever the depth of the tree.
+  A post-order handler may free the element it is given; the walk does not look at it again.
+
+  @param[in] Visitor  The handlers to call.
+  @param[in] Element  The element to start from. Its siblings are not visited.
+  @param[in] Depth    The depth reported for Element.
+  @param[in] Context  Passed to every handler.
+
+  @retval EFI_SUCCESS            The walk finished or a handler stopped it.
+  @retval EFI_INVALID_PARAMETER  Visitor or Element is NULL.
+  @retval other                  The error a handler returned.
+**/
+EFI_STATUS
+DriverXmlWalkElement (
+  CONST DRIVER_XML_VISITOR* Visitor,
+  DRIVER_XML_DATA_HEADER*   Element,
+  UINTN                     Depth,
+  VOID*                     Context
+  );
+
+/**
+  Walk every element in a list and everything below them, calling the visitor's handlers
+  in document order.
+
+  @param[in] Visitor  The handlers to call.
+  @param[in] Branch   The list of elements, usually the TagChildren of a tag.
+  @param[in] Depth    The depth reported for the elements in Branch.
+  @param[in] Context  Passed to every handler.
+
+  @retval EFI_SUCCESS            The walk finished or a handler stopped it.
+  @retval EFI_INVALID_PARAMETER  Visitor or Branch is NULL.
+  @retval other                  The error a handler returned.
+**/
+EFI_STATUS
+DriverXmlWalkBranch (
+  CONST DRIVER_XML_VISITOR* Visitor,
+  LIST_ANCHOR*              Branch,
+  UINTN                     Depth,
+  VOID*                     Context
+  );
+
+/**
+  Find an attribute by its namespace and local name ids from a namespace aware parse.
+
+  @param[in]  NamespaceId    The namespace URI id, or DRIVER_XML_NO_NAMESPACE.
+  @param[in]  LocalNameId    The local name id.
+  @param[in]  AttributeList  The list of attributes to search.
+  @param[out] Node           The matching attribute.
+
+  @retval EFI_SUCCESS            A matching attribute was found.
+  @retval EFI_NOT_FOUND          No attribute matched.
+  @retval EFI_INVALID_PARAMETER  A pointer was NULL.
+**/
+EFI_STATUS
+GetXmlAttributeByQName (
+  IN  UINTN                  NamespaceId,
+  IN  UINTN                  LocalNameId,
+  IN  LIST_ANCHOR*           AttributeList,
+  OUT DRIVER_XML_ATTRIBUTE** Node
+  );
+
+/**
+  Find the first tag, depth first, by its namespace and local name ids from a namespace aware parse.
+
+  @param[in]  NamespaceId  The namespace URI id, or DRIVER_XML_NO_NAMESPACE.
+  @param[in]  LocalNameId  The local name id.
+  @param[in]  ElementList  The branch to search.
+  @param[out] OutputTag    The matching tag.
+
+  @retval EFI_SUCCESS            A matching tag was found.
+  @retval EFI_NOT_FOUND          No tag matched.
+  @retval EFI_INVALID_PARAMETER  A pointer was NULL.
+**/
+EFI_STATUS
+GetXmlTagByQName (
+  IN  UINTN            NamespaceId,
+  IN  UINTN            LocalNameId,
+  IN  LIST_ANCHOR*     ElementList,
+  OUT DRIVER_XML_TAG** OutputTag
+  );
+
+//Name table functions
+/**
+  Create an empty name table.
+
+  @param[out] Table  The new table. Free it with DriverXmlFreeNameTable.
+
+  @retval EFI_SUCCESS            The table was created.
+  @retval EFI_INVALID_PARAMETER  Table is NULL.
+  @retval EFI_OUT_OF_RESOURCES   There was not enough memory for the table.
+**/
+EFI_STATUS
+DriverXmlCreateNameTable (
+  OUT DRIVER_XML_NAME_TABLE** Table
+  );
+
+/**
+  Free a name table and every string in it.
+  Ids from the table must not be used after this.
+
+  @param[in] Table  The table to free.
+**/
+VOID
+DriverXmlFreeNameTable (
+  IN DRIVER_XML_NAME_TABLE* Table
+  );
+
+/**
+  Get the id for a string, adding the string to the table if it is not already there.
+
+  @param[in]  Table   The table to add to.
+  @param[in]  Name    The characters to intern. This does not need to be null terminated.
+  @param[in]  Length  The number of characters in Name.
+  @param[out] Id      The id of the string. This is never 0.
+
+  @retval EFI_SUCCESS            Id is valid.
+  @retval EFI_INVALID_PARAMETER  One of the pointers is NULL.
+  @retval EFI_OUT_OF_RESOURCES   The string could not be added.
+**/
+EFI_STATUS
+DriverXmlInternName (
+  IN  DRIVER_XML_NAME_TABLE* Table,
+  IN  CONST CHAR8*           Name,
+  IN  UINTN                  Length,
+  OUT UINTN*                 Id
+  );
+
+/**
+  Look up the id for a string without adding it to the table.
+
+  @param[in]  Table   The table to search.
+  @param[in]  Name    The characters to look for. This does not need to be null terminated.
+  @param[in]  Length  The number of characters in Name.
+  @param[out] Id      The id of the string.
+
+  @retval EFI_SUCCESS            The string was found and Id is valid.
+  @retval EFI_NOT_FOUND          The string is not in the table.
+  @retval EFI_INVALID_PARAMETER  One of the pointers is NULL.
+**/
+EFI_STATUS
+DriverXmlLookupName (
+  IN  DRIVER_XML_NAME_TABLE* Table,
+  IN  CONST CHAR8*           Name,
+  IN  UINTN                  Length,
+  OUT UINTN*                 Id
+  );
+
+/**
+  Get the string for an id.
+
+  @param[in] Table  The table the id came from.
+  @param[in] Id     The id to look up.
+
+  @return The null terminated string owned by the table, or NULL if the id is not valid.
+**/
+CONST CHAR8*
+DriverXmlGetName (
+  IN DRIVER_XML_NAME_TABLE* Table,
+  IN UINTN                  Id
+  );
+
 //debugging functions
 /**
   This is the main debug print function that will iterate over each XML element
@@ -155,8 +896,8 @@ DbgWalkBranch(
 );
 
 /**
-  The call that determines what data printer to use. This calls through the list of debug data print functions
-  until one returns success.
+  The call that determines what data printer to use. The debug print worker for each element
+  is looked up by its data type.
 
   @param [in]Element    The XML element data to be printed.
   @param [in]Recursive  If an element has children, this can prevent a recursive call exploring the branch.
@@ -177,7 +918,7 @@ DbgPrintData(
 
 //Output functions
 /**
-  Print XML data to a buffer. this will call into a list of worker functions that do the actual print.
+  Print XML data to a buffer. The print worker for each element is looked up by its data type.
   There is no attempt to make the output pretty. Children are not indented on new lines for example.
 
   @param[in]     Data            The XML data to be printed 
@@ -208,6 +949,289 @@ PrintWalkBranch(
     XML_DOCUMENT* OutputDocument
 );
 
+/**
+  Write a parsed tree back out as a document, re-rendering only what changed.
+  Elements that were not modified are copied from Source using their source spans, 
+  so text the tree does not keep (comments, the DOCTYPE, formatting) survives in them.
+  When this returns the spans refer to the output and the modified flags are cleared,
+  so the output can be passed as Source the next time.
+
+  @param[in]     XmlTree         The root of the tree.
+  @param[in]     Source          The document the spans refer to, or NULL to render everything.
+  @param[in]     SourceSize      The size of Source.
+  @param[in out] OutputDocument  The output buffer, set up the same way as for PrintData.
+
+  @retval EFI_SUCCESS            The document was written.
+  @retval EFI_INVALID_PARAMETER  XmlTree or OutputDocument is NULL, or a span is outside Source.
+  @retval EFI_OUT_OF_RESOURCES   The output buffer could not be grown.
+**/
+EFI_STATUS
+PrintDataIncremental (
+  DRIVER_XML_DATA_HEADER* XmlTree,
+  CONST CHAR8*            Source,
+  UINTN                   SourceSize,
+  XML_DOCUMENT*           OutputDocument
+  );
+
+/**
+  Print XML data into a caller owned buffer in one pass, without allocating.
+
+  @param[in]     Data        The XML data to be printed.
+  @param[out]    Buffer      The buffer for the output. May be NULL when *BufferSize is 0.
+  @param[in out] BufferSize  On input the size of Buffer. On output the number of bytes written,
+                             or the number needed if EFI_BUFFER_TOO_SMALL is returned.
+
+  @retval EFI_SUCCESS            The output was written and *BufferSize is its length.
+  @retval EFI_BUFFER_TOO_SMALL   Buffer is too small. *BufferSize is the size needed.
+  @retval EFI_INVALID_PARAMETER  Data or BufferSize is NULL, or Buffer is NULL with a non zero size.
+  @retval EFI_UNSUPPORTED        Data is not a type that can be printed.
+**/
+EFI_STATUS
+PrintDataToBuffer (
+  DRIVER_XML_DATA_HEADER* Data,
+  CHAR8*                  Buffer,
+  UINTN*                  BufferSize
+  );
+
+/**
+  Get the exact number of bytes PrintData writes for some XML data.
+
+  @param[in]  Data  The XML data to be measured.
+  @param[out] Size  The number of bytes.
+
+  @retval EFI_SUCCESS            Size is set.
+  @retval EFI_INVALID_PARAMETER  Data or Size is NULL.
+  @retval EFI_UNSUPPORTED        Data is not a type that can be printed.
+**/
+EFI_STATUS
+DriverXmlMeasureData (
+  DRIVER_XML_DATA_HEADER* Data,
+  UINTN*                  Size
+  );
+
+/**
+  Set up a sink that collects the output in a pool buffer that grows as needed.
+
+  @param[out] MemorySink  The sink to set up.
+
+  @retval EFI_SUCCESS            The sink is ready.
+  @retval EFI_INVALID_PARAMETER  MemorySink is NULL.
+**/
+EFI_STATUS
+DriverXmlInitMemorySink (
+  DRIVER_XML_MEMORY_SINK* MemorySink
+  );
+
+/**
+  Set up a sink that keeps the most recent output in a fixed buffer.
+
+  @param[out] RingSink    The sink to set up.
+  @param[in]  Buffer      The buffer to keep the output in.
+  @param[in]  BufferSize  The size of Buffer.
+
+  @retval EFI_SUCCESS            The sink is ready.
+  @retval EFI_INVALID_PARAMETER  A pointer is NULL or BufferSize is 0.
+**/
+EFI_STATUS
+DriverXmlInitRingSink (
+  DRIVER_XML_RING_SINK* RingSink,
+  CHAR8*                Buffer,
+  UINTN                 BufferSize
+  );
+
+/**
+  Copy what a ring sink holds, oldest byte first.
+
+  @param[in]     RingSink    The ring sink.
+  @param[out]    Buffer      The buffer to copy into.
+  @param[in out] BufferSize  On input the size of Buffer. On output the number of bytes copied,
+                             or the number needed if EFI_BUFFER_TOO_SMALL is returned.
+
+  @retval EFI_SUCCESS            The contents were copied.
+  @retval EFI_BUFFER_TOO_SMALL   Buffer is too small. *BufferSize is the size needed.
+  @retval EFI_INVALID_PARAMETER  RingSink or BufferSize is NULL.
+**/
+EFI_STATUS
+DriverXmlReadRingSink (
+  DRIVER_XML_RING_SINK* RingSink,
+  CHAR8*                Buffer,
+  UINTN*                BufferSize
+  );
+
+/**
+  Set up a sink that streams the output to a file in blocks gathered in a caller's buffer.
+
+  @param[out] FileSink    The sink to set up.
+  @param[in]  File        The file, positioned where the output should go.
+  @param[in]  Buffer      The buffer blocks are gathered in.
+  @param[in]  BufferSize  The size of Buffer.
+
+  @retval EFI_SUCCESS            The sink is ready.
+  @retval EFI_INVALID_PARAMETER  A pointer is NULL or BufferSize is 0.
+**/
+EFI_STATUS
+DriverXmlInitFileSink (
+  DRIVER_XML_FILE_SINK* FileSink,
+  EFI_FILE_PROTOCOL*    File,
+  CHAR8*                Buffer,
+  UINTN                 BufferSize
+  );
+
+/**
+  Set up a sink that prints to the system console.
+
+  @param[out] ConsoleSink  The sink to set up.
+
+  @retval EFI_SUCCESS            The sink is ready.
+  @retval EFI_INVALID_PARAMETER  ConsoleSink is NULL.
+**/
+EFI_STATUS
+DriverXmlInitConsoleSink (
+  DRIVER_XML_CONSOLE_SINK* ConsoleSink
+  );
+
+/**
+  Print XML data to a sink and flush it.
+
+  @param[in] Data  The XML data to be printed.
+  @param[in] Sink  Where the output goes.
+
+  @retval EFI_SUCCESS            The data was printed and the sink flushed.
+  @retval EFI_INVALID_PARAMETER  Data or Sink is NULL.
+  @retval other                  An error from the sink or EFI_UNSUPPORTED for data that can't be printed.
+**/
+EFI_STATUS
+PrintDataToSink (
+  DRIVER_XML_DATA_HEADER* Data,
+  DRIVER_XML_OUTPUT_SINK* Sink
+  );
+
+/**
+  Write a tree as Canonical XML 1.0 without comments, for hashing or signing a document.
+  Attributes are sorted, empty elements get end tags and text is escaped the canonical way.
+
+  @param[in]     XmlTree         The root from the parser, or an element to write as if it were the document.
+  @param[in]     NameTable       The name table of a namespace aware parse, or NULL.
+  @param[in]     Flags           DRIVER_XML_C14N_ flags.
+  @param[in out] OutputDocument  The output buffer, set up the same way as for PrintData.
+
+  @retval EFI_SUCCESS            The canonical form was written.
+  @retval EFI_INVALID_PARAMETER  XmlTree or OutputDocument is NULL, or XmlTree is not a tag.
+  @retval EFI_UNSUPPORTED        Raw text refers to an entity that is not predefined.
+  @retval EFI_DEVICE_ERROR       Raw text holds a malformed reference.
+  @retval EFI_OUT_OF_RESOURCES   The output buffer could not be grown.
+**/
+EFI_STATUS
+PrintDataCanonical (
+  DRIVER_XML_DATA_HEADER* XmlTree,
+  DRIVER_XML_NAME_TABLE*  NameTable,
+  UINT32                  Flags,
+  XML_DOCUMENT*           OutputDocument
+  );
+
+/**
+  Set up a writer that builds a document directly in a sink.
+
+  @param[out] Writer         The writer to set up.
+  @param[in]  Sink           Where the output goes. NULL collects it in Writer->Document
+                             the same way as PrintData, and the buffer belongs to the caller.
+  @param[in]  NameStack      The buffer the names of open elements are kept in.
+  @param[in]  NameStackSize  The size of NameStack. Each open element takes its name length plus one.
+
+  @retval EFI_SUCCESS            The writer is ready.
+  @retval EFI_INVALID_PARAMETER  Writer or NameStack is NULL, or NameStackSize is 0.
+**/
+EFI_STATUS
+DriverXmlInitWriter (
+  DRIVER_XML_WRITER*      Writer,
+  DRIVER_XML_OUTPUT_SINK* Sink,
+  CHAR8*                  NameStack,
+  UINTN                   NameStackSize
+  );
+
+/**
+  Start an element. Its attributes can be written until something else is.
+
+  @param[in] Writer  The writer.
+  @param[in] Name    The element name.
+
+  @retval EFI_SUCCESS            The start tag was begun.
+  @retval EFI_INVALID_PARAMETER  A pointer is NULL or Name is not a valid XML name.
+  @retval EFI_BUFFER_TOO_SMALL   The name stack is full. Nothing was written.
+  @retval other                  An error from the sink, or an earlier error from this writer.
+**/
+EFI_STATUS
+DriverXmlWriterStartElement (
+  DRIVER_XML_WRITER* Writer,
+  CONST CHAR8*       Name
+  );
+
+/**
+  Add an attribute to the element that was just started. The value is escaped.
+
+  @param[in] Writer  The writer.
+  @param[in] Name    The attribute name.
+  @param[in] Value   The value.
+
+  @retval EFI_SUCCESS            The attribute was written.
+  @retval EFI_INVALID_PARAMETER  A pointer is NULL, Name is not a valid XML name,
+                                 or the start tag already has content after it.
+  @retval other                  An error from the sink, or an earlier error from this writer.
+**/
+EFI_STATUS
+DriverXmlWriterAttribute (
+  DRIVER_XML_WRITER* Writer,
+  CONST CHAR8*       Name,
+  CONST CHAR8*       Value
+  );
+
+/**
+  Write char data into the current element. The text is escaped.
+
+  @param[in] Writer  The writer.
+  @param[in] Text    The text.
+  @param[in] Length  The number of characters in Text.
+
+  @retval EFI_SUCCESS            The text was written.
+  @retval EFI_INVALID_PARAMETER  A pointer is NULL.
+  @retval other                  An error from the sink, or an earlier error from this writer.
+**/
+EFI_STATUS
+DriverXmlWriterText (
+  DRIVER_XML_WRITER* Writer,
+  CONST CHAR8*       Text,
+  UINTN              Length
+  );
+
+/**
+  End the innermost open element. An element with no content is written as an empty tag.
+
+  @param[in] Writer  The writer.
+
+  @retval EFI_SUCCESS            The element was ended.
+  @retval EFI_INVALID_PARAMETER  Writer is NULL.
+  @retval EFI_NOT_FOUND          No element is open.
+  @retval other                  An error from the sink, or an earlier error from this writer.
+**/
+EFI_STATUS
+DriverXmlWriterEndElement (
+  DRIVER_XML_WRITER* Writer
+  );
+
+/**
+  End every element that is still open and flush the sink.
+
+  @param[in] Writer  The writer.
+
+  @retval EFI_SUCCESS            The document is complete.
+  @retval EFI_INVALID_PARAMETER  Writer is NULL.
+  @retval other                  An error from the sink, or an earlier error from this writer.
+**/
+EFI_STATUS
+DriverXmlWriterFinish (
+  DRIVER_XML_WRITER* Writer
+  );
+
 
 //main parser call
 /**
@@ -232,4 +1256,374 @@ DriverXmlParse(
   UINTN DocSize,
   DRIVER_XML_DATA_HEADER** XmlTree
   );
+
+/**
+  Parse an XML document with caller supplied options.
+  DriverXmlParse is the same as calling this with NULL options.
+
+  @param[in] XmlText      The XML document to be parsed.
+  @param[in] DocSize      The size of he XML text document
+  @param[in] Options      Optional parse options. NULL selects DRIVER_XML_PARSE_DEFAULT_FLAGS.
+  @param[in out] XmlTree  A pointer to return the root element on.
+
+  @retval EFI_DEVICE_ERROR  There was a tag mismatch or other malformed data in the document.
+  @retval EFI_END_OF_FILE   The end of the document was reached before the proper end of an element.
+
+**/
+EFI_STATUS
+DriverXmlParseEx(
+  VOID*                     XmlText,
+  UINTN                     DocSize,
+  DRIVER_XML_PARSE_OPTIONS* Options,
+  DRIVER_XML_DATA_HEADER**  XmlTree
+  );
+
+/**
+  Update a tree after part of its document was rewritten, parsing only the innermost element
+  that holds the change. The element is replaced by the newly parsed one and every other node 
+  in the tree stays where it is, with its source span moved to match the new document.
+
+  The change is described by the bytes it replaced: OldLength bytes at ChangeOffset in the old
+  document became NewLength bytes at the same offset in NewText.
+
+  @param[in]     NewText       The whole document after the change.
+  @param[in]     NewSize       The size of NewText.
+  @param[in]     ChangeOffset  The offset of the first changed byte.
+  @param[in]     OldLength     The number of bytes replaced in the old document.
+  @param[in]     NewLength     The number of bytes that replaced them.
+  @param[in]     Options       The options the tree was parsed with, or NULL for the defaults.
+  @param[in out] XmlTree       The tree from parsing the old document.
+
+  @retval EFI_SUCCESS             The tree matches NewText.
+  @retval EFI_UNSUPPORTED         The change could not be handled by parsing one element.
+                                  The tree is unchanged; parse the whole document again.
+  @retval EFI_INVALID_PARAMETER   A pointer was NULL or the range is outside the document.
+  @retval EFI_SECURITY_VIOLATION  The element went over one of the Options->Limits budgets.
+  @retval EFI_OUT_OF_RESOURCES    There was not enough memory. The tree is unchanged.
+**/
+EFI_STATUS
+DriverXmlReparseRange (
+  CONST CHAR8*              NewText,
+  UINTN                     NewSize,
+  UINTN                     ChangeOffset,
+  UINTN                     OldLength,
+  UINTN                     NewLength,
+  DRIVER_XML_PARSE_OPTIONS* Options,
+  DRIVER_XML_DATA_HEADER*   XmlTree
+  );
+
+//Binary token functions
+/**
+  Write the nodes below a tag in the binary token format, for handing a tree to another
+  component without printing and parsing it again. The tag itself is not written;
+  DriverXmlDecodeBinary puts the nodes under a new root.
+
+  @param[in]     XmlTree         The tag whose children are written, normally the root of a tree.
+  @param[in out] OutputDocument  Where the tokens go, set up the same way as for PrintData.
+
+  @retval EFI_SUCCESS            The tokens were written.
+  @retval EFI_INVALID_PARAMETER  A pointer is NULL or XmlTree is not a tag.
+  @retval EFI_OUT_OF_RESOURCES   There was not enough memory for the names or the output.
+  @retval other                  An error from the output sink.
+**/
+EFI_STATUS
+DriverXmlEncodeBinary (
+  DRIVER_XML_DATA_HEADER* XmlTree,
+  XML_DOCUMENT*           OutputDocument
+  );
+
+/**
+  Build a tree from the binary token format. The tree is the same as parsing the text the tokens
+  were encoded from, except that it has no source spans. The parse limits and DRIVER_XML_PARSE_NAMESPACES
+  apply as they do to text. The other flags change text as it is tokenized, so they have no effect here.
+
+  @param[in]  Buffer   The tokens.
+  @param[in]  Size     The size of Buffer.
+  @param[in]  Options  Optional parse options. NULL selects the defaults.
+  @param[out] XmlTree  The root of the new tree. Free it with DriverXmlFreeTree.
+
+  @retval EFI_SUCCESS             The tree was built.
+  @retval EFI_INVALID_PARAMETER   A pointer was NULL, or namespaces were asked for without a name table.
+  @retval EFI_UNSUPPORTED         Buffer does not start with the signature and a known version.
+  @retval EFI_END_OF_FILE         The tokens end inside a token or an element.
+  @retval EFI_DEVICE_ERROR        A token is malformed.
+  @retval EFI_SECURITY_VIOLATION  One of the Options->Limits budgets was exceeded.
+  @retval EFI_OUT_OF_RESOURCES    There was not enough memory for the tree.
+**/
+EFI_STATUS
+DriverXmlDecodeBinary (
+  CONST VOID*               Buffer,
+  UINTN                     Size,
+  DRIVER_XML_PARSE_OPTIONS* Options,
+  DRIVER_XML_DATA_HEADER**  XmlTree
+  );
+
+//JSON functions
+/**
+  Write a tree as JSON in the JsonML form. Each element is an array of its name, an object
+  holding its attributes if it has any, then its children in document order. Char data is a
+  string. Repeated children are simply repeated array items, so nothing has to be looked ahead
+  at and the order of mixed content is kept. Processing instructions are left out.
+
+  Given the root from the parser, the first element under it is written as the document.
+  Given any other tag, that element is written.
+
+  @param[in]     XmlTree         The root from the parser, or an element in the tree.
+  @param[in]     Flags           DRIVER_XML_JSON_ flags.
+  @param[in out] OutputDocument  Where the JSON goes, set up the same way as for PrintData.
+
+  @retval EFI_SUCCESS            The JSON was written.
+  @retval EFI_INVALID_PARAMETER  XmlTree or OutputDocument is NULL, or XmlTree is not a tag.
+  @retval EFI_NOT_FOUND          The root has no element under it.
+  @retval EFI_UNSUPPORTED        DRIVER_XML_JSON_RAW_TEXT is set and the text refers to a declared entity.
+  @retval EFI_DEVICE_ERROR       DRIVER_XML_JSON_RAW_TEXT is set and the text holds a malformed reference.
+  @retval other                  An error from the output.
+**/
+EFI_STATUS
+PrintDataJson (
+  DRIVER_XML_DATA_HEADER* XmlTree,
+  UINT32                  Flags,
+  XML_DOCUMENT*           OutputDocument
+  );
+
+/**
+  Write the element in a buffer of binary tokens as JSON, the same as PrintDataJson writes
+  the tree they would decode to, without building the tree. The only memory used is the list
+  of names, so a large inventory costs no more than a small one with the same names.
+
+  @param[in]     Buffer          The tokens from DriverXmlEncodeBinary.
+  @param[in]     Size            The size of Buffer.
+  @param[in]     Flags           DRIVER_XML_JSON_ flags.
+  @param[in out] OutputDocument  Where the JSON goes, set up the same way as for PrintData.
+
+  @retval EFI_SUCCESS            The JSON was written.
+  @retval EFI_INVALID_PARAMETER  Buffer or OutputDocument is NULL.
+  @retval EFI_UNSUPPORTED        Buffer does not start with the signature and a known version,
+                                 or raw text refers to a declared entity.
+  @retval EFI_NOT_FOUND          The tokens hold no element.
+  @retval EFI_END_OF_FILE        The tokens end inside a token or an element.
+  @retval EFI_DEVICE_ERROR       A token or a reference in raw text is malformed.
+  @retval EFI_OUT_OF_RESOURCES   The name list could not be grown.
+  @retval other                  An error from the output.
+**/
+EFI_STATUS
+DriverXmlBinaryToJson (
+  CONST VOID*   Buffer,
+  UINTN         Size,
+  UINT32        Flags,
+  XML_DOCUMENT* OutputDocument
+  );
+
+//Snapshot functions
+/**
+  Make the first snapshot of a tree. The snapshot takes ownership of the tree, which is 
+  freed when the last snapshot that uses it is released. The tree must not be changed 
+  directly after this; make changes through a snapshot instead.
+
+  @param[in]  XmlTree   The root of a tree from DriverXmlParse or DriverXmlParseEx.
+  @param[out] Snapshot  The new snapshot.
+
+  @retval EFI_SUCCESS            The snapshot was created.
+  @retval EFI_INVALID_PARAMETER  A pointer was NULL or XmlTree is not a tag.
+  @retval EFI_OUT_OF_RESOURCES   There was not enough memory.
+**/
+EFI_STATUS
+DriverXmlCreateSnapshot (
+  IN  DRIVER_XML_DATA_HEADER* XmlTree,
+  OUT DRIVER_XML_SNAPSHOT**   Snapshot
+  );
+
+/**
+  Make a new snapshot that starts out the same as an existing one. This takes the same time
+  no matter how large the tree is; nothing in the tree is copied.
+  After this, edits to either snapshot are not seen by the other.
+
+  @param[in]  Snapshot     The snapshot to start from.
+  @param[out] NewSnapshot  The new snapshot.
+
+  @retval EFI_SUCCESS            The snapshot was created.
+  @retval EFI_INVALID_PARAMETER  A pointer was NULL.
+  @retval EFI_OUT_OF_RESOURCES   There was not enough memory.
+**/
+EFI_STATUS
+DriverXmlForkSnapshot (
+  IN  DRIVER_XML_SNAPSHOT*  Snapshot,
+  OUT DRIVER_XML_SNAPSHOT** NewSnapshot
+  );
+
+/**
+  Release a snapshot. Parents that are no longer used by any snapshot are freed with it,
+  and the tree is freed along with the last snapshot.
+
+  @param[in] Snapshot  The snapshot to release.
+**/
+VOID
+DriverXmlReleaseSnapshot (
+  IN DRIVER_XML_SNAPSHOT* Snapshot
+  );
+
+/**
+  Get the shared tree behind a snapshot. Walk it with the usual functions to find the nodes
+  to pass to the other snapshot functions, but do not change it.
+
+  @param[in] Snapshot  The snapshot.
+
+  @return The root of the shared tree, or NULL if Snapshot is NULL.
+**/
+DRIVER_XML_DATA_HEADER*
+DriverXmlGetSnapshotTree (
+  IN DRIVER_XML_SNAPSHOT* Snapshot
+  );
+
+/**
+  Set, add or remove an attribute on a tag in one snapshot.
+
+  @param[in] Snapshot  The snapshot to change.
+  @param[in] Tag       A tag from the snapshot's tree.
+  @param[in] Name      The attribute name.
+  @param[in] Value     The new value, or NULL to remove the attribute.
+
+  @retval EFI_SUCCESS            The snapshot was changed.
+  @retval EFI_INVALID_PARAMETER  A pointer was NULL or Tag is not a tag.
+  @retval EFI_NOT_FOUND          The tag was removed in this snapshot.
+  @retval EFI_OUT_OF_RESOURCES   There was not enough memory.
+**/
+EFI_STATUS
+DriverXmlSnapshotSetAttribute (
+  IN DRIVER_XML_SNAPSHOT* Snapshot,
+  IN DRIVER_XML_TAG*      Tag,
+  IN CONST CHAR8*         Name,
+  IN CONST CHAR8*         Value
+  );
+
+/**
+  Get the value an attribute has in a snapshot.
+
+  @param[in]  Snapshot  The snapshot to read.
+  @param[in]  Tag       A tag from the snapshot's tree.
+  @param[in]  Name      The attribute name.
+  @param[out] Value     The value. It belongs to the snapshot or the tree and stays valid 
+                        until the snapshot is released or the attribute is set again.
+
+  @retval EFI_SUCCESS            Value is valid.
+  @retval EFI_NOT_FOUND          The tag does not have the attribute in this snapshot.
+  @retval EFI_INVALID_PARAMETER  A pointer was NULL.
+**/
+EFI_STATUS
+DriverXmlSnapshotGetAttribute (
+  IN  DRIVER_XML_SNAPSHOT* Snapshot,
+  IN  DRIVER_XML_TAG*      Tag,
+  IN  CONST CHAR8*         Name,
+  OUT CONST CHAR8**        Value
+  );
+
+/**
+  Replace the text of a char data node in one snapshot.
+
+  @param[in] Snapshot  The snapshot to change.
+  @param[in] CharData  A char data node from the snapshot's tree.
+  @param[in] Text      The new text.
+
+  @retval EFI_SUCCESS            The snapshot was changed.
+  @retval EFI_INVALID_PARAMETER  A pointer was NULL or CharData is not char data.
+  @retval EFI_NOT_FOUND          The node was removed in this snapshot.
+  @retval EFI_OUT_OF_RESOURCES   There was not enough memory.
+**/
+EFI_STATUS
+DriverXmlSnapshotSetCharData (
+  IN DRIVER_XML_SNAPSHOT*  Snapshot,
+  IN DRIVER_XML_CHAR_DATA* CharData,
+  IN CONST CHAR8*          Text
+  );
+
+/**
+  Get the text a char data node has in a snapshot.
+
+  @param[in]  Snapshot  The snapshot to read.
+  @param[in]  CharData  A char data node from the snapshot's tree.
+  @param[out] Text      The text. It belongs to the snapshot or the tree.
+  @param[out] Length    Optional. The number of characters in Text.
+
+  @retval EFI_SUCCESS            Text is valid.
+  @retval EFI_NOT_FOUND          The node was removed in this snapshot.
+  @retval EFI_INVALID_PARAMETER  A pointer was NULL or CharData is not char data.
+**/
+EFI_STATUS
+DriverXmlSnapshotGetCharData (
+  IN  DRIVER_XML_SNAPSHOT*  Snapshot,
+  IN  DRIVER_XML_CHAR_DATA* CharData,
+  OUT CONST CHAR8**         Text,
+  OUT UINTN*                Length OPTIONAL
+  );
+
+/**
+  Remove a tag, char data or processing instruction, and everything under it, from one snapshot.
+
+  @param[in] Snapshot  The snapshot to change.
+  @param[in] Node      A node from the snapshot's tree. It can't be the root or an attribute.
+
+  @retval EFI_SUCCESS            The snapshot was changed.
+  @retval EFI_INVALID_PARAMETER  A pointer was NULL or Node can't be removed.
+  @retval EFI_OUT_OF_RESOURCES   There was not enough memory.
+**/
+EFI_STATUS
+DriverXmlSnapshotRemoveNode (
+  IN DRIVER_XML_SNAPSHOT*    Snapshot,
+  IN DRIVER_XML_DATA_HEADER* Node
+  );
+
+/**
+  Check whether a node was removed in a snapshot or one of its parents.
+
+  @param[in] Snapshot  The snapshot to check.
+  @param[in] Node      A node from the snapshot's tree.
+
+  @retval TRUE   The node was removed.
+  @retval FALSE  The node is still there.
+**/
+BOOLEAN
+DriverXmlSnapshotIsRemoved (
+  IN DRIVER_XML_SNAPSHOT*    Snapshot,
+  IN DRIVER_XML_DATA_HEADER* Node
+  );
+
+/**
+  Build an ordinary tree that has a snapshot's edits applied, for example to write a view out 
+  with PrintData. The new tree does not share anything with the snapshot.
+
+  @param[in]  Snapshot  The snapshot to copy.
+  @param[out] XmlTree   The new tree. Free it with DriverXmlFreeTree.
+
+  @retval EFI_SUCCESS            The tree was built.
+  @retval EFI_INVALID_PARAMETER  A pointer was NULL.
+  @retval EFI_OUT_OF_RESOURCES   There was not enough memory. Nothing is returned.
+**/
+EFI_STATUS
+DriverXmlSnapshotToTree (
+  IN  DRIVER_XML_SNAPSHOT*     Snapshot,
+  OUT DRIVER_XML_DATA_HEADER** XmlTree
+  );
+
+//Memory accounting
+/**
+  Get a copy of the library's allocation counters.
+
+  @param[out] Stats  Filled out with the current counters.
+
+  @retval EFI_SUCCESS            Stats was filled out.
+  @retval EFI_INVALID_PARAMETER  Stats is NULL.
+**/
+EFI_STATUS
+DriverXmlGetStats (
+  OUT DRIVER_XML_STATS* Stats
+  );
+
+/**
+  Start a new measurement. Allocation, free and transient counts go back to 0 and the 
+  peak is set to what is in use now. Current usage is kept since that memory is still allocated.
+**/
+VOID
+DriverXmlResetStats (
+  VOID
+  );
 #endif
@@ -26,6 +26,9 @@
 **/
 #ifndef __OPEN_FILE_LIB_H__
 #define __OPEN_FILE_LIB_H__
+
+#include <Protocol/SimpleFileSystem.h>
+
 /**
   This function tries to figure out the path to a file specified by a user.
   If there is a : then this assumes a map name is specified along with a complete path to a file.
@@ -48,4 +51,20 @@ OpenFileFromArgument (
     UINTN*  FileSize
 );
 
+/**
+  Create a file for writing from a string specified by a user, using the same rules
+  as OpenFileFromArgument to find where it goes. A file that already exists is replaced.
+
+  @param [in]  FileString  the string supplied via a command line argument
+  @param [out] File        The created file, open for writing. The caller must close it.
+
+  @retval EFI_SUCCESS  The file was created.
+  @return Error codes from worker functions.
+**/
+EFI_STATUS
+CreateFileFromArgument (
+    CHAR16*             FileString,
+    EFI_FILE_PROTOCOL** File
+);
+
 #endif
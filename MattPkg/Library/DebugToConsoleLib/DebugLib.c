@@ -1,6 +1,6 @@
 /** @file
-  A very basic DebugLib implementation that ignores debug levels and passes all data
-  straight out to the console.
+  A very basic DebugLib implementation that passes the data straight out to the console.
+  Messages are filtered by the DebugPrintErrorLevelLib level and PcdDebugPropertyMask.
   
   Copyright (c) 2016, Matthew Lazarowitz. All rights reserved.<BR>
   This program and the accompanying materials are licensed and made available under
@@ -29,16 +29,317 @@
 #include <Uefi.h>
 #include <Base.h>
 #include <Library/DebugLib.h>
+#include <Library/BaseLib.h>
+#include <Library/PcdLib.h>
+#include <Library/PrintLib.h>
+#include <Library/DebugPrintErrorLevelLib.h>
+#include <Library/TimerLib.h>
+#include <Library/DebugToConsoleLib.h>
 #include <Protocol/SimpleTextOut.h>
 #include <Library/UefiBootServicesTableLib.h>
 
+//
+// The longest single message. This matches the limit AsciiPrint has by default.
+//
+#define MAX_DEBUG_MESSAGE_LENGTH  320
+
+//
+// How many characters are gathered before they are written to the console.
+// Each OutputString call is slow, so a dump of a document one DEBUG per character
+// should cost one call per line or per block rather than one per character.
+//
+#define DEBUG_BUFFER_LENGTH       4096
+
+//
+// Room for the elapsed time put in front of a line when PcdDebugTimestamps is set.
+//
+#define DEBUG_TIMESTAMP_LENGTH    32
+
+//
+// How many characters of the ring are converted at a time when it is dumped to the console.
+//
+#define DEBUG_DUMP_CHUNK_LENGTH   256
+
+CHAR16  mDebugBuffer[DEBUG_BUFFER_LENGTH + DEBUG_TIMESTAMP_LENGTH + MAX_DEBUG_MESSAGE_LENGTH + 1];
+UINTN   mDebugBufferLength = 0;
+BOOLEAN mDebugAtLineStart = TRUE;
+BOOLEAN mInDebugAssert = FALSE;
+
+//
+// The performance counter can be narrow enough to wrap within seconds, so the elapsed
+// time is kept as a running total of the ticks between one timestamp and the next.
+// mDebugTimerStart and mDebugTimerEnd are the counter's range, read with the first timestamp.
+//
+BOOLEAN mDebugTimerStarted = FALSE;
+UINT64  mDebugTimerStart = 0;
+UINT64  mDebugTimerEnd = 0;
+UINT64  mDebugTimerLast = 0;
+UINT64  mDebugTimerElapsed = 0;
+
+//
+// While mDebugRing is allocated, output goes to it instead of the console.
+// mDebugRingHead is where the next character goes and mDebugRingTotal counts every
+// character ever written, so the ring has wrapped once it reaches mDebugRingSize.
+//
+CHAR8*  mDebugRing = NULL;
+UINTN   mDebugRingSize = 0;
+UINTN   mDebugRingHead = 0;
+UINT64  mDebugRingTotal = 0;
+
+//
+// Set once PcdDebugRingSize has been checked. The ring is started by the first message
+// rather than by a constructor, since the boot services table library uses DebugLib itself.
+//
+BOOLEAN mDebugRingChecked = FALSE;
 
-UINTN
-AsciiInternalPrint (
-  IN  CONST CHAR8                      *Format,
-  IN  EFI_SIMPLE_TEXT_OUTPUT_PROTOCOL  *Console,
-  IN  VA_LIST                          Marker
-  );
+/**
+  Write everything gathered so far to the console, or to the ring when one has been started.
+
+  Call this before printing to the console some other way, such as with AsciiPrint,
+  when the order of that output and the debug output matters.
+**/
+VOID
+EFIAPI
+DebugToConsoleFlush (
+  VOID
+  )
+{
+  UINTN Index;
+
+  if (mDebugBufferLength == 0) {
+    return;
+  }
+  if (mDebugRing != NULL) {
+    //
+    // The output is formatted from ASCII, so keeping the low byte of each character loses nothing.
+    //
+    for (Index = 0; Index < mDebugBufferLength; Index++) {
+      mDebugRing[mDebugRingHead] = (CHAR8)mDebugBuffer[Index];
+      mDebugRingHead++;
+      if (mDebugRingHead == mDebugRingSize) {
+        mDebugRingHead = 0;
+      }
+    }
+    mDebugRingTotal += mDebugBufferLength;
+    mDebugBufferLength = 0;
+    return;
+  }
+  mDebugBuffer[mDebugBufferLength] = L'\0';
+  mDebugBufferLength = 0;
+  if (gST != NULL && gST->ConOut != NULL) {
+    gST->ConOut->OutputString (gST->ConOut, mDebugBuffer);
+  }
+}
+
+/**
+  Send debug output to a ring buffer in memory instead of the console.
+
+  Console output is slow enough to change the timing of whatever is being debugged.
+  Once the ring is started, DEBUG output only costs the formatting, and the ring
+  can be dumped with DebugToConsoleDumpRing when the timing no longer matters.
+  When the ring fills, the oldest output is overwritten.
+
+  @param[in] Size  The size of the ring in bytes.
+
+  @retval EFI_SUCCESS            The ring was started.
+  @retval EFI_INVALID_PARAMETER  Size is 0.
+  @retval EFI_ALREADY_STARTED    A ring has already been started.
+  @retval EFI_OUT_OF_RESOURCES   The ring could not be allocated.
+**/
+EFI_STATUS
+EFIAPI
+DebugToConsoleStartRing (
+  IN UINTN Size
+  )
+{
+  EFI_STATUS Status;
+
+  if (Size == 0) {
+    return EFI_INVALID_PARAMETER;
+  }
+  if (mDebugRing != NULL) {
+    return EFI_ALREADY_STARTED;
+  }
+  //
+  // Anything gathered before now belongs on the console.
+  //
+  DebugToConsoleFlush ();
+  Status = gBS->AllocatePool (EfiBootServicesData, Size, (VOID**)&mDebugRing);
+  if (EFI_ERROR (Status)) {
+    mDebugRing = NULL;
+    return EFI_OUT_OF_RESOURCES;
+  }
+  mDebugRingSize = Size;
+  mDebugRingHead = 0;
+  mDebugRingTotal = 0;
+  return EFI_SUCCESS;
+}
+
+/**
+  Write part of the ring to a file, or to the console.
+
+  @param[in] File  The file to write to, or NULL for the console.
+  @param[in] Data  The characters to write.
+  @param[in] Size  The number of characters to write.
+
+  @retval EFI_SUCCESS  The characters were written.
+  @return Errors from the file protocol Write.
+**/
+EFI_STATUS
+WriteDebugRingSpan (
+  IN EFI_FILE_PROTOCOL* File,
+  IN CHAR8*             Data,
+  IN UINTN              Size
+  )
+{
+  CHAR16 Chunk[DEBUG_DUMP_CHUNK_LENGTH + 1];
+  UINTN  ChunkLength;
+  UINTN  Index;
+
+  if (File != NULL) {
+    return File->Write (File, &Size, Data);
+  }
+  while (Size > 0) {
+    ChunkLength = MIN (Size, DEBUG_DUMP_CHUNK_LENGTH);
+    for (Index = 0; Index < ChunkLength; Index++) {
+      Chunk[Index] = (CHAR16)Data[Index];
+    }
+    Chunk[ChunkLength] = L'\0';
+    if (gST != NULL && gST->ConOut != NULL) {
+      gST->ConOut->OutputString (gST->ConOut, Chunk);
+    }
+    Data += ChunkLength;
+    Size -= ChunkLength;
+  }
+  return EFI_SUCCESS;
+}
+
+/**
+  Write the contents of the ring, oldest first, to a file or to the console.
+  The ring keeps collecting output afterwards, and is not emptied.
+
+  @param[in] File  The file to write to, such as one from CreateFileFromArgument, or NULL for the console.
+
+  @retval EFI_SUCCESS      The ring was written.
+  @retval EFI_NOT_STARTED  No ring has been started.
+  @return Errors from the file protocol Write.
+**/
+EFI_STATUS
+EFIAPI
+DebugToConsoleDumpRing (
+  IN EFI_FILE_PROTOCOL* File OPTIONAL
+  )
+{
+  EFI_STATUS Status;
+
+  if (mDebugRing == NULL) {
+    return EFI_NOT_STARTED;
+  }
+  DebugToConsoleFlush ();
+  if (mDebugRingTotal < mDebugRingSize) {
+    return WriteDebugRingSpan (File, mDebugRing, mDebugRingHead);
+  }
+  //
+  // The ring has wrapped, so the oldest output starts at the head.
+  //
+  Status = WriteDebugRingSpan (File, &mDebugRing[mDebugRingHead], mDebugRingSize - mDebugRingHead);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+  return WriteDebugRingSpan (File, mDebugRing, mDebugRingHead);
+}
+
+/**
+  Stop sending debug output to the ring, and free it. Output goes to the console again.
+  Whatever the ring held is discarded, so dump it first if it is wanted.
+
+  @param[out] Total  Optionally returns how many characters were written to the ring,
+                     including any that were overwritten.
+**/
+VOID
+EFIAPI
+DebugToConsoleStopRing (
+  OUT UINT64* Total OPTIONAL
+  )
+{
+  if (mDebugRing == NULL) {
+    if (Total != NULL) {
+      *Total = 0;
+    }
+    return;
+  }
+  DebugToConsoleFlush ();
+  if (Total != NULL) {
+    *Total = mDebugRingTotal;
+  }
+  gBS->FreePool (mDebugRing);
+  mDebugRing = NULL;
+  mDebugRingSize = 0;
+  mDebugRingHead = 0;
+  mDebugRingTotal = 0;
+}
+
+/**
+  Write out anything still gathered when the module that uses this library is unloaded.
+  A ring that was never stopped is dumped to the console so its output is not lost.
+
+  @retval RETURN_SUCCESS  Always.
+**/
+RETURN_STATUS
+EFIAPI
+DebugToConsoleLibDestructor (
+  VOID
+  )
+{
+  if (mDebugRing != NULL) {
+    DebugToConsoleDumpRing (NULL);
+    DebugToConsoleStopRing (NULL);
+  }
+  DebugToConsoleFlush ();
+  return RETURN_SUCCESS;
+}
+
+/**
+  Get the time since the first timestamp was taken.
+
+  @return  The elapsed time in microseconds.
+**/
+UINT64
+DebugElapsedMicroseconds (
+  VOID
+  )
+{
+  UINT64 Now;
+
+  Now = GetPerformanceCounter ();
+  if (!mDebugTimerStarted) {
+    GetPerformanceCounterProperties (&mDebugTimerStart, &mDebugTimerEnd);
+    mDebugTimerStarted = TRUE;
+    mDebugTimerLast = Now;
+    return 0;
+  }
+  if (mDebugTimerStart < mDebugTimerEnd) {
+    //
+    // The counter counts up, from mDebugTimerStart to mDebugTimerEnd and back.
+    //
+    if (Now >= mDebugTimerLast) {
+      mDebugTimerElapsed += Now - mDebugTimerLast;
+    } else {
+      mDebugTimerElapsed += (mDebugTimerEnd - mDebugTimerLast) + (Now - mDebugTimerStart) + 1;
+    }
+  } else {
+    //
+    // The counter counts down, from mDebugTimerStart to mDebugTimerEnd and back.
+    //
+    if (Now <= mDebugTimerLast) {
+      mDebugTimerElapsed += mDebugTimerLast - Now;
+    } else {
+      mDebugTimerElapsed += (mDebugTimerLast - mDebugTimerEnd) + (mDebugTimerStart - Now) + 1;
+    }
+  }
+  mDebugTimerLast = Now;
+  return DivU64x32 (GetTimeInNanoSecond (mDebugTimerElapsed), 1000);
+}
 
 /**
   Prints a debug message to the debug output device if the specified error level is enabled.
@@ -64,16 +365,60 @@ DebugPrint (
   )
 {
   VA_LIST Marker;
-  UINTN   Return;
+  UINTN   Start;
+  UINTN   Index;
+  UINTN   Length;
   ASSERT (Format != NULL);
 
+  if ((ErrorLevel & GetDebugPrintErrorLevel ()) == 0) {
+    return;
+  }
+  if (!mDebugRingChecked) {
+    mDebugRingChecked = TRUE;
+    if (PcdGet32 (PcdDebugRingSize) != 0) {
+      DebugToConsoleStartRing (PcdGet32 (PcdDebugRingSize));
+    }
+  }
+
+  //
+  // There is always room for a timestamp and a whole message after the block,
+  // so a message is never split.
+  //
+  Start = mDebugBufferLength;
+  if (mDebugAtLineStart && PcdGetBool (PcdDebugTimestamps)) {
+    mDebugBufferLength += UnicodeSPrintAsciiFormat (
+                            &mDebugBuffer[Start],
+                            (DEBUG_TIMESTAMP_LENGTH + 1) * sizeof (CHAR16),
+                            "[%10lu us] ",
+                            DebugElapsedMicroseconds ()
+                            );
+  }
   VA_START (Marker, Format);
-
-  Return = AsciiInternalPrint( Format, gST->ConOut, Marker);
-
+  Length = UnicodeVSPrintAsciiFormat (
+             &mDebugBuffer[mDebugBufferLength],
+             (MAX_DEBUG_MESSAGE_LENGTH + 1) * sizeof (CHAR16),
+             Format,
+             Marker
+             );
   VA_END (Marker);
-
-  return;
+  mDebugBufferLength += Length;
+  if (Length > 0) {
+    mDebugAtLineStart = (BOOLEAN)(mDebugBuffer[mDebugBufferLength - 1] == L'\n');
+  }
+
+  if (mDebugBufferLength >= DEBUG_BUFFER_LENGTH) {
+    DebugToConsoleFlush ();
+    return;
+  }
+  //
+  // Whole lines go out as soon as they are finished so the console does not lag behind.
+  //
+  for (Index = Start; Index < mDebugBufferLength; Index++) {
+    if (mDebugBuffer[Index] == L'\n') {
+      DebugToConsoleFlush ();
+      return;
+    }
+  }
 }
 
 
@@ -106,6 +451,35 @@ DebugAssert (
   IN CONST CHAR8  *Description
   )
 {
+  CHAR16 Buffer[MAX_DEBUG_MESSAGE_LENGTH + 1];
+
+  if (mInDebugAssert) {
+    return;
+  }
+  mInDebugAssert = TRUE;
+
+  if (FileName == NULL) {
+    FileName = "(NULL) Filename";
+  }
+  if (Description == NULL) {
+    Description = "(NULL) Description";
+  }
+  //
+  // Anything already gathered belongs before the assert.
+  //
+  DebugToConsoleFlush ();
+  UnicodeSPrintAsciiFormat (Buffer, sizeof (Buffer), "ASSERT %a(%d): %a\n", FileName, LineNumber, Description);
+  if (gST != NULL && gST->ConOut != NULL) {
+    gST->ConOut->OutputString (gST->ConOut, Buffer);
+  }
+  mDebugAtLineStart = TRUE;
+
+  if ((PcdGet8 (PcdDebugPropertyMask) & DEBUG_PROPERTY_ASSERT_BREAKPOINT_ENABLED) != 0) {
+    CpuBreakpoint ();
+  } else if ((PcdGet8 (PcdDebugPropertyMask) & DEBUG_PROPERTY_ASSERT_DEADLOOP_ENABLED) != 0) {
+    CpuDeadLoop ();
+  }
+  mInDebugAssert = FALSE;
 }
 
 
@@ -131,6 +505,9 @@ DebugClearMemory (
   IN UINTN  Length
   )
 {
+  ASSERT (Buffer != NULL);
+
+  gBS->SetMem (Buffer, Length, PcdGet8 (PcdDebugClearMemoryValue));
   return Buffer;
 }
 
@@ -151,7 +528,7 @@ DebugAssertEnabled (
   VOID
   )
 {
-  return FALSE;
+  return (BOOLEAN)((PcdGet8 (PcdDebugPropertyMask) & DEBUG_PROPERTY_DEBUG_ASSERT_ENABLED) != 0);
 }
 
 
@@ -171,7 +548,7 @@ DebugPrintEnabled (
   VOID
   )
 {
-  return TRUE;
+  return (BOOLEAN)((PcdGet8 (PcdDebugPropertyMask) & DEBUG_PROPERTY_DEBUG_PRINT_ENABLED) != 0);
 }
 
 
@@ -191,7 +568,7 @@ DebugCodeEnabled (
   VOID
   )
 {
-  return FALSE;
+  return (BOOLEAN)((PcdGet8 (PcdDebugPropertyMask) & DEBUG_PROPERTY_DEBUG_CODE_ENABLED) != 0);
 }
 
 
@@ -211,13 +588,14 @@ DebugClearMemoryEnabled (
   VOID
   )
 {
-  return FALSE;
+  return (BOOLEAN)((PcdGet8 (PcdDebugPropertyMask) & DEBUG_PROPERTY_CLEAR_MEMORY_ENABLED) != 0);
 }
 
 /**
-  Returns TRUE if any one of the bit is set both in ErrorLevel and PcdFixedDebugPrintErrorLevel.
+  Returns TRUE if any one of the bit is set both in ErrorLevel and the current debug print error level.
 
-  This function compares the bit mask of ErrorLevel and PcdFixedDebugPrintErrorLevel.
+  This function compares the bit mask of ErrorLevel and GetDebugPrintErrorLevel (). The DEBUG
+  macro checks this before it evaluates any arguments, so a filtered message costs only this test.
 
   @retval  TRUE    Current ErrorLevel is supported.
   @retval  FALSE   Current ErrorLevel is not supported.
@@ -229,6 +607,6 @@ DebugPrintLevelEnabled (
   IN  CONST UINTN        ErrorLevel
   )
 {
-  return TRUE;
+  return (BOOLEAN)((ErrorLevel & GetDebugPrintErrorLevel ()) != 0);
 }
 
@@ -0,0 +1,222 @@
+/** @file
+  A binary trace that stores events in a RAM ring and leaves the formatting to a host side decoder.
+  Formatting a DEBUG message costs far more than the code it is usually there to watch, so a
+  trace point here only stores a format string address, the performance counter and three words.
+  
+  Copyright (c) 2016, Matthew Lazarowitz. All rights reserved.<BR>
+  This program and the accompanying materials are licensed and made available under
+  the terms and conditions of the MIT License that accompanies this distribution.
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+**/
+#include <Uefi.h>
+#include <Library/DebugTraceLib.h>
+#include <Library/TimerLib.h>
+#include <Library/UefiBootServicesTableLib.h>
+#include <Protocol/LoadedImage.h>
+
+//
+// While mDebugTraceRecords is allocated, DebugTrace writes to it. mDebugTraceNext is the
+// record the next event goes in and mDebugTraceTotal counts every event traced.
+//
+DEBUG_TRACE_RECORD* mDebugTraceRecords = NULL;
+UINTN               mDebugTraceRecordCount = 0;
+UINTN               mDebugTraceNext = 0;
+UINT64              mDebugTraceTotal = 0;
+UINT64              mDebugTraceImageBase = 0;
+UINT64              mDebugTraceImageSize = 0;
+
+/**
+  Start tracing into a ring of records in memory. Until this is called DebugTrace does nothing.
+  When the ring fills, the oldest records are overwritten.
+
+  @param[in] RecordCount  How many records the ring holds.
+
+  @retval EFI_SUCCESS            Tracing has started.
+  @retval EFI_INVALID_PARAMETER  RecordCount is 0.
+  @retval EFI_ALREADY_STARTED    Tracing has already been started.
+  @retval EFI_OUT_OF_RESOURCES   The ring could not be allocated.
+  @return Errors from looking up the loaded image of the module.
+**/
+EFI_STATUS
+EFIAPI
+DebugTraceStart (
+  IN UINTN RecordCount
+  )
+{
+  EFI_STATUS                 Status;
+  EFI_LOADED_IMAGE_PROTOCOL* LoadedImage;
+
+  if (RecordCount == 0 || RecordCount > MAX_UINTN / sizeof (DEBUG_TRACE_RECORD)) {
+    return EFI_INVALID_PARAMETER;
+  }
+  if (mDebugTraceRecords != NULL) {
+    return EFI_ALREADY_STARTED;
+  }
+  //
+  // Format strings are recorded by address, so the decoder needs to know where the image was loaded.
+  //
+  Status = gBS->OpenProtocol (
+                  gImageHandle,
+                  &gEfiLoadedImageProtocolGuid,
+                  (VOID**)&LoadedImage,
+                  NULL,
+                  NULL,
+                  EFI_OPEN_PROTOCOL_BY_HANDLE_PROTOCOL
+                  );
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+  Status = gBS->AllocatePool (
+                  EfiBootServicesData,
+                  RecordCount * sizeof (DEBUG_TRACE_RECORD),
+                  (VOID**)&mDebugTraceRecords
+                  );
+  if (EFI_ERROR (Status)) {
+    mDebugTraceRecords = NULL;
+    return EFI_OUT_OF_RESOURCES;
+  }
+  mDebugTraceImageBase = (UINT64)(UINTN)LoadedImage->ImageBase;
+  mDebugTraceImageSize = LoadedImage->ImageSize;
+  mDebugTraceRecordCount = RecordCount;
+  mDebugTraceNext = 0;
+  mDebugTraceTotal = 0;
+  return EFI_SUCCESS;
+}
+
+/**
+  Record a trace event. Only the format string address, the time and the argument words
+  are stored, so this costs a few stores. The decoder formats them later, so %a and %s
+  arguments must point to strings that are part of the image, such as string constants.
+
+  @param[in] Format     A PrintLib format string constant.
+  @param[in] Argument0  The first argument the format uses, or 0.
+  @param[in] Argument1  The second argument the format uses, or 0.
+  @param[in] Argument2  The third argument the format uses, or 0.
+**/
+VOID
+EFIAPI
+DebugTrace (
+  IN CONST CHAR8* Format,
+  IN UINT64       Argument0,
+  IN UINT64       Argument1,
+  IN UINT64       Argument2
+  )
+{
+  DEBUG_TRACE_RECORD* Record;
+
+  if (mDebugTraceRecords == NULL) {
+    return;
+  }
+  Record = &mDebugTraceRecords[mDebugTraceNext];
+  Record->Ticks = GetPerformanceCounter ();
+  Record->Format = (UINT64)(UINTN)Format;
+  Record->Arguments[0] = Argument0;
+  Record->Arguments[1] = Argument1;
+  Record->Arguments[2] = Argument2;
+  mDebugTraceNext++;
+  if (mDebugTraceNext == mDebugTraceRecordCount) {
+    mDebugTraceNext = 0;
+  }
+  mDebugTraceTotal++;
+}
+
+/**
+  Write the trace, oldest record first, to a file such as one from CreateFileFromArgument.
+  Tracing carries on afterwards and the ring is not emptied.
+
+  @param[in] File  The file to write to.
+
+  @retval EFI_SUCCESS            The trace was written.
+  @retval EFI_INVALID_PARAMETER  File is NULL.
+  @retval EFI_NOT_STARTED        Tracing has not been started.
+  @return Errors from the file protocol Write.
+**/
+EFI_STATUS
+EFIAPI
+DebugTraceDump (
+  IN EFI_FILE_PROTOCOL* File
+  )
+{
+  EFI_STATUS         Status;
+  DEBUG_TRACE_HEADER Header;
+  UINTN              Size;
+  UINTN              Oldest;
+  UINTN              Count;
+
+  if (File == NULL) {
+    return EFI_INVALID_PARAMETER;
+  }
+  if (mDebugTraceRecords == NULL) {
+    return EFI_NOT_STARTED;
+  }
+  //
+  // Until the ring wraps the oldest record is the first one.
+  //
+  if (mDebugTraceTotal < mDebugTraceRecordCount) {
+    Oldest = 0;
+    Count = (UINTN)mDebugTraceTotal;
+  } else {
+    Oldest = mDebugTraceNext;
+    Count = mDebugTraceRecordCount;
+  }
+
+  gBS->SetMem (&Header, sizeof (Header), 0);
+  Header.Signature = DEBUG_TRACE_SIGNATURE;
+  Header.Version = DEBUG_TRACE_VERSION;
+  Header.ImageBase = mDebugTraceImageBase;
+  Header.ImageSize = mDebugTraceImageSize;
+  Header.Frequency = GetPerformanceCounterProperties (&Header.CounterStart, &Header.CounterEnd);
+  Header.RecordCount = Count;
+  Header.TotalRecords = mDebugTraceTotal;
+  Size = sizeof (Header);
+  Status = File->Write (File, &Size, &Header);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  //
+  // From the oldest record to the end of the ring, then the start of the ring if it has wrapped.
+  //
+  Size = (Count - Oldest) * sizeof (DEBUG_TRACE_RECORD);
+  Status = File->Write (File, &Size, &mDebugTraceRecords[Oldest]);
+  if (EFI_ERROR (Status) || Oldest == 0) {
+    return Status;
+  }
+  Size = Oldest * sizeof (DEBUG_TRACE_RECORD);
+  return File->Write (File, &Size, mDebugTraceRecords);
+}
+
+/**
+  Stop tracing and free the ring. Whatever it held is discarded, so dump it first if it is wanted.
+**/
+VOID
+EFIAPI
+DebugTraceStop (
+  VOID
+  )
+{
+  if (mDebugTraceRecords == NULL) {
+    return;
+  }
+  gBS->FreePool (mDebugTraceRecords);
+  mDebugTraceRecords = NULL;
+  mDebugTraceRecordCount = 0;
+  mDebugTraceNext = 0;
+  mDebugTraceTotal = 0;
+}
@@ -31,36 +31,18 @@
 #include <Library/DebugLib.h>
 #include <DriverXmlStringHandlers.h>
 
-/**
-  A worker function to print an XML element. This allows for individual function calls
-  to handle specific XML data types. Data is output directed based on the debug library.
-
-  @param [in]Element    The XML element data to be printed.
-  @param [in]Recursive  If an element has children, this can prevent a recursive call exploring the branch.
-  @param [in]TreeLevel  Used to indicate what level of recursion we are at. 
-                        This is used to set the indent level and beautify the output.
-
-  @retval EFI_SUCCESS      The element type is supported and the data has been output.
-  @retval EFI_UNSUPPORTED  This function does not support the XML data type passed in.
-
-
-**/
-typedef
-EFI_STATUS
-(*DRIVER_XML_DBG_DATA_PRINTER) (
-  DRIVER_XML_DATA_HEADER* Element,
-  BOOLEAN Recursive,
-  UINTN TreeLevel
-);
-
 //
-// This is the list of debug print worker functions that will be used.
-// After creating a new debug print worker, add it to the list here.
+// How many characters DbgShowChars hands to each DEBUG call. This stays under the
+// message limit of the usual DebugLib instances, which is 256 characters.
 //
-#define DEBUG_PRINT_FUNCTIONS DbgPrintAttribute,DbgPrintTag,DbgPrintEmptyElementTag,DbgPrintPi,DbgPrintCharData
+#define DBG_SHOW_CHARS_CHUNK  128
+
 /**
   Print a specified number of characters.
 
+  The characters are copied into a staging buffer a chunk at a time, with a period in
+  place of each unprintable one, and each chunk goes out in a single DEBUG call.
+
   @param[in] NumChars  The number of characters desired to be printed
   @param[in] Chars     Pointer the array of chars to view.
 **/
@@ -70,18 +52,34 @@ DbgShowChars (
   IN CHAR8* Chars
   )
 {
+  CHAR8 Chunk[DBG_SHOW_CHARS_CHUNK + 1];
   UINTN Index;
+  UINTN ChunkLength;
+
+  //
+  // Skip the copying when the output would be thrown away.
+  //
+  if (!DebugPrintEnabled () || !DebugPrintLevelEnabled (DEBUG_ERROR)) {
+    return;
+  }
+  ChunkLength = 0;
   for (Index = 0; Index < NumChars; Index++){
     //
     // The range of printable characters based on the ASCII table.
     //
     if((Chars[Index] >= ' ' && Chars[Index] <= '~')) {
-      DEBUG ((DEBUG_ERROR, "%c", Chars[Index]));
+      Chunk[ChunkLength] = Chars[Index];
     } else {
       //
       // Just print a period for unprintable characters.
       //
-      DEBUG ((DEBUG_ERROR, "."));
+      Chunk[ChunkLength] = '.';
+    }
+    ChunkLength++;
+    if (ChunkLength == DBG_SHOW_CHARS_CHUNK || Index + 1 == NumChars) {
+      Chunk[ChunkLength] = 0;
+      DEBUG ((DEBUG_ERROR, "%a", Chunk));
+      ChunkLength = 0;
     }
   }
 }
@@ -124,6 +122,9 @@ PrintXmlType (
     case XmlNothing:
       DEBUG ((DEBUG_ERROR, "XmlNothing\n"));
       break;
+    default:
+      DEBUG ((DEBUG_ERROR, "Unknown type %d\n", Data->XmlDataType));
+      break;
   }
 }
 
@@ -131,29 +132,22 @@ PrintXmlType (
   Print an attribute. This generally gets called directly y the tag element print function.
 
   @param [in]Element    The XML element data to be printed.
-  @param [in]Recursive  If an element has children, this can prevent a recursive call exploring the branch.
-  @param [in]TreeLevel  Used to indicate what level of recursion we are at. 
+  @param [in]TreeLevel  Used to indicate what level of the tree we are at. 
                         This is used to set the indent level and beautify the output.
+  @param [in]Context    Points to a BOOLEAN that is FALSE to leave out the children of a tag.
 
-  @retval EFI_SUCCESS      The element type is supported and the data has been output.
-  @retval EFI_UNSUPPORTED  This function does not support the XML data type passed in.
+  @retval EFI_SUCCESS      The data has been output.
 
 **/
 
 EFI_STATUS 
 DbgPrintAttribute (
   IN DRIVER_XML_DATA_HEADER* Data,
-  IN BOOLEAN                 Recursive,
-  IN UINTN                   TreeLevel
+  IN UINTN                   TreeLevel,
+  IN VOID*                   Context
   ) 
 {
   DRIVER_XML_ATTRIBUTE* Attribute;
-  //
-  // Not our data type, tell the dispatcher.
-  //
-  if (Data->XmlDataType != XmlAttribute) {
-    return EFI_UNSUPPORTED;
-  }
 
   Attribute = (DRIVER_XML_ATTRIBUTE*)Data;
   DEBUG((DEBUG_ERROR," %a=\"%a\"",Attribute->AttributeName,Attribute->AttributeData == NULL?"":Attribute->AttributeData));
@@ -162,38 +156,31 @@ DbgPrintAttribute (
 
 
 /**
-  Print an XML tag to the debug pipe.
+  Print the start of an XML tag to the debug pipe.
 
   @param [in]Element    The XML element data to be printed.
-  @param [in]Recursive  If an element has children, this can prevent a recursive call exploring the branch.
-  @param [in]TreeLevel  Used to indicate what level of recursion we are at. 
+  @param [in]TreeLevel  Used to indicate what level of the tree we are at. 
                         This is used to set the indent level and beautify the output.
+  @param [in]Context    Points to a BOOLEAN that is FALSE to leave out the children of a tag.
 
-  @retval EFI_SUCCESS      The element type is supported and the data has been output.
-  @retval EFI_UNSUPPORTED  This function does not support the XML data type passed in.
+  @retval EFI_SUCCESS            The data has been output.
+  @retval DRIVER_XML_VISIT_SKIP  The data has been output and the children are not wanted.
 
 **/
 EFI_STATUS 
 DbgPrintTag (
   IN DRIVER_XML_DATA_HEADER* Data,
-  IN BOOLEAN                 Recursive,
-  IN UINTN                   TreeLevel
+  IN UINTN                   TreeLevel,
+  IN VOID*                   Context
   ) 
 {
   DRIVER_XML_TAG*         Tag;
   DRIVER_XML_ATTRIBUTE*   Attribute;
   DRIVER_XML_DATA_HEADER* LocalXmlData;
-  LIST_ANCHOR*            ChildList;
   LIST_ANCHOR*            AttributeList;
   CHAR8*                  Prefix;
   UINTN                   LeadingSpaces;
   
-  //
-  // Not our data type, tell the dispatcher.
-  //
-  if (Data->XmlDataType != XmlTag) {
-    return EFI_UNSUPPORTED;
-  }
   //
   // As with EDK2 coding standard, indent by 2 spaces
   //
@@ -201,7 +188,7 @@ DbgPrintTag (
   //
   // Set up our prefex to provide a level of indentation that makes the output more readable.
   //
-  Prefix = AllocateZeroPool(LeadingSpaces + 1);
+  Prefix = DriverXmlAllocatePool (XmlAllocScratch, LeadingSpaces + 1);
   gBS->SetMem(Prefix,LeadingSpaces + 1,0x20);
   Prefix[LeadingSpaces] = 0;
   Tag = (DRIVER_XML_TAG*)Data;
@@ -222,20 +209,52 @@ DbgPrintTag (
         continue;
       }
       Attribute = (DRIVER_XML_ATTRIBUTE*)LocalXmlData;
-      DbgPrintData ((DRIVER_XML_DATA_HEADER*)Attribute,FALSE, TreeLevel + 1);
+      DbgPrintAttribute ((DRIVER_XML_DATA_HEADER*)Attribute, TreeLevel + 1, Context);
     }
   }
   DEBUG((DEBUG_ERROR, ">\n", Tag->TagName));
-  ChildList = &Tag->TagChildren;
+  DriverXmlFreePool (Prefix);
   //
-  // Does this tag have children that need to be printed?
+  // The walk prints the children, if they are wanted, and then calls DbgPrintCloseTag.
   //
-  if (Recursive && ChildList != NULL && ChildList->ItemCount > 0) {
-    DbgWalkBranch (ChildList,TreeLevel + 1);
-    
+  if (!*(BOOLEAN*)Context) {
+    return DRIVER_XML_VISIT_SKIP;
   }
+  return EFI_SUCCESS;
+}
+
+/**
+  Print the end of an XML tag to the debug pipe once its children are printed.
+
+  @param [in]Element    The XML element data to be printed.
+  @param [in]TreeLevel  Used to indicate what level of the tree we are at. 
+                        This is used to set the indent level and beautify the output.
+  @param [in]Context    Points to a BOOLEAN that is FALSE to leave out the children of a tag.
+
+  @retval EFI_SUCCESS      The data has been output.
+
+**/
+EFI_STATUS 
+DbgPrintCloseTag (
+  IN DRIVER_XML_DATA_HEADER* Data,
+  IN UINTN                   TreeLevel,
+  IN VOID*                   Context
+  ) 
+{
+  DRIVER_XML_TAG* Tag;
+  CHAR8*          Prefix;
+  UINTN           LeadingSpaces;
+
+  //
+  // As with EDK2 coding standard, indent by 2 spaces
+  //
+  LeadingSpaces = TreeLevel * 2;
+  Prefix = DriverXmlAllocatePool (XmlAllocScratch, LeadingSpaces + 1);
+  gBS->SetMem (Prefix,LeadingSpaces + 1,0x20);
+  Prefix[LeadingSpaces] = 0;
+  Tag = (DRIVER_XML_TAG*)Data;
   DEBUG ((DEBUG_ERROR, "%a</%a>\n", Prefix, Tag->TagName));
-  FreePool (Prefix);
+  DriverXmlFreePool (Prefix);
   return EFI_SUCCESS;
 }
 
@@ -243,19 +262,18 @@ DbgPrintTag (
   Print an XML empty tag to the debug pipe.
 
   @param [in]Element    The XML element data to be printed.
-  @param [in]Recursive  If an element has children, this can prevent a recursive call exploring the branch.
-  @param [in]TreeLevel  Used to indicate what level of recursion we are at. 
+  @param [in]TreeLevel  Used to indicate what level of the tree we are at. 
                         This is used to set the indent level and beautify the output.
+  @param [in]Context    Points to a BOOLEAN that is FALSE to leave out the children of a tag.
 
-  @retval EFI_SUCCESS      The element type is supported and the data has been output.
-  @retval EFI_UNSUPPORTED  This function does not support the XML data type passed in.
+  @retval EFI_SUCCESS      The data has been output.
 
 **/
 EFI_STATUS 
 DbgPrintEmptyElementTag (
   IN DRIVER_XML_DATA_HEADER* Data,
-  IN BOOLEAN                 Recursive,
-  IN UINTN                   TreeLevel
+  IN UINTN                   TreeLevel,
+  IN VOID*                   Context
   ) 
 {
   DRIVER_XML_TAG*         Tag;
@@ -265,9 +283,6 @@ DbgPrintEmptyElementTag (
   CHAR8*                  Prefix;
   UINTN                   LeadingSpaces;
   
-  if (Data->XmlDataType != XmlEmptyTag) {
-    return EFI_UNSUPPORTED;
-  }
   //
   // As with EDK2 coding standard, indent by 2 spaces
   //
@@ -275,7 +290,7 @@ DbgPrintEmptyElementTag (
   //
   // Set up our prefex to provide a level of indentation that makes the output more readable.
   //
-  Prefix = AllocateZeroPool (LeadingSpaces + 1);
+  Prefix = DriverXmlAllocatePool (XmlAllocScratch, LeadingSpaces + 1);
   gBS->SetMem (Prefix,LeadingSpaces + 1,0x20);
   Prefix[LeadingSpaces] = 0;
   
@@ -298,11 +313,11 @@ DbgPrintEmptyElementTag (
         continue;
       }
       Attribute = (DRIVER_XML_ATTRIBUTE*)LocalXmlData;
-      DbgPrintData((DRIVER_XML_DATA_HEADER*)Attribute,FALSE, TreeLevel + 1);
+      DbgPrintAttribute ((DRIVER_XML_DATA_HEADER*)Attribute, TreeLevel + 1, Context);
     }
   }
   DEBUG ((DEBUG_ERROR, "/>\n",Tag->TagName));
-  FreePool (Prefix);
+  DriverXmlFreePool (Prefix);
   return EFI_SUCCESS;
 }
 
@@ -310,28 +325,24 @@ DbgPrintEmptyElementTag (
   Print an XML processor instruction to the debug pipe.
 
   @param [in]Element    The XML element data to be printed.
-  @param [in]Recursive  If an element has children, this can prevent a recursive call exploring the branch.
-  @param [in]TreeLevel  Used to indicate what level of recursion we are at. 
+  @param [in]TreeLevel  Used to indicate what level of the tree we are at. 
                         This is used to set the indent level and beautify the output.
+  @param [in]Context    Points to a BOOLEAN that is FALSE to leave out the children of a tag.
 
-  @retval EFI_SUCCESS      The element type is supported and the data has been output.
-  @retval EFI_UNSUPPORTED  This function does not support the XML data type passed in.
+  @retval EFI_SUCCESS      The data has been output.
 
 **/
 EFI_STATUS 
 DbgPrintPi (
   IN DRIVER_XML_DATA_HEADER* Data,
-  IN BOOLEAN                 Recursive,
-  IN UINTN                   TreeLevel
+  IN UINTN                   TreeLevel,
+  IN VOID*                   Context
   ) 
 {
   DRIVER_XML_PROCESSING_INSTRUCTION* LocalPi;
   CHAR8*                             Prefix;
   UINTN                              LeadingSpaces;
   
-  if (Data->XmlDataType != XmlPi) {
-    return EFI_UNSUPPORTED;
-  }
   //
   // As with EDK2 coding standard, indent by 2 spaces
   //
@@ -339,13 +350,13 @@ DbgPrintPi (
   //
   // Set up our prefex to provide a level of indentation that makes the output more readable.
   //
-  Prefix = AllocateZeroPool (LeadingSpaces + 1);
+  Prefix = DriverXmlAllocatePool (XmlAllocScratch, LeadingSpaces + 1);
   gBS->SetMem (Prefix,LeadingSpaces + 1,0x20);
   Prefix[LeadingSpaces] = 0;
   LocalPi = (DRIVER_XML_PROCESSING_INSTRUCTION*)Data;
   DEBUG ((DEBUG_ERROR, "<?%a %a?>\n", LocalPi->PiTargetName, LocalPi->PiTargetData));
 
-  FreePool (Prefix);
+  DriverXmlFreePool (Prefix);
   return EFI_SUCCESS;
 }
 
@@ -353,28 +364,24 @@ DbgPrintPi (
   Print XML char data to the debug pipe.
 
   @param [in]Element    The XML element data to be printed.
-  @param [in]Recursive  If an element has children, this can prevent a recursive call exploring the branch.
-  @param [in]TreeLevel  Used to indicate what level of recursion we are at. 
+  @param [in]TreeLevel  Used to indicate what level of the tree we are at. 
                         This is used to set the indent level and beautify the output.
+  @param [in]Context    Points to a BOOLEAN that is FALSE to leave out the children of a tag.
 
-  @retval EFI_SUCCESS      The element type is supported and the data has been output.
-  @retval EFI_UNSUPPORTED  This function does not support the XML data type passed in.
+  @retval EFI_SUCCESS      The data has been output.
 
 **/
 EFI_STATUS 
 DbgPrintCharData (
   IN DRIVER_XML_DATA_HEADER* Data,
-  IN BOOLEAN                 Recursive,
-  IN UINTN                   TreeLevel
+  IN UINTN                   TreeLevel,
+  IN VOID*                   Context
   ) 
 {
   DRIVER_XML_CHAR_DATA* LocalCharData;
   CHAR8*                Prefix;
   UINTN                 LeadingSpaces;
   
-  if (Data->XmlDataType != XmlChar) {
-    return EFI_UNSUPPORTED;
-  }
   //
   // As with EDK2 coding standard, indent by 2 spaces
   //
@@ -382,28 +389,57 @@ DbgPrintCharData (
   //
   // Set up our prefex to provide a level of indentation that makes the output more readable.
   //
-  Prefix = AllocateZeroPool (LeadingSpaces + 1);
+  Prefix = DriverXmlAllocatePool (XmlAllocScratch, LeadingSpaces + 1);
   gBS->SetMem (Prefix,LeadingSpaces + 1,0x20);
   Prefix[LeadingSpaces] = 0;
   LocalCharData = (DRIVER_XML_CHAR_DATA*)Data;
   DEBUG ((DEBUG_ERROR, "%a",Prefix));
   DbgShowChars(LocalCharData->DataSize, LocalCharData->CharData);
   DEBUG ((DEBUG_ERROR, "\n"));
-  FreePool (Prefix);
+  DriverXmlFreePool (Prefix);
   return EFI_SUCCESS;
 }
 
+//
+// The debug print worker functions, indexed by XML_DATA_TYPE.
+// After creating a new debug print worker, put it in the slot for its data type.
+//
+CONST DRIVER_XML_VISITOR mXmlDebugPrinter = {
+  {
+    NULL,                     // XmlNothing
+    DbgPrintEmptyElementTag,  // XmlEmptyTag
+    DbgPrintTag,              // XmlTag
+    NULL,                     // XmlCloseTag
+    DbgPrintAttribute,        // XmlAttribute
+    DbgPrintCharData,         // XmlChar
+    DbgPrintPi,               // XmlPi
+    NULL,                     // XmlDecl
+    NULL                      // XmlComment
+  },
+  {
+    NULL,                     // XmlNothing
+    NULL,                     // XmlEmptyTag
+    DbgPrintCloseTag,         // XmlTag
+    NULL,                     // XmlCloseTag
+    NULL,                     // XmlAttribute
+    NULL,                     // XmlChar
+    NULL,                     // XmlPi
+    NULL,                     // XmlDecl
+    NULL                      // XmlComment
+  }
+};
+
 /**
-  The call that determines what data printer to use. This calls through the list of debug data print functions
-  until one returns success.
+  The call that determines what data printer to use. The debug print worker for each element
+  is looked up by its data type.
 
   @param [in]Element    The XML element data to be printed.
-  @param [in]Recursive  If an element has children, this can prevent a recursive call exploring the branch.
-  @param [in]TreeLevel  Used to indicate what level of recursion we are at. 
+  @param [in]Recursive  If an element has children, this can prevent exploring the branch.
+  @param [in]TreeLevel  Used to indicate what level of the tree we are at. 
                         This is used to set the indent level and beautify the output.
 
   @retval EFI_SUCCESS      The element type is supported and the data has been output.
-  @retval EFI_UNSUPPORTED  This function does not support the XML data type passed in.
+  @retval EFI_UNSUPPORTED  There is no debug print worker for the XML data type passed in.
 
 **/
 EFI_STATUS
@@ -412,18 +448,10 @@ DbgPrintData(
   IN BOOLEAN                 Recursive,
   IN UINTN                   TreeLevel
 ){
-  DRIVER_XML_DBG_DATA_PRINTER DataPrinters[] = {DEBUG_PRINT_FUNCTIONS, NULL};
-  UINTN i = 0;
-  EFI_STATUS Status;
-  while (DataPrinters[i] != NULL){
-    Status = DataPrinters[i] (Data, Recursive, TreeLevel);
-    if (Status == EFI_SUCCESS) {
-      return Status;
-    }
-    i++;
+  if ((UINTN)Data->XmlDataType >= XmlDataTypeMax || mXmlDebugPrinter.PreOrder[Data->XmlDataType] == NULL) {
+    return EFI_UNSUPPORTED;
   }
-  
-  return EFI_UNSUPPORTED;
+  return DriverXmlWalkElement (&mXmlDebugPrinter, Data, TreeLevel, &Recursive);
 }
 
 /**
@@ -442,21 +470,8 @@ DbgWalkBranch(
   IN UINTN         TreeLevel
 )
 {
-  DRIVER_XML_DATA_HEADER* BranchDataItem;
-  EFI_STATUS              Status;
-  
-  if (BranchDataList->ItemCount == 0) {
-    return EFI_SUCCESS;
-  }
-  BranchDataItem = (DRIVER_XML_DATA_HEADER*)&BranchDataList->ListStart;
-  while (GetNextXmlElement (BranchDataList, BranchDataItem, &BranchDataItem) == EFI_SUCCESS) {
-    if (BranchDataItem == NULL) {
-      break;
-    }
-    Status = DbgPrintData((DRIVER_XML_DATA_HEADER*)BranchDataItem,TRUE,TreeLevel);
-    if (EFI_ERROR (Status)) { 
-      DEBUG((DEBUG_ERROR, "%a encountered unsupported data\n", __FUNCTION__));
-    }
-  }
-  return EFI_SUCCESS;
+  BOOLEAN Recursive;
+
+  Recursive = TRUE;
+  return DriverXmlWalkBranch (&mXmlDebugPrinter, BranchDataList, TreeLevel, &Recursive);
 }
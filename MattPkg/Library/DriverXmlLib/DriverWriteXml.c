@@ -25,34 +25,59 @@
 #include <uefi.h>
 #include <Library/DebugLib.h>
 #include <Library/MemoryAllocationLib.h>
-#include <Library/PrintLib.h>
 #include <Library/UefiBootServicesTableLib.h>
 #include <Library/BaseLib.h>
 #include <DriverXmlStringHandlers.h>
 
-typedef
-EFI_STATUS
-(*DRIVER_XML_DATA_PRINTER) (
-  DRIVER_XML_DATA_HEADER* Element,
-  XML_DOCUMENT* OutputDocument
-);
+//
+// The smallest output buffer we allocate. After that the buffer doubles each time it fills,
+// so writing a document copies it only a few times whatever its size.
+//
+#define OUTPUT_DOCUMENT_ALLOCATE_STEP 512
 
 //
-// Trying to stream multiple writes out to a buffer we may resize in the middle
-// of multiple write operations gets to be complex and error prone.
-// The WC3 does not specify a max size for anything so this is just a guess.
-// Adjust this define if needed.
+// A word with 0x01 in every byte, and one with 0x80 in every byte.
+// FindEscapeCharacter uses them to test all the bytes of a word at once.
 //
-#define MAX_TEMP_BUFFER_SIZE 128
+#define WORD_LOW_BYTES   ((UINTN)-1 / 0xFF)
+#define WORD_HIGH_BITS   (WORD_LOW_BYTES * 0x80)
 
-// The amount to grow our output buffer by when we determine we need to grow it.
-#define OUTPUT_DOCUMENT_ALLOCATE_STEP 512
+//
+// Number of frames to grow the incremental writer's frame stack by when it fills.
+//
+#define INCREMENTAL_FRAME_STEP 16
 
 //
-// This is the list of debug print worker functions that will be used.
-// After creating a new debug print worker, add it to the list here.
+// How PrintDataIncremental is writing a tag.
 //
-#define XML_PRINT_FUNCTIONS PrintAttribute,PrintTag,PrintEmptyTag,PrintPi,PrintCharData
+typedef enum _XML_INCREMENTAL_MODE {
+  IncrementalCopied,       // The whole element was copied from the source
+  IncrementalCopyBetween,  // Only the child elements are written, the text around them is copied
+  IncrementalRendered      // The element is rendered from the tree
+} XML_INCREMENTAL_MODE;
+
+//
+// The state of one open tag in an incremental write. Cursor and SpanEnd are only used
+// for IncrementalCopyBetween and are the next source byte to copy and the end of the element.
+//
+typedef struct _XML_INCREMENTAL_FRAME {
+  XML_INCREMENTAL_MODE Mode;
+  UINTN                OutputStart;
+  UINTN                Cursor;
+  UINTN                SpanEnd;
+} XML_INCREMENTAL_FRAME;
+
+//
+// The state of one incremental write. Frames holds a frame for each open tag, indexed by depth,
+// so the write needs no call stack of its own however deep the tree is.
+//
+typedef struct _XML_INCREMENTAL_WRITER {
+  CONST CHAR8*           Source;
+  UINTN                  SourceSize;
+  XML_DOCUMENT*          OutputDocument;
+  XML_INCREMENTAL_FRAME* Frames;
+  UINTN                  FrameSlots;
+} XML_INCREMENTAL_WRITER;
 
 
 /**
@@ -90,11 +115,20 @@ ReallocateXmlDocument (
       return EFI_INVALID_PARAMETER;
     }
     //
-    // Initialize everything
+    // Initialize everything. Only the bytes before OperationPtr are ever read so the buffer is not zeroed.
+    //
+    OutputDocument->XmlDocument = AllocatePool (NewSize);
+    if (OutputDocument->XmlDocument == NULL) {
+      return EFI_OUT_OF_RESOURCES;
+    }
+    //
+    // The document belongs to the caller and is given back with FreePool so it is
+    // only counted here rather than allocated through DriverXmlAllocatePool.
     //
-    OutputDocument->XmlDocument = AllocateZeroPool (NewSize);
+    DriverXmlCountCallerAllocation (XmlAllocOutput, 0, NewSize);
     OutputDocument->OperationPtr = OutputDocument->XmlDocument;
     OutputDocument->DocumentSize = NewSize;
+    return EFI_SUCCESS;
   }
   //
   // Calculate an offset for the operations pointer so we can restore it after reallocation
@@ -109,6 +143,7 @@ ReallocateXmlDocument (
   if (TmpBuffer == NULL) {
     return EFI_OUT_OF_RESOURCES;
   }
+  DriverXmlCountCallerAllocation (XmlAllocOutput, OutputDocument->DocumentSize, NewSize);
   OutputDocument->XmlDocument = TmpBuffer;
   OutputDocument->DocumentSize = NewSize;
   //
@@ -118,6 +153,62 @@ ReallocateXmlDocument (
   return EFI_SUCCESS;
 }
 
+/**
+  Append a run of bytes to the output document, growing it when needed.
+  Every byte is counted in RequiredSize. When the document has a sink the bytes go straight
+  to it. A fixed size document is never grown: once the output no longer fits nothing more
+  is written, but the count goes on so the caller learns how big a buffer it needs.
+
+  @param[in]     Bytes           The bytes to append.
+  @param[in]     Length          The number of bytes.
+  @param[in out] OutputDocument  The output document.
+
+  @retval EFI_SUCCESS           The bytes were appended or, for a fixed size document, counted.
+  @retval EFI_OUT_OF_RESOURCES  The document could not be grown.
+  @retval other                 An error from the sink.
+**/
+EFI_STATUS
+BytesToDocument (
+  CONST CHAR8*  Bytes,
+  UINTN         Length,
+  XML_DOCUMENT* OutputDocument
+  )
+{
+  UINTN      DocumentFreeSize;
+  EFI_STATUS Status;
+
+  if (Length == 0) {
+    return EFI_SUCCESS;
+  }
+  OutputDocument->RequiredSize += Length;
+  if (OutputDocument->Sink != NULL) {
+    return OutputDocument->Sink->Write (OutputDocument->Sink, Bytes, Length);
+  }
+  if ((OutputDocument->Flags & XML_DOCUMENT_FIXED_SIZE) != 0) {
+    if (OutputDocument->RequiredSize > OutputDocument->DocumentSize) {
+      return EFI_SUCCESS;
+    }
+  }
+  DocumentFreeSize = ((UINTN)(OutputDocument->XmlDocument + OutputDocument->DocumentSize)) \
+                      - (UINTN)OutputDocument->OperationPtr;
+  if (Length > DocumentFreeSize) {
+    Status = ReallocateXmlDocument (
+               OutputDocument,
+               MAX (
+                 MAX (OutputDocument->DocumentSize * 2, OUTPUT_DOCUMENT_ALLOCATE_STEP),
+                 OutputDocument->DocumentSize - DocumentFreeSize + Length
+                 )
+               );
+    if (EFI_ERROR (Status)) {
+      OutputDocument->RequiredSize -= Length;
+      return Status;
+    }
+  }
+  gBS->CopyMem (OutputDocument->OperationPtr, (VOID*)Bytes, Length);
+  OutputDocument->OperationPtr += Length;
+  return EFI_SUCCESS;
+}
+
 /**
   Insert a string into the buffer of the provided XML document. 
   This will happen where the operations pointer specifies and should be 
@@ -127,341 +218,483 @@ ReallocateXmlDocument (
   @param[in out] OutputDocument  The XML housekeeping data structure used to manage the output buffer.
 
   @retval EFI_SUCCESS            The insert was successful.
+  @retval EFI_OUT_OF_RESOURCES   The document could not be grown.
 **/
 EFI_STATUS
 StringToDocument (
-  CHAR8*        String,
+  CONST CHAR8*  String,
   XML_DOCUMENT* OutputDocument
   )
 {
-  UINTN StringLen;
-  UINTN DocumentFreeSize;
-  
-  StringLen = AsciiStrnLenS(String,MAX_TEMP_BUFFER_SIZE);
-  DocumentFreeSize = ((UINTN)(OutputDocument->XmlDocument + OutputDocument->DocumentSize)) \
-                      - (UINTN)OutputDocument->OperationPtr;
-  if (StringLen > DocumentFreeSize) {
-    //
-    // Out of space.
-    // If the string is smaller than the defined reallocation size, over-provision to prevent
-    // reallocating for every string.
-    // Otherwise, grow the buffer large enough to handle the very long string.
-    //
-    if (StringLen > OUTPUT_DOCUMENT_ALLOCATE_STEP) {
-      ReallocateXmlDocument (OutputDocument, OutputDocument->DocumentSize + StringLen + 1);
-    } else {
-      ReallocateXmlDocument (OutputDocument, OutputDocument->DocumentSize + OUTPUT_DOCUMENT_ALLOCATE_STEP);
-    }
-  }
+  return BytesToDocument (String, AsciiStrLen (String), OutputDocument);
+}
+
+/**
+  Check whether a word holds a byte. Pattern is the byte repeated in every byte of a word.
+
+  @param[in] Word     The bytes to check.
+  @param[in] Pattern  The byte to look for, in every byte.
+
+  @return Non zero if one of the bytes in Word matches.
+**/
+UINTN
+WordHasByte (
+  UINTN Word,
+  UINTN Pattern
+  )
+{
+  Word ^= Pattern;
   //
-  // Copy the string to the buffer
+  // Only a byte that was 0 can borrow into its own high bit without already having it set.
   //
-  gBS->CopyMem (
-        OutputDocument->OperationPtr,
-        String,
-        StringLen
-      );
-  OutputDocument->OperationPtr += StringLen;
-  return EFI_SUCCESS;
-  
+  return (Word - WORD_LOW_BYTES) & ~Word & WORD_HIGH_BITS;
+}
+
+/**
+  Find the next character that may need escaping in text or an attribute value.
+  The text is scanned a word at a time so the long clean runs that make up most
+  values cost one test per word instead of one per character.
+
+  @param[in] Text         The first character to look at.
+  @param[in] End          The end of the text.
+  @param[in] IsAttribute  TRUE to look for the characters of an attribute value, FALSE for char data.
+
+  @return The first '<', '&' or, for char data '>' and for attribute values '"', or End if there is none.
+**/
+CONST CHAR8*
+FindEscapeCharacter (
+  CONST CHAR8* Text,
+  CONST CHAR8* End,
+  BOOLEAN      IsAttribute
+  )
+{
+  CONST CHAR8* Ptr;
+  CHAR8        Quote;
+  UINTN        Word;
+  UINTN        LessThan;
+  UINTN        Ampersand;
+  UINTN        Third;
+
+  Quote = IsAttribute ? '\"' : '>';
+  Ptr = Text;
+  //
+  // Bytes up to a word boundary, so the word reads are aligned and never go past End.
+  //
+  while (Ptr < End && ((UINTN)Ptr & (sizeof (UINTN) - 1)) != 0) {
+    if (*Ptr == '<' || *Ptr == '&' || *Ptr == Quote) {
+      return Ptr;
+    }
+    Ptr++;
+  }
+  LessThan = WORD_LOW_BYTES * '<';
+  Ampersand = WORD_LOW_BYTES * '&';
+  Third = WORD_LOW_BYTES * (UINT8)Quote;
+  while ((UINTN)(End - Ptr) >= sizeof (UINTN)) {
+    Word = *(CONST UINTN*)Ptr;
+    if ((WordHasByte (Word, LessThan) | WordHasByte (Word, Ampersand) | WordHasByte (Word, Third)) != 0) {
+      break;
+    }
+    Ptr += sizeof (UINTN);
+  }
+  while (Ptr < End) {
+    if (*Ptr == '<' || *Ptr == '&' || *Ptr == Quote) {
+      return Ptr;
+    }
+    Ptr++;
+  }
+  return End;
+}
+
+/**
+  Write char data or an attribute value, escaping what would end it or make it malformed.
+  '<' is always escaped, '"' in attribute values since they are written in double quotes,
+  and '>' in char data only where it would close "]]>".
+
+  Text from a parse without DRIVER_XML_PARSE_EXPAND_ENTITIES still holds its references as
+  they were written, so with KeepReferences an '&' that starts a well formed reference is left
+  alone and only any other '&' is escaped. Text from any other tree is literal, so without
+  KeepReferences every '&' is escaped, including one that spells out a reference after expansion.
+
+  @param[in]     Text            The text.
+  @param[in]     Length          The number of characters in Text.
+  @param[in]     IsAttribute     TRUE for an attribute value.
+  @param[in]     KeepReferences  TRUE to leave references in the text as they are.
+  @param[in out] OutputDocument  The output document.
+
+  @retval EFI_SUCCESS           The text was written.
+  @retval EFI_OUT_OF_RESOURCES  The document could not be grown.
+**/
+EFI_STATUS
+EscapedTextToDocument (
+  CONST CHAR8*  Text,
+  UINTN         Length,
+  BOOLEAN       IsAttribute,
+  BOOLEAN       KeepReferences,
+  XML_DOCUMENT* OutputDocument
+  )
+{
+  CONST CHAR8* Run;
+  CONST CHAR8* Ptr;
+  CONST CHAR8* End;
+  CONST CHAR8* Escape;
+  UINTN        EscapeLength;
+  UINTN        RefLength;
+  EFI_STATUS   Status;
+
+  Run = Text;
+  End = Text + Length;
+  Ptr = FindEscapeCharacter (Text, End, IsAttribute);
+  while (Ptr < End) {
+    Escape = NULL;
+    EscapeLength = 0;
+    switch (*Ptr) {
+    case '<':
+      Escape = "&lt;";
+      EscapeLength = 4;
+      break;
+    case '\"':
+      Escape = "&quot;";
+      EscapeLength = 6;
+      break;
+    case '>':
+      if (Ptr - Text >= 2 && Ptr[-1] == ']' && Ptr[-2] == ']') {
+        Escape = "&gt;";
+        EscapeLength = 4;
+      }
+      break;
+    default:
+      if (!KeepReferences || EFI_ERROR (GetReferenceLength (Ptr + 1, End, &RefLength))) {
+        Escape = "&amp;";
+        EscapeLength = 5;
+      }
+      break;
+    }
+    if (Escape != NULL) {
+      Status = BytesToDocument (Run, Ptr - Run, OutputDocument);
+      if (!EFI_ERROR (Status)) {
+        Status = BytesToDocument (Escape, EscapeLength, OutputDocument);
+      }
+      if (EFI_ERROR (Status)) {
+        return Status;
+      }
+      Run = Ptr + 1;
+    }
+    Ptr = FindEscapeCharacter (Ptr + 1, End, IsAttribute);
+  }
+  return BytesToDocument (Run, End - Run, OutputDocument);
 }
 
 /**
   XML data print handler for XML attribute data
 
   @param[in]     Data            The XML data to be printed 
-  @param[in out] OutputDocument  The XML housekeeping data structure containing the output buffer. 
+  @param[in]     Depth           The depth of the data in the walk. Not used.
+  @param[in out] Context         The XML_DOCUMENT containing the output buffer. 
   
-  @retval EFI_SUCCESS      The element type is supported and the data has been output.
-  @retval EFI_UNSUPPORTED  This function does not support the XML data type passed in.
+  @retval EFI_SUCCESS           The data has been output.
+  @retval EFI_OUT_OF_RESOURCES  The document could not be grown.
 
 **/
 EFI_STATUS 
 PrintAttribute (
   DRIVER_XML_DATA_HEADER* Data,
-  XML_DOCUMENT*           OutputDocument
+  UINTN                   Depth,
+  VOID*                   Context
   )
 {
   DRIVER_XML_ATTRIBUTE* Attribute;
-  CHAR8*                TmpBuffer;
-  UINTN                 BufferOffset;
-  
-  if (Data->XmlDataType != XmlAttribute) {
-    return EFI_UNSUPPORTED;
-  }
-  //
-  // Use a pool to prevent any possible stack issues.
-  //
-  TmpBuffer = AllocateZeroPool (MAX_TEMP_BUFFER_SIZE);
-  BufferOffset = 0;
-  
+  XML_DOCUMENT*         OutputDocument;
+  EFI_STATUS            Status;
   
+  OutputDocument = Context;
   Attribute = (DRIVER_XML_ATTRIBUTE*)Data;
   
+  Status = BytesToDocument (" ", 1, OutputDocument);
+  if (!EFI_ERROR (Status)) {
+    Status = StringToDocument (Attribute->AttributeName, OutputDocument);
+  }
+  if (!EFI_ERROR (Status)) {
+    Status = BytesToDocument ("=\"", 2, OutputDocument);
+  }
   //
-  // Use of the ternary operator is to allow for an empty string
+  // A NULL value is written as an empty string
   //
-  BufferOffset += AsciiSPrint (
-                    &TmpBuffer[BufferOffset],
-                    MAX_TEMP_BUFFER_SIZE - BufferOffset, 
-                    " %a=\"%a\"",
-                    Attribute->AttributeName,
-                    Attribute->AttributeData == NULL?"":Attribute->AttributeData
-                    );
-  StringToDocument (TmpBuffer,OutputDocument);
-  FreePool (TmpBuffer);
+  if (!EFI_ERROR (Status) && Attribute->AttributeData != NULL) {
+    Status = EscapedTextToDocument (
+               Attribute->AttributeData,
+               AsciiStrLen (Attribute->AttributeData),
+               TRUE,
+               (BOOLEAN)((Attribute->Flags & DRIVER_XML_TEXT_RAW) != 0),
+               OutputDocument
+               );
+  }
+  if (!EFI_ERROR (Status)) {
+    Status = BytesToDocument ("\"", 1, OutputDocument);
+  }
+  return Status;
+}
+
+/**
+  Write the attributes of a tag, each with a leading space.
+
+  @param[in]     AttributeList   The tag's attributes.
+  @param[in out] OutputDocument  The XML housekeeping data structure containing the output buffer. 
+
+  @retval EFI_SUCCESS           The attributes were written.
+  @retval EFI_OUT_OF_RESOURCES  The document could not be grown.
+**/
+EFI_STATUS
+PrintAttributeList (
+  LIST_ANCHOR*  AttributeList,
+  XML_DOCUMENT* OutputDocument
+  )
+{
+  DRIVER_XML_DATA_HEADER* LocalXmlData;
+  EFI_STATUS              Status;
+
+  if (AttributeList->ItemCount == 0) {
+    return EFI_SUCCESS;
+  }
+  LocalXmlData = (DRIVER_XML_DATA_HEADER*)&AttributeList->ListStart;
+  while (GetNextXmlElement (AttributeList, LocalXmlData, &LocalXmlData) == EFI_SUCCESS) {
+    if (LocalXmlData->XmlDataType != XmlAttribute) {
+      DEBUG((DEBUG_ERROR,"Encountered a non-attribute in the attribute list.\n This is unexpected.\n"));
+      continue;
+    }
+    Status = PrintAttribute (LocalXmlData, 0, OutputDocument);
+    if (EFI_ERROR (Status)) {
+      return Status;
+    }
+  }
   return EFI_SUCCESS;
 }
 
 /**
-  XML data print handler for XML tag data
+  XML data print handler for the start of an XML tag. The walk prints the children
+  and then calls PrintCloseTag.
 
   @param[in]     Data            The XML data to be printed 
-  @param[in out] OutputDocument  The XML housekeeping data structure containing the output buffer. 
+  @param[in]     Depth           The depth of the data in the walk. Not used.
+  @param[in out] Context         The XML_DOCUMENT containing the output buffer. 
   
-  @retval EFI_SUCCESS      The element type is supported and the data has been output.
-  @retval EFI_UNSUPPORTED  This function does not support the XML data type passed in.
+  @retval EFI_SUCCESS           The data has been output.
+  @retval EFI_OUT_OF_RESOURCES  The document could not be grown.
 
 **/
 EFI_STATUS 
 PrintTag (
   DRIVER_XML_DATA_HEADER* Data,
-  XML_DOCUMENT*           OutputDocument 
+  UINTN                   Depth,
+  VOID*                   Context
   ) 
 {
-  DRIVER_XML_TAG*         Tag;
-  DRIVER_XML_DATA_HEADER* LocalXmlData;
-  LIST_ANCHOR*            ChildList;
-  LIST_ANCHOR*            AttributeList;
-  CHAR8*                  TmpBuffer;
-  UINTN                   BufferOffset;
+  DRIVER_XML_TAG* Tag;
+  XML_DOCUMENT*   OutputDocument;
+  EFI_STATUS      Status;
 
-  if (Data->XmlDataType != XmlTag) {
-    return EFI_UNSUPPORTED;
+  OutputDocument = Context;
+  Tag = (DRIVER_XML_TAG*)Data;
+
+  Status = BytesToDocument ("<", 1, OutputDocument);
+  if (!EFI_ERROR (Status)) {
+    Status = StringToDocument (Tag->TagName, OutputDocument);
   }
+  if (!EFI_ERROR (Status)) {
+    Status = PrintAttributeList (&Tag->TagAttributes, OutputDocument);
+  }
+  if (!EFI_ERROR (Status)) {
+    Status = BytesToDocument (">", 1, OutputDocument);
+  }
+  return Status;
+}
+
+/**
+  XML data print handler for the end of an XML tag, called once its children are printed.
+
+  @param[in]     Data            The tag to be closed.
+  @param[in]     Depth           The depth of the data in the walk. Not used.
+  @param[in out] Context         The XML_DOCUMENT containing the output buffer. 
   
-  TmpBuffer = AllocateZeroPool(MAX_TEMP_BUFFER_SIZE);
-  BufferOffset = 0;
-  
+  @retval EFI_SUCCESS           The data has been output.
+  @retval EFI_OUT_OF_RESOURCES  The document could not be grown.
+
+**/
+EFI_STATUS 
+PrintCloseTag (
+  DRIVER_XML_DATA_HEADER* Data,
+  UINTN                   Depth,
+  VOID*                   Context
+  ) 
+{
+  DRIVER_XML_TAG* Tag;
+  XML_DOCUMENT*   OutputDocument;
+  EFI_STATUS      Status;
+
+  OutputDocument = Context;
   Tag = (DRIVER_XML_TAG*)Data;
-  BufferOffset = AsciiSPrint (
-                   TmpBuffer,
-                   MAX_TEMP_BUFFER_SIZE - BufferOffset, 
-                   "<%a",
-                   Tag->TagName
-                   );
-  //
-  // Need to write the buffer before the attributes overwrite things
-  //
-  StringToDocument (TmpBuffer,OutputDocument);
 
-  AttributeList = &Tag->TagAttributes;
-  //
-  // Run through attributes
-  //
-  if (AttributeList != NULL && AttributeList->ItemCount > 0) {
-    LocalXmlData = (DRIVER_XML_DATA_HEADER*)&AttributeList->ListStart;
-    while (GetNextXmlElement (AttributeList,LocalXmlData,&LocalXmlData) == EFI_SUCCESS) {
-      if (LocalXmlData == NULL) {
-        //Sanity check
-        break;
-      }
-      PrintData(LocalXmlData,OutputDocument);
-    }
+  Status = BytesToDocument ("</", 2, OutputDocument);
+  if (!EFI_ERROR (Status)) {
+    Status = StringToDocument (Tag->TagName, OutputDocument);
   }
-  StringToDocument (">", OutputDocument);
-  
-  ChildList = &Tag->TagChildren;
-  if ( ChildList != NULL && ChildList->ItemCount > 0) {
-    //
-    // Print all the children of this tag
-    //
-    PrintWalkBranch(ChildList,OutputDocument);
+  if (!EFI_ERROR (Status)) {
+    Status = BytesToDocument (">", 1, OutputDocument);
   }
-  //
-  // Close the tag
-  //
-  BufferOffset = AsciiSPrint (
-                   TmpBuffer,
-                   MAX_TEMP_BUFFER_SIZE - BufferOffset, 
-                   "</%a>",
-                   Tag->TagName
-                   );
-  StringToDocument (TmpBuffer,OutputDocument);
-  FreePool (TmpBuffer);
-  return EFI_SUCCESS;
+  return Status;
 }
 /**
 XML data print handler for processor instruction data
 
 @param[in]     Data            The XML data to be printed 
-@param[in out] OutputDocument  The XML housekeeping data structure containing the output buffer. 
+@param[in]     Depth           The depth of the data in the walk. Not used.
+@param[in out] Context         The XML_DOCUMENT containing the output buffer. 
 
-@retval EFI_SUCCESS      The element type is supported and the data has been output.
-@retval EFI_UNSUPPORTED  This function does not support the XML data type passed in.
+@retval EFI_SUCCESS           The data has been output.
+@retval EFI_OUT_OF_RESOURCES  The document could not be grown.
 
 **/
 EFI_STATUS 
 PrintPi (
   DRIVER_XML_DATA_HEADER* Data,
-  XML_DOCUMENT*           OutputDocument 
+  UINTN                   Depth,
+  VOID*                   Context
   ) 
 {
   DRIVER_XML_PROCESSING_INSTRUCTION* LocalPi;
-  CHAR8*                             TmpBuffer;
-  UINTN                              BufferOffset;
+  XML_DOCUMENT*                      OutputDocument;
+  EFI_STATUS                         Status;
   
-  if (Data->XmlDataType != XmlPi) {
-    return EFI_UNSUPPORTED;
-  }
-  
-  TmpBuffer = AllocateZeroPool (MAX_TEMP_BUFFER_SIZE);
-  BufferOffset = 0;
+  OutputDocument = Context;
   LocalPi = (DRIVER_XML_PROCESSING_INSTRUCTION*)Data;
   
-  BufferOffset = AsciiSPrint (
-                   TmpBuffer,
-                   MAX_TEMP_BUFFER_SIZE - BufferOffset, 
-                   "<?%a %a?>", 
-                   LocalPi->PiTargetName, 
-                   LocalPi->PiTargetData
-                   );
-  StringToDocument (TmpBuffer, OutputDocument);
-  FreePool (TmpBuffer);
-  return EFI_SUCCESS;
+  Status = BytesToDocument ("<?", 2, OutputDocument);
+  if (!EFI_ERROR (Status) && LocalPi->PiTargetName != NULL) {
+    Status = StringToDocument (LocalPi->PiTargetName, OutputDocument);
+  }
+  //
+  // A PI with no data is written as <?target?>
+  //
+  if (!EFI_ERROR (Status) && LocalPi->PiTargetData != NULL) {
+    Status = BytesToDocument (" ", 1, OutputDocument);
+    if (!EFI_ERROR (Status)) {
+      Status = StringToDocument (LocalPi->PiTargetData, OutputDocument);
+    }
+  }
+  if (!EFI_ERROR (Status)) {
+    Status = BytesToDocument ("?>", 2, OutputDocument);
+  }
+  return Status;
 }
 
 /**
   XML data print handler for an empty XML tag.
 
   @param[in]     Data            The XML data to be printed 
-  @param[in out] OutputDocument  The XML housekeeping data structure containing the output buffer. 
+  @param[in]     Depth           The depth of the data in the walk. Not used.
+  @param[in out] Context         The XML_DOCUMENT containing the output buffer. 
   
-  @retval EFI_SUCCESS      The element type is supported and the data has been output.
-  @retval EFI_UNSUPPORTED  This function does not support the XML data type passed in.
+  @retval EFI_SUCCESS           The data has been output.
+  @retval EFI_OUT_OF_RESOURCES  The document could not be grown.
 
 **/
 EFI_STATUS 
 PrintEmptyTag (
   DRIVER_XML_DATA_HEADER* Data,
-  XML_DOCUMENT* OutputDocument
+  UINTN                   Depth,
+  VOID*                   Context
   ) 
 {
-  DRIVER_XML_TAG*         Tag;
-  DRIVER_XML_ATTRIBUTE*   Attribute;
-  DRIVER_XML_DATA_HEADER* LocalXmlData;
-  LIST_ANCHOR*            AttributeList;
-  CHAR8*                  TmpBuffer;
-  UINTN                   BufferOffset;
-  
-  if (Data->XmlDataType != XmlEmptyTag) {
-    return EFI_UNSUPPORTED;
-  }
-  
-  TmpBuffer = AllocateZeroPool (MAX_TEMP_BUFFER_SIZE);
-  BufferOffset = 0;
+  DRIVER_XML_TAG* Tag;
+  XML_DOCUMENT*   OutputDocument;
+  EFI_STATUS      Status;
   
+  OutputDocument = Context;
   Tag = (DRIVER_XML_TAG*)Data;
 
-  BufferOffset = AsciiSPrint (
-                   TmpBuffer,
-                   MAX_TEMP_BUFFER_SIZE - BufferOffset, 
-                   "<%a",
-                   Tag->TagName
-                   );
-  StringToDocument (TmpBuffer, OutputDocument);
-  
-  AttributeList = &Tag->TagAttributes;
-  
-  // run through attributes
-  if (AttributeList->ItemCount > 0) {
-    LocalXmlData = (DRIVER_XML_DATA_HEADER*)&AttributeList->ListStart;
-    while (GetNextXmlElement (AttributeList, LocalXmlData, &LocalXmlData) == EFI_SUCCESS) {
-      if (LocalXmlData == NULL) {
-        //Sanity check
-        break;
-      }
-      if (LocalXmlData->XmlDataType != XmlAttribute) {
-        DEBUG((DEBUG_ERROR,"Encountered a non-attribute in the attribute list.\n This is unexpected.\n"));
-        continue;
-      }
-      Attribute = (DRIVER_XML_ATTRIBUTE*)LocalXmlData;      
-      PrintData ((DRIVER_XML_DATA_HEADER*)Attribute,OutputDocument);
-    }
+  Status = BytesToDocument ("<", 1, OutputDocument);
+  if (!EFI_ERROR (Status)) {
+    Status = StringToDocument (Tag->TagName, OutputDocument);
   }
-  BufferOffset = AsciiSPrint (
-                   TmpBuffer,
-                   MAX_TEMP_BUFFER_SIZE - BufferOffset, 
-                   "/>",
-                   Tag->TagName
-                   );
-  StringToDocument (TmpBuffer,OutputDocument);
-  FreePool (TmpBuffer);
-  return EFI_SUCCESS;
+  if (!EFI_ERROR (Status)) {
+    Status = PrintAttributeList (&Tag->TagAttributes, OutputDocument);
+  }
+  if (!EFI_ERROR (Status)) {
+    Status = BytesToDocument ("/>", 2, OutputDocument);
+  }
+  return Status;
 }
 
 /**
 XML data print handler for XML char data
 
 @param[in]     Data            The XML data to be printed 
-@param[in out] OutputDocument  The XML housekeeping data structure containing the output buffer. 
+@param[in]     Depth           The depth of the data in the walk. Not used.
+@param[in out] Context         The XML_DOCUMENT containing the output buffer. 
 
-@retval EFI_SUCCESS      The element type is supported and the data has been output.
-@retval EFI_UNSUPPORTED  This function does not support the XML data type passed in.
+@retval EFI_SUCCESS           The data has been output.
+@retval EFI_OUT_OF_RESOURCES  The document could not be grown.
 
 **/
 EFI_STATUS 
 PrintCharData (
   DRIVER_XML_DATA_HEADER* Data,
-  XML_DOCUMENT*           OutputDocument 
+  UINTN                   Depth,
+  VOID*                   Context
   ) 
 {
   DRIVER_XML_CHAR_DATA* LocalCharData;
-  //CHAR8*                             TmpBuffer;
-  //UINTN                              BufferOffset;
-  
-  UINTN DocumentFreeSize;
+  XML_DOCUMENT*         OutputDocument;
 
-  if (Data->XmlDataType != XmlChar) {
-    return EFI_UNSUPPORTED;
-  }
-  
+  OutputDocument = Context;
   LocalCharData = (DRIVER_XML_CHAR_DATA*)Data;
-  DocumentFreeSize = ((UINTN)(OutputDocument->XmlDocument + OutputDocument->DocumentSize)) \
-                      - (UINTN)OutputDocument->OperationPtr;
-  if (LocalCharData->DataSize > DocumentFreeSize) {
-    // Out of space.
-    // If the string is smaller than the defined reallocation size, over-provision to prevent
-    // reallocating for every string.
-    // Otherwise, grow the buffer large enough to handle the very long string.
-    //
-    if (LocalCharData->DataSize > OUTPUT_DOCUMENT_ALLOCATE_STEP) {
-      ReallocateXmlDocument (OutputDocument, OutputDocument->DocumentSize + LocalCharData->DataSize + 1);
-    } else {
-      ReallocateXmlDocument (OutputDocument, OutputDocument->DocumentSize + OUTPUT_DOCUMENT_ALLOCATE_STEP);
-    }
-  }
-  //
-  // The easiest thing to do will be a straight up copy operation
-  //
-  gBS->CopyMem (
-        OutputDocument->OperationPtr,
-        LocalCharData->CharData,
-        LocalCharData->DataSize
-      );
-  OutputDocument->OperationPtr += LocalCharData->DataSize;
-  return EFI_SUCCESS;
+  return EscapedTextToDocument (
+           LocalCharData->CharData,
+           LocalCharData->DataSize,
+           FALSE,
+           (BOOLEAN)((LocalCharData->Flags & DRIVER_XML_TEXT_RAW) != 0),
+           OutputDocument
+           );
 }
 
+//
+// The print worker functions, indexed by XML_DATA_TYPE.
+// After creating a new print worker, put it in the slot for its data type.
+//
+CONST DRIVER_XML_VISITOR mXmlPrinter = {
+  {
+    NULL,            // XmlNothing
+    PrintEmptyTag,   // XmlEmptyTag
+    PrintTag,        // XmlTag
+    NULL,            // XmlCloseTag
+    PrintAttribute,  // XmlAttribute
+    PrintCharData,   // XmlChar
+    PrintPi,         // XmlPi
+    NULL,            // XmlDecl
+    NULL             // XmlComment
+  },
+  {
+    NULL,            // XmlNothing
+    NULL,            // XmlEmptyTag
+    PrintCloseTag,   // XmlTag
+    NULL,            // XmlCloseTag
+    NULL,            // XmlAttribute
+    NULL,            // XmlChar
+    NULL,            // XmlPi
+    NULL,            // XmlDecl
+    NULL             // XmlComment
+  }
+};
+
 /**
-  Print XML data to a buffer. this will call into a list of worker functions that do the actual print.
+  Print XML data to a buffer. The print worker for each element is looked up by its data type.
   There is no attempt to make the output pretty. Children are not indented on new lines for example.
 
   @param[in]     Data            The XML data to be printed 
   @param[in out] OutputDocument  The XML housekeeping data structure containing the output buffer. 
   
-  @retval EFI_SUCCESS      The element type is supported and the data has been output.
-  @retval EFI_UNSUPPORTED  This function does not support the XML data type passed in.
+  @retval EFI_SUCCESS           The element type is supported and the data has been output.
+  @retval EFI_UNSUPPORTED       This function does not support the XML data type passed in.
+  @retval EFI_OUT_OF_RESOURCES  The document could not be grown.
 
 **/
 EFI_STATUS
@@ -470,20 +703,10 @@ PrintData(
   XML_DOCUMENT*           OutputDocument
 )
 {
-  DRIVER_XML_DATA_PRINTER DataPrinters[] = {XML_PRINT_FUNCTIONS,NULL};
-  UINTN                   i;
-  EFI_STATUS              Status;
-  
-  i = 0;
-  while (DataPrinters[i] != NULL){
-    Status = DataPrinters[i] (Data, OutputDocument);
-    if (Status == EFI_SUCCESS) {
-      return Status;
-    }
-    i++;
+  if ((UINTN)Data->XmlDataType >= XmlDataTypeMax || mXmlPrinter.PreOrder[Data->XmlDataType] == NULL) {
+    return EFI_UNSUPPORTED;
   }
-  
-  return EFI_UNSUPPORTED;
+  return DriverXmlWalkElement (&mXmlPrinter, Data, 0, OutputDocument);
 }
 
 /**
@@ -494,6 +717,8 @@ PrintData(
   @param[in out] OutputDocument  The XML housekeeping data structure that will contain the buffer of 
                                  output data.
 
+  @retval EFI_SUCCESS           The branch was printed. Element types with no printer are skipped.
+  @retval EFI_OUT_OF_RESOURCES  The document could not be grown.
 **/
 EFI_STATUS
 PrintWalkBranch(
@@ -501,15 +726,354 @@ PrintWalkBranch(
   XML_DOCUMENT* OutputDocument
 )
 {
-  DRIVER_XML_DATA_HEADER* BranchData;
-  
-  BranchData = (DRIVER_XML_DATA_HEADER*)&BranchList->ListStart;
-  while (GetNextXmlElement (BranchList, BranchData, &BranchData) == EFI_SUCCESS) {
-    if (BranchData == NULL){
-      break;
+  return DriverXmlWalkBranch (&mXmlPrinter, BranchList, 0, OutputDocument);
+}
+
+/**
+  Print XML data into a buffer the caller owns, in one pass and without allocating anything.
+  This follows the usual EFI convention: when the buffer is too small nothing useful is left in it
+  and BufferSize is set to the size needed, so a caller can ask for the size with a
+  BufferSize of 0, allocate once and call again.
+
+  @param[in]     Data        The XML data to be printed.
+  @param[out]    Buffer      The buffer for the output. May be NULL when *BufferSize is 0.
+  @param[in out] BufferSize  On input the size of Buffer. On output the number of bytes written,
+                             or the number needed if EFI_BUFFER_TOO_SMALL is returned.
+
+  @retval EFI_SUCCESS            The output was written and *BufferSize is its length.
+  @retval EFI_BUFFER_TOO_SMALL   Buffer is too small. *BufferSize is the size needed.
+  @retval EFI_INVALID_PARAMETER  Data or BufferSize is NULL, or Buffer is NULL with a non zero size.
+  @retval EFI_UNSUPPORTED        Data is not a type that can be printed.
+**/
+EFI_STATUS
+PrintDataToBuffer (
+  DRIVER_XML_DATA_HEADER* Data,
+  CHAR8*                  Buffer,
+  UINTN*                  BufferSize
+  )
+{
+  XML_DOCUMENT OutputDocument;
+  EFI_STATUS   Status;
+
+  if (Data == NULL || BufferSize == NULL || (Buffer == NULL && *BufferSize != 0)) {
+    return EFI_INVALID_PARAMETER;
+  }
+  OutputDocument.XmlDocument = Buffer;
+  OutputDocument.DocumentSize = *BufferSize;
+  OutputDocument.OperationPtr = Buffer;
+  OutputDocument.Flags = XML_DOCUMENT_FIXED_SIZE;
+  OutputDocument.RequiredSize = 0;
+  OutputDocument.Sink = NULL;
+
+  Status = PrintData (Data, &OutputDocument);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+  *BufferSize = OutputDocument.RequiredSize;
+  if (OutputDocument.RequiredSize > OutputDocument.DocumentSize) {
+    return EFI_BUFFER_TOO_SMALL;
+  }
+  return EFI_SUCCESS;
+}
+
+/**
+  Get the exact number of bytes PrintData writes for some XML data.
+  The printers run without storing anything so the result always matches the output.
+
+  @param[in]  Data  The XML data to be measured, usually a tag and so everything below it.
+  @param[out] Size  The number of bytes.
+
+  @retval EFI_SUCCESS            Size is set.
+  @retval EFI_INVALID_PARAMETER  Data or Size is NULL.
+  @retval EFI_UNSUPPORTED        Data is not a type that can be printed.
+**/
+EFI_STATUS
+DriverXmlMeasureData (
+  DRIVER_XML_DATA_HEADER* Data,
+  UINTN*                  Size
+  )
+{
+  EFI_STATUS Status;
+
+  if (Size == NULL) {
+    return EFI_INVALID_PARAMETER;
+  }
+  *Size = 0;
+  Status = PrintDataToBuffer (Data, NULL, Size);
+  if (Status == EFI_BUFFER_TOO_SMALL) {
+    Status = EFI_SUCCESS;
+  }
+  return Status;
+}
+
+/**
+  Span rebase handler. Moves one tag of a branch that was copied to a new place in the output.
+
+  @param[in]     Element  The tag to move.
+  @param[in]     Depth    The depth of the tag in the walk. Not used.
+  @param[in]     Context  The distance it moved, a UINTN. This may wrap to move spans backwards.
+
+  @retval EFI_SUCCESS  The span was moved.
+**/
+EFI_STATUS
+RebaseSourceSpan (
+  DRIVER_XML_DATA_HEADER* Element,
+  UINTN                   Depth,
+  VOID*                   Context
+  )
+{
+  ((DRIVER_XML_TAG*)Element)->SourceOffset += *(UINTN*)Context;
+  return EFI_SUCCESS;
+}
+
+CONST DRIVER_XML_VISITOR mXmlSpanRebaser = {
+  {
+    NULL,              // XmlNothing
+    RebaseSourceSpan,  // XmlEmptyTag
+    RebaseSourceSpan,  // XmlTag
+    NULL,              // XmlCloseTag
+    NULL,              // XmlAttribute
+    NULL,              // XmlChar
+    NULL,              // XmlPi
+    NULL,              // XmlDecl
+    NULL               // XmlComment
+  },
+  { NULL }
+};
+
+/**
+  Incremental write handler for the start of a tag.
+  An unmodified element is copied from the source and its children are skipped. An element where
+  only something below it changed has the text up to its first child element copied, and the walk
+  goes on to the children. A modified element, or one without a span, is rendered from the tree.
+  When the parent is having the text between its children copied, the text before this element
+  is copied first.
+
+  @param[in]     Element  The tag to write.
+  @param[in]     Depth    The depth of the tag. 0 is the root, which has no tags of its own.
+  @param[in out] Context  The XML_INCREMENTAL_WRITER.
+
+  @retval EFI_SUCCESS            The start of the element was written.
+  @retval DRIVER_XML_VISIT_SKIP  The whole element was copied.
+  @retval EFI_INVALID_PARAMETER  A span is outside Source or out of order.
+  @retval EFI_OUT_OF_RESOURCES   The output or the frame stack could not be grown.
+**/
+EFI_STATUS
+IncrementalStartTag (
+  DRIVER_XML_DATA_HEADER* Element,
+  UINTN                   Depth,
+  VOID*                   Context
+  )
+{
+  XML_INCREMENTAL_WRITER* Writer;
+  XML_INCREMENTAL_FRAME*  Frame;
+  XML_INCREMENTAL_FRAME*  Parent;
+  XML_INCREMENTAL_FRAME*  NewFrames;
+  DRIVER_XML_TAG*         Tag;
+  UINTN                   Delta;
+  EFI_STATUS              Status;
+
+  Writer = Context;
+  Tag = (DRIVER_XML_TAG*)Element;
+  if (Depth >= Writer->FrameSlots) {
+    NewFrames = DriverXmlReallocatePool (
+                  XmlAllocScratch,
+                  Writer->Frames,
+                  (Depth + INCREMENTAL_FRAME_STEP) * sizeof (XML_INCREMENTAL_FRAME)
+                  );
+    if (NewFrames == NULL) {
+      return EFI_OUT_OF_RESOURCES;
+    }
+    Writer->Frames = NewFrames;
+    Writer->FrameSlots = Depth + INCREMENTAL_FRAME_STEP;
+  }
+  if (Depth > 0) {
+    Parent = &Writer->Frames[Depth - 1];
+    if (Parent->Mode == IncrementalCopyBetween) {
+      if (Tag->SourceOffset < Parent->Cursor || Tag->SourceOffset + Tag->SourceLength > Parent->SpanEnd) {
+        return EFI_INVALID_PARAMETER;
+      }
+      Status = BytesToDocument (
+                 &Writer->Source[Parent->Cursor],
+                 Tag->SourceOffset - Parent->Cursor,
+                 Writer->OutputDocument
+                 );
+      if (EFI_ERROR (Status)) {
+        return Status;
+      }
+      Parent->Cursor = Tag->SourceOffset + Tag->SourceLength;
+    }
+  }
+
+  Frame = &Writer->Frames[Depth];
+  Frame->OutputStart = Writer->OutputDocument->RequiredSize;
+  if (Writer->Source != NULL && Tag->SourceLength != 0 && (Tag->Flags & DRIVER_XML_TAG_MODIFIED) == 0) {
+    if (Tag->SourceOffset > Writer->SourceSize || Tag->SourceLength > Writer->SourceSize - Tag->SourceOffset) {
+      return EFI_INVALID_PARAMETER;
+    }
+    if ((Tag->Flags & DRIVER_XML_TAG_CHILD_MODIFIED) == 0) {
+      //
+      // Untouched. Copy it and move the branch's spans to where it landed.
+      //
+      Frame->Mode = IncrementalCopied;
+      Status = BytesToDocument (&Writer->Source[Tag->SourceOffset], Tag->SourceLength, Writer->OutputDocument);
+      if (EFI_ERROR (Status)) {
+        return Status;
+      }
+      if (Frame->OutputStart != Tag->SourceOffset) {
+        Delta = Frame->OutputStart - Tag->SourceOffset;
+        DriverXmlWalkElement (&mXmlSpanRebaser, Element, 0, &Delta);
+      }
+      return DRIVER_XML_VISIT_SKIP;
     }
-    PrintData(BranchData,OutputDocument);
+    //
+    // The start tag, end tag and everything between the child elements is unchanged.
+    //
+    Frame->Mode = IncrementalCopyBetween;
+    Frame->Cursor = Tag->SourceOffset;
+    Frame->SpanEnd = Tag->SourceOffset + Tag->SourceLength;
+    return EFI_SUCCESS;
+  }
+  Frame->Mode = IncrementalRendered;
+  if (Depth == 0) {
+    return EFI_SUCCESS;
+  }
+  if (Tag->XmlDataType == XmlEmptyTag) {
+    return PrintEmptyTag (Element, Depth, Writer->OutputDocument);
   }
+  return PrintTag (Element, Depth, Writer->OutputDocument);
+}
+
+/**
+  Incremental write handler for the end of a tag, called once its children are written.
+  This finishes the element and records where it now is in the output.
+
+  @param[in]     Element  The tag to finish.
+  @param[in]     Depth    The depth of the tag. 0 is the root, which has no tags of its own.
+  @param[in out] Context  The XML_INCREMENTAL_WRITER.
+
+  @retval EFI_SUCCESS           The element was finished.
+  @retval EFI_OUT_OF_RESOURCES  The output could not be grown.
+**/
+EFI_STATUS
+IncrementalEndTag (
+  DRIVER_XML_DATA_HEADER* Element,
+  UINTN                   Depth,
+  VOID*                   Context
+  )
+{
+  XML_INCREMENTAL_WRITER* Writer;
+  XML_INCREMENTAL_FRAME*  Frame;
+  DRIVER_XML_TAG*         Tag;
+  EFI_STATUS              Status;
+
+  Writer = Context;
+  Frame = &Writer->Frames[Depth];
+  Tag = (DRIVER_XML_TAG*)Element;
+  Status = EFI_SUCCESS;
+  if (Frame->Mode == IncrementalCopyBetween) {
+    Status = BytesToDocument (&Writer->Source[Frame->Cursor], Frame->SpanEnd - Frame->Cursor, Writer->OutputDocument);
+  } else if (Frame->Mode == IncrementalRendered && Depth != 0 && Tag->XmlDataType == XmlTag) {
+    Status = PrintCloseTag (Element, Depth, Writer->OutputDocument);
+  }
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+  Tag->SourceOffset = Frame->OutputStart;
+  Tag->SourceLength = Writer->OutputDocument->RequiredSize - Frame->OutputStart;
+  Tag->Flags &= ~(DRIVER_XML_TAG_MODIFIED | DRIVER_XML_TAG_CHILD_MODIFIED);
   return EFI_SUCCESS;
 }
 
+/**
+  Incremental write handler for char data and processing instructions. It is only written when
+  the tag holding it is being rendered; otherwise it is copied along with the text around it.
+  Attributes are not walked; IncrementalStartTag writes them with the tag.
+
+  @param[in]     Element  The data to write.
+  @param[in]     Depth    The depth of the data.
+  @param[in out] Context  The XML_INCREMENTAL_WRITER.
+
+  @retval EFI_SUCCESS           The data was written or is copied with its tag.
+  @retval EFI_OUT_OF_RESOURCES  The output could not be grown.
+**/
+EFI_STATUS
+IncrementalData (
+  DRIVER_XML_DATA_HEADER* Element,
+  UINTN                   Depth,
+  VOID*                   Context
+  )
+{
+  XML_INCREMENTAL_WRITER* Writer;
+
+  Writer = Context;
+  if (Depth == 0 || Writer->Frames[Depth - 1].Mode != IncrementalRendered) {
+    return EFI_SUCCESS;
+  }
+  return mXmlPrinter.PreOrder[Element->XmlDataType] (Element, Depth, Writer->OutputDocument);
+}
+
+CONST DRIVER_XML_VISITOR mXmlIncrementalWriter = {
+  {
+    NULL,                 // XmlNothing
+    IncrementalStartTag,  // XmlEmptyTag
+    IncrementalStartTag,  // XmlTag
+    NULL,                 // XmlCloseTag
+    NULL,                 // XmlAttribute
+    IncrementalData,      // XmlChar
+    IncrementalData,      // XmlPi
+    NULL,                 // XmlDecl
+    NULL                  // XmlComment
+  },
+  {
+    NULL,                 // XmlNothing
+    IncrementalEndTag,    // XmlEmptyTag
+    IncrementalEndTag,    // XmlTag
+    NULL,                 // XmlCloseTag
+    NULL,                 // XmlAttribute
+    NULL,                 // XmlChar
+    NULL,                 // XmlPi
+    NULL,                 // XmlDecl
+    NULL                  // XmlComment
+  }
+};
+
+/**
+  Write a parsed tree back out as a document, re-rendering only what changed.
+  Elements that were not modified are copied from Source using their source spans, 
+  so text the tree does not keep (comments, the DOCTYPE, formatting) survives in them.
+  When this returns the spans refer to the output and the modified flags are cleared,
+  so the output can be passed as Source the next time.
+
+  @param[in]     XmlTree         The root of the tree.
+  @param[in]     Source          The document the spans refer to, or NULL to render everything.
+  @param[in]     SourceSize      The size of Source.
+  @param[in out] OutputDocument  The output buffer, set up the same way as for PrintData.
+
+  @retval EFI_SUCCESS            The document was written.
+  @retval EFI_INVALID_PARAMETER  XmlTree or OutputDocument is NULL, or a span is outside Source.
+  @retval EFI_OUT_OF_RESOURCES   The output buffer could not be grown.
+**/
+EFI_STATUS
+PrintDataIncremental (
+  DRIVER_XML_DATA_HEADER* XmlTree,
+  CONST CHAR8*            Source,
+  UINTN                   SourceSize,
+  XML_DOCUMENT*           OutputDocument
+  )
+{
+  XML_INCREMENTAL_WRITER Writer;
+  EFI_STATUS             Status;
+
+  if (XmlTree == NULL || OutputDocument == NULL || XmlTree->XmlDataType != XmlTag) {
+    return EFI_INVALID_PARAMETER;
+  }
+  Writer.Source = Source;
+  Writer.SourceSize = SourceSize;
+  Writer.OutputDocument = OutputDocument;
+  Writer.Frames = NULL;
+  Writer.FrameSlots = 0;
+  Status = DriverXmlWalkElement (&mXmlIncrementalWriter, XmlTree, 0, &Writer);
+  DriverXmlFreePool (Writer.Frames);
+  return Status;
+}
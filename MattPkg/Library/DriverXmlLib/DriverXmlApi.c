@@ -26,6 +26,7 @@
 #include <Library/DebugLib.h>
 #include <Library/BaseLib.h>
 #include <Library/MemoryAllocationLib.h>
+#include <Library/UefiBootServicesTableLib.h>
 
 /**
   Finds the next DRIVER_XML_DATA_HEADER node in a linked list. 
@@ -110,9 +111,105 @@ GetXmlAttributeByName (
   return EFI_NOT_FOUND;
 }
 
+//
+// What a tag search is looking for and the tag it found.
+//
+typedef struct _XML_TAG_SEARCH {
+  CONST CHAR8*    TagName;
+  UINTN           NamespaceId;
+  UINTN           LocalNameId;
+  DRIVER_XML_TAG* Found;
+} XML_TAG_SEARCH;
+
+/**
+  Tag search handler that matches on the tag name.
+
+  @param[in]     Element  The tag being visited.
+  @param[in]     Depth    The depth of the tag in the walk. Not used.
+  @param[in out] Context  The XML_TAG_SEARCH.
+
+  @retval EFI_SUCCESS            The tag does not match, keep looking.
+  @retval DRIVER_XML_VISIT_STOP  The tag matches and has been recorded.
+**/
+EFI_STATUS
+MatchTagName (
+  DRIVER_XML_DATA_HEADER* Element,
+  UINTN                   Depth,
+  VOID*                   Context
+  )
+{
+  XML_TAG_SEARCH* Search;
+
+  Search = Context;
+  if (AsciiStrCmp (((DRIVER_XML_TAG*)Element)->TagName, Search->TagName) != 0) {
+    return EFI_SUCCESS;
+  }
+  Search->Found = (DRIVER_XML_TAG*)Element;
+  return DRIVER_XML_VISIT_STOP;
+}
+
+/**
+  Tag search handler that matches on the namespace and local name ids.
+
+  @param[in]     Element  The tag being visited.
+  @param[in]     Depth    The depth of the tag in the walk. Not used.
+  @param[in out] Context  The XML_TAG_SEARCH.
+
+  @retval EFI_SUCCESS            The tag does not match, keep looking.
+  @retval DRIVER_XML_VISIT_STOP  The tag matches and has been recorded.
+**/
+EFI_STATUS
+MatchTagQName (
+  DRIVER_XML_DATA_HEADER* Element,
+  UINTN                   Depth,
+  VOID*                   Context
+  )
+{
+  XML_TAG_SEARCH* Search;
+  DRIVER_XML_TAG* Tag;
+
+  Search = Context;
+  Tag = (DRIVER_XML_TAG*)Element;
+  if (Tag->LocalNameId != Search->LocalNameId || Tag->NamespaceId != Search->NamespaceId) {
+    return EFI_SUCCESS;
+  }
+  Search->Found = Tag;
+  return DRIVER_XML_VISIT_STOP;
+}
+
+CONST DRIVER_XML_VISITOR mXmlTagNameSearch = {
+  {
+    NULL,           // XmlNothing
+    MatchTagName,   // XmlEmptyTag
+    MatchTagName,   // XmlTag
+    NULL,           // XmlCloseTag
+    NULL,           // XmlAttribute
+    NULL,           // XmlChar
+    NULL,           // XmlPi
+    NULL,           // XmlDecl
+    NULL            // XmlComment
+  },
+  { NULL }
+};
+
+CONST DRIVER_XML_VISITOR mXmlTagQNameSearch = {
+  {
+    NULL,           // XmlNothing
+    MatchTagQName,  // XmlEmptyTag
+    MatchTagQName,  // XmlTag
+    NULL,           // XmlCloseTag
+    NULL,           // XmlAttribute
+    NULL,           // XmlChar
+    NULL,           // XmlPi
+    NULL,           // XmlDecl
+    NULL            // XmlComment
+  },
+  { NULL }
+};
+
 /**
   Looks for a tag matching the provided name in the provided list. 
-  This will work recursively traversing branches 
+  This searches the branches below the list too, depth first, and returns the first match.
   TODO: Find a better way than with string comparisons (apply a hash table?).
   
   @param[in]     TagName     The Attribute Name to look for
@@ -130,45 +227,360 @@ GetXmlTagByName (
   IN OUT DRIVER_XML_TAG** OutputTag
   )
 {
+  XML_TAG_SEARCH Search;
+  EFI_STATUS     Status;
+
+  if (TagName == NULL || ElementList == NULL || OutputTag == NULL) {
+    DEBUG ((DEBUG_ERROR, "%a : Inputs cannot be NULL\n", __FUNCTION__ ));
+    return EFI_INVALID_PARAMETER;
+  }
+  gBS->SetMem (&Search, sizeof (Search), 0);
+  Search.TagName = TagName;
+  Status = DriverXmlWalkBranch (&mXmlTagNameSearch, ElementList, 0, &Search);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+  if (Search.Found == NULL) {
+    return EFI_NOT_FOUND;
+  }
+  *OutputTag = Search.Found;
+  return EFI_SUCCESS;
+}
+
+
+/**
+  Find an attribute by its namespace and local name ids from a namespace aware parse.
+  The ids come from the name table the document was parsed with, so this is an integer
+  compare instead of a string compare.
+
+  @param[in]  NamespaceId    The namespace URI id, or DRIVER_XML_NO_NAMESPACE.
+  @param[in]  LocalNameId    The local name id.
+  @param[in]  AttributeList  The list of attributes to search.
+  @param[out] Node           The matching attribute.
+
+  @retval EFI_SUCCESS            A matching attribute was found.
+  @retval EFI_NOT_FOUND          No attribute matched.
+  @retval EFI_INVALID_PARAMETER  A pointer was NULL.
+**/
+EFI_STATUS
+GetXmlAttributeByQName (
+  IN  UINTN                  NamespaceId,
+  IN  UINTN                  LocalNameId,
+  IN  LIST_ANCHOR*           AttributeList,
+  OUT DRIVER_XML_ATTRIBUTE** Node
+  )
+{
+  DRIVER_XML_ATTRIBUTE*   LocalAttribute;
   DRIVER_XML_DATA_HEADER* LocalXmlData;
-  DRIVER_XML_TAG*         Tag;
+
+  if (AttributeList == NULL || Node == NULL) {
+    DEBUG ((DEBUG_ERROR, "%a : Inputs cannot be NULL\n", __FUNCTION__));
+    return EFI_INVALID_PARAMETER;
+  }
+
+  if (AttributeList->ItemCount == 0) {
+    return EFI_NOT_FOUND;
+  }
+
+  LocalXmlData = (DRIVER_XML_DATA_HEADER*)&AttributeList->ListStart;
+  while (GetNextXmlElement (AttributeList, LocalXmlData, &LocalXmlData) == EFI_SUCCESS) {
+    if (LocalXmlData->XmlDataType != XmlAttribute) {
+      continue;
+    }
+    LocalAttribute = (DRIVER_XML_ATTRIBUTE*)LocalXmlData;
+    if (LocalAttribute->LocalNameId == LocalNameId && LocalAttribute->NamespaceId == NamespaceId) {
+      *Node = LocalAttribute;
+      return EFI_SUCCESS;
+    }
+  }
+  return EFI_NOT_FOUND;
+}
+
+/**
+  Find the first tag, depth first, by its namespace and local name ids from a namespace aware parse.
+
+  @param[in]  NamespaceId  The namespace URI id, or DRIVER_XML_NO_NAMESPACE.
+  @param[in]  LocalNameId  The local name id.
+  @param[in]  ElementList  The branch to search.
+  @param[out] OutputTag    The matching tag.
+
+  @retval EFI_SUCCESS            A matching tag was found.
+  @retval EFI_NOT_FOUND          No tag matched.
+  @retval EFI_INVALID_PARAMETER  A pointer was NULL.
+**/
+EFI_STATUS
+GetXmlTagByQName (
+  IN  UINTN            NamespaceId,
+  IN  UINTN            LocalNameId,
+  IN  LIST_ANCHOR*     ElementList,
+  OUT DRIVER_XML_TAG** OutputTag
+  )
+{
+  XML_TAG_SEARCH Search;
+  EFI_STATUS     Status;
 
   if (ElementList == NULL || OutputTag == NULL) {
-    DEBUG ((DEBUG_ERROR, "%a : Inputs cannot be NULL\n", __FUNCTION__ ));
+    DEBUG ((DEBUG_ERROR, "%a : Inputs cannot be NULL\n", __FUNCTION__));
     return EFI_INVALID_PARAMETER;
   }
-  if (ElementList->ItemCount == 0) {
+
+  gBS->SetMem (&Search, sizeof (Search), 0);
+  Search.NamespaceId = NamespaceId;
+  Search.LocalNameId = LocalNameId;
+  Status = DriverXmlWalkBranch (&mXmlTagQNameSearch, ElementList, 0, &Search);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+  if (Search.Found == NULL) {
     return EFI_NOT_FOUND;
   }
-  
-  LocalXmlData = (DRIVER_XML_DATA_HEADER*)&ElementList->ListStart;
-  while (GetNextXmlElement (ElementList, LocalXmlData, &LocalXmlData) == EFI_SUCCESS) {
-    if (LocalXmlData == NULL) {
-      //Sanity check
+  *OutputTag = Search.Found;
+  return EFI_SUCCESS;
+}
+
+/**
+  Record that a tag changed so PrintDataIncremental renders it instead of copying it.
+  The functions that change the tree call this; call it after changing a tag directly.
+
+  @param[in] Tag  The tag that changed. For a change to char data or a processing
+                  instruction pass the tag that holds it.
+**/
+VOID
+DriverXmlMarkModified (
+  DRIVER_XML_TAG* Tag
+  )
+{
+  DRIVER_XML_TAG* Ancestor;
+
+  if (Tag == NULL) {
+    return;
+  }
+  Tag->Flags |= DRIVER_XML_TAG_MODIFIED;
+  DriverXmlInvalidateHash (Tag);
+  //
+  // An ancestor that is already marked means the rest of the path is too,
+  // so a burst of edits in one branch only walks up once.
+  //
+  for (Ancestor = Tag->Parent; Ancestor != NULL; Ancestor = Ancestor->Parent) {
+    if ((Ancestor->Flags & DRIVER_XML_TAG_CHILD_MODIFIED) != 0) {
       break;
     }
-    if(LocalXmlData->XmlDataType == XmlTag || LocalXmlData->XmlDataType == XmlEmptyTag) {
-      Tag = (DRIVER_XML_TAG*)LocalXmlData;
-    }
-    //
-    // Found a match
-    //
-    if (AsciiStrCmp(Tag->TagName, TagName) == 0) {
-      *OutputTag = Tag;
-      return EFI_SUCCESS;
+    Ancestor->Flags |= DRIVER_XML_TAG_CHILD_MODIFIED;
+  }
+}
+
+/**
+  Copy a string into a new pool buffer for the tree.
+
+  @param[in] String  The null terminated string to copy.
+  @param[in] Length  The number of characters in String.
+
+  @return The copy, or NULL if there was not enough memory.
+**/
+CHAR8*
+CopyTreeString (
+  CONST CHAR8* String,
+  UINTN        Length
+  )
+{
+  CHAR8* Copy;
+
+  Copy = DriverXmlAllocatePool (XmlAllocString, Length + 1);
+  if (Copy != NULL) {
+    gBS->CopyMem (Copy, (VOID*)String, Length);
+  }
+  return Copy;
+}
+
+/**
+  Set the value of an attribute, adding the attribute if the tag does not have it.
+  The value is literal and every '&' in it is escaped when the tree is written.
+
+  @param[in] Tag    The tag to change.
+  @param[in] Name   The attribute name.
+  @param[in] Value  The new value.
+
+  @retval EFI_SUCCESS            The attribute was set.
+  @retval EFI_INVALID_PARAMETER  A pointer was NULL or Tag is not a tag.
+  @retval EFI_OUT_OF_RESOURCES   There was not enough memory. The tag is unchanged.
+**/
+EFI_STATUS
+DriverXmlSetAttribute (
+  DRIVER_XML_TAG* Tag,
+  CONST CHAR8*    Name,
+  CONST CHAR8*    Value
+  )
+{
+  DRIVER_XML_ATTRIBUTE* Attribute;
+  CHAR8*                NewValue;
+
+  if (Tag == NULL || Name == NULL || Value == NULL) {
+    return EFI_INVALID_PARAMETER;
+  }
+  if (Tag->XmlDataType != XmlTag && Tag->XmlDataType != XmlEmptyTag) {
+    return EFI_INVALID_PARAMETER;
+  }
+  NewValue = CopyTreeString (Value, AsciiStrLen (Value));
+  if (NewValue == NULL) {
+    return EFI_OUT_OF_RESOURCES;
+  }
+  if (GetXmlAttributeByName ((CHAR8*)Name, &Tag->TagAttributes, &Attribute) == EFI_SUCCESS) {
+    DriverXmlFreePool (Attribute->AttributeData);
+    Attribute->AttributeData = NewValue;
+    Attribute->Flags &= ~DRIVER_XML_TEXT_RAW;
+  } else {
+    Attribute = DriverXmlAllocatePool (XmlAllocAttribute, sizeof (DRIVER_XML_ATTRIBUTE));
+    if (Attribute == NULL) {
+      DriverXmlFreePool (NewValue);
+      return EFI_OUT_OF_RESOURCES;
     }
-    else if (LocalXmlData->XmlDataType == XmlTag && Tag->TagChildren.ItemCount > 0) {
-      //
-      // Look in children if available
-      //
-      GetXmlTagByName (
-        TagName,
-        &Tag->TagChildren,
-        OutputTag
-      );
+    Attribute->AttributeName = CopyTreeString (Name, AsciiStrLen (Name));
+    if (Attribute->AttributeName == NULL) {
+      DriverXmlFreePool (Attribute);
+      DriverXmlFreePool (NewValue);
+      return EFI_OUT_OF_RESOURCES;
     }
-    return EFI_NOT_FOUND;
+    Attribute->XmlDataType = XmlAttribute;
+    Attribute->AttributeData = NewValue;
+    InsertTailList (&Tag->TagAttributes.ListStart, &Attribute->DataLink);
+    Tag->TagAttributes.ItemCount++;
   }
-  return EFI_NOT_FOUND;
+  DriverXmlMarkModified (Tag);
+  return EFI_SUCCESS;
+}
+
+/**
+  Replace the text of a char data node.
+  The text is literal and every '&' in it is escaped when the tree is written.
+
+  @param[in] Tag       The tag the char data belongs to.
+  @param[in] CharData  The char data to change.
+  @param[in] Text      The new text.
+
+  @retval EFI_SUCCESS            The text was replaced.
+  @retval EFI_INVALID_PARAMETER  A pointer was NULL or CharData is not char data.
+  @retval EFI_OUT_OF_RESOURCES   There was not enough memory. The node is unchanged.
+**/
+EFI_STATUS
+DriverXmlSetCharData (
+  DRIVER_XML_TAG*       Tag,
+  DRIVER_XML_CHAR_DATA* CharData,
+  CONST CHAR8*          Text
+  )
+{
+  CHAR8* NewText;
+  UINTN  Length;
+
+  if (Tag == NULL || CharData == NULL || Text == NULL || CharData->XmlDataType != XmlChar) {
+    return EFI_INVALID_PARAMETER;
+  }
+  Length = AsciiStrLen (Text);
+  NewText = CopyTreeString (Text, Length);
+  if (NewText == NULL) {
+    return EFI_OUT_OF_RESOURCES;
+  }
+  DriverXmlFreePool (CharData->CharData);
+  CharData->CharData = NewText;
+  CharData->DataSize = Length;
+  CharData->Flags &= ~DRIVER_XML_TEXT_RAW;
+  DriverXmlMarkModified (Tag);
+  return EFI_SUCCESS;
+}
+
+/**
+  Create an empty tree to build by hand. The root is the same kind the parser returns,
+  so the tree can be printed, edited and freed with DriverXmlFreeTree like a parsed one.
+
+  @param[out] XmlTree  The root of the new tree.
+
+  @retval EFI_SUCCESS            The tree was created.
+  @retval EFI_INVALID_PARAMETER  XmlTree is NULL.
+  @retval EFI_OUT_OF_RESOURCES   There was not enough memory.
+**/
+EFI_STATUS
+DriverXmlCreateTree (
+  DRIVER_XML_DATA_HEADER** XmlTree
+  )
+{
+  EFI_STATUS      Status;
+  DRIVER_XML_TAG* Root;
+
+  if (XmlTree == NULL) {
+    return EFI_INVALID_PARAMETER;
+  }
+  Status = CreateRootTag (&Root);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+  *XmlTree = (DRIVER_XML_DATA_HEADER*)Root;
+  return EFI_SUCCESS;
+}
+
+/**
+  Add a new element after the existing children of a tag and mark the tag as modified.
+
+  @param[in]  Tag       The tag to add the element to.
+  @param[in]  Name      The name of the new element. It is copied.
+  @param[in]  DataType  XmlTag for an element that can hold children, or XmlEmptyTag.
+  @param[out] NewTag    The new element.
+
+  @retval EFI_SUCCESS            The element was added.
+  @retval EFI_INVALID_PARAMETER  A pointer was NULL, Tag cannot hold children or DataType is not a tag type.
+  @retval EFI_OUT_OF_RESOURCES   There was not enough memory. The tag is unchanged.
+**/
+EFI_STATUS
+DriverXmlAppendTag (
+  DRIVER_XML_TAG*  Tag,
+  CONST CHAR8*     Name,
+  XML_DATA_TYPE    DataType,
+  DRIVER_XML_TAG** NewTag
+  )
+{
+  CHAR8* NameCopy;
+
+  if (Tag == NULL || Name == NULL || NewTag == NULL || Tag->XmlDataType != XmlTag) {
+    return EFI_INVALID_PARAMETER;
+  }
+  if (DataType != XmlTag && DataType != XmlEmptyTag) {
+    return EFI_INVALID_PARAMETER;
+  }
+  NameCopy = CopyTreeString (Name, AsciiStrLen (Name));
+  if (NameCopy == NULL) {
+    return EFI_OUT_OF_RESOURCES;
+  }
+  *NewTag = DriverXmlCreateChildTag (Tag, NameCopy, DataType);
+  if (*NewTag == NULL) {
+    DriverXmlFreePool (NameCopy);
+    return EFI_OUT_OF_RESOURCES;
+  }
+  return EFI_SUCCESS;
 }
 
+/**
+  Add text after the existing children of a tag and mark the tag as modified.
+
+  @param[in]  Tag          The tag to add the text to.
+  @param[in]  Text         The text. It is copied, and escaped when the tree is written.
+  @param[out] NewCharData  The new char data.
+
+  @retval EFI_SUCCESS            The text was added.
+  @retval EFI_INVALID_PARAMETER  A pointer was NULL or Tag cannot hold children.
+  @retval EFI_OUT_OF_RESOURCES   There was not enough memory. The tag is unchanged.
+**/
+EFI_STATUS
+DriverXmlAppendCharData (
+  DRIVER_XML_TAG*        Tag,
+  CONST CHAR8*           Text,
+  DRIVER_XML_CHAR_DATA** NewCharData
+  )
+{
+  if (Tag == NULL || Text == NULL || NewCharData == NULL || Tag->XmlDataType != XmlTag) {
+    return EFI_INVALID_PARAMETER;
+  }
+  *NewCharData = (DRIVER_XML_CHAR_DATA*)DriverXmlAddCharData (&Tag->TagChildren, (CHAR8*)Text, AsciiStrLen (Text));
+  if (*NewCharData == NULL) {
+    return EFI_OUT_OF_RESOURCES;
+  }
+  DriverXmlMarkModified (Tag);
+  return EFI_SUCCESS;
+}
@@ -0,0 +1,973 @@
+/** @file
+  Binary token encoding of XML trees.
+  Two components that exchange XML can hand over tokens with the lengths worked out and
+  every name written once, instead of printing text on one side and tokenizing it on the other.
+  
+  Copyright (c) 2016, Matthew Lazarowitz. All rights reserved.<BR>
+  This program and the accompanying materials are licensed and made available under
+  the terms and conditions of the MIT License that accompanies this distribution.
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+**/
+#include <uefi.h>
+#include <Library/DebugLib.h>
+#include <Library/BaseLib.h>
+#include <Library/UefiBootServicesTableLib.h>
+#include <DriverXmlStringHandlers.h>
+
+//
+// The most bytes a varint for a UINT64 takes.
+//
+#define BINARY_VARINT_MAX_BYTES     10
+
+//
+// Starting number of slots in the decoder's name list. It doubles when full.
+//
+#define BINARY_NAME_INITIAL_SLOTS   64
+
+//
+// The state of DriverXmlEncodeBinary. Names holds every name written so far, and
+// because the table numbers names from 1 in the order they are added, its ids are
+// the indexes the decoder gives them. NameCount is how many have been written in full.
+//
+typedef struct _XML_BINARY_ENCODER {
+  XML_DOCUMENT*          Document;
+  DRIVER_XML_NAME_TABLE* Names;
+  UINTN                  NameCount;
+} XML_BINARY_ENCODER;
+
+/**
+  Write a number as a varint.
+
+  @param[in]     Value           The number.
+  @param[in out] OutputDocument  Where it goes.
+
+  @retval EFI_SUCCESS  The number was written.
+  @retval other        The error from BytesToDocument.
+**/
+EFI_STATUS
+WriteBinaryNumber (
+  UINTN         Value,
+  XML_DOCUMENT* OutputDocument
+  )
+{
+  UINT8 Encoded[BINARY_VARINT_MAX_BYTES];
+  UINTN Length;
+
+  Length = 0;
+  while (Value >= 0x80) {
+    Encoded[Length++] = (UINT8)(Value | 0x80);
+    Value >>= 7;
+  }
+  Encoded[Length++] = (UINT8)Value;
+  return BytesToDocument ((CHAR8*)Encoded, Length, OutputDocument);
+}
+
+/**
+  Write a string as its length and its bytes.
+
+  @param[in]     Text            The string.
+  @param[in]     Length          The number of bytes in Text.
+  @param[in out] OutputDocument  Where it goes.
+
+  @retval EFI_SUCCESS  The string was written.
+  @retval other        The error from BytesToDocument.
+**/
+EFI_STATUS
+WriteBinaryString (
+  CONST CHAR8*  Text,
+  UINTN         Length,
+  XML_DOCUMENT* OutputDocument
+  )
+{
+  EFI_STATUS Status;
+
+  Status = WriteBinaryNumber (Length, OutputDocument);
+  if (!EFI_ERROR (Status) && Length != 0) {
+    Status = BytesToDocument (Text, Length, OutputDocument);
+  }
+  return Status;
+}
+
+/**
+  Write a PI target or data, which may be absent, as its length plus 1 and its bytes.
+
+  @param[in]     Text            The string, or NULL.
+  @param[in out] OutputDocument  Where it goes.
+
+  @retval EFI_SUCCESS  The string was written.
+  @retval other        The error from BytesToDocument.
+**/
+EFI_STATUS
+WriteBinaryOptionalString (
+  CONST CHAR8*  Text,
+  XML_DOCUMENT* OutputDocument
+  )
+{
+  UINTN      Length;
+  EFI_STATUS Status;
+
+  if (Text == NULL) {
+    return WriteBinaryNumber (0, OutputDocument);
+  }
+  Length = AsciiStrLen (Text);
+  Status = WriteBinaryNumber (Length + 1, OutputDocument);
+  if (!EFI_ERROR (Status) && Length != 0) {
+    Status = BytesToDocument (Text, Length, OutputDocument);
+  }
+  return Status;
+}
+
+/**
+  Write a name. The first time a name is seen it is written in full, after that by its index.
+
+  @param[in out] Encoder  The encoder state.
+  @param[in]     Name     The name.
+
+  @retval EFI_SUCCESS           The name was written.
+  @retval EFI_OUT_OF_RESOURCES  The name could not be added to the table.
+  @retval other                 The error from BytesToDocument.
+**/
+EFI_STATUS
+WriteBinaryName (
+  XML_BINARY_ENCODER* Encoder,
+  CONST CHAR8*        Name
+  )
+{
+  UINTN      Length;
+  UINTN      Id;
+  EFI_STATUS Status;
+
+  Length = AsciiStrLen (Name);
+  Status = DriverXmlInternName (Encoder->Names, Name, Length, &Id);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+  if (Id <= Encoder->NameCount) {
+    return WriteBinaryNumber (Id, Encoder->Document);
+  }
+  Encoder->NameCount = Id;
+  Status = WriteBinaryNumber (0, Encoder->Document);
+  if (!EFI_ERROR (Status)) {
+    Status = WriteBinaryString (Name, Length, Encoder->Document);
+  }
+  return Status;
+}
+
+/**
+  Binary encoder handler for start and empty tags. Writes the tag with its attributes.
+
+  @param[in] Element  The tag.
+  @param[in] Depth    The depth of the tag in the walk. Not used.
+  @param[in] Context  The XML_BINARY_ENCODER.
+
+  @retval EFI_SUCCESS  The tag was written.
+  @retval other        An error from the output or the name table.
+**/
+EFI_STATUS
+EncodeBinaryTag (
+  DRIVER_XML_DATA_HEADER* Element,
+  UINTN                   Depth,
+  VOID*                   Context
+  )
+{
+  XML_BINARY_ENCODER*     Encoder;
+  DRIVER_XML_TAG*         Tag;
+  DRIVER_XML_DATA_HEADER* LocalXmlData;
+  DRIVER_XML_ATTRIBUTE*   Attribute;
+  CHAR8                   Token;
+  EFI_STATUS              Status;
+
+  Encoder = (XML_BINARY_ENCODER*)Context;
+  Tag = (DRIVER_XML_TAG*)Element;
+  Token = (Tag->XmlDataType == XmlTag) ? DRIVER_XML_BINARY_START : DRIVER_XML_BINARY_EMPTY;
+  Status = BytesToDocument (&Token, 1, Encoder->Document);
+  if (!EFI_ERROR (Status)) {
+    Status = WriteBinaryName (Encoder, Tag->TagName);
+  }
+  if (!EFI_ERROR (Status)) {
+    Status = WriteBinaryNumber (Tag->TagAttributes.ItemCount, Encoder->Document);
+  }
+  if (EFI_ERROR (Status) || Tag->TagAttributes.ItemCount == 0) {
+    return Status;
+  }
+  LocalXmlData = (DRIVER_XML_DATA_HEADER*)&Tag->TagAttributes.ListStart;
+  while (!EFI_ERROR (Status)
+         && GetNextXmlElement (&Tag->TagAttributes, LocalXmlData, &LocalXmlData) == EFI_SUCCESS)
+  {
+    Attribute = (DRIVER_XML_ATTRIBUTE*)LocalXmlData;
+    Status = WriteBinaryName (Encoder, Attribute->AttributeName);
+    if (!EFI_ERROR (Status)) {
+      Status = WriteBinaryString (
+                 Attribute->AttributeData,
+                 (Attribute->AttributeData != NULL) ? AsciiStrLen (Attribute->AttributeData) : 0,
+                 Encoder->Document
+                 );
+    }
+  }
+  return Status;
+}
+
+/**
+  Binary encoder handler for the end of a start tag's content.
+
+  @param[in] Element  The tag. Not used.
+  @param[in] Depth    The depth of the tag in the walk. Not used.
+  @param[in] Context  The XML_BINARY_ENCODER.
+
+  @retval EFI_SUCCESS  The end token was written.
+  @retval other        The error from the output.
+**/
+EFI_STATUS
+EncodeBinaryEndTag (
+  DRIVER_XML_DATA_HEADER* Element,
+  UINTN                   Depth,
+  VOID*                   Context
+  )
+{
+  CHAR8 Token;
+
+  Token = DRIVER_XML_BINARY_END;
+  return BytesToDocument (&Token, 1, ((XML_BINARY_ENCODER*)Context)->Document);
+}
+
+/**
+  Binary encoder handler for char data.
+
+  @param[in] Element  The char data.
+  @param[in] Depth    The depth of the char data in the walk. Not used.
+  @param[in] Context  The XML_BINARY_ENCODER.
+
+  @retval EFI_SUCCESS  The text token was written.
+  @retval other        The error from the output.
+**/
+EFI_STATUS
+EncodeBinaryCharData (
+  DRIVER_XML_DATA_HEADER* Element,
+  UINTN                   Depth,
+  VOID*                   Context
+  )
+{
+  DRIVER_XML_CHAR_DATA* CharData;
+  XML_DOCUMENT*         OutputDocument;
+  CHAR8                 Token;
+  EFI_STATUS            Status;
+
+  CharData = (DRIVER_XML_CHAR_DATA*)Element;
+  OutputDocument = ((XML_BINARY_ENCODER*)Context)->Document;
+  Token = DRIVER_XML_BINARY_TEXT;
+  Status = BytesToDocument (&Token, 1, OutputDocument);
+  if (!EFI_ERROR (Status)) {
+    Status = WriteBinaryString (CharData->CharData, CharData->DataSize, OutputDocument);
+  }
+  return Status;
+}
+
+/**
+  Binary encoder handler for processing instructions.
+
+  @param[in] Element  The processing instruction.
+  @param[in] Depth    The depth of the processing instruction in the walk. Not used.
+  @param[in] Context  The XML_BINARY_ENCODER.
+
+  @retval EFI_SUCCESS  The PI token was written.
+  @retval other        The error from the output.
+**/
+EFI_STATUS
+EncodeBinaryPi (
+  DRIVER_XML_DATA_HEADER* Element,
+  UINTN                   Depth,
+  VOID*                   Context
+  )
+{
+  DRIVER_XML_PROCESSING_INSTRUCTION* Pi;
+  XML_DOCUMENT*                      OutputDocument;
+  CHAR8                              Token;
+  EFI_STATUS                         Status;
+
+  Pi = (DRIVER_XML_PROCESSING_INSTRUCTION*)Element;
+  OutputDocument = ((XML_BINARY_ENCODER*)Context)->Document;
+  Token = DRIVER_XML_BINARY_PI;
+  Status = BytesToDocument (&Token, 1, OutputDocument);
+  if (!EFI_ERROR (Status)) {
+    Status = WriteBinaryOptionalString (Pi->PiTargetName, OutputDocument);
+  }
+  if (!EFI_ERROR (Status)) {
+    Status = WriteBinaryOptionalString (Pi->PiTargetData, OutputDocument);
+  }
+  return Status;
+}
+
+CONST DRIVER_XML_VISITOR mXmlBinaryEncoder = {
+  {
+    NULL,                    // XmlNothing
+    EncodeBinaryTag,         // XmlEmptyTag
+    EncodeBinaryTag,         // XmlTag
+    NULL,                    // XmlCloseTag
+    NULL,                    // XmlAttribute
+    EncodeBinaryCharData,    // XmlChar
+    EncodeBinaryPi,          // XmlPi
+    NULL,                    // XmlDecl
+    NULL                     // XmlComment
+  },
+  {
+    NULL,                    // XmlNothing
+    NULL,                    // XmlEmptyTag
+    EncodeBinaryEndTag,      // XmlTag
+    NULL,                    // XmlCloseTag
+    NULL,                    // XmlAttribute
+    NULL,                    // XmlChar
+    NULL,                    // XmlPi
+    NULL,                    // XmlDecl
+    NULL                     // XmlComment
+  }
+};
+
+/**
+  Write the nodes below a tag in the binary token format, for handing a tree to another
+  component without printing and parsing it again. The tag itself is not written;
+  DriverXmlDecodeBinary puts the nodes under a new root.
+
+  @param[in]     XmlTree         The tag whose children are written, normally the root of a tree.
+  @param[in out] OutputDocument  Where the tokens go, set up the same way as for PrintData.
+
+  @retval EFI_SUCCESS            The tokens were written.
+  @retval EFI_INVALID_PARAMETER  A pointer is NULL or XmlTree is not a tag.
+  @retval EFI_OUT_OF_RESOURCES   There was not enough memory for the names or the output.
+  @retval other                  An error from the output sink.
+**/
+EFI_STATUS
+DriverXmlEncodeBinary (
+  DRIVER_XML_DATA_HEADER* XmlTree,
+  XML_DOCUMENT*           OutputDocument
+  )
+{
+  XML_BINARY_ENCODER Encoder;
+  UINT32             Signature;
+  CHAR8              Version;
+  EFI_STATUS         Status;
+
+  if (XmlTree == NULL || OutputDocument == NULL
+      || (XmlTree->XmlDataType != XmlTag && XmlTree->XmlDataType != XmlEmptyTag))
+  {
+    return EFI_INVALID_PARAMETER;
+  }
+  Signature = DRIVER_XML_BINARY_SIGNATURE;
+  Version = DRIVER_XML_BINARY_VERSION;
+  Status = BytesToDocument ((CHAR8*)&Signature, sizeof (Signature), OutputDocument);
+  if (!EFI_ERROR (Status)) {
+    Status = BytesToDocument (&Version, 1, OutputDocument);
+  }
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+  Encoder.Document = OutputDocument;
+  Encoder.NameCount = 0;
+  Status = DriverXmlCreateNameTable (&Encoder.Names);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+  Status = DriverXmlWalkBranch (&mXmlBinaryEncoder, &((DRIVER_XML_TAG*)XmlTree)->TagChildren, 0, &Encoder);
+  DriverXmlFreeNameTable (Encoder.Names);
+  return Status;
+}
+
+/**
+  Check the signature and version at the start of a token buffer and set up a decoder after them.
+
+  @param[out] Decoder  The decoder state to set up.
+  @param[in]  Buffer   The tokens.
+  @param[in]  Size     The size of Buffer.
+
+  @retval EFI_SUCCESS      The decoder is ready.
+  @retval EFI_UNSUPPORTED  Buffer does not start with the signature and a known version.
+**/
+EFI_STATUS
+InitializeBinaryDecoder (
+  XML_BINARY_DECODER* Decoder,
+  CONST VOID*         Buffer,
+  UINTN               Size
+  )
+{
+  if (Size < sizeof (UINT32) + 1
+      || ReadUnaligned32 ((CONST UINT32*)Buffer) != DRIVER_XML_BINARY_SIGNATURE
+      || ((CONST UINT8*)Buffer)[sizeof (UINT32)] != DRIVER_XML_BINARY_VERSION)
+  {
+    return EFI_UNSUPPORTED;
+  }
+  gBS->SetMem (Decoder, sizeof (XML_BINARY_DECODER), 0);
+  Decoder->Next = (CONST UINT8*)Buffer + sizeof (UINT32) + 1;
+  Decoder->End = (CONST UINT8*)Buffer + Size;
+  return EFI_SUCCESS;
+}
+
+/**
+  Free the names a decoder collected.
+
+  @param[in] Decoder  The decoder state.
+**/
+VOID
+FreeBinaryDecoder (
+  XML_BINARY_DECODER* Decoder
+  )
+{
+  if (Decoder->Names != NULL) {
+    DriverXmlFreePool (Decoder->Names);
+    Decoder->Names = NULL;
+  }
+}
+
+/**
+  Read a varint.
+
+  @param[in out] Decoder  The decoder state.
+  @param[out]    Value    The number.
+
+  @retval EFI_SUCCESS       Value is valid.
+  @retval EFI_END_OF_FILE   The buffer ends inside the number.
+  @retval EFI_DEVICE_ERROR  The number does not fit in a UINTN.
+**/
+EFI_STATUS
+ReadBinaryNumber (
+  XML_BINARY_DECODER* Decoder,
+  UINTN*              Value
+  )
+{
+  UINTN Shift;
+  UINT8 Byte;
+
+  *Value = 0;
+  for (Shift = 0; ; Shift += 7) {
+    if (Decoder->Next == Decoder->End) {
+      return EFI_END_OF_FILE;
+    }
+    Byte = *Decoder->Next++;
+    //
+    // The last group that fits may only use the bits left in a UINTN.
+    //
+    if (Shift >= sizeof (UINTN) * 8
+        || (Shift > sizeof (UINTN) * 8 - 7 && ((UINTN)(Byte & 0x7F) >> (sizeof (UINTN) * 8 - Shift)) != 0))
+    {
+      DEBUG ((DEBUG_ERROR, "Binary number too large\n"));
+      return EFI_DEVICE_ERROR;
+    }
+    *Value |= (UINTN)(Byte & 0x7F) << Shift;
+    if ((Byte & 0x80) == 0) {
+      return EFI_SUCCESS;
+    }
+  }
+}
+
+/**
+  Read a string. The string is left in the buffer.
+
+  @param[in out] Decoder  The decoder state.
+  @param[out]    Text     The first byte of the string.
+  @param[out]    Length   The number of bytes in the string.
+
+  @retval EFI_SUCCESS       Text and Length are valid.
+  @retval EFI_END_OF_FILE   The buffer ends inside the string.
+  @retval EFI_DEVICE_ERROR  The length is malformed.
+**/
+EFI_STATUS
+ReadBinaryString (
+  XML_BINARY_DECODER* Decoder,
+  CONST CHAR8**       Text,
+  UINTN*              Length
+  )
+{
+  EFI_STATUS Status;
+
+  Status = ReadBinaryNumber (Decoder, Length);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+  if (*Length > (UINTN)(Decoder->End - Decoder->Next)) {
+    return EFI_END_OF_FILE;
+  }
+  *Text = (CONST CHAR8*)Decoder->Next;
+  Decoder->Next += *Length;
+  return EFI_SUCCESS;
+}
+
+/**
+  Read a PI target or data, which may be absent.
+
+  @param[in out] Decoder  The decoder state.
+  @param[out]    Text     The first byte of the string, or NULL if it is absent.
+  @param[out]    Length   The number of bytes in the string.
+
+  @retval EFI_SUCCESS       Text and Length are valid.
+  @retval EFI_END_OF_FILE   The buffer ends inside the string.
+  @retval EFI_DEVICE_ERROR  The length is malformed.
+**/
+EFI_STATUS
+ReadBinaryOptionalString (
+  XML_BINARY_DECODER* Decoder,
+  CONST CHAR8**       Text,
+  UINTN*              Length
+  )
+{
+  EFI_STATUS Status;
+
+  *Text = NULL;
+  Status = ReadBinaryNumber (Decoder, Length);
+  if (EFI_ERROR (Status) || *Length == 0) {
+    return Status;
+  }
+  (*Length)--;
+  if (*Length > (UINTN)(Decoder->End - Decoder->Next)) {
+    return EFI_END_OF_FILE;
+  }
+  *Text = (CONST CHAR8*)Decoder->Next;
+  Decoder->Next += *Length;
+  return EFI_SUCCESS;
+}
+
+/**
+  Read a name, either in full or as the index of one read before. A name read in full is
+  checked once here, so the tree only ever gets names that print as well-formed XML.
+
+  @param[in out] Decoder  The decoder state.
+  @param[out]    Name     The first character of the name, in the buffer.
+  @param[out]    Length   The number of characters in the name.
+
+  @retval EFI_SUCCESS           Name and Length are valid.
+  @retval EFI_END_OF_FILE       The buffer ends inside the name.
+  @retval EFI_DEVICE_ERROR      The index is unknown or the name is not a valid XML name.
+  @retval EFI_OUT_OF_RESOURCES  The name list could not be grown.
+**/
+EFI_STATUS
+ReadBinaryName (
+  XML_BINARY_DECODER* Decoder,
+  CONST CHAR8**       Name,
+  UINTN*              Length
+  )
+{
+  XML_BINARY_NAME* NewNames;
+  UINTN            Index;
+  EFI_STATUS       Status;
+
+  Status = ReadBinaryNumber (Decoder, &Index);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+  if (Index != 0) {
+    if (Index > Decoder->NameCount) {
+      DEBUG ((DEBUG_ERROR, "Binary name %d is not defined\n", Index));
+      return EFI_DEVICE_ERROR;
+    }
+    *Name = Decoder->Names[Index - 1].Name;
+    *Length = Decoder->Names[Index - 1].Length;
+    return EFI_SUCCESS;
+  }
+  Status = ReadBinaryString (Decoder, Name, Length);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+  if (*Length == 0 || !IsAsciiNameStartChar ((*Name)[0])) {
+    return EFI_DEVICE_ERROR;
+  }
+  for (Index = 1; Index < *Length; Index++) {
+    if (!IsAsciiNameChar ((*Name)[Index])) {
+      return EFI_DEVICE_ERROR;
+    }
+  }
+  if (Decoder->NameCount == Decoder->NameSlots) {
+    NewNames = DriverXmlReallocatePool (
+                 XmlAllocScratch,
+                 Decoder->Names,
+                 (Decoder->NameSlots == 0 ? BINARY_NAME_INITIAL_SLOTS : Decoder->NameSlots * 2) * sizeof (XML_BINARY_NAME)
+                 );
+    if (NewNames == NULL) {
+      return EFI_OUT_OF_RESOURCES;
+    }
+    Decoder->Names = NewNames;
+    Decoder->NameSlots = (Decoder->NameSlots == 0) ? BINARY_NAME_INITIAL_SLOTS : Decoder->NameSlots * 2;
+  }
+  Decoder->Names[Decoder->NameCount].Name = *Name;
+  Decoder->Names[Decoder->NameCount].Length = *Length;
+  Decoder->NameCount++;
+  return EFI_SUCCESS;
+}
+
+/**
+  Copy a string out of the buffer into a null terminated string the tree can own.
+
+  @param[in] Text    The string.
+  @param[in] Length  The number of bytes in Text.
+
+  @return The copy, or NULL if there was not enough memory.
+**/
+CHAR8*
+CopyBinaryString (
+  CONST CHAR8* Text,
+  UINTN        Length
+  )
+{
+  CHAR8* Copy;
+
+  Copy = DriverXmlAllocatePool (XmlAllocString, Length + 1);
+  if (Copy != NULL && Length != 0) {
+    gBS->CopyMem (Copy, (VOID*)Text, Length);
+  }
+  return Copy;
+}
+
+/**
+  Add a tag from a START or EMPTY token, with its attributes, to the end of a tag's children.
+
+  @param[in out] Context  The parser state holding the options, limits and namespace bindings.
+  @param[in out] Decoder  The decoder state, just past the token type.
+  @param[in out] Parent   The tag to add the new tag to.
+  @param[in]     Type     XmlTag or XmlEmptyTag.
+  @param[out]    NewTag   The new tag.
+
+  @retval EFI_SUCCESS             The tag was added. Its namespace bindings are in scope.
+  @retval EFI_SECURITY_VIOLATION  A parse limit was exceeded.
+  @retval other                   The token is malformed or there was not enough memory.
+                                  Anything already added stays in the tree.
+**/
+EFI_STATUS
+DecodeBinaryTag (
+  XML_PARSER_CONTEXT* Context,
+  XML_BINARY_DECODER* Decoder,
+  DRIVER_XML_TAG*     Parent,
+  XML_DATA_TYPE       Type,
+  DRIVER_XML_TAG**    NewTag
+  )
+{
+  DRIVER_XML_PARSE_LIMITS* Limits;
+  DRIVER_XML_TAG*          Tag;
+  CONST CHAR8*             Name;
+  UINTN                    NameLength;
+  CONST CHAR8*             Value;
+  UINTN                    ValueLength;
+  CHAR8*                   NameCopy;
+  CHAR8*                   ValueCopy;
+  DRIVER_XML_ATTRIBUTE*    Attribute;
+  UINTN                    AttributeCount;
+  UINTN                    Index;
+  EFI_STATUS               Status;
+
+  Limits = &Context->Options.Limits;
+  Status = ReadBinaryName (Decoder, &Name, &NameLength);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+  //
+  // Depth is checked before the tag is added, the same as for text.
+  //
+  if (Limits->MaxDepth != 0 && Context->Depth >= Limits->MaxDepth) {
+    DEBUG ((DEBUG_ERROR, "Tags nested deeper than the %d level limit\n", Limits->MaxDepth));
+    return EFI_SECURITY_VIOLATION;
+  }
+  Status = ChargeParseBudget (Context, 1, sizeof (DRIVER_XML_TAG) + NameLength + 1);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+  NameCopy = CopyBinaryString (Name, NameLength);
+  if (NameCopy == NULL) {
+    return EFI_OUT_OF_RESOURCES;
+  }
+  Tag = DriverXmlCreateTag (Parent, NameCopy, Type);
+  if (Tag == NULL) {
+    DriverXmlFreePool (NameCopy);
+    return EFI_OUT_OF_RESOURCES;
+  }
+  Status = ReadBinaryNumber (Decoder, &AttributeCount);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+  for (Index = 0; Index < AttributeCount; Index++) {
+    Status = ReadBinaryName (Decoder, &Name, &NameLength);
+    if (!EFI_ERROR (Status)) {
+      Status = ReadBinaryString (Decoder, &Value, &ValueLength);
+    }
+    if (EFI_ERROR (Status)) {
+      return Status;
+    }
+    if (Limits->MaxAttributes != 0 && Index >= Limits->MaxAttributes) {
+      DEBUG ((DEBUG_ERROR, "Tag %a has more than %d attributes\n", Tag->TagName, Limits->MaxAttributes));
+      return EFI_SECURITY_VIOLATION;
+    }
+    if (Limits->MaxTextLength != 0 && ValueLength > Limits->MaxTextLength) {
+      DEBUG ((DEBUG_ERROR, "Attribute longer than the %d character limit\n", Limits->MaxTextLength));
+      return EFI_SECURITY_VIOLATION;
+    }
+    Status = ChargeParseBudget (Context, 0, sizeof (DRIVER_XML_ATTRIBUTE) + NameLength + 1 + ValueLength + 1);
+    if (EFI_ERROR (Status)) {
+      return Status;
+    }
+    NameCopy = CopyBinaryString (Name, NameLength);
+    ValueCopy = CopyBinaryString (Value, ValueLength);
+    Attribute = NULL;
+    if (NameCopy != NULL && ValueCopy != NULL) {
+      Attribute = DriverXmlAddAttribute (Tag, NameCopy, ValueCopy);
+    }
+    if (Attribute == NULL) {
+      if (NameCopy != NULL) {
+        DriverXmlFreePool (NameCopy);
+      }
+      if (ValueCopy != NULL) {
+        DriverXmlFreePool (ValueCopy);
+      }
+      return EFI_OUT_OF_RESOURCES;
+    }
+    //
+    // The tokens carry text as the encoded tree held it, so mark it the way a parse with
+    // the same options would have.
+    //
+    if ((Context->Options.Flags & DRIVER_XML_PARSE_EXPAND_ENTITIES) == 0) {
+      Attribute->Flags |= DRIVER_XML_TEXT_RAW;
+    }
+  }
+  if ((Context->Options.Flags & DRIVER_XML_PARSE_NAMESPACES) != 0) {
+    Status = DriverXmlResolveNamespaces (Context, Tag);
+    if (EFI_ERROR (Status)) {
+      return Status;
+    }
+  }
+  *NewTag = Tag;
+  return EFI_SUCCESS;
+}
+
+/**
+  Add char data from a TEXT token to the end of a tag's children.
+
+  @param[in out] Context  The parser state holding the limits.
+  @param[in out] Decoder  The decoder state, just past the token type.
+  @param[in out] Parent   The tag to add the char data to.
+
+  @retval EFI_SUCCESS             The char data was added.
+  @retval EFI_SECURITY_VIOLATION  A parse limit was exceeded.
+  @retval other                   The token is malformed or there was not enough memory.
+**/
+EFI_STATUS
+DecodeBinaryText (
+  XML_PARSER_CONTEXT* Context,
+  XML_BINARY_DECODER* Decoder,
+  DRIVER_XML_TAG*     Parent
+  )
+{
+  CONST CHAR8*          Text;
+  UINTN                 Length;
+  DRIVER_XML_CHAR_DATA* CharData;
+  EFI_STATUS            Status;
+
+  Status = ReadBinaryString (Decoder, &Text, &Length);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+  if (Context->Options.Limits.MaxTextLength != 0 && Length > Context->Options.Limits.MaxTextLength) {
+    DEBUG ((DEBUG_ERROR, "Char data longer than the %d character limit\n", Context->Options.Limits.MaxTextLength));
+    return EFI_SECURITY_VIOLATION;
+  }
+  Status = ChargeParseBudget (Context, 1, sizeof (DRIVER_XML_CHAR_DATA) + Length + 1);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+  CharData = (DRIVER_XML_CHAR_DATA*)DriverXmlAddCharData (&Parent->TagChildren, (CHAR8*)Text, Length);
+  if (CharData == NULL) {
+    return EFI_OUT_OF_RESOURCES;
+  }
+  if ((Context->Options.Flags & DRIVER_XML_PARSE_EXPAND_ENTITIES) == 0) {
+    CharData->Flags |= DRIVER_XML_TEXT_RAW;
+  }
+  return EFI_SUCCESS;
+}
+
+/**
+  Add a processing instruction from a PI token to the end of a tag's children.
+
+  @param[in out] Context  The parser state holding the limits.
+  @param[in out] Decoder  The decoder state, just past the token type.
+  @param[in out] Parent   The tag to add the processing instruction to.
+
+  @retval EFI_SUCCESS             The processing instruction was added.
+  @retval EFI_SECURITY_VIOLATION  A parse limit was exceeded.
+  @retval other                   The token is malformed or there was not enough memory.
+**/
+EFI_STATUS
+DecodeBinaryPi (
+  XML_PARSER_CONTEXT* Context,
+  XML_BINARY_DECODER* Decoder,
+  DRIVER_XML_TAG*     Parent
+  )
+{
+  DRIVER_XML_PROCESSING_INSTRUCTION* Pi;
+  CONST CHAR8*                       Target;
+  UINTN                              TargetLength;
+  CONST CHAR8*                       Data;
+  UINTN                              DataLength;
+  EFI_STATUS                         Status;
+
+  Status = ReadBinaryOptionalString (Decoder, &Target, &TargetLength);
+  if (!EFI_ERROR (Status)) {
+    Status = ReadBinaryOptionalString (Decoder, &Data, &DataLength);
+  }
+  if (!EFI_ERROR (Status)) {
+    Status = ChargeParseBudget (
+               Context,
+               1,
+               sizeof (DRIVER_XML_PROCESSING_INSTRUCTION) + TargetLength + 1 + DataLength + 1
+               );
+  }
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+  Pi = DriverXmlAllocatePool (XmlAllocPi, sizeof (DRIVER_XML_PROCESSING_INSTRUCTION));
+  if (Pi == NULL) {
+    return EFI_OUT_OF_RESOURCES;
+  }
+  Pi->XmlDataType = XmlPi;
+  InsertTailList (&Parent->TagChildren.ListStart, &Pi->DataLink);
+  Parent->TagChildren.ItemCount++;
+  if (Target != NULL) {
+    Pi->PiTargetName = CopyBinaryString (Target, TargetLength);
+    if (Pi->PiTargetName == NULL) {
+      return EFI_OUT_OF_RESOURCES;
+    }
+  }
+  if (Data != NULL) {
+    Pi->PiTargetData = CopyBinaryString (Data, DataLength);
+    if (Pi->PiTargetData == NULL) {
+      return EFI_OUT_OF_RESOURCES;
+    }
+  }
+  return EFI_SUCCESS;
+}
+
+/**
+  Build a tree from the binary token format. The tree is the same as parsing the text the tokens
+  were encoded from, except that it has no source spans. The parse limits and DRIVER_XML_PARSE_NAMESPACES
+  apply as they do to text. The other flags change text as it is tokenized, so they have no effect here.
+
+  The tokens are read in one pass with the open elements tracked by their parent links, so the
+  stack used is the same however deeply the elements are nested.
+
+  @param[in]  Buffer   The tokens.
+  @param[in]  Size     The size of Buffer.
+  @param[in]  Options  Optional parse options. NULL selects the defaults.
+  @param[out] XmlTree  The root of the new tree. Free it with DriverXmlFreeTree.
+
+  @retval EFI_SUCCESS             The tree was built.
+  @retval EFI_INVALID_PARAMETER   A pointer was NULL, or namespaces were asked for without a name table.
+  @retval EFI_UNSUPPORTED         Buffer does not start with the signature and a known version.
+  @retval EFI_END_OF_FILE         The tokens end inside a token or an element.
+  @retval EFI_DEVICE_ERROR        A token is malformed.
+  @retval EFI_SECURITY_VIOLATION  One of the Options->Limits budgets was exceeded.
+  @retval EFI_OUT_OF_RESOURCES    There was not enough memory for the tree.
+**/
+EFI_STATUS
+DriverXmlDecodeBinary (
+  CONST VOID*               Buffer,
+  UINTN                     Size,
+  DRIVER_XML_PARSE_OPTIONS* Options,
+  DRIVER_XML_DATA_HEADER**  XmlTree
+  )
+{
+  XML_PARSER_CONTEXT Context;
+  XML_BINARY_DECODER Decoder;
+  DRIVER_XML_TAG*    Root;
+  DRIVER_XML_TAG*    Parent;
+  DRIVER_XML_TAG*    Tag;
+  UINT8              Token;
+  EFI_STATUS         Status;
+
+  if (Buffer == NULL || XmlTree == NULL) {
+    return EFI_INVALID_PARAMETER;
+  }
+  if (Options != NULL
+      && (Options->Flags & DRIVER_XML_PARSE_NAMESPACES) != 0
+      && Options->NameTable == NULL)
+  {
+    return EFI_INVALID_PARAMETER;
+  }
+  Status = InitializeBinaryDecoder (&Decoder, Buffer, Size);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+  Status = CreateRootTag (&Root);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+  InitializeParserContext (&Context, (CHAR8*)Buffer, (CHAR8*)Buffer, Size, Options);
+  Parent = Root;
+  while (!EFI_ERROR (Status) && Decoder.Next < Decoder.End) {
+    Token = *Decoder.Next++;
+    switch (Token) {
+    case DRIVER_XML_BINARY_START:
+    case DRIVER_XML_BINARY_EMPTY:
+      Status = DecodeBinaryTag (
+                 &Context,
+                 &Decoder,
+                 Parent,
+                 (Token == DRIVER_XML_BINARY_START) ? XmlTag : XmlEmptyTag,
+                 &Tag
+                 );
+      if (EFI_ERROR (Status)) {
+        break;
+      }
+      if (Token == DRIVER_XML_BINARY_START) {
+        Context.Depth++;
+        Parent = Tag;
+      } else {
+        //
+        // Depth is left alone, as in ParseBranch. The empty tag's declarations were pushed at
+        // the current depth, and any earlier sibling's were popped when it ended, so the pop
+        // removes exactly this tag's. Raising Depth first would leave them in scope.
+        //
+        DriverXmlPopNamespaceBindings (&Context);
+      }
+      break;
+    case DRIVER_XML_BINARY_END:
+      if (Parent == Root) {
+        DEBUG ((DEBUG_ERROR, "Binary end token with no element open\n"));
+        Status = EFI_DEVICE_ERROR;
+        break;
+      }
+      Context.Depth--;
+      DriverXmlPopNamespaceBindings (&Context);
+      Parent = Parent->Parent;
+      break;
+    case DRIVER_XML_BINARY_TEXT:
+      Status = DecodeBinaryText (&Context, &Decoder, Parent);
+      break;
+    case DRIVER_XML_BINARY_PI:
+      Status = DecodeBinaryPi (&Context, &Decoder, Parent);
+      break;
+    default:
+      DEBUG ((DEBUG_ERROR, "Unknown binary token %d\n", Token));
+      Status = EFI_DEVICE_ERROR;
+      break;
+    }
+  }
+  if (!EFI_ERROR (Status) && Parent != Root) {
+    DEBUG ((DEBUG_ERROR, "Binary tokens end inside %a\n", Parent->TagName));
+    Status = EFI_END_OF_FILE;
+  }
+  DriverXmlFreeNamespaceBindings (&Context);
+  FreeBinaryDecoder (&Decoder);
+  if (EFI_ERROR (Status)) {
+    DriverXmlFreeTree ((DRIVER_XML_DATA_HEADER*)Root);
+    return Status;
+  }
+  *XmlTree = (DRIVER_XML_DATA_HEADER*)Root;
+  return EFI_SUCCESS;
+}
@@ -0,0 +1,700 @@
+/** @file
+  Canonical XML output for the XML library.
+  Writes a tree in the form given by Canonical XML 1.0 (without comments) so two documents
+  that mean the same thing produce the same bytes and can be hashed or signed.
+  
+  Copyright (c) 2016, Matthew Lazarowitz. All rights reserved.<BR>
+  This program and the accompanying materials are licensed and made available under
+  the terms and conditions of the MIT License that accompanies this distribution.
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+**/
+#include <uefi.h>
+#include <Library/DebugLib.h>
+#include <Library/BaseLib.h>
+#include <DriverXmlStringHandlers.h>
+
+//
+// The state shared by every element of one canonical write.
+//
+typedef struct _XML_C14N_WRITER {
+  XML_DOCUMENT*          OutputDocument;
+  DRIVER_XML_NAME_TABLE* NameTable;
+  UINT32                 Flags;
+  //
+  // The element the write started from. Namespace declarations above it are not in the output.
+  //
+  DRIVER_XML_TAG*        Top;
+} XML_C14N_WRITER;
+
+/**
+  Compare two strings as unsigned bytes, which is the order C14N uses for UTF-8 names.
+
+  @param[in] First   The first string.
+  @param[in] Second  The second string.
+
+  @return Less than 0, 0 or greater than 0 as First sorts before, the same as or after Second.
+**/
+INTN
+CompareCanonicalNames (
+  CONST CHAR8* First,
+  CONST CHAR8* Second
+  )
+{
+  while (*First != '\0' && *First == *Second) {
+    First++;
+    Second++;
+  }
+  return (INTN)(UINT8)*First - (INTN)(UINT8)*Second;
+}
+
+/**
+  Get the prefix an xmlns attribute declares.
+
+  @param[in] Attribute  The attribute to check.
+
+  @return The declared prefix, "" for the default namespace, or NULL if this is not a namespace declaration.
+**/
+CONST CHAR8*
+GetDeclaredPrefix (
+  DRIVER_XML_ATTRIBUTE* Attribute
+  )
+{
+  CONST CHAR8* Name;
+
+  Name = Attribute->AttributeName;
+  if (AsciiStrnCmp (Name, "xmlns", 5) != 0) {
+    return NULL;
+  }
+  if (Name[5] == '\0') {
+    return "";
+  }
+  if (Name[5] == ':') {
+    return &Name[6];
+  }
+  return NULL;
+}
+
+/**
+  Order two attributes the way C14N does. Namespace declarations come first, sorted by prefix.
+  The rest are sorted by namespace URI and then local name. Without a name table every
+  attribute is treated as having no namespace and its qualified name is the sort key.
+
+  @param[in] Writer  The writer state holding the name table.
+  @param[in] First   The first attribute.
+  @param[in] Second  The second attribute.
+
+  @return Less than 0, 0 or greater than 0 as First sorts before, the same as or after Second.
+**/
+INTN
+CompareCanonicalAttributes (
+  XML_C14N_WRITER*      Writer,
+  DRIVER_XML_ATTRIBUTE* First,
+  DRIVER_XML_ATTRIBUTE* Second
+  )
+{
+  CONST CHAR8* FirstPrefix;
+  CONST CHAR8* SecondPrefix;
+  CONST CHAR8* FirstName;
+  CONST CHAR8* SecondName;
+  INTN         Result;
+
+  FirstPrefix = GetDeclaredPrefix (First);
+  SecondPrefix = GetDeclaredPrefix (Second);
+  if (FirstPrefix != NULL || SecondPrefix != NULL) {
+    if (FirstPrefix == NULL) {
+      return 1;
+    }
+    if (SecondPrefix == NULL) {
+      return -1;
+    }
+    return CompareCanonicalNames (FirstPrefix, SecondPrefix);
+  }
+  if (Writer->NameTable != NULL && First->LocalNameId != 0 && Second->LocalNameId != 0) {
+    FirstName = DriverXmlGetName (Writer->NameTable, First->NamespaceId);
+    SecondName = DriverXmlGetName (Writer->NameTable, Second->NamespaceId);
+    Result = CompareCanonicalNames (
+               (FirstName != NULL) ? FirstName : "",
+               (SecondName != NULL) ? SecondName : ""
+               );
+    if (Result != 0) {
+      return Result;
+    }
+    return CompareCanonicalNames (
+             DriverXmlGetName (Writer->NameTable, First->LocalNameId),
+             DriverXmlGetName (Writer->NameTable, Second->LocalNameId)
+             );
+  }
+  return CompareCanonicalNames (First->AttributeName, Second->AttributeName);
+}
+
+/**
+  Check whether a namespace declaration repeats one already in scope in the output.
+  C14N only writes a declaration where it changes the binding.
+
+  @param[in] Writer     The writer state.
+  @param[in] Tag        The tag the declaration is on.
+  @param[in] Attribute  The xmlns attribute.
+
+  @retval TRUE   The declaration is already in effect and is left out.
+  @retval FALSE  The declaration is written.
+**/
+BOOLEAN
+IsSuperfluousNamespace (
+  XML_C14N_WRITER*      Writer,
+  DRIVER_XML_TAG*       Tag,
+  DRIVER_XML_ATTRIBUTE* Attribute
+  )
+{
+  DRIVER_XML_TAG*       Ancestor;
+  DRIVER_XML_ATTRIBUTE* Declaration;
+
+  Ancestor = Tag;
+  while (Ancestor != Writer->Top && Ancestor->Parent != NULL) {
+    Ancestor = Ancestor->Parent;
+    if (Ancestor->Parent == NULL) {
+      //
+      // The document root is not an element.
+      //
+      break;
+    }
+    if (GetXmlAttributeByName (Attribute->AttributeName, &Ancestor->TagAttributes, &Declaration) == EFI_SUCCESS) {
+      return (BOOLEAN)(AsciiStrCmp (Declaration->AttributeData, Attribute->AttributeData) == 0);
+    }
+  }
+  //
+  // Nothing above declares it, so only xmlns="" (no default namespace) is already in effect.
+  //
+  return (BOOLEAN)(Attribute->AttributeName[5] == '\0' && Attribute->AttributeData[0] == '\0');
+}
+
+/**
+  Write one character with the escaping C14N uses for text or attribute values.
+
+  @param[in] Writer       The writer state.
+  @param[in] Character    The character.
+  @param[in] IsAttribute  TRUE for an attribute value.
+
+  @retval EFI_SUCCESS           The character was written.
+  @retval EFI_OUT_OF_RESOURCES  The output could not be grown.
+**/
+EFI_STATUS
+WriteCanonicalChar (
+  XML_C14N_WRITER* Writer,
+  CHAR8            Character,
+  BOOLEAN          IsAttribute
+  )
+{
+  switch (Character) {
+  case '&':
+    return BytesToDocument ("&amp;", 5, Writer->OutputDocument);
+  case '<':
+    return BytesToDocument ("&lt;", 4, Writer->OutputDocument);
+  case '>':
+    if (!IsAttribute) {
+      return BytesToDocument ("&gt;", 4, Writer->OutputDocument);
+    }
+    break;
+  case '\"':
+    if (IsAttribute) {
+      return BytesToDocument ("&quot;", 6, Writer->OutputDocument);
+    }
+    break;
+  case '\t':
+    if (IsAttribute) {
+      return BytesToDocument ("&#x9;", 5, Writer->OutputDocument);
+    }
+    break;
+  case '\n':
+    if (IsAttribute) {
+      return BytesToDocument ("&#xA;", 5, Writer->OutputDocument);
+    }
+    break;
+  case '\r':
+    return BytesToDocument ("&#xD;", 5, Writer->OutputDocument);
+  default:
+    break;
+  }
+  return BytesToDocument (&Character, 1, Writer->OutputDocument);
+}
+
+/**
+  Write text or an attribute value in canonical form.
+  Runs of ordinary characters are copied to the output directly and only the characters
+  that need escaping are handled one at a time.
+
+  Line ends in the tree are still as they were in the document, so CR LF and a lone CR become LF.
+  In attribute values literal tabs and line ends become spaces, the same as attribute value normalization.
+  With DRIVER_XML_C14N_RAW_TEXT character references and the predefined entities in raw text
+  are replaced here.
+
+  @param[in] Writer       The writer state.
+  @param[in] Text         The text.
+  @param[in] Length       The number of characters in Text.
+  @param[in] IsAttribute  TRUE for an attribute value.
+  @param[in] Raw          TRUE when Text still holds its references as written.
+
+  @retval EFI_SUCCESS           The text was written.
+  @retval EFI_UNSUPPORTED       Raw text refers to an entity other than the predefined ones.
+  @retval EFI_DEVICE_ERROR      Raw text holds a malformed reference.
+  @retval EFI_OUT_OF_RESOURCES  The output could not be grown.
+**/
+EFI_STATUS
+WriteCanonicalText (
+  XML_C14N_WRITER* Writer,
+  CONST CHAR8*     Text,
+  UINTN            Length,
+  BOOLEAN          IsAttribute,
+  BOOLEAN          Raw
+  )
+{
+  CONST CHAR8* Run;
+  CONST CHAR8* Ptr;
+  CONST CHAR8* End;
+  CHAR8        Character;
+  CHAR8        Encoded[4];
+  UINTN        RefLength;
+  UINT32       CodePoint;
+  EFI_STATUS   Status;
+
+  Run = Text;
+  Ptr = Text;
+  End = Text + Length;
+  Status = EFI_SUCCESS;
+  while (Ptr < End) {
+    Character = *Ptr;
+    if (Character != '&' && Character != '<' && Character != '>' && Character != '\"'
+        && Character != '\t' && Character != '\n' && Character != '\r') 
+    {
+      Ptr++;
+      continue;
+    }
+    Status = BytesToDocument (Run, Ptr - Run, Writer->OutputDocument);
+    if (EFI_ERROR (Status)) {
+      return Status;
+    }
+    if (Character == '\r') {
+      //
+      // CR LF is one line end.
+      //
+      if (Ptr + 1 < End && Ptr[1] == '\n') {
+        Ptr++;
+      }
+      Character = '\n';
+    }
+    if (IsAttribute && (Character == '\t' || Character == '\n')) {
+      Status = BytesToDocument (" ", 1, Writer->OutputDocument);
+      Ptr++;
+    } else if (Character == '&' && Raw && (Writer->Flags & DRIVER_XML_C14N_RAW_TEXT) != 0) {
+      Status = GetReferenceLength (Ptr + 1, End, &RefLength);
+      if (EFI_ERROR (Status)) {
+        DEBUG ((DEBUG_ERROR, "Malformed reference in the tree\n"));
+        return Status;
+      }
+      if (Ptr[1] == '#') {
+        Status = ParseCharReference (Ptr + 1, RefLength, &CodePoint);
+        if (EFI_ERROR (Status)) {
+          return Status;
+        }
+        if (CodePoint < 0x80) {
+          Status = WriteCanonicalChar (Writer, (CHAR8)CodePoint, IsAttribute);
+        } else {
+          Status = BytesToDocument (Encoded, DriverXmlEncodeUtf8 (CodePoint, Encoded), Writer->OutputDocument);
+        }
+      } else if (GetPredefinedEntity (Ptr + 1, RefLength, &Character)) {
+        Status = WriteCanonicalChar (Writer, Character, IsAttribute);
+      } else {
+        DEBUG ((DEBUG_ERROR, "Entity %.*a was not expanded by the parse\n", RefLength, Ptr + 1));
+        return EFI_UNSUPPORTED;
+      }
+      Ptr += RefLength + 2;
+    } else {
+      Status = WriteCanonicalChar (Writer, Character, IsAttribute);
+      Ptr++;
+    }
+    if (EFI_ERROR (Status)) {
+      return Status;
+    }
+    Run = Ptr;
+  }
+  return BytesToDocument (Run, End - Run, Writer->OutputDocument);
+}
+
+/**
+  Write a string with no escaping, such as an element name.
+
+  @param[in] Writer  The writer state.
+  @param[in] String  The null terminated string.
+
+  @retval EFI_SUCCESS           The string was written.
+  @retval EFI_OUT_OF_RESOURCES  The output could not be grown.
+**/
+EFI_STATUS
+WriteCanonicalString (
+  XML_C14N_WRITER* Writer,
+  CONST CHAR8*     String
+  )
+{
+  return BytesToDocument (String, AsciiStrLen (String), Writer->OutputDocument);
+}
+
+/**
+  Write the attributes of a tag in canonical order.
+  The next attribute is found by a scan for the smallest one after the last written,
+  which needs no memory and is quick for the handful of attributes a tag usually has.
+
+  @param[in] Writer  The writer state.
+  @param[in] Tag     The tag.
+
+  @retval EFI_SUCCESS           The attributes were written.
+  @retval EFI_OUT_OF_RESOURCES  The output could not be grown.
+**/
+EFI_STATUS
+WriteCanonicalAttributes (
+  XML_C14N_WRITER* Writer,
+  DRIVER_XML_TAG*  Tag
+  )
+{
+  DRIVER_XML_ATTRIBUTE*   Last;
+  DRIVER_XML_ATTRIBUTE*   Next;
+  DRIVER_XML_ATTRIBUTE*   Attribute;
+  DRIVER_XML_DATA_HEADER* LocalXmlData;
+  UINTN                   Written;
+  EFI_STATUS              Status;
+
+  Last = NULL;
+  for (Written = 0; Written < Tag->TagAttributes.ItemCount; Written++) {
+    Next = NULL;
+    LocalXmlData = (DRIVER_XML_DATA_HEADER*)&Tag->TagAttributes.ListStart;
+    while (GetNextXmlElement (&Tag->TagAttributes, LocalXmlData, &LocalXmlData) == EFI_SUCCESS) {
+      Attribute = (DRIVER_XML_ATTRIBUTE*)LocalXmlData;
+      if (Last != NULL && CompareCanonicalAttributes (Writer, Attribute, Last) <= 0) {
+        continue;
+      }
+      if (Next == NULL || CompareCanonicalAttributes (Writer, Attribute, Next) < 0) {
+        Next = Attribute;
+      }
+    }
+    if (Next == NULL) {
+      break;
+    }
+    Last = Next;
+    if (GetDeclaredPrefix (Next) != NULL && IsSuperfluousNamespace (Writer, Tag, Next)) {
+      continue;
+    }
+    Status = BytesToDocument (" ", 1, Writer->OutputDocument);
+    if (!EFI_ERROR (Status)) {
+      Status = WriteCanonicalString (Writer, Next->AttributeName);
+    }
+    if (!EFI_ERROR (Status)) {
+      Status = BytesToDocument ("=\"", 2, Writer->OutputDocument);
+    }
+    if (!EFI_ERROR (Status)) {
+      Status = WriteCanonicalText (
+                 Writer,
+                 Next->AttributeData,
+                 AsciiStrLen (Next->AttributeData),
+                 TRUE,
+                 (BOOLEAN)((Next->Flags & DRIVER_XML_TEXT_RAW) != 0)
+                 );
+    }
+    if (!EFI_ERROR (Status)) {
+      Status = BytesToDocument ("\"", 1, Writer->OutputDocument);
+    }
+    if (EFI_ERROR (Status)) {
+      return Status;
+    }
+  }
+  return EFI_SUCCESS;
+}
+
+/**
+  Write a processing instruction. The XML declaration is not part of the canonical form.
+
+  @param[in] Writer  The writer state.
+  @param[in] Pi      The processing instruction.
+
+  @retval EFI_SUCCESS           The PI was written or skipped.
+  @retval EFI_OUT_OF_RESOURCES  The output could not be grown.
+**/
+EFI_STATUS
+WriteCanonicalPi (
+  XML_C14N_WRITER*                   Writer,
+  DRIVER_XML_PROCESSING_INSTRUCTION* Pi
+  )
+{
+  EFI_STATUS Status;
+
+  if (Pi->PiTargetName == NULL) {
+    return EFI_SUCCESS;
+  }
+  Status = BytesToDocument ("<?", 2, Writer->OutputDocument);
+  if (!EFI_ERROR (Status)) {
+    Status = WriteCanonicalString (Writer, Pi->PiTargetName);
+  }
+  if (!EFI_ERROR (Status) && Pi->PiTargetData != NULL && Pi->PiTargetData[0] != '\0') {
+    Status = BytesToDocument (" ", 1, Writer->OutputDocument);
+    if (!EFI_ERROR (Status)) {
+      Status = WriteCanonicalString (Writer, Pi->PiTargetData);
+    }
+  }
+  if (!EFI_ERROR (Status)) {
+    Status = BytesToDocument ("?>", 2, Writer->OutputDocument);
+  }
+  return Status;
+}
+
+/**
+  C14N handler for a start tag. Empty elements are written as a start and end tag pair.
+
+  @param[in]     Element  The element.
+  @param[in]     Depth    The depth of the element in the walk. Not used.
+  @param[in out] Context  The XML_C14N_WRITER.
+
+  @retval EFI_SUCCESS  The start tag was written.
+  @retval other        An error from writing the text or growing the output.
+**/
+EFI_STATUS
+WriteCanonicalStartTag (
+  DRIVER_XML_DATA_HEADER* Element,
+  UINTN                   Depth,
+  VOID*                   Context
+  )
+{
+  XML_C14N_WRITER* Writer;
+  DRIVER_XML_TAG*  Tag;
+  EFI_STATUS       Status;
+
+  Writer = (XML_C14N_WRITER*)Context;
+  Tag = (DRIVER_XML_TAG*)Element;
+  Status = BytesToDocument ("<", 1, Writer->OutputDocument);
+  if (!EFI_ERROR (Status)) {
+    Status = WriteCanonicalString (Writer, Tag->TagName);
+  }
+  if (!EFI_ERROR (Status) && Tag->TagAttributes.ItemCount > 0) {
+    Status = WriteCanonicalAttributes (Writer, Tag);
+  }
+  if (!EFI_ERROR (Status)) {
+    Status = BytesToDocument (">", 1, Writer->OutputDocument);
+  }
+  return Status;
+}
+
+/**
+  C14N handler for the end of an element, called once everything in it has been written.
+
+  @param[in]     Element  The element.
+  @param[in]     Depth    The depth of the element in the walk. Not used.
+  @param[in out] Context  The XML_C14N_WRITER.
+
+  @retval EFI_SUCCESS  The end tag was written.
+  @retval other        An error from growing the output.
+**/
+EFI_STATUS
+WriteCanonicalEndTag (
+  DRIVER_XML_DATA_HEADER* Element,
+  UINTN                   Depth,
+  VOID*                   Context
+  )
+{
+  XML_C14N_WRITER* Writer;
+  EFI_STATUS       Status;
+
+  Writer = (XML_C14N_WRITER*)Context;
+  Status = BytesToDocument ("</", 2, Writer->OutputDocument);
+  if (!EFI_ERROR (Status)) {
+    Status = WriteCanonicalString (Writer, ((DRIVER_XML_TAG*)Element)->TagName);
+  }
+  if (!EFI_ERROR (Status)) {
+    Status = BytesToDocument (">", 1, Writer->OutputDocument);
+  }
+  return Status;
+}
+
+/**
+  C14N handler for character data.
+
+  @param[in]     Element  The character data.
+  @param[in]     Depth    The depth of the data in the walk. Not used.
+  @param[in out] Context  The XML_C14N_WRITER.
+
+  @retval EFI_SUCCESS  The text was written.
+  @retval other        An error from WriteCanonicalText.
+**/
+EFI_STATUS
+WriteCanonicalCharData (
+  DRIVER_XML_DATA_HEADER* Element,
+  UINTN                   Depth,
+  VOID*                   Context
+  )
+{
+  DRIVER_XML_CHAR_DATA* CharData;
+
+  CharData = (DRIVER_XML_CHAR_DATA*)Element;
+  return WriteCanonicalText (
+           (XML_C14N_WRITER*)Context,
+           CharData->CharData,
+           CharData->DataSize,
+           FALSE,
+           (BOOLEAN)((CharData->Flags & DRIVER_XML_TEXT_RAW) != 0)
+           );
+}
+
+/**
+  C14N handler for a processing instruction inside an element.
+
+  @param[in]     Element  The processing instruction.
+  @param[in]     Depth    The depth of the PI in the walk. Not used.
+  @param[in out] Context  The XML_C14N_WRITER.
+
+  @retval EFI_SUCCESS  The PI was written or skipped.
+  @retval other        An error from WriteCanonicalPi.
+**/
+EFI_STATUS
+WriteCanonicalPiData (
+  DRIVER_XML_DATA_HEADER* Element,
+  UINTN                   Depth,
+  VOID*                   Context
+  )
+{
+  return WriteCanonicalPi ((XML_C14N_WRITER*)Context, (DRIVER_XML_PROCESSING_INSTRUCTION*)Element);
+}
+
+//
+// Writes an element and everything in it. Comments have no handler and are left out.
+//
+CONST DRIVER_XML_VISITOR mXmlCanonicalWriter = {
+  {
+    NULL,                    // XmlNothing
+    WriteCanonicalStartTag,  // XmlEmptyTag
+    WriteCanonicalStartTag,  // XmlTag
+    NULL,                    // XmlCloseTag
+    NULL,                    // XmlAttribute
+    WriteCanonicalCharData,  // XmlChar
+    WriteCanonicalPiData,    // XmlPi
+    NULL,                    // XmlDecl
+    NULL                     // XmlComment
+  },
+  {
+    NULL,                    // XmlNothing
+    WriteCanonicalEndTag,    // XmlEmptyTag
+    WriteCanonicalEndTag,    // XmlTag
+    NULL,                    // XmlCloseTag
+    NULL,                    // XmlAttribute
+    NULL,                    // XmlChar
+    NULL,                    // XmlPi
+    NULL,                    // XmlDecl
+    NULL                     // XmlComment
+  }
+};
+
+/**
+  Write a tree as Canonical XML 1.0 without comments.
+
+  Attributes are sorted with namespace declarations first, empty elements get an end tag,
+  text and attribute values are escaped the canonical way, and attribute values use double quotes.
+  Given the root from the parser, whitespace outside the document element and the XML declaration
+  are dropped, and processing instructions before and after the document element are separated
+  from it by a line feed. Given any other tag, that element is written as if it were the document.
+
+  Text goes straight into the output document with no intermediate strings and no memory is
+  allocated apart from growing the output.
+
+  @param[in]     XmlTree         The root from the parser, or an element in the tree.
+  @param[in]     NameTable       The name table of a namespace aware parse, used to sort attributes
+                                 by namespace URI. May be NULL to sort by qualified name.
+  @param[in]     Flags           DRIVER_XML_C14N_ flags.
+  @param[in out] OutputDocument  The output buffer, set up the same way as for PrintData.
+
+  @retval EFI_SUCCESS            The canonical form was written.
+  @retval EFI_INVALID_PARAMETER  XmlTree or OutputDocument is NULL, or XmlTree is not a tag.
+  @retval EFI_UNSUPPORTED        DRIVER_XML_C14N_RAW_TEXT is set and the text refers to a declared entity.
+  @retval EFI_DEVICE_ERROR       DRIVER_XML_C14N_RAW_TEXT is set and the text holds a malformed reference.
+  @retval EFI_OUT_OF_RESOURCES   The output buffer could not be grown.
+**/
+EFI_STATUS
+PrintDataCanonical (
+  DRIVER_XML_DATA_HEADER* XmlTree,
+  DRIVER_XML_NAME_TABLE*  NameTable,
+  UINT32                  Flags,
+  XML_DOCUMENT*           OutputDocument
+  )
+{
+  XML_C14N_WRITER         Writer;
+  DRIVER_XML_TAG*         Root;
+  DRIVER_XML_DATA_HEADER* Child;
+  BOOLEAN                 SeenElement;
+  EFI_STATUS              Status;
+
+  if (XmlTree == NULL || OutputDocument == NULL) {
+    return EFI_INVALID_PARAMETER;
+  }
+  if (XmlTree->XmlDataType != XmlTag && XmlTree->XmlDataType != XmlEmptyTag) {
+    return EFI_INVALID_PARAMETER;
+  }
+  Root = (DRIVER_XML_TAG*)XmlTree;
+  Writer.OutputDocument = OutputDocument;
+  Writer.NameTable = NameTable;
+  Writer.Flags = Flags;
+  Writer.Top = Root;
+  if (Root->Parent != NULL) {
+    return DriverXmlWalkElement (&mXmlCanonicalWriter, XmlTree, 0, &Writer);
+  }
+
+  SeenElement = FALSE;
+  Status = EFI_SUCCESS;
+  if (Root->TagChildren.ItemCount == 0) {
+    return EFI_SUCCESS;
+  }
+  Child = (DRIVER_XML_DATA_HEADER*)&Root->TagChildren.ListStart;
+  while (GetNextXmlElement (&Root->TagChildren, Child, &Child) == EFI_SUCCESS) {
+    switch (Child->XmlDataType) {
+    case XmlTag:
+    case XmlEmptyTag:
+      Writer.Top = (DRIVER_XML_TAG*)Child;
+      Status = DriverXmlWalkElement (&mXmlCanonicalWriter, Child, 0, &Writer);
+      SeenElement = TRUE;
+      break;
+    case XmlPi:
+      if (((DRIVER_XML_PROCESSING_INSTRUCTION*)Child)->PiTargetName == NULL
+          || AsciiStrCmp (((DRIVER_XML_PROCESSING_INSTRUCTION*)Child)->PiTargetName, "xml") == 0) 
+      {
+        break;
+      }
+      if (SeenElement) {
+        Status = BytesToDocument ("\n", 1, OutputDocument);
+      }
+      if (!EFI_ERROR (Status)) {
+        Status = WriteCanonicalPi (&Writer, (DRIVER_XML_PROCESSING_INSTRUCTION*)Child);
+      }
+      if (!EFI_ERROR (Status) && !SeenElement) {
+        Status = BytesToDocument ("\n", 1, OutputDocument);
+      }
+      break;
+    default:
+      //
+      // Text outside the document element is only whitespace and is not part of the canonical form.
+      //
+      break;
+    }
+    if (EFI_ERROR (Status)) {
+      return Status;
+    }
+  }
+  return EFI_SUCCESS;
+}
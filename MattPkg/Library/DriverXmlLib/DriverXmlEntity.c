@@ -0,0 +1,834 @@
+/** @file
+  Entity support for the XML parser.
+  General entities declared in the DOCTYPE internal subset are compiled into a hashed
+  table and expanded, along with the predefined entities and character references, in
+  char data and attribute values. Expansion is bounded by a nesting depth and a total
+  byte limit so a document of exponentially nested entities can't exhaust memory.
+  
+  @par Extensible Markup Language (XML) 1.0 section 4 https://www.w3.org/TR/xml/#sec-physical-struct
+  
+  Copyright (c) 2016, Matthew Lazarowitz. All rights reserved.<BR>
+  This program and the accompanying materials are licensed and made available under
+  the terms and conditions of the MIT License that accompanies this distribution.
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+**/
+#include <Uefi.h>
+#include <Library/UefiBootServicesTableLib.h>
+#include <Library/BaseLib.h>
+#include <Library/MemoryAllocationLib.h>
+#include <Library/DebugLib.h>
+#include <DriverXmlStringHandlers.h>
+
+//
+// Number of value slots to grow the entity value array by.
+//
+#define ENTITY_VALUE_STEP 16
+
+//
+// Smallest buffer allocated for expanded text.
+//
+#define EXPAND_BUFFER_MIN_SIZE 64
+
+//
+// Output buffer for entity expansion. Size doubles as it fills so appends are amortized O(1).
+//
+typedef struct _EXPAND_BUFFER {
+  CHAR8* Data;
+  UINTN  Length;
+  UINTN  Size;
+} EXPAND_BUFFER;
+
+/**
+  Append characters to an expansion buffer, growing it if needed.
+  The data is always kept null terminated.
+
+  @param[in out] Buffer  The buffer to append to.
+  @param[in]     Data    The characters to append.
+  @param[in]     Length  The number of characters to append.
+
+  @retval EFI_SUCCESS           The characters were appended.
+  @retval EFI_OUT_OF_RESOURCES  The buffer could not be grown.
+**/
+EFI_STATUS
+AppendToExpandBuffer (
+  IN OUT EXPAND_BUFFER* Buffer,
+  IN     CONST CHAR8*   Data,
+  IN     UINTN          Length
+  )
+{
+  CHAR8* NewData;
+  UINTN  NewSize;
+
+  if (Buffer->Length + Length + 1 > Buffer->Size) {
+    NewSize = (Buffer->Size == 0) ? EXPAND_BUFFER_MIN_SIZE : Buffer->Size;
+    while (NewSize < Buffer->Length + Length + 1) {
+      NewSize *= 2;
+    }
+    NewData = DriverXmlReallocatePool (XmlAllocString, Buffer->Data, NewSize);
+    if (NewData == NULL) {
+      return EFI_OUT_OF_RESOURCES;
+    }
+    Buffer->Data = NewData;
+    Buffer->Size = NewSize;
+  }
+  gBS->CopyMem (&Buffer->Data[Buffer->Length], (VOID*)Data, Length);
+  Buffer->Length += Length;
+  Buffer->Data[Buffer->Length] = '\0';
+  return EFI_SUCCESS;
+}
+
+/**
+  Convert the body of a character reference into a code point.
+
+  Spec says the definition is:
+  CharRef    ::=    '&#' [0-9]+ ';' | '&#x' [0-9a-fA-F]+ ';'
+  
+  @param[in]  Reference  The characters between the '&' and ';', starting with '#'.
+  @param[in]  Length     The number of characters in Reference.
+  @param[out] CodePoint  The character that is referenced.
+
+  @retval EFI_SUCCESS       CodePoint is valid.
+  @retval EFI_DEVICE_ERROR  The reference is malformed or refers to a character XML does not allow.
+**/
+EFI_STATUS
+ParseCharReference (
+  IN  CONST CHAR8* Reference,
+  IN  UINTN        Length,
+  OUT UINT32*      CodePoint
+  )
+{
+  UINTN  Index;
+  UINT32 Base;
+  UINT32 Digit;
+  UINT32 Value;
+  CHAR8  Character;
+
+  Index = 1;
+  Base = 10;
+  if (Length > 1 && Reference[1] == 'x') {
+    Base = 16;
+    Index++;
+  }
+  if (Index >= Length) {
+    return EFI_DEVICE_ERROR;
+  }
+  Value = 0;
+  for (; Index < Length; Index++) {
+    Character = Reference[Index];
+    if (Character >= '0' && Character <= '9') {
+      Digit = Character - '0';
+    } else if (Base == 16 && Character >= 'a' && Character <= 'f') {
+      Digit = Character - 'a' + 10;
+    } else if (Base == 16 && Character >= 'A' && Character <= 'F') {
+      Digit = Character - 'A' + 10;
+    } else {
+      return EFI_DEVICE_ERROR;
+    }
+    Value = Value * Base + Digit;
+    if (Value > 0x10FFFF) {
+      return EFI_DEVICE_ERROR;
+    }
+  }
+  //
+  // Char ::= #x9 | #xA | #xD | [#x20-#xD7FF] | [#xE000-#xFFFD] | [#x10000-#x10FFFF]
+  //
+  if ((Value < 0x20 && Value != 0x9 && Value != 0xA && Value != 0xD)
+      || (Value >= 0xD800 && Value <= 0xDFFF)
+      || Value == 0xFFFE || Value == 0xFFFF) 
+  {
+    return EFI_DEVICE_ERROR;
+  }
+  *CodePoint = Value;
+  return EFI_SUCCESS;
+}
+
+/**
+  Encode a character as UTF-8.
+
+  @param[in]  CodePoint  The character.
+  @param[out] Encoded    Receives up to 4 bytes.
+
+  @return The number of bytes written to Encoded.
+**/
+UINTN
+DriverXmlEncodeUtf8 (
+  IN  UINT32 CodePoint,
+  OUT CHAR8* Encoded
+  )
+{
+  if (CodePoint < 0x80) {
+    Encoded[0] = (CHAR8)CodePoint;
+    return 1;
+  }
+  if (CodePoint < 0x800) {
+    Encoded[0] = (CHAR8)(0xC0 | (CodePoint >> 6));
+    Encoded[1] = (CHAR8)(0x80 | (CodePoint & 0x3F));
+    return 2;
+  }
+  if (CodePoint < 0x10000) {
+    Encoded[0] = (CHAR8)(0xE0 | (CodePoint >> 12));
+    Encoded[1] = (CHAR8)(0x80 | ((CodePoint >> 6) & 0x3F));
+    Encoded[2] = (CHAR8)(0x80 | (CodePoint & 0x3F));
+    return 3;
+  }
+  Encoded[0] = (CHAR8)(0xF0 | (CodePoint >> 18));
+  Encoded[1] = (CHAR8)(0x80 | ((CodePoint >> 12) & 0x3F));
+  Encoded[2] = (CHAR8)(0x80 | ((CodePoint >> 6) & 0x3F));
+  Encoded[3] = (CHAR8)(0x80 | (CodePoint & 0x3F));
+  return 4;
+}
+
+/**
+  Append a character reference to an expansion buffer.
+  The library works on 8 bit characters so anything outside ASCII is stored as UTF-8.
+
+  @param[in out] Buffer     The buffer to append to.
+  @param[in]     Reference  The characters between the '&' and ';', starting with '#'.
+  @param[in]     Length     The number of characters in Reference.
+
+  @retval EFI_SUCCESS           The character was appended.
+  @retval EFI_DEVICE_ERROR      The reference is not valid.
+  @retval EFI_OUT_OF_RESOURCES  The buffer could not be grown.
+**/
+EFI_STATUS
+AppendCharReference (
+  IN OUT EXPAND_BUFFER* Buffer,
+  IN     CONST CHAR8*   Reference,
+  IN     UINTN          Length
+  )
+{
+  EFI_STATUS Status;
+  UINT32     CodePoint;
+  CHAR8      Encoded[4];
+
+  Status = ParseCharReference (Reference, Length, &CodePoint);
+  if (EFI_ERROR (Status)) {
+    DEBUG ((DEBUG_ERROR, "Invalid character reference\n"));
+    return Status;
+  }
+  return AppendToExpandBuffer (Buffer, Encoded, DriverXmlEncodeUtf8 (CodePoint, Encoded));
+}
+
+/**
+  Get the replacement character for one of the 5 predefined entities.
+
+  @param[in]  Name       The entity name.
+  @param[in]  Length     The number of characters in Name.
+  @param[out] Character  The replacement character.
+
+  @retval TRUE   Name is a predefined entity.
+  @retval FALSE  Name is not a predefined entity.
+**/
+BOOLEAN
+GetPredefinedEntity (
+  IN  CONST CHAR8* Name,
+  IN  UINTN        Length,
+  OUT CHAR8*       Character
+  )
+{
+  if (Length == 2 && Name[1] == 't') {
+    if (Name[0] == 'l') {
+      *Character = '<';
+      return TRUE;
+    }
+    if (Name[0] == 'g') {
+      *Character = '>';
+      return TRUE;
+    }
+  }
+  if (Length == 3 && AsciiStrnCmp (Name, "amp", 3) == 0) {
+    *Character = '&';
+    return TRUE;
+  }
+  if (Length == 4 && AsciiStrnCmp (Name, "apos", 4) == 0) {
+    *Character = '\'';
+    return TRUE;
+  }
+  if (Length == 4 && AsciiStrnCmp (Name, "quot", 4) == 0) {
+    *Character = '\"';
+    return TRUE;
+  }
+  return FALSE;
+}
+
+/**
+  Find the ';' that ends a reference and check the name in between.
+
+  @param[in]  Text       The text starting just after the '&'.
+  @param[in]  End        The end of the text.
+  @param[out] RefLength  The number of characters between '&' and ';'.
+
+  @retval EFI_SUCCESS       The reference is well formed.
+  @retval EFI_DEVICE_ERROR  There is no ';' or the name contains an invalid character.
+**/
+EFI_STATUS
+GetReferenceLength (
+  IN  CONST CHAR8* Text,
+  IN  CONST CHAR8* End,
+  OUT UINTN*       RefLength
+  )
+{
+  CONST CHAR8* Ptr;
+
+  Ptr = Text;
+  if (Ptr < End && *Ptr == '#') {
+    Ptr++;
+  } else if (Ptr >= End || !IsAsciiNameStartChar (*Ptr)) {
+    return EFI_DEVICE_ERROR;
+  }
+  while (Ptr < End && *Ptr != ';') {
+    if (!IsAsciiNameChar (*Ptr)) {
+      return EFI_DEVICE_ERROR;
+    }
+    Ptr++;
+  }
+  if (Ptr >= End) {
+    return EFI_DEVICE_ERROR;
+  }
+  *RefLength = Ptr - Text;
+  return EFI_SUCCESS;
+}
+
+/**
+  Worker for DriverXmlExpandReferences. Replaces the references in a run of text
+  and recurses into the replacement text of declared entities.
+
+  @param[in out] Context  The parser state holding the entity table and limits.
+  @param[in]     Text     The text to expand.
+  @param[in]     Length   The number of characters in Text.
+  @param[in]     Depth    How many entity replacements deep this text is.
+  @param[in out] Buffer   The buffer the expanded text is appended to.
+
+  @retval EFI_SUCCESS             The text was expanded.
+  @retval EFI_DEVICE_ERROR        A reference is malformed or names an undeclared entity.
+  @retval EFI_UNSUPPORTED         A reference names an external entity.
+  @retval EFI_SECURITY_VIOLATION  The depth or expansion limit was exceeded.
+  @retval EFI_OUT_OF_RESOURCES    The buffer could not be grown.
+**/
+EFI_STATUS
+ExpandText (
+  IN OUT XML_PARSER_CONTEXT* Context,
+  IN     CONST CHAR8*        Text,
+  IN     UINTN               Length,
+  IN     UINTN               Depth,
+  IN OUT EXPAND_BUFFER*      Buffer
+  )
+{
+  EFI_STATUS        Status;
+  CONST CHAR8*      Ptr;
+  CONST CHAR8*      RunStart;
+  CONST CHAR8*      End;
+  UINTN             RefLength;
+  UINTN             EntityId;
+  XML_ENTITY_VALUE* Entity;
+  CHAR8             Character;
+
+  Ptr = Text;
+  End = Text + Length;
+  while (Ptr < End) {
+    //
+    // Copy the plain text up to the next reference in one go.
+    //
+    RunStart = Ptr;
+    while (Ptr < End && *Ptr != '&') {
+      Ptr++;
+    }
+    if (Ptr > RunStart) {
+      Status = AppendToExpandBuffer (Buffer, RunStart, Ptr - RunStart);
+      if (EFI_ERROR (Status)) {
+        return Status;
+      }
+    }
+    if (Ptr >= End) {
+      break;
+    }
+    Ptr++;
+    Status = GetReferenceLength (Ptr, End, &RefLength);
+    if (EFI_ERROR (Status)) {
+      DEBUG ((DEBUG_ERROR, "Malformed reference in text\n"));
+      return Status;
+    }
+
+    if (*Ptr == '#') {
+      Status = AppendCharReference (Buffer, Ptr, RefLength);
+    } else if (GetPredefinedEntity (Ptr, RefLength, &Character)) {
+      Status = AppendToExpandBuffer (Buffer, &Character, 1);
+    } else {
+      if (Context->EntityNames == NULL 
+          || DriverXmlLookupName (Context->EntityNames, Ptr, RefLength, &EntityId) != EFI_SUCCESS) 
+      {
+        DEBUG ((DEBUG_ERROR, "Reference to undeclared entity\n"));
+        return EFI_DEVICE_ERROR;
+      }
+      Entity = &Context->EntityValues[EntityId];
+      if (Entity->Value == NULL) {
+        DEBUG ((DEBUG_ERROR, "External entity %a can't be expanded\n", DriverXmlGetName (Context->EntityNames, EntityId)));
+        return EFI_UNSUPPORTED;
+      }
+      //
+      // Both limits are checked before any work is done so a nested or
+      // exponential entity stops as soon as it goes over.
+      //
+      if (Depth + 1 > Context->MaxEntityDepth) {
+        DEBUG ((DEBUG_ERROR, "Entity %a nested too deeply\n", DriverXmlGetName (Context->EntityNames, EntityId)));
+        return EFI_SECURITY_VIOLATION;
+      }
+      Context->ExpandedBytes += Entity->Length;
+      if (Context->ExpandedBytes > Context->MaxEntityExpansion) {
+        DEBUG ((DEBUG_ERROR, "Entity expansion limit of %d bytes exceeded\n", Context->MaxEntityExpansion));
+        return EFI_SECURITY_VIOLATION;
+      }
+      Status = ExpandText (Context, Entity->Value, Entity->Length, Depth + 1, Buffer);
+    }
+    if (EFI_ERROR (Status)) {
+      return Status;
+    }
+    Ptr += RefLength + 1;
+  }
+  return EFI_SUCCESS;
+}
+
+/**
+  Replace the entity and character references in a run of char data or an attribute value.
+  Replacement text is treated as text. Markup inside an entity value is not turned into elements.
+
+  @param[in out] Context         The parser state holding the entity table and limits.
+  @param[in]     Text            The text to expand.
+  @param[in]     Length          The number of characters in Text.
+  @param[out]    Expanded        The expanded text. The caller must free this.
+  @param[out]    ExpandedLength  The number of characters in Expanded.
+
+  @retval EFI_SUCCESS             The text was expanded.
+  @retval EFI_DEVICE_ERROR        A reference is malformed or names an undeclared entity.
+  @retval EFI_UNSUPPORTED         A reference names an external entity.
+  @retval EFI_SECURITY_VIOLATION  The depth or expansion limit was exceeded.
+  @retval EFI_OUT_OF_RESOURCES    There was not enough memory for the expanded text.
+**/
+EFI_STATUS
+DriverXmlExpandReferences (
+  IN OUT XML_PARSER_CONTEXT* Context,
+  IN     CONST CHAR8*        Text,
+  IN     UINTN               Length,
+  OUT    CHAR8**             Expanded,
+  OUT    UINTN*              ExpandedLength
+  )
+{
+  EFI_STATUS    Status;
+  EXPAND_BUFFER Buffer;
+
+  Buffer.Data = NULL;
+  Buffer.Length = 0;
+  Buffer.Size = 0;
+  //
+  // Make sure there is a buffer even if the text expands to nothing.
+  //
+  Status = AppendToExpandBuffer (&Buffer, "", 0);
+  if (!EFI_ERROR (Status)) {
+    Status = ExpandText (Context, Text, Length, 0, &Buffer);
+  }
+  if (EFI_ERROR (Status)) {
+    if (Buffer.Data != NULL) {
+      DriverXmlFreePool (Buffer.Data);
+    }
+    return Status;
+  }
+  *Expanded = Buffer.Data;
+  *ExpandedLength = Buffer.Length;
+  return EFI_SUCCESS;
+}
+
+/**
+  Skip over the rest of a markup declaration in the internal subset.
+  Quoted literals may contain '>' so they are stepped over as a whole.
+
+  @param[in out] Ptr  The current position. On return this is just after the closing '>'.
+  @param[in]     End  The end of the internal subset.
+
+  @retval EFI_SUCCESS      The declaration was skipped.
+  @retval EFI_END_OF_FILE  The declaration was not closed.
+**/
+EFI_STATUS
+SkipMarkupDeclaration (
+  IN OUT CHAR8** Ptr,
+  IN     CHAR8*  End
+  )
+{
+  CHAR8* LocalPtr;
+  CHAR8  QuoteChar;
+
+  LocalPtr = *Ptr;
+  while (LocalPtr < End && *LocalPtr != '>') {
+    if (*LocalPtr == '\"' || *LocalPtr == '\'') {
+      QuoteChar = *LocalPtr;
+      LocalPtr++;
+      while (LocalPtr < End && *LocalPtr != QuoteChar) {
+        LocalPtr++;
+      }
+    }
+    LocalPtr++;
+  }
+  if (LocalPtr >= End) {
+    return EFI_END_OF_FILE;
+  }
+  *Ptr = LocalPtr + 1;
+  return EFI_SUCCESS;
+}
+
+/**
+  Skip ahead to just past a terminating sequence such as "-->" or "?>".
+
+  @param[in out] Ptr         The current position. On return this is just after Terminator.
+  @param[in]     End         The end of the internal subset.
+  @param[in]     Terminator  The sequence to look for.
+
+  @retval EFI_SUCCESS      The terminator was found.
+  @retval EFI_END_OF_FILE  The terminator was not found.
+**/
+EFI_STATUS
+SkipPast (
+  IN OUT CHAR8**      Ptr,
+  IN     CHAR8*       End,
+  IN     CONST CHAR8* Terminator
+  )
+{
+  CHAR8* LocalPtr;
+  UINTN  Length;
+
+  Length = AsciiStrLen (Terminator);
+  for (LocalPtr = *Ptr; LocalPtr + Length <= End; LocalPtr++) {
+    if (AsciiStrnCmp (LocalPtr, Terminator, Length) == 0) {
+      *Ptr = LocalPtr + Length;
+      return EFI_SUCCESS;
+    }
+  }
+  return EFI_END_OF_FILE;
+}
+
+/**
+  Store the compiled value of a general entity. 
+  The first declaration of an entity is binding, later ones are ignored as the spec requires.
+
+  @param[in out] Context     The parser state holding the entity table.
+  @param[in]     Name        The entity name.
+  @param[in]     NameLength  The number of characters in Name.
+  @param[in]     Literal     The entity value without quotes, or NULL for an external entity.
+  @param[in]     Length      The number of characters in Literal.
+
+  @retval EFI_SUCCESS           The entity was stored or was already declared.
+  @retval EFI_DEVICE_ERROR      The literal has a bad character reference.
+  @retval EFI_OUT_OF_RESOURCES  The table could not be grown.
+**/
+EFI_STATUS
+AddEntity (
+  IN OUT XML_PARSER_CONTEXT* Context,
+  IN     CHAR8*              Name,
+  IN     UINTN               NameLength,
+  IN     CHAR8*              Literal,
+  IN     UINTN               Length
+  )
+{
+  EFI_STATUS        Status;
+  UINTN             EntityId;
+  UINTN             NewSlots;
+  XML_ENTITY_VALUE* NewValues;
+  EXPAND_BUFFER     Buffer;
+  CHAR8*            Ptr;
+  CHAR8*            RunStart;
+  CHAR8*            End;
+  UINTN             RefLength;
+  CHAR8             Character;
+
+  if (GetPredefinedEntity (Name, NameLength, &Character)) {
+    return EFI_SUCCESS;
+  }
+  if (Context->EntityNames == NULL) {
+    Status = DriverXmlCreateNameTable (&Context->EntityNames);
+    if (EFI_ERROR (Status)) {
+      return Status;
+    }
+  }
+  if (DriverXmlLookupName (Context->EntityNames, Name, NameLength, &EntityId) == EFI_SUCCESS) {
+    return EFI_SUCCESS;
+  }
+  Status = DriverXmlInternName (Context->EntityNames, Name, NameLength, &EntityId);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+  if (EntityId >= Context->EntitySlots) {
+    NewSlots = EntityId + ENTITY_VALUE_STEP;
+    NewValues = DriverXmlReallocatePool (
+                  XmlAllocTable,
+                  Context->EntityValues,
+                  NewSlots * sizeof (XML_ENTITY_VALUE)
+                  );
+    if (NewValues == NULL) {
+      return EFI_OUT_OF_RESOURCES;
+    }
+    Context->EntityValues = NewValues;
+    Context->EntitySlots = NewSlots;
+  }
+  if (Literal == NULL) {
+    return EFI_SUCCESS;
+  }
+
+  //
+  // Character references are replaced when the entity is declared.
+  // Entity references are left alone and replaced each time the entity is used.
+  //
+  Buffer.Data = NULL;
+  Buffer.Length = 0;
+  Buffer.Size = 0;
+  Status = AppendToExpandBuffer (&Buffer, "", 0);
+  Ptr = Literal;
+  End = Literal + Length;
+  RefLength = 0;
+  while (!EFI_ERROR (Status) && Ptr < End) {
+    RunStart = Ptr;
+    while (Ptr < End && !(Ptr[0] == '&' && Ptr + 1 < End && Ptr[1] == '#')) {
+      Ptr++;
+    }
+    Status = AppendToExpandBuffer (&Buffer, RunStart, Ptr - RunStart);
+    if (EFI_ERROR (Status) || Ptr >= End) {
+      break;
+    }
+    Ptr++;
+    Status = GetReferenceLength (Ptr, End, &RefLength);
+    if (EFI_ERROR (Status)) {
+      break;
+    }
+    Status = AppendCharReference (&Buffer, Ptr, RefLength);
+    Ptr += RefLength + 1;
+  }
+  if (EFI_ERROR (Status)) {
+    if (Buffer.Data != NULL) {
+      DriverXmlFreePool (Buffer.Data);
+    }
+    return Status;
+  }
+  Context->EntityValues[EntityId].Value = Buffer.Data;
+  Context->EntityValues[EntityId].Length = Buffer.Length;
+  return EFI_SUCCESS;
+}
+
+/**
+  Parse an entity declaration from the internal subset.
+  
+  Spec says the definition is:
+  GEDecl     ::=    '<!ENTITY' S Name S EntityDef S? '>'
+  PEDecl     ::=    '<!ENTITY' S '%' S Name S PEDef S? '>'
+  EntityDef  ::=    EntityValue | (ExternalID NDataDecl?)
+
+  Parameter entities are only meaningful inside the DTD which is not validated so they are skipped.
+
+  @param[in out] Context  The parser state holding the entity table.
+  @param[in out] Ptr      Points just past "<!ENTITY". On return this is just after the closing '>'.
+  @param[in]     End      The end of the internal subset.
+
+  @retval EFI_SUCCESS       The declaration was parsed.
+  @retval EFI_DEVICE_ERROR  The declaration is malformed.
+  @retval EFI_END_OF_FILE   The declaration was not closed.
+**/
+EFI_STATUS
+ParseEntityDeclaration (
+  IN OUT XML_PARSER_CONTEXT* Context,
+  IN OUT CHAR8**             Ptr,
+  IN     CHAR8*              End
+  )
+{
+  EFI_STATUS Status;
+  CHAR8*     LocalPtr;
+  CHAR8*     Name;
+  UINTN      NameLength;
+  CHAR8*     Literal;
+  UINTN      Length;
+  CHAR8      QuoteChar;
+
+  LocalPtr = *Ptr;
+  if (LocalPtr >= End || !IsAsciiWhitespace (*LocalPtr)) {
+    return EFI_DEVICE_ERROR;
+  }
+  while (LocalPtr < End && IsAsciiWhitespace (*LocalPtr)) {
+    LocalPtr++;
+  }
+  if (LocalPtr < End && *LocalPtr == '%') {
+    Status = SkipMarkupDeclaration (&LocalPtr, End);
+    *Ptr = LocalPtr;
+    return Status;
+  }
+
+  Name = LocalPtr;
+  if (LocalPtr >= End || !IsAsciiNameStartChar (*LocalPtr)) {
+    return EFI_DEVICE_ERROR;
+  }
+  while (LocalPtr < End && IsAsciiNameChar (*LocalPtr)) {
+    LocalPtr++;
+  }
+  NameLength = LocalPtr - Name;
+  while (LocalPtr < End && IsAsciiWhitespace (*LocalPtr)) {
+    LocalPtr++;
+  }
+  if (LocalPtr >= End) {
+    return EFI_END_OF_FILE;
+  }
+
+  //
+  // A quoted value is an internal entity. Anything else is an ExternalID 
+  // that this library has no way to fetch.
+  //
+  Literal = NULL;
+  Length = 0;
+  if (*LocalPtr == '\"' || *LocalPtr == '\'') {
+    QuoteChar = *LocalPtr;
+    LocalPtr++;
+    Literal = LocalPtr;
+    while (LocalPtr < End && *LocalPtr != QuoteChar) {
+      LocalPtr++;
+    }
+    if (LocalPtr >= End) {
+      return EFI_END_OF_FILE;
+    }
+    Length = LocalPtr - Literal;
+    LocalPtr++;
+  }
+  Status = SkipMarkupDeclaration (&LocalPtr, End);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+  *Ptr = LocalPtr;
+  return AddEntity (Context, Name, NameLength, Literal, Length);
+}
+
+/**
+  Compile the general entities declared in a DOCTYPE internal subset into the
+  entity table used for expansion. Other declarations are skipped over since the
+  document is not validated.
+
+  Spec says the definition is:
+  doctypedecl    ::=    '<!DOCTYPE' S Name (S ExternalID)? S? ('[' intSubset ']' S?)? '>'
+  intSubset      ::=    (markupdecl | DeclSep)*
+
+  @param[in out] Context      The parser state holding the entity table.
+  @param[in]     Declaration  The declaration extracted from the document.
+  @param[in]     Length       The number of characters in Declaration.
+
+  @retval EFI_SUCCESS       The declaration was not a DOCTYPE or the internal subset was compiled.
+  @retval EFI_DEVICE_ERROR  The internal subset is malformed or there is a second DOCTYPE.
+  @retval EFI_END_OF_FILE   A declaration in the internal subset was not closed.
+**/
+EFI_STATUS
+DriverXmlParseDoctype (
+  IN OUT XML_PARSER_CONTEXT* Context,
+  IN     CHAR8*              Declaration,
+  IN     UINTN               Length
+  )
+{
+  EFI_STATUS Status;
+  CHAR8*     Ptr;
+  CHAR8*     End;
+  CHAR8      QuoteChar;
+
+  if (Length < 9 || AsciiStrnCmp (Declaration, "<!DOCTYPE", 9) != 0) {
+    return EFI_SUCCESS;
+  }
+  if (Context->SeenDoctype) {
+    DEBUG ((DEBUG_ERROR, "Only one DOCTYPE is allowed\n"));
+    return EFI_DEVICE_ERROR;
+  }
+  Context->SeenDoctype = TRUE;
+
+  //
+  // Find the start of the internal subset. The ExternalID may have quoted literals.
+  //
+  Ptr = Declaration + 9;
+  End = Declaration + Length;
+  while (Ptr < End && *Ptr != '[') {
+    if (*Ptr == '\"' || *Ptr == '\'') {
+      QuoteChar = *Ptr;
+      Ptr++;
+      while (Ptr < End && *Ptr != QuoteChar) {
+        Ptr++;
+      }
+    }
+    Ptr++;
+  }
+  if (Ptr >= End) {
+    return EFI_SUCCESS;
+  }
+  Ptr++;
+
+  Status = EFI_SUCCESS;
+  while (!EFI_ERROR (Status)) {
+    while (Ptr < End && IsAsciiWhitespace (*Ptr)) {
+      Ptr++;
+    }
+    if (Ptr >= End) {
+      return EFI_END_OF_FILE;
+    }
+    if (*Ptr == ']') {
+      return EFI_SUCCESS;
+    }
+    if (End - Ptr >= 4 && AsciiStrnCmp (Ptr, "<!--", 4) == 0) {
+      Status = SkipPast (&Ptr, End, "-->");
+    } else if (End - Ptr >= 2 && AsciiStrnCmp (Ptr, "<?", 2) == 0) {
+      Status = SkipPast (&Ptr, End, "?>");
+    } else if (*Ptr == '%') {
+      //
+      // Parameter entity reference between declarations.
+      //
+      Status = SkipPast (&Ptr, End, ";");
+    } else if (End - Ptr >= 8 && AsciiStrnCmp (Ptr, "<!ENTITY", 8) == 0) {
+      Ptr += 8;
+      Status = ParseEntityDeclaration (Context, &Ptr, End);
+    } else if (End - Ptr >= 2 && AsciiStrnCmp (Ptr, "<!", 2) == 0) {
+      Status = SkipMarkupDeclaration (&Ptr, End);
+    } else {
+      DEBUG ((DEBUG_ERROR, "Unexpected data in DOCTYPE internal subset\n"));
+      Status = EFI_DEVICE_ERROR;
+    }
+  }
+  return Status;
+}
+
+/**
+  Free the entity table once the parse is finished.
+
+  @param[in out] Context  The parser state holding the entity table.
+**/
+VOID
+DriverXmlFreeEntities (
+  IN OUT XML_PARSER_CONTEXT* Context
+  )
+{
+  UINTN Index;
+
+  if (Context->EntityValues != NULL) {
+    for (Index = 0; Index < Context->EntitySlots; Index++) {
+      if (Context->EntityValues[Index].Value != NULL) {
+        DriverXmlFreePool (Context->EntityValues[Index].Value);
+      }
+    }
+    DriverXmlFreePool (Context->EntityValues);
+  }
+  if (Context->EntityNames != NULL) {
+    DriverXmlFreeNameTable (Context->EntityNames);
+  }
+  Context->EntityValues = NULL;
+  Context->EntityNames = NULL;
+  Context->EntitySlots = 0;
+}
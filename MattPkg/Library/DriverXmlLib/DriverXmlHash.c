@@ -0,0 +1,745 @@
+/** @file
+  Structural hashes for the XML library.
+  Each tag can carry a hash of its whole subtree so trees can be compared, diffed and
+  searched for repeated branches by looking only at the parts that differ.
+  
+  Copyright (c) 2016, Matthew Lazarowitz. All rights reserved.<BR>
+  This program and the accompanying materials are licensed and made available under
+  the terms and conditions of the MIT License that accompanies this distribution.
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+**/
+#include <uefi.h>
+#include <Library/DebugLib.h>
+#include <Library/BaseLib.h>
+#include <DriverXmlStringHandlers.h>
+
+#define FNV64_OFFSET_BASIS 0xCBF29CE484222325ULL
+#define FNV64_PRIME        0x00000100000001B3ULL
+
+//
+// The duplicate table starts with this many slots and doubles when it is 3/4 full.
+//
+#define DUPLICATE_TABLE_INITIAL_SLOTS 64
+
+//
+// The diff starts with room for this many levels of matched tags and doubles as it goes deeper.
+//
+#define DIFF_STACK_INITIAL_FRAMES 16
+
+//
+// Values mixed in ahead of each kind of child so, for example, a PI and char data
+// holding the same text do not hash the same.
+//
+#define HASH_KIND_TAG       1
+#define HASH_KIND_CHAR_DATA 2
+#define HASH_KIND_PI        3
+
+/**
+  Continue an FNV-1a hash over a run of bytes.
+
+  @param[in] Hash    The hash so far.
+  @param[in] Data    The bytes to add.
+  @param[in] Length  The number of bytes.
+
+  @return The updated hash.
+**/
+UINT64
+HashBytes (
+  UINT64      Hash,
+  CONST VOID* Data,
+  UINTN       Length
+  )
+{
+  CONST UINT8* Bytes;
+  UINTN        Index;
+
+  Bytes = Data;
+  for (Index = 0; Index < Length; Index++) {
+    Hash ^= Bytes[Index];
+    Hash = MultU64x64 (Hash, FNV64_PRIME);
+  }
+  return Hash;
+}
+
+/**
+  Continue a hash over a 64 bit value.
+
+  @param[in] Hash   The hash so far.
+  @param[in] Value  The value to add.
+
+  @return The updated hash.
+**/
+UINT64
+HashValue (
+  UINT64 Hash,
+  UINT64 Value
+  )
+{
+  return HashBytes (Hash, &Value, sizeof (Value));
+}
+
+/**
+  Continue a hash over a string. The length goes in first so "ab","c" and "a","bc" differ.
+
+  @param[in] Hash    The hash so far.
+  @param[in] String  The string, which may be NULL.
+  @param[in] Length  The number of characters in String.
+
+  @return The updated hash.
+**/
+UINT64
+HashText (
+  UINT64       Hash,
+  CONST CHAR8* String,
+  UINTN        Length
+  )
+{
+  Hash = HashValue (Hash, Length);
+  if (String != NULL) {
+    Hash = HashBytes (Hash, String, Length);
+  }
+  return Hash;
+}
+
+/**
+  Continue a hash over a null terminated string, which may be NULL.
+
+  @param[in] Hash    The hash so far.
+  @param[in] String  The string.
+
+  @return The updated hash.
+**/
+UINT64
+HashString (
+  UINT64       Hash,
+  CONST CHAR8* String
+  )
+{
+  return HashText (Hash, String, (String != NULL) ? AsciiStrLen (String) : 0);
+}
+
+/**
+  Mark a tag's hash and the hashes of every tag above it as out of date.
+  A tag with an out of date hash always has out of date ancestors, so the walk
+  stops at the first one that is already marked.
+
+  @param[in] Tag  The tag that changed.
+**/
+VOID
+DriverXmlInvalidateHash (
+  DRIVER_XML_TAG* Tag
+  )
+{
+  while (Tag != NULL && (Tag->Flags & DRIVER_XML_TAG_HASH_VALID) != 0) {
+    Tag->Flags &= ~DRIVER_XML_TAG_HASH_VALID;
+    Tag = Tag->Parent;
+  }
+}
+
+/**
+  Compute the hashes of a tag whose child tags already have valid hashes.
+  LocalHash covers the name, the attributes and the char data and PIs held directly by the tag.
+  Attributes are added together so their order does not matter. Hash covers LocalHash and
+  every child in order, with child tags represented by their own Hash.
+
+  @param[in] Tag  The tag to hash.
+**/
+VOID
+UpdateTagHash (
+  DRIVER_XML_TAG* Tag
+  )
+{
+  DRIVER_XML_DATA_HEADER*            Child;
+  DRIVER_XML_ATTRIBUTE*              Attribute;
+  DRIVER_XML_CHAR_DATA*              CharData;
+  DRIVER_XML_PROCESSING_INSTRUCTION* Pi;
+  UINT64                             AttributeSum;
+  UINT64                             LocalHash;
+  UINT64                             Hash;
+
+  if ((Tag->Flags & DRIVER_XML_TAG_HASH_VALID) != 0) {
+    return;
+  }
+  AttributeSum = 0;
+  if (Tag->TagAttributes.ItemCount > 0) {
+    Child = (DRIVER_XML_DATA_HEADER*)&Tag->TagAttributes.ListStart;
+    while (GetNextXmlElement (&Tag->TagAttributes, Child, &Child) == EFI_SUCCESS) {
+      Attribute = (DRIVER_XML_ATTRIBUTE*)Child;
+      AttributeSum += HashString (HashString (FNV64_OFFSET_BASIS, Attribute->AttributeName), Attribute->AttributeData);
+    }
+  }
+  LocalHash = HashString (FNV64_OFFSET_BASIS, Tag->TagName);
+  LocalHash = HashValue (LocalHash, AttributeSum);
+  Hash = FNV64_OFFSET_BASIS;
+  if (Tag->TagChildren.ItemCount > 0) {
+    Child = (DRIVER_XML_DATA_HEADER*)&Tag->TagChildren.ListStart;
+    while (GetNextXmlElement (&Tag->TagChildren, Child, &Child) == EFI_SUCCESS) {
+      switch (Child->XmlDataType) {
+      case XmlTag:
+      case XmlEmptyTag:
+        ASSERT ((((DRIVER_XML_TAG*)Child)->Flags & DRIVER_XML_TAG_HASH_VALID) != 0);
+        Hash = HashValue (HashValue (Hash, HASH_KIND_TAG), ((DRIVER_XML_TAG*)Child)->Hash);
+        break;
+      case XmlChar:
+        CharData = (DRIVER_XML_CHAR_DATA*)Child;
+        LocalHash = HashText (HashValue (LocalHash, HASH_KIND_CHAR_DATA), CharData->CharData, CharData->DataSize);
+        Hash = HashText (HashValue (Hash, HASH_KIND_CHAR_DATA), CharData->CharData, CharData->DataSize);
+        break;
+      case XmlPi:
+        Pi = (DRIVER_XML_PROCESSING_INSTRUCTION*)Child;
+        LocalHash = HashString (HashString (HashValue (LocalHash, HASH_KIND_PI), Pi->PiTargetName), Pi->PiTargetData);
+        Hash = HashString (HashString (HashValue (Hash, HASH_KIND_PI), Pi->PiTargetName), Pi->PiTargetData);
+        break;
+      default:
+        break;
+      }
+    }
+  }
+  Tag->LocalHash = LocalHash;
+  Tag->Hash = HashValue (Hash, LocalHash);
+  Tag->Flags |= DRIVER_XML_TAG_HASH_VALID;
+}
+
+/**
+  Hash walk handler run before a tag's children. A tag with a valid hash has valid
+  hashes all the way down, so its children are skipped.
+
+  @param[in] Element  The tag.
+  @param[in] Depth    Not used.
+  @param[in] Context  Not used.
+
+  @retval EFI_SUCCESS            The tag's children need hashing.
+  @retval DRIVER_XML_VISIT_SKIP  The tag is already hashed.
+**/
+EFI_STATUS
+SkipHashedTag (
+  DRIVER_XML_DATA_HEADER* Element,
+  UINTN                   Depth,
+  VOID*                   Context
+  )
+{
+  if ((((DRIVER_XML_TAG*)Element)->Flags & DRIVER_XML_TAG_HASH_VALID) != 0) {
+    return DRIVER_XML_VISIT_SKIP;
+  }
+  return EFI_SUCCESS;
+}
+
+/**
+  Hash walk handler run after a tag's children, which have all been hashed by then.
+
+  @param[in] Element  The tag.
+  @param[in] Depth    Not used.
+  @param[in] Context  Not used.
+
+  @retval EFI_SUCCESS  The tag has a valid hash.
+**/
+EFI_STATUS
+HashTagNode (
+  DRIVER_XML_DATA_HEADER* Element,
+  UINTN                   Depth,
+  VOID*                   Context
+  )
+{
+  UpdateTagHash ((DRIVER_XML_TAG*)Element);
+  return EFI_SUCCESS;
+}
+
+//
+// Hashes the tags bottom up, each after everything below it.
+//
+CONST DRIVER_XML_VISITOR mXmlHasher = {
+  {
+    NULL,           // XmlNothing
+    SkipHashedTag,  // XmlEmptyTag
+    SkipHashedTag,  // XmlTag
+    NULL,           // XmlCloseTag
+    NULL,           // XmlAttribute
+    NULL,           // XmlChar
+    NULL,           // XmlPi
+    NULL,           // XmlDecl
+    NULL            // XmlComment
+  },
+  {
+    NULL,           // XmlNothing
+    HashTagNode,    // XmlEmptyTag
+    HashTagNode,    // XmlTag
+    NULL,           // XmlCloseTag
+    NULL,           // XmlAttribute
+    NULL,           // XmlChar
+    NULL,           // XmlPi
+    NULL,           // XmlDecl
+    NULL            // XmlComment
+  }
+};
+
+/**
+  Bring the structural hashes of a tree up to date.
+  The first call hashes every tag in one bottom up pass. After that only the tags changed
+  through the library's editing functions (or passed to DriverXmlMarkModified) and their
+  ancestors are hashed again.
+
+  @param[in] XmlTree  The root of the tree or of a branch.
+
+  @retval EFI_SUCCESS            Every tag in the tree has a valid hash.
+  @retval EFI_INVALID_PARAMETER  XmlTree is NULL or not a tag.
+**/
+EFI_STATUS
+DriverXmlUpdateHashes (
+  DRIVER_XML_DATA_HEADER* XmlTree
+  )
+{
+  if (XmlTree == NULL || (XmlTree->XmlDataType != XmlTag && XmlTree->XmlDataType != XmlEmptyTag)) {
+    return EFI_INVALID_PARAMETER;
+  }
+  return DriverXmlWalkElement (&mXmlHasher, XmlTree, 0, NULL);
+}
+
+/**
+  Compare two trees or branches by their structural hashes.
+  Their hashes are brought up to date first, so on trees that are already hashed this is constant time.
+  Equal hashes are taken to mean equal trees. With 64 bit hashes a false match is very unlikely
+  but the answer is not a byte for byte comparison.
+
+  @param[in] First   The first tree.
+  @param[in] Second  The second tree.
+
+  @retval TRUE   The trees have the same names, attributes, text and shape.
+  @retval FALSE  The trees differ or a pointer is not a tag.
+**/
+BOOLEAN
+DriverXmlTreesEqual (
+  DRIVER_XML_DATA_HEADER* First,
+  DRIVER_XML_DATA_HEADER* Second
+  )
+{
+  if (EFI_ERROR (DriverXmlUpdateHashes (First)) || EFI_ERROR (DriverXmlUpdateHashes (Second))) {
+    return FALSE;
+  }
+  return (BOOLEAN)(((DRIVER_XML_TAG*)First)->Hash == ((DRIVER_XML_TAG*)Second)->Hash);
+}
+
+/**
+  Get the next child of a tag that is a tag.
+
+  @param[in] Tag      The parent.
+  @param[in] Current  The child to start after, or NULL for the first.
+
+  @return The next child tag, or NULL at the end of the list.
+**/
+DRIVER_XML_TAG*
+GetNextChildTag (
+  DRIVER_XML_TAG* Tag,
+  DRIVER_XML_TAG* Current
+  )
+{
+  DRIVER_XML_DATA_HEADER* Child;
+
+  if (Tag->TagChildren.ItemCount == 0) {
+    return NULL;
+  }
+  Child = (Current != NULL) ? (DRIVER_XML_DATA_HEADER*)Current : (DRIVER_XML_DATA_HEADER*)&Tag->TagChildren.ListStart;
+  while (GetNextXmlElement (&Tag->TagChildren, Child, &Child) == EFI_SUCCESS) {
+    if (Child->XmlDataType == XmlTag || Child->XmlDataType == XmlEmptyTag) {
+      return (DRIVER_XML_TAG*)Child;
+    }
+  }
+  return NULL;
+}
+
+/**
+  Check whether a sibling with a given hash follows a tag.
+
+  @param[in] Parent  The tag holding the siblings.
+  @param[in] Start   The first sibling to check.
+  @param[in] Hash    The hash to look for.
+
+  @retval TRUE   A matching sibling was found.
+  @retval FALSE  No sibling from Start on has the hash.
+**/
+BOOLEAN
+IsHashInSiblings (
+  DRIVER_XML_TAG* Parent,
+  DRIVER_XML_TAG* Start,
+  UINT64          Hash
+  )
+{
+  for (; Start != NULL; Start = GetNextChildTag (Parent, Start)) {
+    if (Start->Hash == Hash) {
+      return TRUE;
+    }
+  }
+  return FALSE;
+}
+
+//
+// A pair of matching tags the diff is inside, and the next child tags of each still to match.
+//
+typedef struct _XML_DIFF_FRAME {
+  DRIVER_XML_TAG* Old;
+  DRIVER_XML_TAG* New;
+  DRIVER_XML_TAG* OldChild;
+  DRIVER_XML_TAG* NewChild;
+} XML_DIFF_FRAME;
+
+//
+// The pairs from the starting tags down to the one being compared, so the diff keeps its
+// place without recursing.
+//
+typedef struct _XML_DIFF_STACK {
+  XML_DIFF_FRAME* Frames;
+  UINTN           Count;
+  UINTN           Slots;
+} XML_DIFF_STACK;
+
+/**
+  Start comparing a pair of matching tags. A pair with equal hashes is the same all the way
+  down so nothing is pushed for it.
+
+  @param[in out] Stack     The diff stack.
+  @param[in]     Old       The tag in the old tree.
+  @param[in]     New       The matching tag in the new tree.
+  @param[in]     Callback  Called for each difference.
+  @param[in]     Context   Passed to Callback.
+
+  @retval EFI_SUCCESS           The pair was compared or pushed.
+  @retval EFI_OUT_OF_RESOURCES  The stack could not be grown.
+**/
+EFI_STATUS
+PushDiffFrame (
+  XML_DIFF_STACK*          Stack,
+  DRIVER_XML_TAG*          Old,
+  DRIVER_XML_TAG*          New,
+  DRIVER_XML_DIFF_CALLBACK Callback,
+  VOID*                    Context
+  )
+{
+  XML_DIFF_FRAME* NewFrames;
+  XML_DIFF_FRAME* Frame;
+  UINTN           NewSlots;
+
+  if (Old->Hash == New->Hash) {
+    return EFI_SUCCESS;
+  }
+  if (Old->LocalHash != New->LocalHash) {
+    Callback (XmlDiffChanged, Old, New, Context);
+  }
+  if (Stack->Count == Stack->Slots) {
+    NewSlots = (Stack->Slots == 0) ? DIFF_STACK_INITIAL_FRAMES : Stack->Slots * 2;
+    NewFrames = DriverXmlReallocatePool (XmlAllocScratch, Stack->Frames, NewSlots * sizeof (XML_DIFF_FRAME));
+    if (NewFrames == NULL) {
+      return EFI_OUT_OF_RESOURCES;
+    }
+    Stack->Frames = NewFrames;
+    Stack->Slots = NewSlots;
+  }
+  Frame = &Stack->Frames[Stack->Count++];
+  Frame->Old = Old;
+  Frame->New = New;
+  Frame->OldChild = GetNextChildTag (Old, NULL);
+  Frame->NewChild = GetNextChildTag (New, NULL);
+  return EFI_SUCCESS;
+}
+
+/**
+  Worker for DriverXmlDiffTrees. Branches with equal hashes are skipped without being looked at.
+
+  Child tags are matched in order. A pair with equal hashes is the same, and a pair with the same
+  name is the same element with changes inside it. Otherwise whichever side has its next tag
+  show up later on the other side is taken to have had tags added or removed in front of it.
+  A matched pair is compared all the way down before the next pair of siblings.
+
+  @param[in] Old       The tag in the old tree.
+  @param[in] New       The matching tag in the new tree.
+  @param[in] Callback  Called for each difference.
+  @param[in] Context   Passed to Callback.
+
+  @retval EFI_SUCCESS           The differences were reported.
+  @retval EFI_OUT_OF_RESOURCES  There was not enough memory for the diff stack.
+**/
+EFI_STATUS
+DiffTags (
+  DRIVER_XML_TAG*          Old,
+  DRIVER_XML_TAG*          New,
+  DRIVER_XML_DIFF_CALLBACK Callback,
+  VOID*                    Context
+  )
+{
+  XML_DIFF_STACK  Stack;
+  XML_DIFF_FRAME* Frame;
+  DRIVER_XML_TAG* OldChild;
+  DRIVER_XML_TAG* NewChild;
+  EFI_STATUS      Status;
+
+  Stack.Frames = NULL;
+  Stack.Count = 0;
+  Stack.Slots = 0;
+  Status = PushDiffFrame (&Stack, Old, New, Callback, Context);
+  while (!EFI_ERROR (Status) && Stack.Count > 0) {
+    Frame = &Stack.Frames[Stack.Count - 1];
+    OldChild = Frame->OldChild;
+    NewChild = Frame->NewChild;
+    if (OldChild != NULL && NewChild != NULL) {
+      if (OldChild->Hash == NewChild->Hash || AsciiStrCmp (OldChild->TagName, NewChild->TagName) == 0) {
+        //
+        // Move this level on first; the push may move the frames.
+        //
+        Frame->OldChild = GetNextChildTag (Frame->Old, OldChild);
+        Frame->NewChild = GetNextChildTag (Frame->New, NewChild);
+        Status = PushDiffFrame (&Stack, OldChild, NewChild, Callback, Context);
+      } else if (IsHashInSiblings (Frame->New, NewChild, OldChild->Hash)) {
+        Callback (XmlDiffAdded, NULL, NewChild, Context);
+        Frame->NewChild = GetNextChildTag (Frame->New, NewChild);
+      } else {
+        Callback (XmlDiffRemoved, OldChild, NULL, Context);
+        Frame->OldChild = GetNextChildTag (Frame->Old, OldChild);
+      }
+      continue;
+    }
+    for (; OldChild != NULL; OldChild = GetNextChildTag (Frame->Old, OldChild)) {
+      Callback (XmlDiffRemoved, OldChild, NULL, Context);
+    }
+    for (; NewChild != NULL; NewChild = GetNextChildTag (Frame->New, NewChild)) {
+      Callback (XmlDiffAdded, NULL, NewChild, Context);
+    }
+    Stack.Count--;
+  }
+  DriverXmlFreePool (Stack.Frames);
+  return Status;
+}
+
+/**
+  Report the differences between two versions of a tree.
+  Hashes are brought up to date first. Matching branches are skipped by comparing their
+  hashes, so the work done follows the size of the differences rather than the size of the trees.
+
+  The callback gets XmlDiffChanged for a tag whose name, attributes, char data or PIs changed
+  (its child tags are reported separately), XmlDiffAdded for a tag only in the new tree and
+  XmlDiffRemoved for a tag only in the old tree. Nothing below an added or removed tag is reported.
+
+  @param[in] OldTree   The old version.
+  @param[in] NewTree   The new version.
+  @param[in] Callback  Called for each difference.
+  @param[in] Context   Passed to Callback.
+
+  @retval EFI_SUCCESS            The differences were reported.
+  @retval EFI_INVALID_PARAMETER  A tree is not a tag or Callback is NULL.
+  @retval EFI_OUT_OF_RESOURCES   There was not enough memory to keep track of the depth.
+**/
+EFI_STATUS
+DriverXmlDiffTrees (
+  DRIVER_XML_DATA_HEADER*  OldTree,
+  DRIVER_XML_DATA_HEADER*  NewTree,
+  DRIVER_XML_DIFF_CALLBACK Callback,
+  VOID*                    Context
+  )
+{
+  if (Callback == NULL
+      || EFI_ERROR (DriverXmlUpdateHashes (OldTree)) 
+      || EFI_ERROR (DriverXmlUpdateHashes (NewTree))) 
+  {
+    return EFI_INVALID_PARAMETER;
+  }
+  return DiffTags ((DRIVER_XML_TAG*)OldTree, (DRIVER_XML_TAG*)NewTree, Callback, Context);
+}
+
+//
+// An open addressed table of tags keyed by their hash, for finding repeated branches.
+//
+typedef struct _XML_DUPLICATE_TABLE {
+  DRIVER_XML_TAG** Slots;
+  UINTN            SlotCount;
+  UINTN            Used;
+} XML_DUPLICATE_TABLE;
+
+/**
+  Find the slot for a hash, which holds either a tag with that hash or NULL.
+
+  @param[in] Table  The table.
+  @param[in] Hash   The hash to look for.
+
+  @return The slot.
+**/
+DRIVER_XML_TAG**
+FindDuplicateSlot (
+  XML_DUPLICATE_TABLE* Table,
+  UINT64               Hash
+  )
+{
+  UINTN Index;
+
+  Index = (UINTN)Hash & (Table->SlotCount - 1);
+  while (Table->Slots[Index] != NULL && Table->Slots[Index]->Hash != Hash) {
+    Index = (Index + 1) & (Table->SlotCount - 1);
+  }
+  return &Table->Slots[Index];
+}
+
+/**
+  Double the size of the duplicate table.
+
+  @param[in out] Table  The table.
+
+  @retval EFI_SUCCESS           The table was grown.
+  @retval EFI_OUT_OF_RESOURCES  There was not enough memory. The table is unchanged.
+**/
+EFI_STATUS
+GrowDuplicateTable (
+  XML_DUPLICATE_TABLE* Table
+  )
+{
+  DRIVER_XML_TAG** OldSlots;
+  UINTN            OldCount;
+  UINTN            Index;
+
+  OldSlots = Table->Slots;
+  OldCount = Table->SlotCount;
+  Table->Slots = DriverXmlAllocatePool (XmlAllocTable, OldCount * 2 * sizeof (DRIVER_XML_TAG*));
+  if (Table->Slots == NULL) {
+    Table->Slots = OldSlots;
+    return EFI_OUT_OF_RESOURCES;
+  }
+  Table->SlotCount = OldCount * 2;
+  for (Index = 0; Index < OldCount; Index++) {
+    if (OldSlots[Index] != NULL) {
+      *FindDuplicateSlot (Table, OldSlots[Index]->Hash) = OldSlots[Index];
+    }
+  }
+  DriverXmlFreePool (OldSlots);
+  return EFI_SUCCESS;
+}
+
+//
+// The state of a search for repeated branches.
+//
+typedef struct _XML_DUPLICATE_SEARCH {
+  XML_DUPLICATE_TABLE      Table;
+  DRIVER_XML_DIFF_CALLBACK Callback;
+  VOID*                    Context;
+} XML_DUPLICATE_SEARCH;
+
+/**
+  Duplicate search walk handler for a tag. The first tag with each hash goes in the table
+  and the ones after it are reported.
+
+  @param[in] Element  The tag.
+  @param[in] Depth    Not used.
+  @param[in] Context  The XML_DUPLICATE_SEARCH.
+
+  @retval EFI_SUCCESS            The tag was added to the table.
+  @retval DRIVER_XML_VISIT_SKIP  The tag repeats an earlier one.
+  @retval EFI_OUT_OF_RESOURCES   The table could not be grown.
+**/
+EFI_STATUS
+FindDuplicateTag (
+  DRIVER_XML_DATA_HEADER* Element,
+  UINTN                   Depth,
+  VOID*                   Context
+  )
+{
+  XML_DUPLICATE_SEARCH* Search;
+  DRIVER_XML_TAG*       Tag;
+  DRIVER_XML_TAG**      Slot;
+
+  Search = Context;
+  Tag = (DRIVER_XML_TAG*)Element;
+  Slot = FindDuplicateSlot (&Search->Table, Tag->Hash);
+  if (*Slot != NULL) {
+    //
+    // Everything below a repeat is repeated too, so it is not searched.
+    //
+    Search->Callback (XmlDiffDuplicate, *Slot, Tag, Search->Context);
+    return DRIVER_XML_VISIT_SKIP;
+  }
+  *Slot = Tag;
+  Search->Table.Used++;
+  if (Search->Table.Used * 4 >= Search->Table.SlotCount * 3) {
+    return GrowDuplicateTable (&Search->Table);
+  }
+  return EFI_SUCCESS;
+}
+
+//
+// Visits the tags in document order, so the first copy of a branch is always the one kept.
+//
+CONST DRIVER_XML_VISITOR mXmlDuplicateFinder = {
+  {
+    NULL,              // XmlNothing
+    FindDuplicateTag,  // XmlEmptyTag
+    FindDuplicateTag,  // XmlTag
+    NULL,              // XmlCloseTag
+    NULL,              // XmlAttribute
+    NULL,              // XmlChar
+    NULL,              // XmlPi
+    NULL,              // XmlDecl
+    NULL               // XmlComment
+  },
+  {
+    NULL,              // XmlNothing
+    NULL,              // XmlEmptyTag
+    NULL,              // XmlTag
+    NULL,              // XmlCloseTag
+    NULL,              // XmlAttribute
+    NULL,              // XmlChar
+    NULL,              // XmlPi
+    NULL,              // XmlDecl
+    NULL               // XmlComment
+  }
+};
+
+/**
+  Find branches of a tree that are repeated, so a caller can share or store them once.
+  The callback gets XmlDiffDuplicate with the first copy as OldTag and the repeat as NewTag.
+  Branches inside a repeat are not reported.
+
+  @param[in] XmlTree   The root of the tree.
+  @param[in] Callback  Called for each repeat.
+  @param[in] Context   Passed to Callback.
+
+  @retval EFI_SUCCESS            The tree was searched.
+  @retval EFI_INVALID_PARAMETER  XmlTree is not a tag or Callback is NULL.
+  @retval EFI_OUT_OF_RESOURCES   There was not enough memory for the table of hashes.
+**/
+EFI_STATUS
+DriverXmlFindDuplicateSubtrees (
+  DRIVER_XML_DATA_HEADER*  XmlTree,
+  DRIVER_XML_DIFF_CALLBACK Callback,
+  VOID*                    Context
+  )
+{
+  XML_DUPLICATE_SEARCH Search;
+  EFI_STATUS           Status;
+
+  if (Callback == NULL || EFI_ERROR (DriverXmlUpdateHashes (XmlTree))) {
+    return EFI_INVALID_PARAMETER;
+  }
+  Search.Table.SlotCount = DUPLICATE_TABLE_INITIAL_SLOTS;
+  Search.Table.Used = 0;
+  Search.Table.Slots = DriverXmlAllocatePool (XmlAllocTable, Search.Table.SlotCount * sizeof (DRIVER_XML_TAG*));
+  if (Search.Table.Slots == NULL) {
+    return EFI_OUT_OF_RESOURCES;
+  }
+  Search.Callback = Callback;
+  Search.Context = Context;
+  //
+  // The root is not compared with anything, only the branches below it.
+  //
+  Status = DriverXmlWalkBranch (&mXmlDuplicateFinder, &((DRIVER_XML_TAG*)XmlTree)->TagChildren, 0, &Search);
+  DriverXmlFreePool (Search.Table.Slots);
+  return Status;
+}
@@ -0,0 +1,613 @@
+/** @file
+  Conversion of XML to JSON.
+  Trees, or binary tokens without building a tree, are written as JSON through an output
+  document or sink in one pass, for tools that would rather read JSON than XML.
+  
+  Copyright (c) 2016, Matthew Lazarowitz. All rights reserved.<BR>
+  This program and the accompanying materials are licensed and made available under
+  the terms and conditions of the MIT License that accompanies this distribution.
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+**/
+#include <uefi.h>
+#include <Library/DebugLib.h>
+#include <Library/BaseLib.h>
+#include <Library/UefiBootServicesTableLib.h>
+#include <DriverXmlStringHandlers.h>
+
+//
+// The state of a JSON conversion. NeedComma is set once the array being written has an
+// item, so the next item is separated from it. Nothing else about the open elements is
+// kept, which is what lets a document of any size or depth be converted in constant memory.
+//
+typedef struct _XML_JSON_WRITER {
+  XML_DOCUMENT* OutputDocument;
+  UINT32        Flags;
+  BOOLEAN       NeedComma;
+} XML_JSON_WRITER;
+
+/**
+  Write one character of a JSON string, escaped if JSON needs it.
+
+  @param[in] Writer     The writer state.
+  @param[in] Character  The character.
+
+  @retval EFI_SUCCESS  The character was written.
+  @retval other        The error from the output.
+**/
+EFI_STATUS
+WriteJsonChar (
+  XML_JSON_WRITER* Writer,
+  CHAR8            Character
+  )
+{
+  CHAR8 Escaped[6];
+
+  switch (Character) {
+  case '\"':
+    return BytesToDocument ("\\\"", 2, Writer->OutputDocument);
+  case '\\':
+    return BytesToDocument ("\\\\", 2, Writer->OutputDocument);
+  case '\n':
+    return BytesToDocument ("\\n", 2, Writer->OutputDocument);
+  case '\r':
+    return BytesToDocument ("\\r", 2, Writer->OutputDocument);
+  case '\t':
+    return BytesToDocument ("\\t", 2, Writer->OutputDocument);
+  default:
+    break;
+  }
+  if ((UINT8)Character >= 0x20) {
+    return BytesToDocument (&Character, 1, Writer->OutputDocument);
+  }
+  Escaped[0] = '\\';
+  Escaped[1] = 'u';
+  Escaped[2] = '0';
+  Escaped[3] = '0';
+  Escaped[4] = "0123456789abcdef"[(Character >> 4) & 0xF];
+  Escaped[5] = "0123456789abcdef"[Character & 0xF];
+  return BytesToDocument (Escaped, sizeof (Escaped), Writer->OutputDocument);
+}
+
+/**
+  Write text as a JSON string, with the quotes.
+  Runs of ordinary characters are copied to the output directly and only the characters
+  that need escaping are handled one at a time. Bytes from 0x80 up are passed through,
+  so UTF-8 text stays UTF-8.
+
+  With DRIVER_XML_JSON_RAW_TEXT character references and the predefined entities in
+  ReplaceReferences text are replaced with the characters they stand for.
+
+  @param[in] Writer             The writer state.
+  @param[in] Text               The text.
+  @param[in] Length             The number of characters in Text.
+  @param[in] ReplaceReferences  TRUE for raw char data and attribute values, FALSE for names
+                                and literal text.
+
+  @retval EFI_SUCCESS       The string was written.
+  @retval EFI_UNSUPPORTED   Raw text refers to an entity other than the predefined ones.
+  @retval EFI_DEVICE_ERROR  Raw text holds a malformed reference.
+  @retval other             The error from the output.
+**/
+EFI_STATUS
+WriteJsonString (
+  XML_JSON_WRITER* Writer,
+  CONST CHAR8*     Text,
+  UINTN            Length,
+  BOOLEAN          ReplaceReferences
+  )
+{
+  CONST CHAR8* Run;
+  CONST CHAR8* Ptr;
+  CONST CHAR8* End;
+  CHAR8        Character;
+  CHAR8        Encoded[4];
+  UINTN        RefLength;
+  UINT32       CodePoint;
+  EFI_STATUS   Status;
+
+  if ((Writer->Flags & DRIVER_XML_JSON_RAW_TEXT) == 0) {
+    ReplaceReferences = FALSE;
+  }
+  Status = BytesToDocument ("\"", 1, Writer->OutputDocument);
+  Run = Text;
+  Ptr = Text;
+  End = Text + Length;
+  while (!EFI_ERROR (Status) && Ptr < End) {
+    Character = *Ptr;
+    if ((UINT8)Character >= 0x20 && Character != '\"' && Character != '\\'
+        && (Character != '&' || !ReplaceReferences))
+    {
+      Ptr++;
+      continue;
+    }
+    Status = BytesToDocument (Run, Ptr - Run, Writer->OutputDocument);
+    if (EFI_ERROR (Status)) {
+      return Status;
+    }
+    if (Character == '&') {
+      Status = GetReferenceLength (Ptr + 1, End, &RefLength);
+      if (EFI_ERROR (Status)) {
+        DEBUG ((DEBUG_ERROR, "Malformed reference in the tree\n"));
+        return Status;
+      }
+      if (Ptr[1] == '#') {
+        Status = ParseCharReference (Ptr + 1, RefLength, &CodePoint);
+        if (EFI_ERROR (Status)) {
+          return Status;
+        }
+        if (CodePoint < 0x80) {
+          Status = WriteJsonChar (Writer, (CHAR8)CodePoint);
+        } else {
+          Status = BytesToDocument (Encoded, DriverXmlEncodeUtf8 (CodePoint, Encoded), Writer->OutputDocument);
+        }
+      } else if (GetPredefinedEntity (Ptr + 1, RefLength, &Character)) {
+        Status = WriteJsonChar (Writer, Character);
+      } else {
+        DEBUG ((DEBUG_ERROR, "Entity %.*a was not expanded by the parse\n", RefLength, Ptr + 1));
+        return EFI_UNSUPPORTED;
+      }
+      Ptr += RefLength + 2;
+    } else {
+      Status = WriteJsonChar (Writer, Character);
+      Ptr++;
+    }
+    Run = Ptr;
+  }
+  if (!EFI_ERROR (Status)) {
+    Status = BytesToDocument (Run, End - Run, Writer->OutputDocument);
+  }
+  if (!EFI_ERROR (Status)) {
+    Status = BytesToDocument ("\"", 1, Writer->OutputDocument);
+  }
+  return Status;
+}
+
+/**
+  Begin the array for an element and write its name. The attributes, if any, come next.
+
+  @param[in] Writer  The writer state.
+  @param[in] Name    The element name.
+  @param[in] Length  The number of characters in Name.
+
+  @retval EFI_SUCCESS  The element was begun.
+  @retval other        The error from the output.
+**/
+EFI_STATUS
+WriteJsonElementStart (
+  XML_JSON_WRITER* Writer,
+  CONST CHAR8*     Name,
+  UINTN            Length
+  )
+{
+  EFI_STATUS Status;
+
+  Status = EFI_SUCCESS;
+  if (Writer->NeedComma) {
+    Status = BytesToDocument (",", 1, Writer->OutputDocument);
+  }
+  if (!EFI_ERROR (Status)) {
+    Status = BytesToDocument ("[", 1, Writer->OutputDocument);
+  }
+  if (!EFI_ERROR (Status)) {
+    Status = WriteJsonString (Writer, Name, Length, FALSE);
+  }
+  Writer->NeedComma = TRUE;
+  return Status;
+}
+
+/**
+  Write one member of the attribute object of the element just begun.
+
+  @param[in] Writer       The writer state.
+  @param[in] Name         The attribute name.
+  @param[in] NameLength   The number of characters in Name.
+  @param[in] Value        The attribute value.
+  @param[in] ValueLength  The number of characters in Value.
+  @param[in] Raw          TRUE when Value still holds its references as written.
+  @param[in] First        TRUE for the element's first attribute, which opens the object.
+
+  @retval EFI_SUCCESS  The attribute was written.
+  @retval other        The error from WriteJsonString or the output.
+**/
+EFI_STATUS
+WriteJsonAttribute (
+  XML_JSON_WRITER* Writer,
+  CONST CHAR8*     Name,
+  UINTN            NameLength,
+  CONST CHAR8*     Value,
+  UINTN            ValueLength,
+  BOOLEAN          Raw,
+  BOOLEAN          First
+  )
+{
+  EFI_STATUS Status;
+
+  Status = BytesToDocument (First ? ",{" : ",", First ? 2 : 1, Writer->OutputDocument);
+  if (!EFI_ERROR (Status)) {
+    Status = WriteJsonString (Writer, Name, NameLength, FALSE);
+  }
+  if (!EFI_ERROR (Status)) {
+    Status = BytesToDocument (":", 1, Writer->OutputDocument);
+  }
+  if (!EFI_ERROR (Status)) {
+    Status = WriteJsonString (Writer, Value, ValueLength, Raw);
+  }
+  return Status;
+}
+
+/**
+  Write char data as a string item of the open element.
+
+  @param[in] Writer  The writer state.
+  @param[in] Text    The text.
+  @param[in] Length  The number of characters in Text.
+  @param[in] Raw     TRUE when Text still holds its references as written.
+
+  @retval EFI_SUCCESS  The text was written.
+  @retval other        The error from WriteJsonString or the output.
+**/
+EFI_STATUS
+WriteJsonText (
+  XML_JSON_WRITER* Writer,
+  CONST CHAR8*     Text,
+  UINTN            Length,
+  BOOLEAN          Raw
+  )
+{
+  EFI_STATUS Status;
+
+  Status = EFI_SUCCESS;
+  if (Writer->NeedComma) {
+    Status = BytesToDocument (",", 1, Writer->OutputDocument);
+  }
+  if (!EFI_ERROR (Status)) {
+    Status = WriteJsonString (Writer, Text, Length, Raw);
+  }
+  Writer->NeedComma = TRUE;
+  return Status;
+}
+
+/**
+  Close the array of the innermost open element.
+
+  @param[in] Writer  The writer state.
+
+  @retval EFI_SUCCESS  The element was closed.
+  @retval other        The error from the output.
+**/
+EFI_STATUS
+WriteJsonElementEnd (
+  XML_JSON_WRITER* Writer
+  )
+{
+  Writer->NeedComma = TRUE;
+  return BytesToDocument ("]", 1, Writer->OutputDocument);
+}
+
+/**
+  JSON writer handler for start and empty tags. Writes the name and the attribute object.
+  An empty tag is closed straight away.
+
+  @param[in] Element  The tag.
+  @param[in] Depth    The depth of the tag in the walk. Not used.
+  @param[in] Context  The XML_JSON_WRITER.
+
+  @retval EFI_SUCCESS  The tag was written.
+  @retval other        An error from writing the strings or the output.
+**/
+EFI_STATUS
+WriteJsonStartTag (
+  DRIVER_XML_DATA_HEADER* Element,
+  UINTN                   Depth,
+  VOID*                   Context
+  )
+{
+  XML_JSON_WRITER*        Writer;
+  DRIVER_XML_TAG*         Tag;
+  DRIVER_XML_DATA_HEADER* LocalXmlData;
+  DRIVER_XML_ATTRIBUTE*   Attribute;
+  BOOLEAN                 First;
+  EFI_STATUS              Status;
+
+  Writer = (XML_JSON_WRITER*)Context;
+  Tag = (DRIVER_XML_TAG*)Element;
+  Status = WriteJsonElementStart (Writer, Tag->TagName, AsciiStrLen (Tag->TagName));
+  if (!EFI_ERROR (Status) && Tag->TagAttributes.ItemCount != 0) {
+    First = TRUE;
+    LocalXmlData = (DRIVER_XML_DATA_HEADER*)&Tag->TagAttributes.ListStart;
+    while (!EFI_ERROR (Status)
+           && GetNextXmlElement (&Tag->TagAttributes, LocalXmlData, &LocalXmlData) == EFI_SUCCESS)
+    {
+      Attribute = (DRIVER_XML_ATTRIBUTE*)LocalXmlData;
+      Status = WriteJsonAttribute (
+                 Writer,
+                 Attribute->AttributeName,
+                 AsciiStrLen (Attribute->AttributeName),
+                 (Attribute->AttributeData != NULL) ? Attribute->AttributeData : "",
+                 (Attribute->AttributeData != NULL) ? AsciiStrLen (Attribute->AttributeData) : 0,
+                 (BOOLEAN)((Attribute->Flags & DRIVER_XML_TEXT_RAW) != 0),
+                 First
+                 );
+      First = FALSE;
+    }
+    if (!EFI_ERROR (Status)) {
+      Status = BytesToDocument ("}", 1, Writer->OutputDocument);
+    }
+  }
+  if (!EFI_ERROR (Status) && Tag->XmlDataType == XmlEmptyTag) {
+    Status = WriteJsonElementEnd (Writer);
+  }
+  return Status;
+}
+
+/**
+  JSON writer handler for the end of a start tag's content.
+
+  @param[in] Element  The tag. Not used.
+  @param[in] Depth    The depth of the tag in the walk. Not used.
+  @param[in] Context  The XML_JSON_WRITER.
+
+  @retval EFI_SUCCESS  The element's array was closed.
+  @retval other        The error from the output.
+**/
+EFI_STATUS
+WriteJsonEndTag (
+  DRIVER_XML_DATA_HEADER* Element,
+  UINTN                   Depth,
+  VOID*                   Context
+  )
+{
+  return WriteJsonElementEnd ((XML_JSON_WRITER*)Context);
+}
+
+/**
+  JSON writer handler for char data.
+
+  @param[in] Element  The char data.
+  @param[in] Depth    The depth of the char data in the walk. Not used.
+  @param[in] Context  The XML_JSON_WRITER.
+
+  @retval EFI_SUCCESS  The text was written.
+  @retval other        An error from writing the string or the output.
+**/
+EFI_STATUS
+WriteJsonCharData (
+  DRIVER_XML_DATA_HEADER* Element,
+  UINTN                   Depth,
+  VOID*                   Context
+  )
+{
+  DRIVER_XML_CHAR_DATA* CharData;
+
+  CharData = (DRIVER_XML_CHAR_DATA*)Element;
+  return WriteJsonText (
+           (XML_JSON_WRITER*)Context,
+           CharData->CharData,
+           CharData->DataSize,
+           (BOOLEAN)((CharData->Flags & DRIVER_XML_TEXT_RAW) != 0)
+           );
+}
+
+CONST DRIVER_XML_VISITOR mXmlJsonWriter = {
+  {
+    NULL,                    // XmlNothing
+    WriteJsonStartTag,       // XmlEmptyTag
+    WriteJsonStartTag,       // XmlTag
+    NULL,                    // XmlCloseTag
+    NULL,                    // XmlAttribute
+    WriteJsonCharData,       // XmlChar
+    NULL,                    // XmlPi
+    NULL,                    // XmlDecl
+    NULL                     // XmlComment
+  },
+  {
+    NULL,                    // XmlNothing
+    NULL,                    // XmlEmptyTag
+    WriteJsonEndTag,         // XmlTag
+    NULL,                    // XmlCloseTag
+    NULL,                    // XmlAttribute
+    NULL,                    // XmlChar
+    NULL,                    // XmlPi
+    NULL,                    // XmlDecl
+    NULL                     // XmlComment
+  }
+};
+
+/**
+  Write a tree as JSON in the JsonML form. Each element is an array of its name, an object
+  holding its attributes if it has any, then its children in document order. Char data is a
+  string. Repeated children are simply repeated array items, so nothing has to be looked ahead
+  at and the order of mixed content is kept. Processing instructions are left out.
+
+  Given the root from the parser, the first element under it is written as the document.
+  Given any other tag, that element is written.
+
+  @param[in]     XmlTree         The root from the parser, or an element in the tree.
+  @param[in]     Flags           DRIVER_XML_JSON_ flags.
+  @param[in out] OutputDocument  Where the JSON goes, set up the same way as for PrintData.
+
+  @retval EFI_SUCCESS            The JSON was written.
+  @retval EFI_INVALID_PARAMETER  XmlTree or OutputDocument is NULL, or XmlTree is not a tag.
+  @retval EFI_NOT_FOUND          The root has no element under it.
+  @retval EFI_UNSUPPORTED        DRIVER_XML_JSON_RAW_TEXT is set and the text refers to a declared entity.
+  @retval EFI_DEVICE_ERROR       DRIVER_XML_JSON_RAW_TEXT is set and the text holds a malformed reference.
+  @retval other                  An error from the output.
+**/
+EFI_STATUS
+PrintDataJson (
+  DRIVER_XML_DATA_HEADER* XmlTree,
+  UINT32                  Flags,
+  XML_DOCUMENT*           OutputDocument
+  )
+{
+  XML_JSON_WRITER         Writer;
+  DRIVER_XML_TAG*         Root;
+  DRIVER_XML_DATA_HEADER* Child;
+
+  if (XmlTree == NULL || OutputDocument == NULL) {
+    return EFI_INVALID_PARAMETER;
+  }
+  if (XmlTree->XmlDataType != XmlTag && XmlTree->XmlDataType != XmlEmptyTag) {
+    return EFI_INVALID_PARAMETER;
+  }
+  Writer.OutputDocument = OutputDocument;
+  Writer.Flags = Flags;
+  Writer.NeedComma = FALSE;
+  Root = (DRIVER_XML_TAG*)XmlTree;
+  if (Root->Parent != NULL) {
+    return DriverXmlWalkElement (&mXmlJsonWriter, XmlTree, 0, &Writer);
+  }
+  if (Root->TagChildren.ItemCount != 0) {
+    Child = (DRIVER_XML_DATA_HEADER*)&Root->TagChildren.ListStart;
+    while (GetNextXmlElement (&Root->TagChildren, Child, &Child) == EFI_SUCCESS) {
+      if (Child->XmlDataType == XmlTag || Child->XmlDataType == XmlEmptyTag) {
+        return DriverXmlWalkElement (&mXmlJsonWriter, Child, 0, &Writer);
+      }
+    }
+  }
+  return EFI_NOT_FOUND;
+}
+
+/**
+  Write the element in a buffer of binary tokens as JSON, the same as PrintDataJson writes
+  the tree they would decode to, without building the tree. The tokens are read in one pass
+  and the only memory used is the list of names, so a large inventory costs no more than a
+  small one with the same element and attribute names.
+
+  @param[in]     Buffer          The tokens from DriverXmlEncodeBinary.
+  @param[in]     Size            The size of Buffer.
+  @param[in]     Flags           DRIVER_XML_JSON_ flags.
+  @param[in out] OutputDocument  Where the JSON goes, set up the same way as for PrintData.
+
+  @retval EFI_SUCCESS            The JSON was written.
+  @retval EFI_INVALID_PARAMETER  Buffer or OutputDocument is NULL.
+  @retval EFI_UNSUPPORTED        Buffer does not start with the signature and a known version,
+                                 or raw text refers to a declared entity.
+  @retval EFI_NOT_FOUND          The tokens hold no element.
+  @retval EFI_END_OF_FILE        The tokens end inside a token or an element.
+  @retval EFI_DEVICE_ERROR       A token or a reference in raw text is malformed.
+  @retval EFI_OUT_OF_RESOURCES   The name list could not be grown.
+  @retval other                  An error from the output.
+**/
+EFI_STATUS
+DriverXmlBinaryToJson (
+  CONST VOID*   Buffer,
+  UINTN         Size,
+  UINT32        Flags,
+  XML_DOCUMENT* OutputDocument
+  )
+{
+  XML_JSON_WRITER    Writer;
+  XML_BINARY_DECODER Decoder;
+  CONST CHAR8*       Name;
+  UINTN              NameLength;
+  CONST CHAR8*       Value;
+  UINTN              ValueLength;
+  UINTN              AttributeCount;
+  UINTN              Index;
+  UINTN              Depth;
+  BOOLEAN            SeenElement;
+  UINT8              Token;
+  EFI_STATUS         Status;
+
+  if (Buffer == NULL || OutputDocument == NULL) {
+    return EFI_INVALID_PARAMETER;
+  }
+  Status = InitializeBinaryDecoder (&Decoder, Buffer, Size);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+  Writer.OutputDocument = OutputDocument;
+  Writer.Flags = Flags;
+  Writer.NeedComma = FALSE;
+  Depth = 0;
+  SeenElement = FALSE;
+  //
+  // Stop once the first top level element is done. Top level text and PIs are skipped.
+  //
+  while (!EFI_ERROR (Status) && Decoder.Next < Decoder.End && !(SeenElement && Depth == 0)) {
+    Token = *Decoder.Next++;
+    switch (Token) {
+    case DRIVER_XML_BINARY_START:
+    case DRIVER_XML_BINARY_EMPTY:
+      Status = ReadBinaryName (&Decoder, &Name, &NameLength);
+      if (!EFI_ERROR (Status)) {
+        Status = WriteJsonElementStart (&Writer, Name, NameLength);
+      }
+      if (!EFI_ERROR (Status)) {
+        Status = ReadBinaryNumber (&Decoder, &AttributeCount);
+      }
+      for (Index = 0; !EFI_ERROR (Status) && Index < AttributeCount; Index++) {
+        Status = ReadBinaryName (&Decoder, &Name, &NameLength);
+        if (!EFI_ERROR (Status)) {
+          Status = ReadBinaryString (&Decoder, &Value, &ValueLength);
+        }
+        if (!EFI_ERROR (Status)) {
+          Status = WriteJsonAttribute (&Writer, Name, NameLength, Value, ValueLength, TRUE, (BOOLEAN)(Index == 0));
+        }
+      }
+      if (!EFI_ERROR (Status) && AttributeCount != 0) {
+        Status = BytesToDocument ("}", 1, OutputDocument);
+      }
+      if (EFI_ERROR (Status)) {
+        break;
+      }
+      SeenElement = TRUE;
+      if (Token == DRIVER_XML_BINARY_START) {
+        Depth++;
+      } else {
+        Status = WriteJsonElementEnd (&Writer);
+      }
+      break;
+    case DRIVER_XML_BINARY_END:
+      if (Depth == 0) {
+        DEBUG ((DEBUG_ERROR, "Binary end token with no element open\n"));
+        Status = EFI_DEVICE_ERROR;
+        break;
+      }
+      Depth--;
+      Status = WriteJsonElementEnd (&Writer);
+      break;
+    case DRIVER_XML_BINARY_TEXT:
+      Status = ReadBinaryString (&Decoder, &Value, &ValueLength);
+      if (!EFI_ERROR (Status) && Depth != 0) {
+        Status = WriteJsonText (&Writer, Value, ValueLength, TRUE);
+      }
+      break;
+    case DRIVER_XML_BINARY_PI:
+      Status = ReadBinaryOptionalString (&Decoder, &Name, &NameLength);
+      if (!EFI_ERROR (Status)) {
+        Status = ReadBinaryOptionalString (&Decoder, &Value, &ValueLength);
+      }
+      break;
+    default:
+      DEBUG ((DEBUG_ERROR, "Unknown binary token %d\n", Token));
+      Status = EFI_DEVICE_ERROR;
+      break;
+    }
+  }
+  FreeBinaryDecoder (&Decoder);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+  if (Depth != 0) {
+    return EFI_END_OF_FILE;
+  }
+  return SeenElement ? EFI_SUCCESS : EFI_NOT_FOUND;
+}
@@ -0,0 +1,240 @@
+/** @file
+  Allocation accounting for DriverXmlLib.
+  Every allocation the library makes goes through here so the memory a tree costs,
+  the peak during a parse and the allocate-then-free churn can be measured.
+  
+  Copyright (c) 2016, Matthew Lazarowitz. All rights reserved.<BR>
+  This program and the accompanying materials are licensed and made available under
+  the terms and conditions of the MIT License that accompanies this distribution.
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+**/
+#include <Uefi.h>
+#include <Library/UefiBootServicesTableLib.h>
+#include <Library/BaseLib.h>
+#include <Library/MemoryAllocationLib.h>
+#include <Library/DebugLib.h>
+#include <DriverXmlStringHandlers.h>
+
+#define XML_POOL_SIGNATURE SIGNATURE_32 ('X', 'm', 'l', 'P')
+
+//
+// Placed in front of every allocation so a free knows the type and size to take back
+// out of the counters. The size of this keeps the caller's buffer 8 byte aligned.
+// Size is 64 bits wide so the header is the same 16 bytes on IA32 and X64.
+//
+typedef struct _XML_POOL_HEADER {
+  UINT32 Signature;
+  UINT32 Type;
+  UINT64 Size;
+} XML_POOL_HEADER;
+
+STATIC_ASSERT (sizeof (XML_POOL_HEADER) % 8 == 0, "XML_POOL_HEADER must keep pool buffers 8 byte aligned");
+
+DRIVER_XML_STATS mDriverXmlStats;
+
+/**
+  Count an allocation.
+
+  @param[in] Type  The type the memory is for.
+  @param[in] Size  The number of bytes allocated.
+**/
+VOID
+DriverXmlCountAllocation (
+  IN XML_ALLOC_TYPE Type,
+  IN UINTN          Size
+  )
+{
+  mDriverXmlStats.Types[Type].Allocations++;
+  mDriverXmlStats.Types[Type].CurrentBytes += Size;
+  mDriverXmlStats.Types[Type].TotalBytes += Size;
+  mDriverXmlStats.CurrentBytes += Size;
+  if (mDriverXmlStats.CurrentBytes > mDriverXmlStats.PeakBytes) {
+    mDriverXmlStats.PeakBytes = mDriverXmlStats.CurrentBytes;
+  }
+}
+
+/**
+  Count a free.
+
+  @param[in] Type  The type the memory was allocated as.
+  @param[in] Size  The number of bytes that were allocated.
+**/
+VOID
+DriverXmlCountFree (
+  IN XML_ALLOC_TYPE Type,
+  IN UINTN          Size
+  )
+{
+  mDriverXmlStats.Types[Type].Frees++;
+  mDriverXmlStats.Types[Type].CurrentBytes -= Size;
+  mDriverXmlStats.CurrentBytes -= Size;
+  //
+  // Only scratch memory is freed by the call that allocated it. Counting the frees from
+  // freeing a tree would just make this the total number of frees.
+  //
+  if (Type == XmlAllocScratch) {
+    mDriverXmlStats.TransientCount++;
+    mDriverXmlStats.TransientBytes += Size;
+  }
+}
+
+/**
+  Allocate zeroed memory for the library and count it.
+  Memory from here must be given back with DriverXmlFreePool.
+
+  @param[in] Type  What the memory is for.
+  @param[in] Size  The number of bytes to allocate.
+
+  @return The zeroed buffer or NULL if there was not enough memory.
+**/
+VOID*
+DriverXmlAllocatePool (
+  IN XML_ALLOC_TYPE Type,
+  IN UINTN          Size
+  )
+{
+  XML_POOL_HEADER* Header;
+
+  ASSERT (Type < XmlAllocTypeMax);
+  Header = AllocateZeroPool (sizeof (XML_POOL_HEADER) + Size);
+  if (Header == NULL) {
+    return NULL;
+  }
+  Header->Signature = XML_POOL_SIGNATURE;
+  Header->Type = Type;
+  Header->Size = Size;
+  DriverXmlCountAllocation (Type, Size);
+  return Header + 1;
+}
+
+/**
+  Free memory from DriverXmlAllocatePool or DriverXmlReallocatePool.
+
+  @param[in] Buffer  The buffer to free. NULL is ignored.
+**/
+VOID
+DriverXmlFreePool (
+  IN VOID* Buffer
+  )
+{
+  XML_POOL_HEADER* Header;
+
+  if (Buffer == NULL) {
+    return;
+  }
+  Header = (XML_POOL_HEADER*)Buffer - 1;
+  ASSERT (Header->Signature == XML_POOL_SIGNATURE);
+  DriverXmlCountFree ((XML_ALLOC_TYPE)Header->Type, (UINTN)Header->Size);
+  Header->Signature = 0;
+  FreePool (Header);
+}
+
+/**
+  Change the size of a buffer from DriverXmlAllocatePool. 
+  The contents are kept up to the smaller of the two sizes and any new space is zeroed.
+
+  @param[in] Type     What the memory is for.
+  @param[in] Buffer   The buffer to resize. NULL allocates a new buffer.
+  @param[in] NewSize  The new size in bytes.
+
+  @return The resized buffer, or NULL if there was not enough memory. The old buffer
+          is still valid when this fails.
+**/
+VOID*
+DriverXmlReallocatePool (
+  IN XML_ALLOC_TYPE Type,
+  IN VOID*          Buffer,
+  IN UINTN          NewSize
+  )
+{
+  VOID*            NewBuffer;
+  XML_POOL_HEADER* Header;
+
+  NewBuffer = DriverXmlAllocatePool (Type, NewSize);
+  if (NewBuffer == NULL || Buffer == NULL) {
+    return NewBuffer;
+  }
+  Header = (XML_POOL_HEADER*)Buffer - 1;
+  gBS->CopyMem (NewBuffer, Buffer, (Header->Size < NewSize) ? (UINTN)Header->Size : NewSize);
+  DriverXmlFreePool (Buffer);
+  return NewBuffer;
+}
+
+/**
+  Count memory the library allocates straight from the pool because the caller will free it,
+  such as an output document. Pass an OldSize of 0 for a new allocation, or the old size
+  when a buffer is grown.
+
+  @param[in] Type     What the memory is for.
+  @param[in] OldSize  The size that was counted before, 0 if none.
+  @param[in] NewSize  The size now allocated.
+**/
+VOID
+DriverXmlCountCallerAllocation (
+  IN XML_ALLOC_TYPE Type,
+  IN UINTN          OldSize,
+  IN UINTN          NewSize
+  )
+{
+  if (OldSize != 0) {
+    DriverXmlCountFree (Type, OldSize);
+  }
+  DriverXmlCountAllocation (Type, NewSize);
+}
+
+/**
+  Get a copy of the library's allocation counters.
+
+  @param[out] Stats  Filled out with the current counters.
+
+  @retval EFI_SUCCESS            Stats was filled out.
+  @retval EFI_INVALID_PARAMETER  Stats is NULL.
+**/
+EFI_STATUS
+DriverXmlGetStats (
+  OUT DRIVER_XML_STATS* Stats
+  )
+{
+  if (Stats == NULL) {
+    return EFI_INVALID_PARAMETER;
+  }
+  gBS->CopyMem (Stats, &mDriverXmlStats, sizeof (DRIVER_XML_STATS));
+  return EFI_SUCCESS;
+}
+
+/**
+  Start a new measurement. Allocation, free and transient counts go back to 0 and the 
+  peak is set to what is in use now. Current usage is kept since that memory is still allocated.
+**/
+VOID
+DriverXmlResetStats (
+  VOID
+  )
+{
+  UINTN Index;
+
+  for (Index = 0; Index < XmlAllocTypeMax; Index++) {
+    mDriverXmlStats.Types[Index].Allocations = 0;
+    mDriverXmlStats.Types[Index].Frees = 0;
+    mDriverXmlStats.Types[Index].TotalBytes = mDriverXmlStats.Types[Index].CurrentBytes;
+  }
+  mDriverXmlStats.PeakBytes = mDriverXmlStats.CurrentBytes;
+  mDriverXmlStats.TransientCount = 0;
+  mDriverXmlStats.TransientBytes = 0;
+}
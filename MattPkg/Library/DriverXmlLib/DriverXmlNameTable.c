@@ -0,0 +1,364 @@
+/** @file
+  A table of interned strings used to give names and namespace URIs small integer ids.
+  Comparing ids replaces repeated string splitting and comparison when searching a tree.
+
+  Copyright (c) 2016, Matthew Lazarowitz. All rights reserved.<BR>
+  This program and the accompanying materials are licensed and made available under
+  the terms and conditions of the MIT License that accompanies this distribution.
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+**/
+#include <Uefi.h>
+#include <Library/UefiBootServicesTableLib.h>
+#include <Library/BaseLib.h>
+#include <Library/BaseMemoryLib.h>
+#include <Library/MemoryAllocationLib.h>
+#include <Library/DebugLib.h>
+#include <DriverXmlStringHandlers.h>
+
+//
+// Starting number of hash buckets. This must be a power of 2.
+// The table doubles when the average chain gets longer than 2 entries.
+//
+#define NAME_TABLE_INITIAL_BUCKETS 64
+
+//
+// Starting number of slots in the id to entry map.
+//
+#define NAME_TABLE_INITIAL_IDS     64
+
+//
+// FNV-1a parameters for 32 bit hashes.
+//
+#define FNV32_OFFSET_BASIS 0x811C9DC5
+#define FNV32_PRIME        0x01000193
+
+typedef struct _NAME_TABLE_ENTRY NAME_TABLE_ENTRY;
+
+//
+// One interned string. The string data follows the structure in the same allocation.
+//
+struct _NAME_TABLE_ENTRY {
+  NAME_TABLE_ENTRY* Next;
+  UINT32            Hash;
+  UINTN             Length;
+  UINTN             Id;
+  CHAR8             Name[1];
+};
+
+struct _DRIVER_XML_NAME_TABLE {
+  NAME_TABLE_ENTRY** Buckets;
+  UINTN              BucketCount;
+  NAME_TABLE_ENTRY** Entries;     // Indexed by id. Slot 0 is never used.
+  UINTN              EntrySlots;
+  UINTN              EntryCount;
+};
+
+/**
+  Hash a run of characters with FNV-1a.
+  This has a good distribution for the short names found in XML and needs no tables.
+
+  @param[in] Data    The characters to hash.
+  @param[in] Length  The number of characters to hash.
+
+  @return The 32 bit hash of the data.
+**/
+UINT32
+DriverXmlHashString (
+  IN CONST CHAR8* Data,
+  IN UINTN        Length
+  )
+{
+  UINT32 Hash;
+  UINTN  Index;
+
+  Hash = FNV32_OFFSET_BASIS;
+  for (Index = 0; Index < Length; Index++) {
+    Hash ^= (UINT8)Data[Index];
+    Hash *= FNV32_PRIME;
+  }
+  return Hash;
+}
+
+/**
+  Create an empty name table.
+
+  @param[out] Table  The new table. Free it with DriverXmlFreeNameTable.
+
+  @retval EFI_SUCCESS            The table was created.
+  @retval EFI_INVALID_PARAMETER  Table is NULL.
+  @retval EFI_OUT_OF_RESOURCES   There was not enough memory for the table.
+**/
+EFI_STATUS
+DriverXmlCreateNameTable (
+  OUT DRIVER_XML_NAME_TABLE** Table
+  )
+{
+  DRIVER_XML_NAME_TABLE* LocalTable;
+
+  if (Table == NULL) {
+    return EFI_INVALID_PARAMETER;
+  }
+  LocalTable = DriverXmlAllocatePool (XmlAllocTable, sizeof (DRIVER_XML_NAME_TABLE));
+  if (LocalTable == NULL) {
+    return EFI_OUT_OF_RESOURCES;
+  }
+  LocalTable->Buckets = DriverXmlAllocatePool (XmlAllocTable, NAME_TABLE_INITIAL_BUCKETS * sizeof (NAME_TABLE_ENTRY*));
+  LocalTable->Entries = DriverXmlAllocatePool (XmlAllocTable, NAME_TABLE_INITIAL_IDS * sizeof (NAME_TABLE_ENTRY*));
+  if (LocalTable->Buckets == NULL || LocalTable->Entries == NULL) {
+    DriverXmlFreeNameTable (LocalTable);
+    return EFI_OUT_OF_RESOURCES;
+  }
+  LocalTable->BucketCount = NAME_TABLE_INITIAL_BUCKETS;
+  LocalTable->EntrySlots = NAME_TABLE_INITIAL_IDS;
+  //
+  // Id 0 is reserved to mean "no name" so the first real entry gets 1.
+  //
+  LocalTable->EntryCount = 1;
+  *Table = LocalTable;
+  return EFI_SUCCESS;
+}
+
+/**
+  Free a name table and every string in it.
+  Ids from the table must not be used after this.
+
+  @param[in] Table  The table to free.
+**/
+VOID
+DriverXmlFreeNameTable (
+  IN DRIVER_XML_NAME_TABLE* Table
+  )
+{
+  UINTN Index;
+
+  if (Table == NULL) {
+    return;
+  }
+  if (Table->Entries != NULL) {
+    for (Index = 1; Index < Table->EntryCount; Index++) {
+      DriverXmlFreePool (Table->Entries[Index]);
+    }
+    DriverXmlFreePool (Table->Entries);
+  }
+  if (Table->Buckets != NULL) {
+    DriverXmlFreePool (Table->Buckets);
+  }
+  DriverXmlFreePool (Table);
+}
+
+/**
+  Double the number of hash buckets and rehash the existing entries into them.
+
+  @param[in out] Table  The table to grow.
+
+  @retval EFI_SUCCESS           The table was grown.
+  @retval EFI_OUT_OF_RESOURCES  The new bucket array could not be allocated. The table is unchanged.
+**/
+EFI_STATUS
+GrowNameTableBuckets (
+  IN OUT DRIVER_XML_NAME_TABLE* Table
+  )
+{
+  NAME_TABLE_ENTRY** NewBuckets;
+  NAME_TABLE_ENTRY*  Entry;
+  UINTN              NewCount;
+  UINTN              Index;
+  UINTN              Bucket;
+
+  NewCount = Table->BucketCount * 2;
+  NewBuckets = DriverXmlAllocatePool (XmlAllocTable, NewCount * sizeof (NAME_TABLE_ENTRY*));
+  if (NewBuckets == NULL) {
+    return EFI_OUT_OF_RESOURCES;
+  }
+  //
+  // Every entry is in the id map so walk that instead of the old chains.
+  //
+  for (Index = 1; Index < Table->EntryCount; Index++) {
+    Entry = Table->Entries[Index];
+    Bucket = Entry->Hash & (NewCount - 1);
+    Entry->Next = NewBuckets[Bucket];
+    NewBuckets[Bucket] = Entry;
+  }
+  DriverXmlFreePool (Table->Buckets);
+  Table->Buckets = NewBuckets;
+  Table->BucketCount = NewCount;
+  return EFI_SUCCESS;
+}
+
+/**
+  Find the entry for a string in a name table.
+
+  @param[in] Table   The table to search.
+  @param[in] Name    The characters to look for. This does not need to be null terminated.
+  @param[in] Length  The number of characters in Name.
+  @param[in] Hash    The hash of the characters from DriverXmlHashString.
+
+  @return The matching entry or NULL if the string has not been interned.
+**/
+NAME_TABLE_ENTRY*
+FindNameTableEntry (
+  IN DRIVER_XML_NAME_TABLE* Table,
+  IN CONST CHAR8*           Name,
+  IN UINTN                  Length,
+  IN UINT32                 Hash
+  )
+{
+  NAME_TABLE_ENTRY* Entry;
+
+  Entry = Table->Buckets[Hash & (Table->BucketCount - 1)];
+  while (Entry != NULL) {
+    if (Entry->Hash == Hash
+      && Entry->Length == Length
+      && CompareMem (Entry->Name, Name, Length) == 0)
+    {
+      return Entry;
+    }
+    Entry = Entry->Next;
+  }
+  return NULL;
+}
+
+/**
+  Look up the id for a string without adding it to the table.
+  This is what a search should use since a string that was never interned cannot match anything.
+
+  @param[in]  Table   The table to search.
+  @param[in]  Name    The characters to look for. This does not need to be null terminated.
+  @param[in]  Length  The number of characters in Name.
+  @param[out] Id      The id of the string.
+
+  @retval EFI_SUCCESS            The string was found and Id is valid.
+  @retval EFI_NOT_FOUND          The string is not in the table.
+  @retval EFI_INVALID_PARAMETER  One of the pointers is NULL.
+**/
+EFI_STATUS
+DriverXmlLookupName (
+  IN  DRIVER_XML_NAME_TABLE* Table,
+  IN  CONST CHAR8*           Name,
+  IN  UINTN                  Length,
+  OUT UINTN*                 Id
+  )
+{
+  NAME_TABLE_ENTRY* Entry;
+
+  if (Table == NULL || Name == NULL || Id == NULL) {
+    return EFI_INVALID_PARAMETER;
+  }
+  Entry = FindNameTableEntry (Table, Name, Length, DriverXmlHashString (Name, Length));
+  if (Entry == NULL) {
+    return EFI_NOT_FOUND;
+  }
+  *Id = Entry->Id;
+  return EFI_SUCCESS;
+}
+
+/**
+  Get the id for a string, adding the string to the table if it is not already there.
+
+  @param[in]  Table   The table to add to.
+  @param[in]  Name    The characters to intern. This does not need to be null terminated.
+  @param[in]  Length  The number of characters in Name.
+  @param[out] Id      The id of the string. This is never 0.
+
+  @retval EFI_SUCCESS            Id is valid.
+  @retval EFI_INVALID_PARAMETER  One of the pointers is NULL.
+  @retval EFI_OUT_OF_RESOURCES   The string could not be added.
+**/
+EFI_STATUS
+DriverXmlInternName (
+  IN  DRIVER_XML_NAME_TABLE* Table,
+  IN  CONST CHAR8*           Name,
+  IN  UINTN                  Length,
+  OUT UINTN*                 Id
+  )
+{
+  NAME_TABLE_ENTRY*  Entry;
+  NAME_TABLE_ENTRY** NewEntries;
+  UINT32             Hash;
+  UINTN              Bucket;
+
+  if (Table == NULL || Name == NULL || Id == NULL) {
+    return EFI_INVALID_PARAMETER;
+  }
+  Hash = DriverXmlHashString (Name, Length);
+  Entry = FindNameTableEntry (Table, Name, Length, Hash);
+  if (Entry != NULL) {
+    *Id = Entry->Id;
+    return EFI_SUCCESS;
+  }
+
+  //
+  // Make sure there is a slot for the new id before anything is allocated for the entry.
+  //
+  if (Table->EntryCount == Table->EntrySlots) {
+    NewEntries = DriverXmlReallocatePool (
+                   XmlAllocTable,
+                   Table->Entries,
+                   Table->EntrySlots * 2 * sizeof (NAME_TABLE_ENTRY*)
+                   );
+    if (NewEntries == NULL) {
+      return EFI_OUT_OF_RESOURCES;
+    }
+    Table->Entries = NewEntries;
+    Table->EntrySlots *= 2;
+  }
+  //
+  // Keep the chains short. Failing to grow only costs lookup speed so it is not an error.
+  //
+  if (Table->EntryCount > Table->BucketCount * 2) {
+    GrowNameTableBuckets (Table);
+  }
+
+  Entry = DriverXmlAllocatePool (XmlAllocTable, sizeof (NAME_TABLE_ENTRY) + Length);
+  if (Entry == NULL) {
+    return EFI_OUT_OF_RESOURCES;
+  }
+  gBS->CopyMem (Entry->Name, (VOID*)Name, Length);
+  Entry->Hash = Hash;
+  Entry->Length = Length;
+  Entry->Id = Table->EntryCount;
+  Bucket = Hash & (Table->BucketCount - 1);
+  Entry->Next = Table->Buckets[Bucket];
+  Table->Buckets[Bucket] = Entry;
+  Table->Entries[Entry->Id] = Entry;
+  Table->EntryCount++;
+
+  *Id = Entry->Id;
+  return EFI_SUCCESS;
+}
+
+/**
+  Get the string for an id.
+
+  @param[in] Table  The table the id came from.
+  @param[in] Id     The id to look up.
+
+  @return The null terminated string owned by the table, or NULL if the id is not valid.
+**/
+CONST CHAR8*
+DriverXmlGetName (
+  IN DRIVER_XML_NAME_TABLE* Table,
+  IN UINTN                  Id
+  )
+{
+  if (Table == NULL || Id == 0 || Id >= Table->EntryCount) {
+    return NULL;
+  }
+  return Table->Entries[Id]->Name;
+}
@@ -0,0 +1,371 @@
+/** @file
+  Namespace processing for the XML parser.
+  Prefixes are resolved through a stack of the xmlns bindings in scope while the document
+  is parsed, and names are interned so a tree can be searched by id.
+  
+  @par Namespaces in XML 1.0 https://www.w3.org/TR/xml-names/
+  
+  Copyright (c) 2016, Matthew Lazarowitz. All rights reserved.<BR>
+  This program and the accompanying materials are licensed and made available under
+  the terms and conditions of the MIT License that accompanies this distribution.
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+**/
+#include <Uefi.h>
+#include <Library/UefiBootServicesTableLib.h>
+#include <Library/BaseLib.h>
+#include <Library/MemoryAllocationLib.h>
+#include <Library/DebugLib.h>
+#include <DriverXmlStringHandlers.h>
+
+//
+// URIs the namespace spec binds without a declaration.
+//
+#define XML_NAMESPACE_URI   "http://www.w3.org/XML/1998/namespace"
+#define XMLNS_NAMESPACE_URI "http://www.w3.org/2000/xmlns/"
+
+//
+// Number of bindings to grow the binding stack by when it fills.
+//
+#define NAMESPACE_BINDING_STEP 16
+
+/**
+  Add a prefix binding to the top of the scope stack.
+
+  @param[in out] Context   The parser state holding the binding stack.
+  @param[in]     PrefixId  The prefix id, 0 for the default namespace.
+  @param[in]     UriId     The namespace URI id, 0 to remove the default namespace.
+
+  @retval EFI_SUCCESS           The binding was added.
+  @retval EFI_OUT_OF_RESOURCES  The stack could not be grown.
+**/
+EFI_STATUS
+PushNamespaceBinding (
+  IN OUT XML_PARSER_CONTEXT* Context,
+  IN     UINTN               PrefixId,
+  IN     UINTN               UriId
+  )
+{
+  XML_NAMESPACE_BINDING* NewBindings;
+
+  if (Context->BindingCount == Context->BindingSlots) {
+    NewBindings = DriverXmlReallocatePool (
+                    XmlAllocTable,
+                    Context->Bindings,
+                    (Context->BindingSlots + NAMESPACE_BINDING_STEP) * sizeof (XML_NAMESPACE_BINDING)
+                    );
+    if (NewBindings == NULL) {
+      return EFI_OUT_OF_RESOURCES;
+    }
+    Context->Bindings = NewBindings;
+    Context->BindingSlots += NAMESPACE_BINDING_STEP;
+  }
+  Context->Bindings[Context->BindingCount].PrefixId = PrefixId;
+  Context->Bindings[Context->BindingCount].UriId = UriId;
+  Context->Bindings[Context->BindingCount].Depth = Context->Depth;
+  Context->BindingCount++;
+  return EFI_SUCCESS;
+}
+
+/**
+  Drop the bindings of an element that has ended and of everything that was inside it.
+  Call this once Context->Depth is back to the depth the element was added at.
+
+  @param[in out] Context  The parser state holding the binding stack.
+**/
+VOID
+DriverXmlPopNamespaceBindings (
+  IN OUT XML_PARSER_CONTEXT* Context
+  )
+{
+  while (Context->BindingCount > 0
+         && Context->Bindings[Context->BindingCount - 1].Depth >= Context->Depth) 
+  {
+    Context->BindingCount--;
+  }
+}
+
+/**
+  Free the binding stack once the parse is finished.
+
+  @param[in out] Context  The parser state holding the binding stack.
+**/
+VOID
+DriverXmlFreeNamespaceBindings (
+  IN OUT XML_PARSER_CONTEXT* Context
+  )
+{
+  if (Context->Bindings != NULL) {
+    DriverXmlFreePool (Context->Bindings);
+  }
+  Context->Bindings = NULL;
+  Context->BindingCount = 0;
+  Context->BindingSlots = 0;
+}
+
+/**
+  Split a qualified name into its prefix and local part.
+  
+  Spec says the definition is:
+  QName    ::=    PrefixedName | UnprefixedName
+  PrefixedName    ::=    Prefix ':' LocalPart
+
+  @param[in]  Name          The name from the tag or attribute.
+  @param[out] PrefixLength  The number of characters in the prefix, 0 if there is no prefix.
+  @param[out] LocalName     The local part of the name inside Name.
+
+  @retval EFI_SUCCESS       The name was split.
+  @retval EFI_DEVICE_ERROR  The name has an empty prefix or local part, or more than one colon.
+**/
+EFI_STATUS
+SplitQualifiedName (
+  IN  CHAR8*  Name,
+  OUT UINTN*  PrefixLength,
+  OUT CHAR8** LocalName
+  )
+{
+  UINTN Index;
+
+  *PrefixLength = 0;
+  *LocalName = Name;
+  for (Index = 0; Name[Index] != '\0'; Index++) {
+    if (Name[Index] != ':') {
+      continue;
+    }
+    if (*LocalName != Name || Index == 0 || Name[Index + 1] == '\0') {
+      DEBUG ((DEBUG_ERROR, "Name %a is not a valid qualified name\n", Name));
+      return EFI_DEVICE_ERROR;
+    }
+    *PrefixLength = Index;
+    *LocalName = &Name[Index + 1];
+  }
+  return EFI_SUCCESS;
+}
+
+/**
+  Find the namespace URI a prefix is bound to in the current scope.
+
+  @param[in]  Context       The parser state holding the binding stack.
+  @param[in]  Prefix        The prefix characters.
+  @param[in]  PrefixLength  The number of prefix characters, 0 for the default namespace.
+  @param[out] UriId         The namespace URI id, 0 when there is no default namespace.
+
+  @retval EFI_SUCCESS    UriId is valid.
+  @retval EFI_NOT_FOUND  The prefix is not bound.
+**/
+EFI_STATUS
+LookupNamespacePrefix (
+  IN  XML_PARSER_CONTEXT* Context,
+  IN  CHAR8*              Prefix,
+  IN  UINTN               PrefixLength,
+  OUT UINTN*              UriId
+  )
+{
+  EFI_STATUS Status;
+  UINTN      PrefixId;
+  UINTN      Index;
+
+  PrefixId = 0;
+  if (PrefixLength != 0) {
+    Status = DriverXmlLookupName (Context->Options.NameTable, Prefix, PrefixLength, &PrefixId);
+    if (EFI_ERROR (Status)) {
+      PrefixId = 0;
+    }
+  }
+  if (PrefixLength == 0 || PrefixId != 0) {
+    //
+    // Innermost binding wins so search from the top of the stack.
+    //
+    for (Index = Context->BindingCount; Index > 0; Index--) {
+      if (Context->Bindings[Index - 1].PrefixId == PrefixId) {
+        *UriId = Context->Bindings[Index - 1].UriId;
+        return EFI_SUCCESS;
+      }
+    }
+  }
+  if (PrefixLength == 0) {
+    *UriId = DRIVER_XML_NO_NAMESPACE;
+    return EFI_SUCCESS;
+  }
+  //
+  // The xml prefix is bound by definition.
+  //
+  if (PrefixLength == 3 && AsciiStrnCmp (Prefix, "xml", 3) == 0) {
+    return DriverXmlInternName (
+             Context->Options.NameTable,
+             XML_NAMESPACE_URI,
+             sizeof (XML_NAMESPACE_URI) - 1,
+             UriId
+             );
+  }
+  return EFI_NOT_FOUND;
+}
+
+/**
+  Check if an attribute is a namespace declaration.
+
+  @param[in]  Name       The attribute name.
+  @param[out] Prefix     The declared prefix, or NULL when the default namespace is declared.
+
+  @retval TRUE   The attribute is xmlns or xmlns:prefix.
+  @retval FALSE  The attribute is a regular attribute.
+**/
+BOOLEAN
+IsNamespaceDeclaration (
+  IN  CHAR8*  Name,
+  OUT CHAR8** Prefix
+  )
+{
+  if (AsciiStrnCmp (Name, "xmlns", 5) != 0) {
+    return FALSE;
+  }
+  if (Name[5] == '\0') {
+    *Prefix = NULL;
+    return TRUE;
+  }
+  if (Name[5] == ':') {
+    *Prefix = &Name[6];
+    return TRUE;
+  }
+  return FALSE;
+}
+
+/**
+  Apply namespace processing to a tag that was just added to the tree.
+  The xmlns attributes on the tag are pushed onto the binding stack first since they are
+  in scope for the tag itself. Then the tag and each attribute get their namespace and 
+  local name ids. The caller pops the bindings when the element closes.
+
+  @param[in out] Context  The parser state holding the binding stack and name table.
+  @param[in out] Tag      The tag to resolve.
+
+  @retval EFI_SUCCESS           The tag and attributes were resolved.
+  @retval EFI_DEVICE_ERROR      A prefix is not bound or a name is not a valid qualified name.
+  @retval EFI_OUT_OF_RESOURCES  The name table or binding stack could not be grown.
+**/
+EFI_STATUS
+DriverXmlResolveNamespaces (
+  IN OUT XML_PARSER_CONTEXT* Context,
+  IN OUT DRIVER_XML_TAG*     Tag
+  )
+{
+  EFI_STATUS             Status;
+  DRIVER_XML_NAME_TABLE* Table;
+  DRIVER_XML_DATA_HEADER* LocalXmlData;
+  DRIVER_XML_ATTRIBUTE*  Attribute;
+  CHAR8*                 DeclaredPrefix;
+  CHAR8*                 LocalName;
+  UINTN                  PrefixLength;
+  UINTN                  PrefixId;
+  UINTN                  UriId;
+  UINTN                  XmlnsUriId;
+
+  Table = Context->Options.NameTable;
+  Status = DriverXmlInternName (Table, XMLNS_NAMESPACE_URI, sizeof (XMLNS_NAMESPACE_URI) - 1, &XmlnsUriId);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  //
+  // Declarations first, they apply to the tag they appear on.
+  // GetNextXmlElement can't walk an empty list so skip tags without attributes.
+  //
+  LocalXmlData = (DRIVER_XML_DATA_HEADER*)&Tag->TagAttributes.ListStart;
+  while (Tag->TagAttributes.ItemCount != 0 && GetNextXmlElement (&Tag->TagAttributes, LocalXmlData, &LocalXmlData) == EFI_SUCCESS) {
+    Attribute = (DRIVER_XML_ATTRIBUTE*)LocalXmlData;
+    if (!IsNamespaceDeclaration (Attribute->AttributeName, &DeclaredPrefix)) {
+      continue;
+    }
+    UriId = DRIVER_XML_NO_NAMESPACE;
+    if (Attribute->AttributeData != NULL) {
+      Status = DriverXmlInternName (Table, Attribute->AttributeData, AsciiStrLen (Attribute->AttributeData), &UriId);
+      if (EFI_ERROR (Status)) {
+        return Status;
+      }
+    }
+    PrefixId = 0;
+    if (DeclaredPrefix != NULL) {
+      if (UriId == DRIVER_XML_NO_NAMESPACE || *DeclaredPrefix == '\0') {
+        DEBUG ((DEBUG_ERROR, "Invalid namespace declaration %a on %a\n", Attribute->AttributeName, Tag->TagName));
+        return EFI_DEVICE_ERROR;
+      }
+      Status = DriverXmlInternName (Table, DeclaredPrefix, AsciiStrLen (DeclaredPrefix), &PrefixId);
+      if (EFI_ERROR (Status)) {
+        return Status;
+      }
+    }
+    Status = PushNamespaceBinding (Context, PrefixId, UriId);
+    if (EFI_ERROR (Status)) {
+      return Status;
+    }
+    //
+    // Declarations live in the xmlns namespace. The local name is the declared prefix or "xmlns".
+    //
+    Attribute->NamespaceId = XmlnsUriId;
+    LocalName = (DeclaredPrefix != NULL) ? DeclaredPrefix : Attribute->AttributeName;
+    Status = DriverXmlInternName (Table, LocalName, AsciiStrLen (LocalName), &Attribute->LocalNameId);
+    if (EFI_ERROR (Status)) {
+      return Status;
+    }
+  }
+
+  //
+  // The tag name. Unprefixed tags take the default namespace.
+  //
+  Status = SplitQualifiedName (Tag->TagName, &PrefixLength, &LocalName);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+  Status = LookupNamespacePrefix (Context, Tag->TagName, PrefixLength, &Tag->NamespaceId);
+  if (EFI_ERROR (Status)) {
+    DEBUG ((DEBUG_ERROR, "Unbound namespace prefix on tag %a\n", Tag->TagName));
+    return EFI_DEVICE_ERROR;
+  }
+  Status = DriverXmlInternName (Table, LocalName, AsciiStrLen (LocalName), &Tag->LocalNameId);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  //
+  // The remaining attributes. Unprefixed attributes are not in any namespace.
+  //
+  LocalXmlData = (DRIVER_XML_DATA_HEADER*)&Tag->TagAttributes.ListStart;
+  while (Tag->TagAttributes.ItemCount != 0 && GetNextXmlElement (&Tag->TagAttributes, LocalXmlData, &LocalXmlData) == EFI_SUCCESS) {
+    Attribute = (DRIVER_XML_ATTRIBUTE*)LocalXmlData;
+    if (IsNamespaceDeclaration (Attribute->AttributeName, &DeclaredPrefix)) {
+      continue;
+    }
+    Status = SplitQualifiedName (Attribute->AttributeName, &PrefixLength, &LocalName);
+    if (EFI_ERROR (Status)) {
+      return Status;
+    }
+    Attribute->NamespaceId = DRIVER_XML_NO_NAMESPACE;
+    if (PrefixLength != 0) {
+      Status = LookupNamespacePrefix (Context, Attribute->AttributeName, PrefixLength, &Attribute->NamespaceId);
+      if (EFI_ERROR (Status)) {
+        DEBUG ((DEBUG_ERROR, "Unbound namespace prefix on attribute %a\n", Attribute->AttributeName));
+        return EFI_DEVICE_ERROR;
+      }
+    }
+    Status = DriverXmlInternName (Table, LocalName, AsciiStrLen (LocalName), &Attribute->LocalNameId);
+    if (EFI_ERROR (Status)) {
+      return Status;
+    }
+  }
+  return EFI_SUCCESS;
+}
@@ -26,6 +26,7 @@
 #include <Uefi.h>
 #include <Library/UefiBootServicesTableLib.h>
 #include <Library/DebugLib.h>
+#include <Library/DebugTraceLib.h>
 #include <Library/MemoryAllocationLib.h>
 #include <Library/BaseLib.h>
 #include <Library/DriverXmlLib.h>
@@ -36,6 +37,45 @@ PrintXmlType(
   DRIVER_XML_DATA_HEADER* Data
 );
 
+EFI_STATUS
+RemoveElement (
+  LIST_ANCHOR*            ElementList,
+  DRIVER_XML_DATA_HEADER* Element
+  );
+
+/**
+  Count a new piece of the tree against the parse limits before it is allocated.
+
+  @param[in out] Context  The parser state holding the limits and usage so far.
+  @param[in]     Nodes    The number of nodes being added, 0 for an attribute.
+  @param[in]     Bytes    The number of bytes about to be allocated for the tree.
+
+  @retval EFI_SUCCESS             The allocation fits in the budget and has been counted.
+  @retval EFI_SECURITY_VIOLATION  MaxNodes or MaxBytes would be exceeded.
+**/
+EFI_STATUS
+ChargeParseBudget (
+  XML_PARSER_CONTEXT* Context,
+  UINTN               Nodes,
+  UINTN               Bytes
+  )
+{
+  DRIVER_XML_PARSE_LIMITS* Limits;
+
+  Limits = &Context->Options.Limits;
+  if (Limits->MaxNodes != 0 && Nodes > Limits->MaxNodes - Context->NodeCount) {
+    DEBUG ((DEBUG_ERROR, "Parse stopped at the %d node limit\n", Limits->MaxNodes));
+    return EFI_SECURITY_VIOLATION;
+  }
+  if (Limits->MaxBytes != 0 && Bytes > Limits->MaxBytes - Context->BytesUsed) {
+    DEBUG ((DEBUG_ERROR, "Parse stopped at the %d byte limit\n", Limits->MaxBytes));
+    return EFI_SECURITY_VIOLATION;
+  }
+  Context->NodeCount += Nodes;
+  Context->BytesUsed += Bytes;
+  return EFI_SUCCESS;
+}
+
 /**
   Create a new attribute from the provided data and add it to the 
   provided list of attributes.
@@ -44,7 +84,7 @@ PrintXmlType(
   @param[in]     AtrributeName    The name of the attribute.
   @param[in]     AttributeData    The data portion of the attribute.
   
-  @return  The new attribute that was allocated and filled out.
+  @return  The new attribute that was allocated and filled out, or NULL if there was no memory.
 **/
 DRIVER_XML_ATTRIBUTE*
 DriverXmlAddAttribute (
@@ -56,8 +96,10 @@ DriverXmlAddAttribute (
   DRIVER_XML_ATTRIBUTE* LocalAttribute;
   LIST_ANCHOR*          AttributeList;
   
-  LocalAttribute = AllocateZeroPool (sizeof (DRIVER_XML_ATTRIBUTE));
-  ASSERT (LocalAttribute != NULL);
+  LocalAttribute = DriverXmlAllocatePool (XmlAllocAttribute, sizeof (DRIVER_XML_ATTRIBUTE));
+  if (LocalAttribute == NULL) {
+    return NULL;
+  }
   
   AttributeList = &(ParentElement->TagAttributes);
   LocalAttribute->XmlDataType = XmlAttribute;
@@ -88,9 +130,9 @@ DriverXmlDeleteAttribute (
   RemoveEntryList (&(Attribute->DataLink));
   AttribList->ItemCount--;
   
-  gBS->FreePool (Attribute->AttributeName);
-  gBS->FreePool (Attribute->AttributeData);
-  gBS->FreePool (Attribute);
+  DriverXmlFreePool (Attribute->AttributeName);
+  DriverXmlFreePool (Attribute->AttributeData);
+  DriverXmlFreePool (Attribute);
   
   return;
 }
@@ -112,16 +154,14 @@ DeleteAttributeList (
   DRIVER_XML_DATA_HEADER* ChildData;
   DRIVER_XML_ATTRIBUTE*   Attribute;
   
-  while (GetNextXmlElement (AttributeList, ChildData, &ChildData) == EFI_SUCCESS) {
-    if (ChildData == NULL) {
-      //
-      // Sanity check
-      //
-      return  EFI_NOT_FOUND;
-    }
+  //
+  // Always take the first entry. The entry is freed so it can't be used to find the next one.
+  //
+  while (!IsListEmpty (&AttributeList->ListStart)) {
+    ChildData = (DRIVER_XML_DATA_HEADER*)GetFirstNode (&AttributeList->ListStart);
     if (ChildData->XmlDataType != XmlAttribute) {
       DEBUG((DEBUG_ERROR,"Encountered a non-attribute in the attribute list.\n This is unexpected.\n"));
-      continue;
+      return EFI_ABORTED;
     }
     Attribute = (DRIVER_XML_ATTRIBUTE*)ChildData;
     DriverXmlDeleteAttribute (AttributeList, Attribute);
@@ -133,87 +173,157 @@ DeleteAttributeList (
 }
 
 /**
-  Worker function for deleting a list of elements.
+  Free a tag or empty tag. The walk has already freed its children.
 
-  @param[in out] ElementList  The list of elements to delete.
+  @param[in] Element  The tag to free.
+  @param[in] Depth    The depth of the tag in the walk. Not used.
+  @param[in] Context  Not used.
 
-  @retval EFI_SUCCESS The list was successfully deleted.
-  @retval 
+  @retval EFI_SUCCESS  The tag was freed.
 **/
 EFI_STATUS
-DeleteElementList (
-    LIST_ANCHOR* ElementList
-)
+FreeTagNode (
+  DRIVER_XML_DATA_HEADER* Element,
+  UINTN                   Depth,
+  VOID*                   Context
+  )
 {
-  DRIVER_XML_DATA_HEADER* ChildData;
-  
-  if (ElementList != NULL && ElementList->ItemCount > 0) {
-    ChildData = (DRIVER_XML_DATA_HEADER*)&ElementList->ListStart;
-    while (GetNextXmlElement (ElementList, ChildData, &ChildData) == EFI_SUCCESS) {
-      if (ChildData == NULL) {
-        return EFI_NOT_FOUND;
-      }
-      DriverXmlDeleteElement(ElementList, ChildData);
-    }
-  }
-  if (ElementList->ItemCount != 0) {
-    return EFI_ABORTED;
-  }
+  DRIVER_XML_TAG* Tag;
+
+  Tag = (DRIVER_XML_TAG*)Element;
+  DeleteAttributeList (&Tag->TagAttributes);
+  //
+  // The strings hang off the node so they go before it does.
+  //
+  DriverXmlFreePool (Tag->TagName);
+  DriverXmlFreePool (Tag);
   return EFI_SUCCESS;
 }
 
+/**
+  Free a char data element.
+
+  @param[in] Element  The char data to free.
+  @param[in] Depth    The depth of the element in the walk. Not used.
+  @param[in] Context  Not used.
+
+  @retval EFI_SUCCESS  The element was freed.
+**/
+EFI_STATUS
+FreeCharDataNode (
+  DRIVER_XML_DATA_HEADER* Element,
+  UINTN                   Depth,
+  VOID*                   Context
+  )
+{
+  DriverXmlFreePool (((DRIVER_XML_CHAR_DATA*)Element)->CharData);
+  DriverXmlFreePool (Element);
+  return EFI_SUCCESS;
+}
 
 /**
-  Worker function for DriverXmlDeleteElement. 
-  This handles empty elements that may only have an attribute list.
+  Free a processing instruction element.
 
-  @param[in out] ElementList  The list of XML elements to add a new one to.
-  @param[in]     Element      The XML tag element to be deleted.
-  
+  @param[in] Element  The processing instruction to free.
+  @param[in] Depth    The depth of the element in the walk. Not used.
+  @param[in] Context  Not used.
+
+  @retval EFI_SUCCESS  The element was freed.
 **/
 EFI_STATUS
-DriverXmlDeleteEmptyTag (
-  LIST_ANCHOR*            ElementList,
-  DRIVER_XML_DATA_HEADER* Element
-)
+FreePiNode (
+  DRIVER_XML_DATA_HEADER* Element,
+  UINTN                   Depth,
+  VOID*                   Context
+  )
 {
-  LIST_ANCHOR* AttributeList;
-  
-  if (Element->XmlDataType != XmlEmptyTag){
-    return EFI_INVALID_PARAMETER;
-  }
-  AttributeList = &((DRIVER_XML_TAG*)Element)->TagAttributes;
-  DeleteAttributeList (AttributeList);
+  DriverXmlFreePool (((DRIVER_XML_PROCESSING_INSTRUCTION*)Element)->PiTargetName);
+  DriverXmlFreePool (((DRIVER_XML_PROCESSING_INSTRUCTION*)Element)->PiTargetData);
+  DriverXmlFreePool (Element);
   return EFI_SUCCESS;
 }
 
+/**
+  Free an element of a type that holds nothing else.
+
+  @param[in] Element  The element to free.
+  @param[in] Depth    The depth of the element in the walk. Not used.
+  @param[in] Context  Not used.
+
+  @retval EFI_SUCCESS  The element was freed.
+**/
 EFI_STATUS
-DriverXmlDeleteTagAndChildren (
+FreeDataNode (
+  DRIVER_XML_DATA_HEADER* Element,
+  UINTN                   Depth,
+  VOID*                   Context
+  )
+{
+  DriverXmlFreePool (Element);
+  return EFI_SUCCESS;
+}
+
+//
+// Frees each element after everything below it, so a branch of any depth is taken
+// down without recursion. Elements below the start are freed without being unlinked,
+// so the start must already be off any list it was on.
+//
+CONST DRIVER_XML_VISITOR mXmlFreer = {
+  {
+    NULL,              // XmlNothing
+    NULL,              // XmlEmptyTag
+    NULL,              // XmlTag
+    NULL,              // XmlCloseTag
+    NULL,              // XmlAttribute
+    NULL,              // XmlChar
+    NULL,              // XmlPi
+    NULL,              // XmlDecl
+    NULL               // XmlComment
+  },
+  {
+    FreeDataNode,      // XmlNothing
+    FreeTagNode,       // XmlEmptyTag
+    FreeTagNode,       // XmlTag
+    FreeDataNode,      // XmlCloseTag
+    FreeDataNode,      // XmlAttribute
+    FreeCharDataNode,  // XmlChar
+    FreePiNode,        // XmlPi
+    FreeDataNode,      // XmlDecl
+    FreeDataNode       // XmlComment
+  }
+};
+
+/**
+  Unlink and free an element, its children and its attributes without marking the parent
+  as modified. This is for taking down whole branches and for the parser's own clean up.
+
+  @param[in out] ElementList  The list the element is on.
+  @param[in]     Element      The element to free.
+**/
+EFI_STATUS
+RemoveElement (
   LIST_ANCHOR*            ElementList,
   DRIVER_XML_DATA_HEADER* Element
-)
+  )
 {
-  LIST_ANCHOR* ListToDelete;
-  
-  if (Element->XmlDataType != XmlTag){
-    return EFI_INVALID_PARAMETER;
-  }
-  ListToDelete = &((DRIVER_XML_TAG*)Element)->TagAttributes;
-  DeleteAttributeList (ListToDelete);
-  ListToDelete = &((DRIVER_XML_TAG*)Element)->TagChildren;
-  DeleteElementList (ListToDelete);
-  
-  
-  return EFI_SUCCESS;
+  RemoveEntryList(&(Element->DataLink));
+  ElementList->ItemCount--;
+  return DriverXmlWalkElement (&mXmlFreer, Element, 0, NULL);
 }
+
 /**
   Delete an element from a list of elements. 
   This will also free all the memory associated with the element
   This will also free all the children and attributes
 
-  @param[in out] ElementList  The list of XML elements to add a new one to.
-  @param[in]     Element      The XML tag element to be deleted.
-  
+  Nothing is marked as modified. Use DriverXmlDeleteChild to delete from a tag
+  that will be written with PrintDataIncremental.
+
+  @param[in out] ElementList  The list the element is on.
+  @param[in]     Element      The element to be deleted.
+
+  @retval EFI_SUCCESS            The element was deleted.
+  @retval EFI_INVALID_PARAMETER  A pointer was NULL.
 **/
 EFI_STATUS
 DriverXmlDeleteElement (
@@ -221,44 +331,117 @@ DriverXmlDeleteElement (
   DRIVER_XML_DATA_HEADER* Element
   )
 {
-  
-  
-  
-  if (Element->XmlDataType == XmlEmptyTag){
-    DriverXmlDeleteEmptyTag (ElementList, Element);
+  if (ElementList == NULL || Element == NULL) {
+    return EFI_INVALID_PARAMETER;
   }
-  
-  if (Element->XmlDataType == XmlTag){
-    DriverXmlDeleteTagAndChildren (ElementList, Element);
+  if (Element->XmlDataType == XmlAttribute) {
+    DriverXmlDeleteAttribute (ElementList, (DRIVER_XML_ATTRIBUTE*)Element);
+    return EFI_SUCCESS;
   }
-  
+  return RemoveElement (ElementList, Element);
+}
 
-  RemoveEntryList(&(Element->DataLink));
-  ElementList->ItemCount--;
-  gBS->FreePool(Element);
+/**
+  Delete a child or an attribute of a tag and mark the tag as modified.
+  This will also free all the memory associated with the element,
+  including the children and attributes of a deleted tag.
+
+  @param[in out] Parent   The tag the element belongs to.
+  @param[in]     Element  The element to delete. An attribute is taken off the tag's
+                          attributes, anything else off its children.
+
+  @retval EFI_SUCCESS            The element was deleted.
+  @retval EFI_INVALID_PARAMETER  A pointer was NULL or Parent is not a tag.
+  @retval EFI_NOT_FOUND          Element is not on the matching list of Parent.
+**/
+EFI_STATUS
+DriverXmlDeleteChild (
+  DRIVER_XML_TAG*         Parent,
+  DRIVER_XML_DATA_HEADER* Element
+  )
+{
+  LIST_ANCHOR*            ElementList;
+  DRIVER_XML_DATA_HEADER* Entry;
+
+  if (Parent == NULL || Element == NULL) {
+    return EFI_INVALID_PARAMETER;
+  }
+  if (Parent->XmlDataType != XmlTag && Parent->XmlDataType != XmlEmptyTag) {
+    return EFI_INVALID_PARAMETER;
+  }
+  if (Element->XmlDataType == XmlAttribute) {
+    ElementList = &Parent->TagAttributes;
+  } else {
+    ElementList = &Parent->TagChildren;
+  }
+
+  //
+  // Unlinking an element that is on some other list would corrupt both lists.
+  //
+  if (ElementList->ItemCount == 0) {
+    return EFI_NOT_FOUND;
+  }
+  Entry = (DRIVER_XML_DATA_HEADER*)&ElementList->ListStart;
+  while (GetNextXmlElement (ElementList, Entry, &Entry) == EFI_SUCCESS) {
+    if (Entry == Element) {
+      break;
+    }
+  }
+  if (Entry != Element) {
+    return EFI_NOT_FOUND;
+  }
+
+  DriverXmlDeleteElement (ElementList, Element);
+  DriverXmlMarkModified (Parent);
   return EFI_SUCCESS;
 }
 
 /**
-  Create a new element data structure and add it to a list of elements.
+  Free a whole tree returned by DriverXmlParse or DriverXmlParseEx, including the root.
+  The root is not on any list so it is freed by walking it alone instead of through RemoveElement.
+
+  @param[in] XmlTree  The root of the tree.
+
+  @retval EFI_SUCCESS            The tree was freed.
+  @retval EFI_INVALID_PARAMETER  XmlTree is NULL or is not a tag.
+**/
+EFI_STATUS
+DriverXmlFreeTree (
+  DRIVER_XML_DATA_HEADER* XmlTree
+  )
+{
+  if (XmlTree == NULL || XmlTree->XmlDataType != XmlTag) {
+    return EFI_INVALID_PARAMETER;
+  }
+  return DriverXmlWalkElement (&mXmlFreer, XmlTree, 0, NULL);
+}
+
+/**
+  Create a new element data structure and add it to the end of a tag's children.
+  Nothing is marked as modified, so this is for building a tree that is not written
+  with PrintDataIncremental against an older document, such as while parsing.
 
-  @param[in out] ElementList  The list of elements to add the new element to
-  @param[in]     TagName  The name of the element to be added.
-  @param[in]     DataType     The element type to be added to the list.
+  @param[in out] ParentElement  The tag to add the new element to.
+  @param[in]     TagName        The name of the element to be added.
+  @param[in]     DataType       The element type to be added to the list.
   
-  @return  The XML element that was allocated with the XML element name filled out.
+  @return  The XML element that was allocated with the XML element name filled out,
+           or NULL if there was no memory.
 **/
 DRIVER_XML_TAG*
 DriverXmlCreateTag (
-  LIST_ANCHOR*  ElementList,
-  CHAR8*        TagName,
-  XML_DATA_TYPE DataType
+  DRIVER_XML_TAG* ParentElement,
+  CHAR8*          TagName,
+  XML_DATA_TYPE   DataType
   )
 {
   DRIVER_XML_TAG* Tag;
+  LIST_ANCHOR*    ElementList;
 
-  Tag = AllocateZeroPool (sizeof(DRIVER_XML_TAG));
-  ASSERT (Tag != NULL);
+  Tag = DriverXmlAllocatePool (XmlAllocTag, sizeof(DRIVER_XML_TAG));
+  if (Tag == NULL) {
+    return NULL;
+  }
   
   Tag->XmlDataType = DataType;
   Tag->TagName = TagName;
@@ -269,7 +452,9 @@ DriverXmlCreateTag (
   InitializeListHead(&Tag->TagAttributes.ListStart);
   Tag->TagChildren.ItemCount = 0;
   Tag->TagAttributes.ItemCount = 0;
+  Tag->Parent = ParentElement;
   
+  ElementList = &ParentElement->TagChildren;
   InsertTailList (&(ElementList->ListStart), &(Tag->DataLink));
   ElementList->ItemCount++;
   return Tag;
@@ -278,6 +463,8 @@ DriverXmlCreateTag (
 /**
   Add an XML element to the child list of a provided XML element.
   A new XML element will be allocated and returned to the caller.
+  The parent is marked as modified, so PrintDataIncremental renders it with the new
+  child instead of copying it from the document it was parsed from.
 
   @param[in out] ParentElement       The parent XML element to add a child to.
   @param[in]     ChildTagName    The element name parsed out of the XML data for the child. See the XML spec.
@@ -294,10 +481,13 @@ DriverXmlCreateChildTag (
   DRIVER_XML_TAG* ChildElement;
   
   ChildElement = DriverXmlCreateTag (
-                   &ParentElement->TagChildren,
+                   ParentElement,
                    ChildTagName,
                    ChildDataType
                    );
+  if (ChildElement != NULL) {
+    DriverXmlMarkModified (ParentElement);
+  }
 
   return ChildElement;
 }
@@ -320,12 +510,13 @@ DriverXmlDeleteChildElement (
   LIST_ANCHOR* ElementList;
 
   ElementList = &((DRIVER_XML_TAG*)ParentElement)->TagChildren;
-  DriverXmlDeleteElement (ElementList,Element);
+  RemoveElement (ElementList, Element);
   return;
 }
 
 EFI_STATUS
 ParseAttributes (
+  XML_PARSER_CONTEXT* Context,
   DRIVER_XML_TAG* Element,
   CHAR8* Chunk
 ){
@@ -333,11 +524,15 @@ ParseAttributes (
   CHAR8* Attribute;
   CHAR8* AttributeName;
   CHAR8* AttributeData;
+  CHAR8* ExpandedData;
+  UINTN ExpandedLength;
+  UINTN DataLength;
   DRIVER_XML_ATTRIBUTE* LocalXmlAttributes;
+  DRIVER_XML_PARSE_LIMITS* Limits;
   
   
   Status = EFI_SUCCESS;
-
+  Limits = &Context->Options.Limits;
   
   if (!IsAsciiXmlTagWithAttributes(Chunk,&Attribute)){
     return EFI_SUCCESS;
@@ -354,7 +549,54 @@ ParseAttributes (
         );
     if (!EFI_ERROR(Status)){
       //DEBUG((DEBUG_ERROR, "Got attribute %a:%a\n",AttributeName,AttributeData));
-      LocalXmlAttributes = DriverXmlAddAttribute(Element,AttributeName,AttributeData);
+      if ((Context->Options.Flags & DRIVER_XML_PARSE_EXPAND_ENTITIES) != 0 
+          && AttributeData != NULL 
+          && AsciiStrStr (AttributeData, "&") != NULL) 
+      {
+        Status = DriverXmlExpandReferences (
+                   Context,
+                   AttributeData,
+                   AsciiStrLen (AttributeData),
+                   &ExpandedData,
+                   &ExpandedLength
+                   );
+        DriverXmlFreePool (AttributeData);
+        if (EFI_ERROR (Status)) {
+          DriverXmlFreePool (AttributeName);
+          return Status;
+        }
+        AttributeData = ExpandedData;
+      }
+      DataLength = (AttributeData != NULL) ? AsciiStrLen (AttributeData) : 0;
+      if (Limits->MaxAttributes != 0 && Element->TagAttributes.ItemCount >= Limits->MaxAttributes) {
+        DEBUG((DEBUG_ERROR, "Tag %a has more than %d attributes\n", Element->TagName, Limits->MaxAttributes));
+        Status = EFI_SECURITY_VIOLATION;
+      } else if (Limits->MaxTextLength != 0 && DataLength > Limits->MaxTextLength) {
+        DEBUG((DEBUG_ERROR, "Attribute %a longer than the %d character limit\n", AttributeName, Limits->MaxTextLength));
+        Status = EFI_SECURITY_VIOLATION;
+      } else {
+        Status = ChargeParseBudget (
+                   Context,
+                   0,
+                   sizeof (DRIVER_XML_ATTRIBUTE) + AsciiStrLen (AttributeName) + 1 + DataLength + 1
+                   );
+      }
+      LocalXmlAttributes = NULL;
+      if (!EFI_ERROR (Status)) {
+        LocalXmlAttributes = DriverXmlAddAttribute(Element,AttributeName,AttributeData);
+        if (LocalXmlAttributes == NULL) {
+          Status = EFI_OUT_OF_RESOURCES;
+        } else if ((Context->Options.Flags & DRIVER_XML_PARSE_EXPAND_ENTITIES) == 0) {
+          LocalXmlAttributes->Flags |= DRIVER_XML_TEXT_RAW;
+        }
+      }
+      if (EFI_ERROR (Status)) {
+        DriverXmlFreePool (AttributeName);
+        if (AttributeData != NULL) {
+          DriverXmlFreePool (AttributeData);
+        }
+        return Status;
+      }
     } else {
       //
       // Aborted means we hit the end of the element. 
@@ -381,7 +623,8 @@ ParseAttributes (
   @param[in out] ElementList    The list of XML elements to add a new one to.
   @param[in]     CharData       The XML content block to be added.
   
-  @return  The XML content element that was allocated with the pointer to the content storage set up.
+  @return  The XML content element that was allocated with the pointer to the content storage set up,
+           or NULL if there was no memory.
 **/
 DRIVER_XML_DATA_HEADER*
 DriverXmlAddCharData (
@@ -390,15 +633,21 @@ DriverXmlAddCharData (
   UINTN CharDataLen
   )
 {
-  DRIVER_XML_CHAR_DATA *LocalCharData = AllocateZeroPool (sizeof(DRIVER_XML_CHAR_DATA));
+  DRIVER_XML_CHAR_DATA *LocalCharData = DriverXmlAllocatePool (XmlAllocCharData, sizeof(DRIVER_XML_CHAR_DATA));
 
-  ASSERT(LocalCharData!=NULL);
+  if (LocalCharData == NULL) {
+    return NULL;
+  }
   
   LocalCharData->XmlDataType = XmlChar;
   //
   // extra +1 is to make sure there is a terminating null if anyone prints it as a string
   //
-  LocalCharData->CharData = AllocateZeroPool(CharDataLen + 1); 
+  LocalCharData->CharData = DriverXmlAllocatePool (XmlAllocString, CharDataLen + 1); 
+  if (LocalCharData->CharData == NULL) {
+    DriverXmlFreePool (LocalCharData);
+    return NULL;
+  }
   LocalCharData->DataSize = CharDataLen;
   
   gBS->CopyMem (
@@ -415,47 +664,88 @@ DriverXmlAddCharData (
   This will add either a start tag, or and empty tag to the supplied list.
   This will extract the name and all attributes on the tag. All necessary memory
   is allocated by the worker functions. 
+  When namespace processing is enabled the tag's xmlns attributes are pushed on the 
+  binding stack and the names are resolved. The caller pops the bindings.
 
+  @param[in out] Context     The parser state holding the options and namespace bindings.
   @param[in out] ParentList  The list of XML elements to add a new one to.
   @param[in]     XmlString   The war XML string containing all the markup
+  @param[in]     DataType    XmlTag or XmlEmptyTag.
+  @param[out]    NewTag      The XML tag data structure that was created.
   
-  @return  The XML tag data structure that was created.
+  @retval EFI_SUCCESS             The tag was added to the parent.
+  @retval EFI_DEVICE_ERROR        The tag was malformed or used an unbound namespace prefix.
+  @retval EFI_SECURITY_VIOLATION  A parse limit was exceeded.
+  @retval EFI_OUT_OF_RESOURCES    There was not enough memory for the tag.
 **/
-DRIVER_XML_DATA_HEADER*
+EFI_STATUS
 DriverXmlAddTag (
+    XML_PARSER_CONTEXT* Context,
     DRIVER_XML_DATA_HEADER* ParentElement,
     CHAR8* XmlString,
-    XML_DATA_TYPE DataType
+    XML_DATA_TYPE DataType,
+    DRIVER_XML_DATA_HEADER** NewTag
 ){
   CHAR8* TagName;
   DRIVER_XML_TAG* LocalElement;
   DRIVER_XML_TAG* ParentTag;
   EFI_STATUS Status;
 
+  *NewTag = NULL;
   if (ParentElement->XmlDataType != XmlTag 
       && ParentElement->XmlDataType != XmlEmptyTag)
   {
-    return NULL;
+    return EFI_INVALID_PARAMETER;
   }
   ParentTag = (DRIVER_XML_TAG*)ParentElement;
   Status = AsciiGetTagNameFromElement (
              XmlString,
              &TagName
              );
-  LocalElement = DriverXmlCreateChildTag (
+  if (EFI_ERROR (Status)) {
+    return EFI_DEVICE_ERROR;
+  }
+  Status = ChargeParseBudget (Context, 1, sizeof (DRIVER_XML_TAG) + AsciiStrLen (TagName) + 1);
+  if (EFI_ERROR (Status)) {
+    DriverXmlFreePool (TagName);
+    return Status;
+  }
+  LocalElement = DriverXmlCreateTag (
                    ParentTag,
                    TagName,
                    DataType
                    );
-  Status = ParseAttributes (LocalElement, XmlString);
+  if (LocalElement == NULL) {
+    DriverXmlFreePool (TagName);
+    return EFI_OUT_OF_RESOURCES;
+  }
+  Status = ParseAttributes (Context, LocalElement, XmlString);
   if (EFI_ERROR (Status) && Status != EFI_NOT_FOUND) {
     DEBUG((DEBUG_ERROR, "Deleting bad attribute\n"));
     DriverXmlDeleteChildElement(
       ParentTag,
       (DRIVER_XML_DATA_HEADER*)LocalElement
       );
+    //
+    // Entity limits are reported as is so the caller can tell them apart from bad markup.
+    //
+    if (Status == EFI_SECURITY_VIOLATION || Status == EFI_OUT_OF_RESOURCES) {
+      return Status;
+    }
+    return EFI_DEVICE_ERROR;
   }
-  return (DRIVER_XML_DATA_HEADER*)LocalElement;
+  if ((Context->Options.Flags & DRIVER_XML_PARSE_NAMESPACES) != 0) {
+    Status = DriverXmlResolveNamespaces (Context, LocalElement);
+    if (EFI_ERROR (Status)) {
+      DriverXmlDeleteChildElement(
+        ParentTag,
+        (DRIVER_XML_DATA_HEADER*)LocalElement
+        );
+      return Status;
+    }
+  }
+  *NewTag = (DRIVER_XML_DATA_HEADER*)LocalElement;
+  return EFI_SUCCESS;
 }
 
 DRIVER_XML_DATA_HEADER*
@@ -478,7 +768,16 @@ DriverXmlAddPI (
       &PiTargetName,
       &PiTargetData
       );
-  LocalPi = AllocateZeroPool(sizeof(DRIVER_XML_PROCESSING_INSTRUCTION));
+  LocalPi = DriverXmlAllocatePool (XmlAllocPi, sizeof(DRIVER_XML_PROCESSING_INSTRUCTION));
+  if (LocalPi == NULL) {
+    if (PiTargetName != NULL) {
+      DriverXmlFreePool (PiTargetName);
+    }
+    if (PiTargetData != NULL) {
+      DriverXmlFreePool (PiTargetData);
+    }
+    return NULL;
+  }
   LocalPi->XmlDataType = XmlPi;
   LocalPi->PiTargetName = PiTargetName;
   LocalPi->PiTargetData = PiTargetData;
@@ -488,6 +787,27 @@ DriverXmlAddPI (
   return (DRIVER_XML_DATA_HEADER*)LocalPi;
 }
 
+/**
+  Finish an element whose content has been parsed. Its span is extended past the close tag
+  and the namespace bindings declared on it go out of scope.
+
+  @param[in out] Context  The parser state.
+  @param[in out] Tag      The element that ended.
+
+  @return The parent of the element, which the parse carries on in.
+**/
+DRIVER_XML_TAG*
+EndParsedElement (
+  XML_PARSER_CONTEXT* Context,
+  DRIVER_XML_TAG*     Tag
+  )
+{
+  Tag->SourceLength = Context->Document.OperationPtr - Context->SourceBase - Tag->SourceOffset;
+  Context->Depth--;
+  DriverXmlPopNamespaceBindings (Context);
+  return Tag->Parent;
+}
+
 /**
   Actual parser code. The process is as follows:
   1) Extract something from < to the closing > 
@@ -496,13 +816,13 @@ DriverXmlAddPI (
   3) Element is checked for the presence of attributes, 
      if it is an empty element, or if it is a close tag.
   4) Attributes are extracted and added to a list of attributes on the element.
-  5) If the element is not empty or a close tag, 
-     this function is recursively called to parse discovered branches.
+  5) If the element is not empty or a close tag, it becomes the parent and parsing carries on
+     inside it. Its close tag moves back up through the Parent link, so nesting costs no stack.
   6) Control gets returned to the caller when the close tag for the parent element is found, 
      or the EOF is found. Caller can tell if EOF is expected or not.
   
 
-  @param[in] Xml           The XML document data and stream pointers to assist in parsing..
+  @param[in] Context       The parser state holding the document stream pointers and parse options.
   @param[in] EndOfData     The end of the data as determined by a caller further up in the process.
   @param[in out] Parent    The parent XML element for the branch.
   
@@ -514,70 +834,150 @@ DriverXmlAddPI (
 **/
 EFI_STATUS
 ParseBranch (
-  XML_DOCUMENT *Xml,
+  XML_PARSER_CONTEXT* Context,
   CHAR8* EndOfData,
   DRIVER_XML_DATA_HEADER* Parent
   )
 {
+  XML_DOCUMENT* Xml;
   CHAR8* Chunk;
+  UINTN ChunkLength;
   XML_DATA_TYPE DataType;
   CHAR8* TagName;
   CHAR8* ParentName;
   DRIVER_XML_DATA_HEADER* LocalXmlData;
+  DRIVER_XML_TAG* Tag;
+  DRIVER_XML_TAG* Top;
+  DRIVER_XML_CHAR_DATA* CharData;
+  CHAR8* ExpandedData;
+  UINTN ExpandedLength;
   EFI_STATUS Status;
-  CHAR8* OldOpPtr;
   
   // We only expect tags to contain children to parse through.
   if (Parent->XmlDataType != XmlTag) {
     return EFI_INVALID_PARAMETER;
   }
+  Xml = &Context->Document;
+  Top = (DRIVER_XML_TAG*)Parent;
   while (Xml->OperationPtr < EndOfData) {
-    OldOpPtr = Xml->OperationPtr;
     Status = AsciiExtractMarkupOrText(
-               Xml,
+               Context,
                &Chunk,
+               &ChunkLength,
                &DataType
                );
     if (!(EFI_ERROR(Status))) {
       switch (DataType) {
       case XmlPi:
         //add handling
-        DriverXmlAddPI (
-            Parent,
-            Chunk,
-            DataType
-        );
+        Status = ChargeParseBudget (Context, 1, sizeof (DRIVER_XML_PROCESSING_INSTRUCTION) + ChunkLength);
+        if (!EFI_ERROR (Status) 
+            && DriverXmlAddPI (Parent, Chunk, DataType) == NULL) 
+        {
+          Status = EFI_OUT_OF_RESOURCES;
+        }
+        if (EFI_ERROR (Status)) {
+          DriverXmlFreePool (Chunk);
+          return Status;
+        }
         break;
       case XmlDecl:
         //this is a broad category, break it down more?
+        //For now only the entities in a DOCTYPE are kept.
+        if ((Context->Options.Flags & DRIVER_XML_PARSE_EXPAND_ENTITIES) != 0) {
+          Status = DriverXmlParseDoctype (Context, Chunk, ChunkLength);
+          if (EFI_ERROR (Status)) {
+            DEBUG((DEBUG_ERROR, "Bad DOCTYPE %r\n", Status));
+            DriverXmlFreePool (Chunk);
+            return Status;
+          }
+        }
         break;
       case XmlChar:
-        // Need solid handling here because data can be very long
-        // use the operations pointer to get the data size.
-        DriverXmlAddCharData (
-            &((DRIVER_XML_TAG*)Parent)->TagChildren,
-            Chunk,
-            Xml->OperationPtr - OldOpPtr
-            );
+        // Need solid handling here because data can be very long.
+        // The tokenizer reports the size since trimming may have shortened the chunk.
+        if ((Context->Options.Flags & DRIVER_XML_PARSE_EXPAND_ENTITIES) != 0 
+            && AsciiStrStr (Chunk, "&") != NULL) 
+        {
+          Status = DriverXmlExpandReferences (
+                     Context,
+                     Chunk,
+                     ChunkLength,
+                     &ExpandedData,
+                     &ExpandedLength
+                     );
+          DriverXmlFreePool (Chunk);
+          if (EFI_ERROR (Status)) {
+            return Status;
+          }
+          Chunk = ExpandedData;
+          ChunkLength = ExpandedLength;
+          if (Context->Options.Limits.MaxTextLength != 0 
+              && ChunkLength > Context->Options.Limits.MaxTextLength) 
+          {
+            DEBUG((DEBUG_ERROR, "Expanded char data longer than the %d character limit\n", Context->Options.Limits.MaxTextLength));
+            DriverXmlFreePool (Chunk);
+            return EFI_SECURITY_VIOLATION;
+          }
+        }
+        DEBUG_TRACE2 ("ParseBranch: %d bytes of char data at depth %d\n", ChunkLength, Context->Depth);
+        Status = ChargeParseBudget (Context, 1, sizeof (DRIVER_XML_CHAR_DATA) + ChunkLength + 1);
+        if (!EFI_ERROR (Status)) {
+          CharData = (DRIVER_XML_CHAR_DATA*)DriverXmlAddCharData (
+                                              &((DRIVER_XML_TAG*)Parent)->TagChildren,
+                                              Chunk,
+                                              ChunkLength
+                                              );
+          if (CharData == NULL) {
+            Status = EFI_OUT_OF_RESOURCES;
+          } else if ((Context->Options.Flags & DRIVER_XML_PARSE_EXPAND_ENTITIES) == 0) {
+            CharData->Flags |= DRIVER_XML_TEXT_RAW;
+          }
+        }
+        if (EFI_ERROR (Status)) {
+          DriverXmlFreePool (Chunk);
+          return Status;
+        }
         break;
       case XmlTag:
-        LocalXmlData = DriverXmlAddTag(
-                         Parent,
-                         Chunk,
-                         DataType
-                         );
-        Status = ParseBranch(
-            Xml,
-            EndOfData,
-            LocalXmlData
-            );
-        break;
       case XmlEmptyTag:
-        LocalXmlData = DriverXmlAddTag(
-                         Parent,
-                         Chunk,
-                         DataType
-                         );
+        //
+        // Depth is checked before the tag is added.
+        //
+        if (Context->Options.Limits.MaxDepth != 0 
+            && Context->Depth >= Context->Options.Limits.MaxDepth) 
+        {
+          DEBUG((DEBUG_ERROR, "Tags nested deeper than the %d level limit\n", Context->Options.Limits.MaxDepth));
+          DriverXmlFreePool (Chunk);
+          return EFI_SECURITY_VIOLATION;
+        }
+        //
+        // Namespace declarations on the tag are in scope until its close tag.
+        //
+        Status = DriverXmlAddTag(
+                   Context,
+                   Parent,
+                   Chunk,
+                   DataType,
+                   &LocalXmlData
+                   );
+        if (EFI_ERROR (Status)) {
+          DriverXmlFreePool (Chunk);
+          return Status;
+        }
+        //
+        // The chunk is a copy of the start tag and the stream pointer is just past it.
+        //
+        Tag = (DRIVER_XML_TAG*)LocalXmlData;
+        Tag->SourceOffset = (Xml->OperationPtr - AsciiStrLen (Chunk)) - Context->SourceBase;
+        Tag->SourceLength = Xml->OperationPtr - Context->SourceBase - Tag->SourceOffset;
+        DEBUG_TRACE2 ("ParseBranch: tag at offset %d, depth %d\n", Tag->SourceOffset, Context->Depth);
+        if (DataType == XmlTag) {
+          Context->Depth++;
+          Parent = LocalXmlData;
+        } else {
+          DriverXmlPopNamespaceBindings (Context);
+        }
         break;
       case XmlCloseTag:
         Status = AsciiGetTagNameFromElement(
@@ -590,35 +990,34 @@ ParseBranch (
         ParentName = ((DRIVER_XML_TAG*)Parent)->TagName;
         if (AsciiStrCmp(TagName, ParentName) != 0){
           DEBUG((DEBUG_ERROR,"Close tag mismatch: Parent: %a current: %a\n", ParentName, TagName));
-          gBS->FreePool(TagName);
-          gBS->FreePool(Chunk);
+          DriverXmlFreePool (TagName);
+          DriverXmlFreePool (Chunk);
           return EFI_DEVICE_ERROR;
-        } else {
-          gBS->FreePool(TagName);
-          gBS->FreePool(Chunk);
-          return EFI_SUCCESS; 
         }
-        break;
+        DriverXmlFreePool (TagName);
+        DriverXmlFreePool (Chunk);
+        if ((DRIVER_XML_TAG*)Parent == Top) {
+          return EFI_SUCCESS;
+        }
+        Parent = (DRIVER_XML_DATA_HEADER*)EndParsedElement (Context, (DRIVER_XML_TAG*)Parent);
+        continue;
       default:
         break;
       }
 
-      gBS->FreePool(Chunk);
+      DriverXmlFreePool (Chunk);
     } else {
       DEBUG((DEBUG_ERROR, "Error %r\n", Status));
       if (Status == EFI_END_OF_FILE) {
-        
         //
-        // TODO: fix this. We need to make sure we hit the real EOF and we don't have an incomplete file
-        // 
-        ParentName = ((DRIVER_XML_TAG*)Parent)->TagName;
-        if (AsciiStrCmp(ParentName,"Root") == 0) {
-        	DEBUG((DEBUG_ERROR,"End of file reached, all done!\n"));
-        	return EFI_SUCCESS;
-        } else {
-          DEBUG((DEBUG_ERROR,"Unclosed tag %a\n",ParentName));
-          return EFI_END_OF_FILE;
+        // The end of the data is only the end of the document when no element is left open.
+        //
+        if ((DRIVER_XML_TAG*)Parent == Top) {
+          DEBUG((DEBUG_ERROR,"End of file reached, all done!\n"));
+          return EFI_SUCCESS;
         }
+        DEBUG((DEBUG_ERROR,"Unclosed tag %a\n",((DRIVER_XML_TAG*)Parent)->TagName));
+        return EFI_END_OF_FILE;
       }
       DEBUG((DEBUG_ERROR,"Failed to extract next chunk\n"));
       DEBUG((DEBUG_ERROR,"Status returned is %r\n",Status));
@@ -626,6 +1025,13 @@ ParseBranch (
     }
   }
 
+  //
+  // The data ran out. A document that stops inside an element is truncated.
+  //
+  if ((DRIVER_XML_TAG*)Parent != Top) {
+    DEBUG((DEBUG_ERROR,"Unclosed tag %a\n",((DRIVER_XML_TAG*)Parent)->TagName));
+    return EFI_END_OF_FILE;
+  }
   return EFI_SUCCESS;
 }
 
@@ -652,35 +1058,113 @@ DriverXmlParse(
   DRIVER_XML_DATA_HEADER** XmlTree
   )
 {
-  EFI_STATUS Status;  
-  XML_DOCUMENT Xml;
-  CHAR8* EndOfData;
-  DRIVER_XML_TAG* Root = AllocateZeroPool (sizeof (DRIVER_XML_TAG));
-  CHAR8* RootStr = AllocateZeroPool (5);
-  
+  return DriverXmlParseEx (XmlText, DocSize, NULL, XmlTree);
+}
+
+/**
+  Allocate the root tag every tree hangs from.
+
+  @param[out] Root  The new root.
+
+  @retval EFI_SUCCESS           The root was created.
+  @retval EFI_OUT_OF_RESOURCES  There was not enough memory.
+**/
+EFI_STATUS
+CreateRootTag (
+  DRIVER_XML_TAG** Root
+  )
+{
+  DRIVER_XML_TAG* LocalRoot;
+  CHAR8*          RootStr;
+
   // 
   // XML talks of a root. Create one, and maybe use for metadata in the future.
   // If root were a global, we might need a rocket too.
   //
-  Root = AllocateZeroPool (sizeof (DRIVER_XML_TAG));
+  LocalRoot = DriverXmlAllocatePool (XmlAllocTag, sizeof (DRIVER_XML_TAG));
+  RootStr = DriverXmlAllocatePool (XmlAllocString, 5);
+  if (LocalRoot == NULL || RootStr == NULL) {
+    if (LocalRoot != NULL) {
+      DriverXmlFreePool (LocalRoot);
+    }
+    if (RootStr != NULL) {
+      DriverXmlFreePool (RootStr);
+    }
+    return EFI_OUT_OF_RESOURCES;
+  }
   RootStr[0] = 'R';
   RootStr[1] = 'o';
   RootStr[2] = 'o';
   RootStr[3] = 't';
-  Root->TagName = RootStr;
-  Root->XmlDataType = XmlTag;
-  
-  Xml.XmlDocument = (CHAR8*)XmlText;
-  Xml.DocumentSize = DocSize;
-  Xml.OperationPtr = Xml.XmlDocument;  
-  EndOfData = Xml.XmlDocument + Xml.DocumentSize;
-  
-  Status = EFI_SUCCESS;
+  LocalRoot->TagName = RootStr;
+  LocalRoot->XmlDataType = XmlTag;
+  InitializeListHead(&LocalRoot->TagChildren.ListStart);
+  InitializeListHead(&LocalRoot->TagAttributes.ListStart);
+  *Root = LocalRoot;
+  return EFI_SUCCESS;
+}
+
+/**
+  Set up the parser state for a run over part or all of a document.
 
-  InitializeListHead(&Root->TagChildren.ListStart);
-  while (Xml.OperationPtr < EndOfData) {
+  @param[out] Context     The parser state to fill out.
+  @param[in]  SourceBase  The start of the whole document. Source spans are measured from here.
+  @param[in]  Text        The first character to parse.
+  @param[in]  Size        The number of characters to parse.
+  @param[in]  Options     Optional parse options. NULL selects DRIVER_XML_PARSE_DEFAULT_FLAGS.
+**/
+VOID
+InitializeParserContext (
+  XML_PARSER_CONTEXT*       Context,
+  CHAR8*                    SourceBase,
+  CHAR8*                    Text,
+  UINTN                     Size,
+  DRIVER_XML_PARSE_OPTIONS* Options
+  )
+{
+  gBS->SetMem (Context, sizeof (XML_PARSER_CONTEXT), 0);
+  Context->Document.XmlDocument = Text;
+  Context->Document.DocumentSize = Size;
+  Context->Document.OperationPtr = Text;
+  Context->SourceBase = SourceBase;
+  if (Options != NULL) {
+    Context->Options = *Options;
+  } else {
+    Context->Options.Flags = DRIVER_XML_PARSE_DEFAULT_FLAGS;
+  }
+  Context->MaxEntityDepth = Context->Options.MaxEntityDepth;
+  if (Context->MaxEntityDepth == 0) {
+    Context->MaxEntityDepth = DRIVER_XML_DEFAULT_MAX_ENTITY_DEPTH;
+  }
+  Context->MaxEntityExpansion = Context->Options.MaxEntityExpansion;
+  if (Context->MaxEntityExpansion == 0) {
+    Context->MaxEntityExpansion = DRIVER_XML_DEFAULT_MAX_ENTITY_EXPANSION;
+  }
+}
+
+/**
+  Parse everything in the context's document into the children of Root, then release
+  the namespace and entity state the parse built up.
+
+  @param[in]     Context  The parser state from InitializeParserContext.
+  @param[in out] Root     The tag to add the top level elements to.
+
+  @return Status information from ParseBranch.
+**/
+EFI_STATUS
+ParseDocument (
+  XML_PARSER_CONTEXT* Context,
+  DRIVER_XML_TAG*     Root
+  )
+{
+  EFI_STATUS Status;
+  CHAR8*     EndOfData;
+
+  Status = EFI_SUCCESS;
+  EndOfData = Context->Document.XmlDocument + Context->Document.DocumentSize;
+  while (Context->Document.OperationPtr < EndOfData) {
     Status = ParseBranch(
-        &Xml,
+        Context,
         EndOfData,
         (DRIVER_XML_DATA_HEADER*)Root
         );
@@ -690,9 +1174,318 @@ DriverXmlParse(
     }
     DEBUG((DEBUG_ERROR, "%d children on root\n", Root->TagChildren.ItemCount));
   }
+  DriverXmlFreeNamespaceBindings (Context);
+  DriverXmlFreeEntities (Context);
+  return Status;
+}
+
+/**
+  Parse an XML document with caller supplied options.
+  DriverXmlParse is the same as calling this with NULL options.
+
+  @param[in] XmlText      The XML document to be parsed.
+  @param[in] DocSize      The size of he XML text document
+  @param[in] Options      Optional parse options. NULL selects DRIVER_XML_PARSE_DEFAULT_FLAGS.
+  @param[in out] XmlTree  A pointer to return the root element on.
+
+  @retval EFI_DEVICE_ERROR        There was a tag mismatch or other malformed data in the document.
+  @retval EFI_END_OF_FILE         The end of the document was reached before the proper end of an element.
+  @retval EFI_SECURITY_VIOLATION  One of the Options->Limits budgets or an entity limit was exceeded.
+  @retval EFI_OUT_OF_RESOURCES    There was not enough memory for the tree.
+
+**/
+EFI_STATUS
+DriverXmlParseEx(
+  VOID*                     XmlText,
+  UINTN                     DocSize,
+  DRIVER_XML_PARSE_OPTIONS* Options,
+  DRIVER_XML_DATA_HEADER**  XmlTree
+  )
+{
+  EFI_STATUS Status;  
+  XML_PARSER_CONTEXT Context;
+  DRIVER_XML_TAG* Root;
+  
+  if (XmlText == NULL || XmlTree == NULL) {
+    return EFI_INVALID_PARAMETER;
+  }
+  if (Options != NULL 
+      && (Options->Flags & DRIVER_XML_PARSE_NAMESPACES) != 0 
+      && Options->NameTable == NULL) 
+  {
+    return EFI_INVALID_PARAMETER;
+  }
+  Status = CreateRootTag (&Root);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+  Root->SourceLength = DocSize;
+  DEBUG_TRACE1 ("DriverXmlParseEx: parsing %d bytes\n", DocSize);
+  InitializeParserContext (&Context, XmlText, XmlText, DocSize, Options);
+  Status = ParseDocument (&Context, Root);
+  DEBUG_TRACE1 ("DriverXmlParseEx: %r\n", Status);
   if (!EFI_ERROR(Status)){
 	  *XmlTree = (DRIVER_XML_DATA_HEADER*)Root;
+  } else {
+    //
+    // Give back everything a failed parse allocated so a rejected document
+    // costs nothing once this returns.
+    //
+    DriverXmlFreeTree ((DRIVER_XML_DATA_HEADER*)Root);
+  }
+  return Status;  
+}
+
+//
+// The edit ShiftSourceSpan moves the tree's spans for.
+//
+typedef struct _XML_SPAN_SHIFT {
+  UINTN OldEnd;     // The offset just past the replaced bytes in the old document.
+  UINTN OldLength;  // The number of bytes replaced.
+  UINTN NewLength;  // The number of bytes that replaced them.
+} XML_SPAN_SHIFT;
+
+/**
+  Span shift handler. Moves the source span of one tag to account for an edit. Tags that start
+  after the replaced bytes move by the change in length and tags that contain them grow or shrink.
+  Branches that end before the edit are skipped.
+
+  @param[in] Element  The tag to update.
+  @param[in] Depth    The depth of the tag in the walk. Not used.
+  @param[in] Context  The XML_SPAN_SHIFT describing the edit.
+
+  @retval EFI_SUCCESS            The span was moved and the children need looking at.
+  @retval DRIVER_XML_VISIT_SKIP  The branch ends before the edit and was left alone.
+**/
+EFI_STATUS
+ShiftSourceSpan (
+  DRIVER_XML_DATA_HEADER* Element,
+  UINTN                   Depth,
+  VOID*                   Context
+  )
+{
+  DRIVER_XML_TAG* Tag;
+  XML_SPAN_SHIFT* Shift;
+
+  Tag = (DRIVER_XML_TAG*)Element;
+  Shift = (XML_SPAN_SHIFT*)Context;
+  if (Tag->SourceOffset + Tag->SourceLength < Shift->OldEnd
+      || (Tag->SourceOffset + Tag->SourceLength == Shift->OldEnd && Shift->OldLength == 0)) 
+  {
+    return DRIVER_XML_VISIT_SKIP;
+  }
+  if (Tag->SourceOffset >= Shift->OldEnd) {
+    Tag->SourceOffset = Tag->SourceOffset + Shift->NewLength - Shift->OldLength;
+  } else {
+    Tag->SourceLength = Tag->SourceLength + Shift->NewLength - Shift->OldLength;
+  }
+  return EFI_SUCCESS;
+}
+
+CONST DRIVER_XML_VISITOR mXmlSpanShifter = {
+  {
+    NULL,             // XmlNothing
+    ShiftSourceSpan,  // XmlEmptyTag
+    ShiftSourceSpan,  // XmlTag
+    NULL,             // XmlCloseTag
+    NULL,             // XmlAttribute
+    NULL,             // XmlChar
+    NULL,             // XmlPi
+    NULL,             // XmlDecl
+    NULL              // XmlComment
+  },
+  { NULL }
+};
+
+/**
+  Find the innermost element whose source span holds all of the replaced bytes.
+  An insertion right at the start or end of an element belongs to its parent.
+
+  @param[in]  Root          The root of the tree.
+  @param[in]  ChangeOffset  The offset of the first replaced byte.
+  @param[in]  OldLength     The number of bytes replaced.
+  @param[out] Parent        The tag holding the element.
+  @param[out] Depth         How deeply the element is nested.
+
+  @return The element, or NULL if no element holds the edit.
+**/
+DRIVER_XML_TAG*
+FindEnclosingElement (
+  DRIVER_XML_TAG*  Root,
+  UINTN            ChangeOffset,
+  UINTN            OldLength,
+  DRIVER_XML_TAG** Parent,
+  UINTN*           Depth
+  )
+{
+  DRIVER_XML_TAG*         Current;
+  DRIVER_XML_TAG*         Found;
+  DRIVER_XML_TAG*         Tag;
+  DRIVER_XML_DATA_HEADER* Child;
+  UINTN                   Start;
+  UINTN                   End;
+
+  Current = Root;
+  Found = NULL;
+  *Depth = 0;
+  while (Current->TagChildren.ItemCount > 0) {
+    Tag = NULL;
+    Child = (DRIVER_XML_DATA_HEADER*)&Current->TagChildren.ListStart;
+    while (GetNextXmlElement (&Current->TagChildren, Child, &Child) == EFI_SUCCESS) {
+      if (Child->XmlDataType != XmlTag && Child->XmlDataType != XmlEmptyTag) {
+        continue;
+      }
+      Start = ((DRIVER_XML_TAG*)Child)->SourceOffset;
+      End = Start + ((DRIVER_XML_TAG*)Child)->SourceLength;
+      if (ChangeOffset < Start || ChangeOffset + OldLength > End) {
+        continue;
+      }
+      if (OldLength == 0 && (ChangeOffset == Start || ChangeOffset == End)) {
+        continue;
+      }
+      Tag = (DRIVER_XML_TAG*)Child;
+      break;
+    }
+    if (Tag == NULL) {
+      break;
+    }
+    *Parent = Current;
+    Found = Tag;
+    Current = Tag;
+    (*Depth)++;
   }
-  return EFI_SUCCESS;  
+  //
+  // Depth counts the element itself; the parser counts the tags above what it is adding.
+  //
+  if (Found != NULL) {
+    (*Depth)--;
+  }
+  return Found;
 }
 
+/**
+  Update a tree after part of its document was rewritten, parsing only the innermost element
+  that holds the change. The element is replaced by the newly parsed one and every other node 
+  in the tree stays where it is, with its source span moved to match the new document.
+
+  The change is described by the bytes it replaced: OldLength bytes at ChangeOffset in the old
+  document became NewLength bytes at the same offset in NewText.
+
+  @param[in]     NewText       The whole document after the change.
+  @param[in]     NewSize       The size of NewText.
+  @param[in]     ChangeOffset  The offset of the first changed byte.
+  @param[in]     OldLength     The number of bytes replaced in the old document.
+  @param[in]     NewLength     The number of bytes that replaced them.
+  @param[in]     Options       The options the tree was parsed with, or NULL for the defaults.
+  @param[in out] XmlTree       The tree from parsing the old document.
+
+  @retval EFI_SUCCESS             The tree matches NewText.
+  @retval EFI_UNSUPPORTED         The change could not be handled by parsing one element, for example
+                                  it is outside every element, the element no longer parses on its own,
+                                  or the parse uses namespaces or entities from outside the element.
+                                  The tree is unchanged; parse the whole document again.
+  @retval EFI_INVALID_PARAMETER   A pointer was NULL or the range is outside the document.
+  @retval EFI_SECURITY_VIOLATION  The element went over one of the Options->Limits budgets.
+  @retval EFI_OUT_OF_RESOURCES    There was not enough memory. The tree is unchanged.
+**/
+EFI_STATUS
+DriverXmlReparseRange (
+  CONST CHAR8*              NewText,
+  UINTN                     NewSize,
+  UINTN                     ChangeOffset,
+  UINTN                     OldLength,
+  UINTN                     NewLength,
+  DRIVER_XML_PARSE_OPTIONS* Options,
+  DRIVER_XML_DATA_HEADER*   XmlTree
+  )
+{
+  EFI_STATUS              Status;
+  XML_PARSER_CONTEXT      Context;
+  DRIVER_XML_TAG*         Root;
+  DRIVER_XML_TAG*         Parent;
+  DRIVER_XML_TAG*         OldElement;
+  DRIVER_XML_TAG*         Scratch;
+  DRIVER_XML_DATA_HEADER* NewElement;
+  UINTN                   Depth;
+  UINTN                   Start;
+  UINTN                   NewElementLength;
+  XML_SPAN_SHIFT          Shift;
+
+  if (NewText == NULL || XmlTree == NULL || XmlTree->XmlDataType != XmlTag) {
+    return EFI_INVALID_PARAMETER;
+  }
+  if (ChangeOffset > NewSize || NewLength > NewSize - ChangeOffset) {
+    return EFI_INVALID_PARAMETER;
+  }
+  //
+  // Prefix bindings and entity declarations live outside the element and are gone
+  // once the original parse returns, so those parses can't be done piecewise.
+  //
+  if (Options != NULL 
+      && (Options->Flags & (DRIVER_XML_PARSE_NAMESPACES | DRIVER_XML_PARSE_EXPAND_ENTITIES)) != 0) 
+  {
+    return EFI_UNSUPPORTED;
+  }
+  Root = (DRIVER_XML_TAG*)XmlTree;
+  Parent = NULL;
+  OldElement = FindEnclosingElement (Root, ChangeOffset, OldLength, &Parent, &Depth);
+  if (OldElement == NULL) {
+    return EFI_UNSUPPORTED;
+  }
+  Start = OldElement->SourceOffset;
+  NewElementLength = OldElement->SourceLength + NewLength - OldLength;
+  if (Start + NewElementLength > NewSize) {
+    return EFI_INVALID_PARAMETER;
+  }
+
+  //
+  // Parse the element's new text on its own. Spans are still measured from the
+  // start of the document so the new nodes line up with the rest of the tree.
+  //
+  Status = CreateRootTag (&Scratch);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+  InitializeParserContext (&Context, (CHAR8*)NewText, (CHAR8*)NewText + Start, NewElementLength, Options);
+  Context.Depth = Depth;
+  Status = ParseDocument (&Context, Scratch);
+  if (!EFI_ERROR (Status)) {
+    //
+    // The edit must still leave exactly one element covering the same text,
+    // otherwise the parent's children changed and the parent has to be parsed.
+    //
+    NewElement = (DRIVER_XML_DATA_HEADER*)GetFirstNode (&Scratch->TagChildren.ListStart);
+    if (Scratch->TagChildren.ItemCount != 1
+        || (NewElement->XmlDataType != XmlTag && NewElement->XmlDataType != XmlEmptyTag)
+        || ((DRIVER_XML_TAG*)NewElement)->SourceOffset != Start
+        || ((DRIVER_XML_TAG*)NewElement)->SourceLength != NewElementLength)
+    {
+      Status = EFI_UNSUPPORTED;
+    }
+  }
+  if (EFI_ERROR (Status)) {
+    DriverXmlFreeTree ((DRIVER_XML_DATA_HEADER*)Scratch);
+    if (Status == EFI_SECURITY_VIOLATION || Status == EFI_OUT_OF_RESOURCES) {
+      return Status;
+    }
+    return EFI_UNSUPPORTED;
+  }
+
+  //
+  // Nothing can fail from here. Move the spans of the old tree, then swap the new
+  // element in where the old one was.
+  //
+  Shift.OldEnd = ChangeOffset + OldLength;
+  Shift.OldLength = OldLength;
+  Shift.NewLength = NewLength;
+  DriverXmlWalkElement (&mXmlSpanShifter, (DRIVER_XML_DATA_HEADER*)Root, 0, &Shift);
+  RemoveEntryList (&NewElement->DataLink);
+  Scratch->TagChildren.ItemCount--;
+  InsertHeadList (&OldElement->DataLink, &NewElement->DataLink);
+  Parent->TagChildren.ItemCount++;
+  ((DRIVER_XML_TAG*)NewElement)->Parent = Parent;
+  DriverXmlInvalidateHash (Parent);
+  RemoveElement (&Parent->TagChildren, (DRIVER_XML_DATA_HEADER*)OldElement);
+  DriverXmlFreeTree ((DRIVER_XML_DATA_HEADER*)Scratch);
+  return EFI_SUCCESS;
+}
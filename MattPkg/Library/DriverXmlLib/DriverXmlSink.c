@@ -0,0 +1,439 @@
+/** @file
+  Output sinks for the XML library.
+  A sink takes printed XML as it is produced so a document can be streamed to a file or the
+  console without ever holding all of it in memory.
+  
+  Copyright (c) 2016, Matthew Lazarowitz. All rights reserved.<BR>
+  This program and the accompanying materials are licensed and made available under
+  the terms and conditions of the MIT License that accompanies this distribution.
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+**/
+#include <uefi.h>
+#include <Library/DebugLib.h>
+#include <Library/BaseLib.h>
+#include <Library/UefiBootServicesTableLib.h>
+#include <DriverXmlStringHandlers.h>
+
+//
+// The console takes UCS-2 strings, so output is converted this many characters at a time.
+// Each character may become two (LF becomes CR LF) plus the terminator.
+//
+#define CONSOLE_SINK_CHUNK 64
+
+/**
+  Memory sink write. Appends to the sink's growable document.
+
+  @param[in] Sink    The memory sink.
+  @param[in] Bytes   The output.
+  @param[in] Length  The number of bytes.
+
+  @retval EFI_SUCCESS           The bytes were stored.
+  @retval EFI_OUT_OF_RESOURCES  The buffer could not be grown.
+**/
+EFI_STATUS
+MemorySinkWrite (
+  DRIVER_XML_OUTPUT_SINK* Sink,
+  CONST CHAR8*            Bytes,
+  UINTN                   Length
+  )
+{
+  return BytesToDocument (Bytes, Length, &((DRIVER_XML_MEMORY_SINK*)Sink)->Document);
+}
+
+/**
+  Flush for sinks that hold nothing back.
+
+  @param[in] Sink  The sink.
+
+  @retval EFI_SUCCESS  Always.
+**/
+EFI_STATUS
+NullSinkFlush (
+  DRIVER_XML_OUTPUT_SINK* Sink
+  )
+{
+  return EFI_SUCCESS;
+}
+
+/**
+  Set up a sink that collects the output in a pool buffer.
+  When done, MemorySink->Document.XmlDocument is the output and belongs to the caller.
+
+  @param[out] MemorySink  The sink to set up.
+
+  @retval EFI_SUCCESS            The sink is ready.
+  @retval EFI_INVALID_PARAMETER  MemorySink is NULL.
+**/
+EFI_STATUS
+DriverXmlInitMemorySink (
+  DRIVER_XML_MEMORY_SINK* MemorySink
+  )
+{
+  if (MemorySink == NULL) {
+    return EFI_INVALID_PARAMETER;
+  }
+  gBS->SetMem (MemorySink, sizeof (DRIVER_XML_MEMORY_SINK), 0);
+  MemorySink->Sink.Write = MemorySinkWrite;
+  MemorySink->Sink.Flush = NullSinkFlush;
+  return EFI_SUCCESS;
+}
+
+/**
+  Ring sink write. Older output is overwritten once the buffer is full.
+
+  @param[in] Sink    The ring sink.
+  @param[in] Bytes   The output.
+  @param[in] Length  The number of bytes.
+
+  @retval EFI_SUCCESS  The bytes were stored.
+**/
+EFI_STATUS
+RingSinkWrite (
+  DRIVER_XML_OUTPUT_SINK* Sink,
+  CONST CHAR8*            Bytes,
+  UINTN                   Length
+  )
+{
+  DRIVER_XML_RING_SINK* Ring;
+  UINTN                 Part;
+
+  Ring = (DRIVER_XML_RING_SINK*)Sink;
+  Ring->TotalBytes += Length;
+  if (Length >= Ring->BufferSize) {
+    //
+    // Only the tail of this write survives.
+    //
+    gBS->CopyMem (Ring->Buffer, (VOID*)&Bytes[Length - Ring->BufferSize], Ring->BufferSize);
+    Ring->Next = 0;
+    return EFI_SUCCESS;
+  }
+  Part = MIN (Length, Ring->BufferSize - Ring->Next);
+  gBS->CopyMem (&Ring->Buffer[Ring->Next], (VOID*)Bytes, Part);
+  if (Part < Length) {
+    gBS->CopyMem (Ring->Buffer, (VOID*)&Bytes[Part], Length - Part);
+  }
+  Ring->Next = (Ring->Next + Length) % Ring->BufferSize;
+  return EFI_SUCCESS;
+}
+
+/**
+  Set up a sink that keeps the most recent output in a fixed buffer.
+  This suits logging a tree from code that can't allocate, where the end of the output matters most.
+
+  @param[out] RingSink    The sink to set up.
+  @param[in]  Buffer      The buffer to keep the output in.
+  @param[in]  BufferSize  The size of Buffer.
+
+  @retval EFI_SUCCESS            The sink is ready.
+  @retval EFI_INVALID_PARAMETER  A pointer is NULL or BufferSize is 0.
+**/
+EFI_STATUS
+DriverXmlInitRingSink (
+  DRIVER_XML_RING_SINK* RingSink,
+  CHAR8*                Buffer,
+  UINTN                 BufferSize
+  )
+{
+  if (RingSink == NULL || Buffer == NULL || BufferSize == 0) {
+    return EFI_INVALID_PARAMETER;
+  }
+  RingSink->Sink.Write = RingSinkWrite;
+  RingSink->Sink.Flush = NullSinkFlush;
+  RingSink->Buffer = Buffer;
+  RingSink->BufferSize = BufferSize;
+  RingSink->Next = 0;
+  RingSink->TotalBytes = 0;
+  return EFI_SUCCESS;
+}
+
+/**
+  Copy what a ring sink holds, oldest byte first.
+
+  @param[in]     RingSink    The ring sink.
+  @param[out]    Buffer      The buffer to copy into.
+  @param[in out] BufferSize  On input the size of Buffer. On output the number of bytes copied,
+                             or the number needed if EFI_BUFFER_TOO_SMALL is returned.
+
+  @retval EFI_SUCCESS            The contents were copied.
+  @retval EFI_BUFFER_TOO_SMALL   Buffer is too small. *BufferSize is the size needed.
+  @retval EFI_INVALID_PARAMETER  RingSink or BufferSize is NULL.
+**/
+EFI_STATUS
+DriverXmlReadRingSink (
+  DRIVER_XML_RING_SINK* RingSink,
+  CHAR8*                Buffer,
+  UINTN*                BufferSize
+  )
+{
+  UINTN Held;
+
+  if (RingSink == NULL || BufferSize == NULL) {
+    return EFI_INVALID_PARAMETER;
+  }
+  if (RingSink->TotalBytes < RingSink->BufferSize) {
+    Held = (UINTN)RingSink->TotalBytes;
+  } else {
+    Held = RingSink->BufferSize;
+  }
+  if (*BufferSize < Held || Buffer == NULL) {
+    *BufferSize = Held;
+    return (Held == 0) ? EFI_SUCCESS : EFI_BUFFER_TOO_SMALL;
+  }
+  if (Held < RingSink->BufferSize) {
+    gBS->CopyMem (Buffer, RingSink->Buffer, Held);
+  } else {
+    //
+    // Full, so the oldest byte is the one about to be overwritten.
+    //
+    gBS->CopyMem (Buffer, &RingSink->Buffer[RingSink->Next], Held - RingSink->Next);
+    gBS->CopyMem (&Buffer[Held - RingSink->Next], RingSink->Buffer, RingSink->Next);
+  }
+  *BufferSize = Held;
+  return EFI_SUCCESS;
+}
+
+/**
+  Write a block to the sink's file.
+
+  @param[in] FileSink  The file sink.
+  @param[in] Bytes     The data.
+  @param[in] Length    The number of bytes.
+
+  @retval EFI_SUCCESS       The block was written.
+  @retval EFI_DEVICE_ERROR  The file took fewer bytes than it was given.
+  @retval other             An error from EFI_FILE_PROTOCOL.Write.
+**/
+EFI_STATUS
+WriteFileBlock (
+  DRIVER_XML_FILE_SINK* FileSink,
+  CONST CHAR8*          Bytes,
+  UINTN                 Length
+  )
+{
+  UINTN      Written;
+  EFI_STATUS Status;
+
+  Written = Length;
+  Status = FileSink->File->Write (FileSink->File, &Written, (VOID*)Bytes);
+  if (EFI_ERROR (Status)) {
+    DEBUG ((DEBUG_ERROR, "XML file sink write failed: %r\n", Status));
+    return Status;
+  }
+  if (Written != Length) {
+    return EFI_DEVICE_ERROR;
+  }
+  return EFI_SUCCESS;
+}
+
+/**
+  File sink write. Output is gathered into whole blocks before it goes to the file.
+  A run at least a block long that arrives while the buffer is empty goes straight to the file.
+
+  @param[in] Sink    The file sink.
+  @param[in] Bytes   The output.
+  @param[in] Length  The number of bytes.
+
+  @retval EFI_SUCCESS  The bytes were buffered or written.
+  @retval other        The file write failed.
+**/
+EFI_STATUS
+FileSinkWrite (
+  DRIVER_XML_OUTPUT_SINK* Sink,
+  CONST CHAR8*            Bytes,
+  UINTN                   Length
+  )
+{
+  DRIVER_XML_FILE_SINK* FileSink;
+  UINTN                 Part;
+  EFI_STATUS            Status;
+
+  FileSink = (DRIVER_XML_FILE_SINK*)Sink;
+  while (Length > 0) {
+    if (FileSink->Used == 0 && Length >= FileSink->BufferSize) {
+      Part = Length - (Length % FileSink->BufferSize);
+      Status = WriteFileBlock (FileSink, Bytes, Part);
+    } else {
+      Part = MIN (Length, FileSink->BufferSize - FileSink->Used);
+      gBS->CopyMem (&FileSink->Buffer[FileSink->Used], (VOID*)Bytes, Part);
+      FileSink->Used += Part;
+      Status = EFI_SUCCESS;
+      if (FileSink->Used == FileSink->BufferSize) {
+        Status = WriteFileBlock (FileSink, FileSink->Buffer, FileSink->Used);
+        FileSink->Used = 0;
+      }
+    }
+    if (EFI_ERROR (Status)) {
+      return Status;
+    }
+    Bytes += Part;
+    Length -= Part;
+  }
+  return EFI_SUCCESS;
+}
+
+/**
+  File sink flush. Writes the partial block and flushes the file.
+
+  @param[in] Sink  The file sink.
+
+  @retval EFI_SUCCESS  Everything is in the file.
+  @retval other        The file write or flush failed.
+**/
+EFI_STATUS
+FileSinkFlush (
+  DRIVER_XML_OUTPUT_SINK* Sink
+  )
+{
+  DRIVER_XML_FILE_SINK* FileSink;
+  EFI_STATUS            Status;
+
+  FileSink = (DRIVER_XML_FILE_SINK*)Sink;
+  if (FileSink->Used > 0) {
+    Status = WriteFileBlock (FileSink, FileSink->Buffer, FileSink->Used);
+    FileSink->Used = 0;
+    if (EFI_ERROR (Status)) {
+      return Status;
+    }
+  }
+  return FileSink->File->Flush (FileSink->File);
+}
+
+/**
+  Set up a sink that streams the output to a file opened for writing.
+  Memory use is the caller's buffer whatever the size of the document. A buffer that is a
+  multiple of the device's block size gives the fewest and largest writes.
+
+  @param[out] FileSink    The sink to set up.
+  @param[in]  File        The file, positioned where the output should go.
+  @param[in]  Buffer      The buffer blocks are gathered in.
+  @param[in]  BufferSize  The size of Buffer.
+
+  @retval EFI_SUCCESS            The sink is ready.
+  @retval EFI_INVALID_PARAMETER  A pointer is NULL or BufferSize is 0.
+**/
+EFI_STATUS
+DriverXmlInitFileSink (
+  DRIVER_XML_FILE_SINK* FileSink,
+  EFI_FILE_PROTOCOL*    File,
+  CHAR8*                Buffer,
+  UINTN                 BufferSize
+  )
+{
+  if (FileSink == NULL || File == NULL || Buffer == NULL || BufferSize == 0) {
+    return EFI_INVALID_PARAMETER;
+  }
+  FileSink->Sink.Write = FileSinkWrite;
+  FileSink->Sink.Flush = FileSinkFlush;
+  FileSink->File = File;
+  FileSink->Buffer = Buffer;
+  FileSink->BufferSize = BufferSize;
+  FileSink->Used = 0;
+  return EFI_SUCCESS;
+}
+
+/**
+  Console sink write. Converts the output to UCS-2 a piece at a time and prints it.
+
+  @param[in] Sink    The console sink.
+  @param[in] Bytes   The output.
+  @param[in] Length  The number of bytes.
+
+  @retval EFI_SUCCESS  The output was printed.
+  @retval other        An error from the console.
+**/
+EFI_STATUS
+ConsoleSinkWrite (
+  DRIVER_XML_OUTPUT_SINK* Sink,
+  CONST CHAR8*            Bytes,
+  UINTN                   Length
+  )
+{
+  CHAR16     Chunk[CONSOLE_SINK_CHUNK * 2 + 1];
+  UINTN      Index;
+  UINTN      Count;
+  EFI_STATUS Status;
+
+  Index = 0;
+  while (Index < Length) {
+    for (Count = 0; Index < Length && Count + 1 < CONSOLE_SINK_CHUNK * 2; Index++) {
+      if (Bytes[Index] == '\n') {
+        Chunk[Count++] = L'\r';
+      }
+      Chunk[Count++] = (CHAR16)(UINT8)Bytes[Index];
+    }
+    Chunk[Count] = L'\0';
+    Status = gST->ConOut->OutputString (gST->ConOut, Chunk);
+    if (EFI_ERROR (Status)) {
+      return Status;
+    }
+  }
+  return EFI_SUCCESS;
+}
+
+/**
+  Set up a sink that prints to the system console.
+
+  @param[out] ConsoleSink  The sink to set up.
+
+  @retval EFI_SUCCESS            The sink is ready.
+  @retval EFI_INVALID_PARAMETER  ConsoleSink is NULL.
+**/
+EFI_STATUS
+DriverXmlInitConsoleSink (
+  DRIVER_XML_CONSOLE_SINK* ConsoleSink
+  )
+{
+  if (ConsoleSink == NULL) {
+    return EFI_INVALID_PARAMETER;
+  }
+  ConsoleSink->Sink.Write = ConsoleSinkWrite;
+  ConsoleSink->Sink.Flush = NullSinkFlush;
+  return EFI_SUCCESS;
+}
+
+/**
+  Print XML data to a sink and flush it.
+
+  @param[in] Data  The XML data to be printed.
+  @param[in] Sink  Where the output goes.
+
+  @retval EFI_SUCCESS            The data was printed and the sink flushed.
+  @retval EFI_INVALID_PARAMETER  Data or Sink is NULL.
+  @retval other                  An error from the sink or EFI_UNSUPPORTED for data that can't be printed.
+**/
+EFI_STATUS
+PrintDataToSink (
+  DRIVER_XML_DATA_HEADER* Data,
+  DRIVER_XML_OUTPUT_SINK* Sink
+  )
+{
+  XML_DOCUMENT OutputDocument;
+  EFI_STATUS   Status;
+
+  if (Data == NULL || Sink == NULL) {
+    return EFI_INVALID_PARAMETER;
+  }
+  gBS->SetMem (&OutputDocument, sizeof (OutputDocument), 0);
+  OutputDocument.Sink = Sink;
+  Status = PrintData (Data, &OutputDocument);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+  return Sink->Flush (Sink);
+}
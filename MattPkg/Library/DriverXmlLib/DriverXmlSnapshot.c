@@ -0,0 +1,1093 @@
+/** @file
+  Copy-on-write views of a parsed tree.
+  A snapshot shares the tree and keeps only the changes made through it, so several
+  versions of a large document cost one tree plus their edits.
+  
+  Copyright (c) 2016, Matthew Lazarowitz. All rights reserved.<BR>
+  This program and the accompanying materials are licensed and made available under
+  the terms and conditions of the MIT License that accompanies this distribution.
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+**/
+#include <Uefi.h>
+#include <Library/UefiBootServicesTableLib.h>
+#include <Library/BaseLib.h>
+#include <Library/MemoryAllocationLib.h>
+#include <Library/DebugLib.h>
+#include <DriverXmlStringHandlers.h>
+
+//
+// Number of edit slots added each time a snapshot runs out of room.
+//
+#define SNAPSHOT_EDIT_STEP 8
+
+//
+// Starting number of edit hash buckets in a snapshot. This must be a power of 2.
+// The buckets double when the average chain gets longer than 2 edits.
+//
+#define SNAPSHOT_INITIAL_BUCKETS 16
+
+typedef enum _XML_SNAPSHOT_EDIT_TYPE {
+  XmlSnapshotSetAttribute,
+  XmlSnapshotSetCharData,
+  XmlSnapshotRemoveNode
+} XML_SNAPSHOT_EDIT_TYPE;
+
+//
+// One change a snapshot makes to the shared tree.
+// Attribute edits are keyed by the tag and the attribute name so a snapshot can add
+// attributes the tree does not have. A NULL Value removes the attribute.
+// The edits of a snapshot are chained into hash buckets by node. Links are edit
+// indexes plus one, since the edit array moves when it grows, and 0 ends a chain.
+//
+typedef struct _XML_SNAPSHOT_EDIT {
+  XML_SNAPSHOT_EDIT_TYPE  EditType;
+  DRIVER_XML_DATA_HEADER* Node;
+  CHAR8*                  Name;
+  CHAR8*                  Value;
+  UINTN                   ValueLength;
+  UINTN                   NextEdit;     // The next older edit in the same bucket
+} XML_SNAPSHOT_EDIT;
+
+//
+// A view of a tree. The tree itself is never changed once it is in a snapshot;
+// each snapshot holds only its own edits and reads fall through to the parent and then the tree.
+// The snapshot at the bottom of a chain (Parent == NULL) owns the tree.
+//
+struct _DRIVER_XML_SNAPSHOT {
+  UINTN                   RefCount;
+  DRIVER_XML_SNAPSHOT*    Parent;
+  DRIVER_XML_DATA_HEADER* Tree;
+  XML_SNAPSHOT_EDIT*      Edits;
+  UINTN                   EditCount;
+  UINTN                   EditSlots;
+  UINTN*                  Buckets;      // The newest edit in each bucket
+  UINTN                   BucketCount;
+};
+
+//
+// Where DriverXmlSnapshotToTree is in the copy. Dest is the new tag that copies of the
+// elements being visited are added to.
+//
+typedef struct _XML_SNAPSHOT_COPY {
+  DRIVER_XML_SNAPSHOT* Snapshot;
+  DRIVER_XML_TAG*      Dest;
+} XML_SNAPSHOT_COPY;
+
+/**
+  Copy a string into a new pool buffer.
+
+  @param[in] String  The characters to copy.
+  @param[in] Length  The number of characters to copy.
+
+  @return A null terminated copy, or NULL if there was not enough memory.
+**/
+CHAR8*
+CopySnapshotString (
+  IN CONST CHAR8* String,
+  IN UINTN        Length
+  )
+{
+  CHAR8* Copy;
+
+  Copy = DriverXmlAllocatePool (XmlAllocString, Length + 1);
+  if (Copy != NULL) {
+    gBS->CopyMem (Copy, (VOID*)String, Length);
+  }
+  return Copy;
+}
+
+/**
+  Get the hash bucket a node's edits are chained into.
+
+  @param[in] Snapshot  The snapshot that holds the edits. It must have buckets.
+  @param[in] Node      The node the edits are for.
+
+  @return The bucket index.
+**/
+UINTN
+SnapshotEditBucket (
+  IN DRIVER_XML_SNAPSHOT*    Snapshot,
+  IN DRIVER_XML_DATA_HEADER* Node
+  )
+{
+  return DriverXmlHashString ((CONST CHAR8*)&Node, sizeof (Node)) & (Snapshot->BucketCount - 1);
+}
+
+/**
+  Step through the edits one snapshot holds for a node, newest first.
+  The snapshot's parents are not searched.
+
+  @param[in] Level  The snapshot to search.
+  @param[in] Node   The node the edits are for.
+  @param[in] Edit   The edit this returned last time, or NULL to start with the newest.
+
+  @return The next edit for the node, or NULL if there are no more.
+**/
+XML_SNAPSHOT_EDIT*
+NextSnapshotEdit (
+  IN DRIVER_XML_SNAPSHOT*    Level,
+  IN DRIVER_XML_DATA_HEADER* Node,
+  IN XML_SNAPSHOT_EDIT*      Edit OPTIONAL
+  )
+{
+  UINTN Link;
+
+  if (Level->BucketCount == 0) {
+    return NULL;
+  }
+  if (Edit == NULL) {
+    Link = Level->Buckets[SnapshotEditBucket (Level, Node)];
+  } else {
+    Link = Edit->NextEdit;
+  }
+  while (Link != 0) {
+    Edit = &Level->Edits[Link - 1];
+    if (Edit->Node == Node) {
+      return Edit;
+    }
+    Link = Edit->NextEdit;
+  }
+  return NULL;
+}
+
+/**
+  Give a snapshot its first hash buckets, or double them, and chain the edits it already
+  has into the new buckets.
+
+  @param[in out] Snapshot  The snapshot to grow.
+
+  @retval EFI_SUCCESS           The buckets were grown.
+  @retval EFI_OUT_OF_RESOURCES  There was not enough memory. The snapshot is unchanged.
+**/
+EFI_STATUS
+GrowSnapshotBuckets (
+  IN OUT DRIVER_XML_SNAPSHOT* Snapshot
+  )
+{
+  UINTN* NewBuckets;
+  UINTN  NewCount;
+  UINTN  Index;
+  UINTN  Bucket;
+
+  NewCount = (Snapshot->BucketCount == 0) ? SNAPSHOT_INITIAL_BUCKETS : Snapshot->BucketCount * 2;
+  NewBuckets = DriverXmlAllocatePool (XmlAllocSnapshot, NewCount * sizeof (UINTN));
+  if (NewBuckets == NULL) {
+    return EFI_OUT_OF_RESOURCES;
+  }
+  DriverXmlFreePool (Snapshot->Buckets);
+  Snapshot->Buckets = NewBuckets;
+  Snapshot->BucketCount = NewCount;
+  //
+  // Oldest first, so each chain ends up newest first.
+  //
+  for (Index = 0; Index < Snapshot->EditCount; Index++) {
+    Bucket = SnapshotEditBucket (Snapshot, Snapshot->Edits[Index].Node);
+    Snapshot->Edits[Index].NextEdit = NewBuckets[Bucket];
+    NewBuckets[Bucket] = Index + 1;
+  }
+  return EFI_SUCCESS;
+}
+
+/**
+  Find the newest edit that applies to a node, looking through the snapshot and then its parents.
+  Removing a node hides it from every lookup so a remove edit matches any name.
+
+  @param[in] Snapshot  The snapshot to search from.
+  @param[in] Node      The node the edit is for.
+  @param[in] Name      The attribute name, or NULL for char data and removes.
+
+  @return The edit, or NULL if the snapshot chain leaves the node as it is in the tree.
+**/
+XML_SNAPSHOT_EDIT*
+FindSnapshotEdit (
+  IN DRIVER_XML_SNAPSHOT*    Snapshot,
+  IN DRIVER_XML_DATA_HEADER* Node,
+  IN CONST CHAR8*            Name
+  )
+{
+  DRIVER_XML_SNAPSHOT* Level;
+  XML_SNAPSHOT_EDIT*   Edit;
+
+  for (Level = Snapshot; Level != NULL; Level = Level->Parent) {
+    //
+    // Newest first so a later edit in the same snapshot wins.
+    //
+    for (Edit = NextSnapshotEdit (Level, Node, NULL); Edit != NULL; Edit = NextSnapshotEdit (Level, Node, Edit)) {
+      if (Edit->EditType == XmlSnapshotRemoveNode) {
+        return Edit;
+      }
+      if (Name == NULL) {
+        if (Edit->Name == NULL) {
+          return Edit;
+        }
+      } else if (Edit->Name != NULL && AsciiStrCmp (Edit->Name, Name) == 0) {
+        return Edit;
+      }
+    }
+  }
+  return NULL;
+}
+
+/**
+  Record an edit in a snapshot. An earlier edit of the same thing in the same snapshot is replaced
+  so repeated writes do not grow the snapshot.
+
+  @param[in] Snapshot  The snapshot to change.
+  @param[in] EditType  What kind of edit this is.
+  @param[in] Node      The node being changed.
+  @param[in] Name      The attribute name for attribute edits, otherwise NULL.
+  @param[in] Value     The new value, or NULL.
+
+  @retval EFI_SUCCESS           The edit was recorded.
+  @retval EFI_OUT_OF_RESOURCES  There was not enough memory.
+**/
+EFI_STATUS
+AddSnapshotEdit (
+  IN DRIVER_XML_SNAPSHOT*    Snapshot,
+  IN XML_SNAPSHOT_EDIT_TYPE  EditType,
+  IN DRIVER_XML_DATA_HEADER* Node,
+  IN CONST CHAR8*            Name,
+  IN CONST CHAR8*            Value
+  )
+{
+  XML_SNAPSHOT_EDIT* Edit;
+  XML_SNAPSHOT_EDIT* NewEdits;
+  CHAR8*             NameCopy;
+  CHAR8*             ValueCopy;
+  UINTN              ValueLength;
+  UINTN              Bucket;
+
+  NameCopy = NULL;
+  ValueCopy = NULL;
+  ValueLength = 0;
+  if (Value != NULL) {
+    ValueLength = AsciiStrLen (Value);
+    ValueCopy = CopySnapshotString (Value, ValueLength);
+    if (ValueCopy == NULL) {
+      return EFI_OUT_OF_RESOURCES;
+    }
+  }
+
+  for (Edit = NextSnapshotEdit (Snapshot, Node, NULL); Edit != NULL; Edit = NextSnapshotEdit (Snapshot, Node, Edit)) {
+    if (Edit->EditType != EditType) {
+      continue;
+    }
+    if (Name == NULL || AsciiStrCmp (Edit->Name, Name) == 0) {
+      DriverXmlFreePool (Edit->Value);
+      Edit->Value = ValueCopy;
+      Edit->ValueLength = ValueLength;
+      return EFI_SUCCESS;
+    }
+  }
+
+  if (Name != NULL) {
+    NameCopy = CopySnapshotString (Name, AsciiStrLen (Name));
+    if (NameCopy == NULL) {
+      DriverXmlFreePool (ValueCopy);
+      return EFI_OUT_OF_RESOURCES;
+    }
+  }
+  if (Snapshot->BucketCount == 0 && EFI_ERROR (GrowSnapshotBuckets (Snapshot))) {
+    DriverXmlFreePool (NameCopy);
+    DriverXmlFreePool (ValueCopy);
+    return EFI_OUT_OF_RESOURCES;
+  }
+  if (Snapshot->EditCount == Snapshot->EditSlots) {
+    NewEdits = DriverXmlReallocatePool (
+                 XmlAllocSnapshot,
+                 Snapshot->Edits,
+                 (Snapshot->EditSlots + SNAPSHOT_EDIT_STEP) * sizeof (XML_SNAPSHOT_EDIT)
+                 );
+    if (NewEdits == NULL) {
+      DriverXmlFreePool (NameCopy);
+      DriverXmlFreePool (ValueCopy);
+      return EFI_OUT_OF_RESOURCES;
+    }
+    Snapshot->Edits = NewEdits;
+    Snapshot->EditSlots += SNAPSHOT_EDIT_STEP;
+  }
+  Edit = &Snapshot->Edits[Snapshot->EditCount++];
+  Edit->EditType = EditType;
+  Edit->Node = Node;
+  Edit->Name = NameCopy;
+  Edit->Value = ValueCopy;
+  Edit->ValueLength = ValueLength;
+  Bucket = SnapshotEditBucket (Snapshot, Node);
+  Edit->NextEdit = Snapshot->Buckets[Bucket];
+  Snapshot->Buckets[Bucket] = Snapshot->EditCount;
+  if (Snapshot->EditCount > Snapshot->BucketCount * 2) {
+    //
+    // Longer chains are only slower, so carry on with them if this fails.
+    //
+    GrowSnapshotBuckets (Snapshot);
+  }
+  return EFI_SUCCESS;
+}
+
+/**
+  Free the edits a snapshot holds.
+
+  @param[in] Snapshot  The snapshot to empty.
+**/
+VOID
+FreeSnapshotEdits (
+  IN DRIVER_XML_SNAPSHOT* Snapshot
+  )
+{
+  UINTN Index;
+
+  for (Index = 0; Index < Snapshot->EditCount; Index++) {
+    DriverXmlFreePool (Snapshot->Edits[Index].Name);
+    DriverXmlFreePool (Snapshot->Edits[Index].Value);
+  }
+  DriverXmlFreePool (Snapshot->Edits);
+  DriverXmlFreePool (Snapshot->Buckets);
+  Snapshot->Edits = NULL;
+  Snapshot->EditCount = 0;
+  Snapshot->EditSlots = 0;
+  Snapshot->Buckets = NULL;
+  Snapshot->BucketCount = 0;
+}
+
+/**
+  Make the first snapshot of a tree. The snapshot takes ownership of the tree, which is 
+  freed when the last snapshot that uses it is released. The tree must not be changed 
+  directly after this; make changes through a snapshot instead.
+
+  @param[in]  XmlTree   The root of a tree from DriverXmlParse or DriverXmlParseEx.
+  @param[out] Snapshot  The new snapshot.
+
+  @retval EFI_SUCCESS            The snapshot was created.
+  @retval EFI_INVALID_PARAMETER  A pointer was NULL or XmlTree is not a tag.
+  @retval EFI_OUT_OF_RESOURCES   There was not enough memory.
+**/
+EFI_STATUS
+DriverXmlCreateSnapshot (
+  IN  DRIVER_XML_DATA_HEADER* XmlTree,
+  OUT DRIVER_XML_SNAPSHOT**   Snapshot
+  )
+{
+  DRIVER_XML_SNAPSHOT* LocalSnapshot;
+
+  if (XmlTree == NULL || Snapshot == NULL || XmlTree->XmlDataType != XmlTag) {
+    return EFI_INVALID_PARAMETER;
+  }
+  LocalSnapshot = DriverXmlAllocatePool (XmlAllocSnapshot, sizeof (DRIVER_XML_SNAPSHOT));
+  if (LocalSnapshot == NULL) {
+    return EFI_OUT_OF_RESOURCES;
+  }
+  LocalSnapshot->RefCount = 1;
+  LocalSnapshot->Tree = XmlTree;
+  *Snapshot = LocalSnapshot;
+  return EFI_SUCCESS;
+}
+
+/**
+  Make a new snapshot that starts out the same as an existing one. This takes the same time
+  no matter how large the tree is; nothing in the tree is copied.
+  After this, edits to either snapshot are not seen by the other.
+
+  @param[in]  Snapshot     The snapshot to start from.
+  @param[out] NewSnapshot  The new snapshot.
+
+  @retval EFI_SUCCESS            The snapshot was created.
+  @retval EFI_INVALID_PARAMETER  A pointer was NULL.
+  @retval EFI_OUT_OF_RESOURCES   There was not enough memory.
+**/
+EFI_STATUS
+DriverXmlForkSnapshot (
+  IN  DRIVER_XML_SNAPSHOT*  Snapshot,
+  OUT DRIVER_XML_SNAPSHOT** NewSnapshot
+  )
+{
+  DRIVER_XML_SNAPSHOT* Child;
+  DRIVER_XML_SNAPSHOT* Frozen;
+
+  if (Snapshot == NULL || NewSnapshot == NULL) {
+    return EFI_INVALID_PARAMETER;
+  }
+  Child = DriverXmlAllocatePool (XmlAllocSnapshot, sizeof (DRIVER_XML_SNAPSHOT));
+  if (Child == NULL) {
+    return EFI_OUT_OF_RESOURCES;
+  }
+  Child->RefCount = 1;
+  Child->Tree = Snapshot->Tree;
+
+  if (Snapshot->EditCount == 0 && Snapshot->Parent != NULL) {
+    //
+    // Nothing of its own to protect so both can sit on the same parent.
+    //
+    Child->Parent = Snapshot->Parent;
+    Child->Parent->RefCount++;
+  } else {
+    //
+    // Move the edits (and tree ownership when this is the bottom of the chain) into a
+    // snapshot nobody holds directly. Both snapshots build on it from here, so the 
+    // edits they make next stay separate.
+    //
+    Frozen = DriverXmlAllocatePool (XmlAllocSnapshot, sizeof (DRIVER_XML_SNAPSHOT));
+    if (Frozen == NULL) {
+      DriverXmlFreePool (Child);
+      return EFI_OUT_OF_RESOURCES;
+    }
+    Frozen->RefCount = 2;
+    Frozen->Parent = Snapshot->Parent;
+    Frozen->Tree = Snapshot->Tree;
+    Frozen->Edits = Snapshot->Edits;
+    Frozen->EditCount = Snapshot->EditCount;
+    Frozen->EditSlots = Snapshot->EditSlots;
+    Frozen->Buckets = Snapshot->Buckets;
+    Frozen->BucketCount = Snapshot->BucketCount;
+    Snapshot->Parent = Frozen;
+    Snapshot->Edits = NULL;
+    Snapshot->EditCount = 0;
+    Snapshot->EditSlots = 0;
+    Snapshot->Buckets = NULL;
+    Snapshot->BucketCount = 0;
+    Child->Parent = Frozen;
+  }
+  *NewSnapshot = Child;
+  return EFI_SUCCESS;
+}
+
+/**
+  Release a snapshot. Parents that are no longer used by any snapshot are freed with it,
+  and the tree is freed along with the last snapshot.
+
+  @param[in] Snapshot  The snapshot to release.
+**/
+VOID
+DriverXmlReleaseSnapshot (
+  IN DRIVER_XML_SNAPSHOT* Snapshot
+  )
+{
+  DRIVER_XML_SNAPSHOT* Parent;
+
+  while (Snapshot != NULL) {
+    ASSERT (Snapshot->RefCount > 0);
+    if (--Snapshot->RefCount > 0) {
+      return;
+    }
+    Parent = Snapshot->Parent;
+    if (Parent == NULL) {
+      DriverXmlFreeTree (Snapshot->Tree);
+    }
+    FreeSnapshotEdits (Snapshot);
+    DriverXmlFreePool (Snapshot);
+    Snapshot = Parent;
+  }
+}
+
+/**
+  Get the shared tree behind a snapshot. Walk it with the usual functions to find the nodes
+  to pass to the other snapshot functions, but do not change it.
+
+  @param[in] Snapshot  The snapshot.
+
+  @return The root of the shared tree, or NULL if Snapshot is NULL.
+**/
+DRIVER_XML_DATA_HEADER*
+DriverXmlGetSnapshotTree (
+  IN DRIVER_XML_SNAPSHOT* Snapshot
+  )
+{
+  if (Snapshot == NULL) {
+    return NULL;
+  }
+  return Snapshot->Tree;
+}
+
+/**
+  Set, add or remove an attribute on a tag in one snapshot.
+
+  @param[in] Snapshot  The snapshot to change.
+  @param[in] Tag       A tag from the snapshot's tree.
+  @param[in] Name      The attribute name.
+  @param[in] Value     The new value, or NULL to remove the attribute.
+
+  @retval EFI_SUCCESS            The snapshot was changed.
+  @retval EFI_INVALID_PARAMETER  A pointer was NULL or Tag is not a tag.
+  @retval EFI_NOT_FOUND          The tag was removed in this snapshot.
+  @retval EFI_OUT_OF_RESOURCES   There was not enough memory.
+**/
+EFI_STATUS
+DriverXmlSnapshotSetAttribute (
+  IN DRIVER_XML_SNAPSHOT* Snapshot,
+  IN DRIVER_XML_TAG*      Tag,
+  IN CONST CHAR8*         Name,
+  IN CONST CHAR8*         Value
+  )
+{
+  if (Snapshot == NULL || Tag == NULL || Name == NULL) {
+    return EFI_INVALID_PARAMETER;
+  }
+  if (Tag->XmlDataType != XmlTag && Tag->XmlDataType != XmlEmptyTag) {
+    return EFI_INVALID_PARAMETER;
+  }
+  if (DriverXmlSnapshotIsRemoved (Snapshot, (DRIVER_XML_DATA_HEADER*)Tag)) {
+    return EFI_NOT_FOUND;
+  }
+  return AddSnapshotEdit (Snapshot, XmlSnapshotSetAttribute, (DRIVER_XML_DATA_HEADER*)Tag, Name, Value);
+}
+
+/**
+  Get the value an attribute has in a snapshot.
+
+  @param[in]  Snapshot  The snapshot to read.
+  @param[in]  Tag       A tag from the snapshot's tree.
+  @param[in]  Name      The attribute name.
+  @param[out] Value     The value. It belongs to the snapshot or the tree and stays valid 
+                        until the snapshot is released or the attribute is set again.
+
+  @retval EFI_SUCCESS            Value is valid.
+  @retval EFI_NOT_FOUND          The tag does not have the attribute in this snapshot.
+  @retval EFI_INVALID_PARAMETER  A pointer was NULL.
+**/
+EFI_STATUS
+DriverXmlSnapshotGetAttribute (
+  IN  DRIVER_XML_SNAPSHOT* Snapshot,
+  IN  DRIVER_XML_TAG*      Tag,
+  IN  CONST CHAR8*         Name,
+  OUT CONST CHAR8**        Value
+  )
+{
+  XML_SNAPSHOT_EDIT*    Edit;
+  DRIVER_XML_ATTRIBUTE* Attribute;
+  EFI_STATUS            Status;
+
+  if (Snapshot == NULL || Tag == NULL || Name == NULL || Value == NULL) {
+    return EFI_INVALID_PARAMETER;
+  }
+  Edit = FindSnapshotEdit (Snapshot, (DRIVER_XML_DATA_HEADER*)Tag, Name);
+  if (Edit != NULL) {
+    if (Edit->EditType == XmlSnapshotRemoveNode || Edit->Value == NULL) {
+      return EFI_NOT_FOUND;
+    }
+    *Value = Edit->Value;
+    return EFI_SUCCESS;
+  }
+  Status = GetXmlAttributeByName ((CHAR8*)Name, &Tag->TagAttributes, &Attribute);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+  *Value = (Attribute->AttributeData != NULL) ? Attribute->AttributeData : "";
+  return EFI_SUCCESS;
+}
+
+/**
+  Replace the text of a char data node in one snapshot.
+
+  @param[in] Snapshot  The snapshot to change.
+  @param[in] CharData  A char data node from the snapshot's tree.
+  @param[in] Text      The new text.
+
+  @retval EFI_SUCCESS            The snapshot was changed.
+  @retval EFI_INVALID_PARAMETER  A pointer was NULL or CharData is not char data.
+  @retval EFI_NOT_FOUND          The node was removed in this snapshot.
+  @retval EFI_OUT_OF_RESOURCES   There was not enough memory.
+**/
+EFI_STATUS
+DriverXmlSnapshotSetCharData (
+  IN DRIVER_XML_SNAPSHOT*  Snapshot,
+  IN DRIVER_XML_CHAR_DATA* CharData,
+  IN CONST CHAR8*          Text
+  )
+{
+  if (Snapshot == NULL || CharData == NULL || Text == NULL || CharData->XmlDataType != XmlChar) {
+    return EFI_INVALID_PARAMETER;
+  }
+  if (DriverXmlSnapshotIsRemoved (Snapshot, (DRIVER_XML_DATA_HEADER*)CharData)) {
+    return EFI_NOT_FOUND;
+  }
+  return AddSnapshotEdit (Snapshot, XmlSnapshotSetCharData, (DRIVER_XML_DATA_HEADER*)CharData, NULL, Text);
+}
+
+/**
+  Get the text a char data node has in a snapshot.
+
+  @param[in]  Snapshot  The snapshot to read.
+  @param[in]  CharData  A char data node from the snapshot's tree.
+  @param[out] Text      The text. It belongs to the snapshot or the tree.
+  @param[out] Length    Optional. The number of characters in Text.
+
+  @retval EFI_SUCCESS            Text is valid.
+  @retval EFI_NOT_FOUND          The node was removed in this snapshot.
+  @retval EFI_INVALID_PARAMETER  A pointer was NULL or CharData is not char data.
+**/
+EFI_STATUS
+DriverXmlSnapshotGetCharData (
+  IN  DRIVER_XML_SNAPSHOT*  Snapshot,
+  IN  DRIVER_XML_CHAR_DATA* CharData,
+  OUT CONST CHAR8**         Text,
+  OUT UINTN*                Length OPTIONAL
+  )
+{
+  XML_SNAPSHOT_EDIT* Edit;
+
+  if (Snapshot == NULL || CharData == NULL || Text == NULL || CharData->XmlDataType != XmlChar) {
+    return EFI_INVALID_PARAMETER;
+  }
+  Edit = FindSnapshotEdit (Snapshot, (DRIVER_XML_DATA_HEADER*)CharData, NULL);
+  if (Edit == NULL) {
+    *Text = CharData->CharData;
+    if (Length != NULL) {
+      *Length = CharData->DataSize;
+    }
+    return EFI_SUCCESS;
+  }
+  if (Edit->EditType == XmlSnapshotRemoveNode) {
+    return EFI_NOT_FOUND;
+  }
+  *Text = Edit->Value;
+  if (Length != NULL) {
+    *Length = Edit->ValueLength;
+  }
+  return EFI_SUCCESS;
+}
+
+/**
+  Remove a tag, char data or processing instruction, and everything under it, from one snapshot.
+
+  @param[in] Snapshot  The snapshot to change.
+  @param[in] Node      A node from the snapshot's tree. It can't be the root or an attribute.
+
+  @retval EFI_SUCCESS            The snapshot was changed.
+  @retval EFI_INVALID_PARAMETER  A pointer was NULL or Node can't be removed.
+  @retval EFI_OUT_OF_RESOURCES   There was not enough memory.
+**/
+EFI_STATUS
+DriverXmlSnapshotRemoveNode (
+  IN DRIVER_XML_SNAPSHOT*    Snapshot,
+  IN DRIVER_XML_DATA_HEADER* Node
+  )
+{
+  if (Snapshot == NULL || Node == NULL || Node == Snapshot->Tree || Node->XmlDataType == XmlAttribute) {
+    return EFI_INVALID_PARAMETER;
+  }
+  if (DriverXmlSnapshotIsRemoved (Snapshot, Node)) {
+    return EFI_SUCCESS;
+  }
+  return AddSnapshotEdit (Snapshot, XmlSnapshotRemoveNode, Node, NULL, NULL);
+}
+
+/**
+  Check whether a node was removed in a snapshot or one of its parents.
+  Only the node itself is checked. Its descendants are hidden by DriverXmlSnapshotToTree
+  but are not marked individually.
+
+  @param[in] Snapshot  The snapshot to check.
+  @param[in] Node      A node from the snapshot's tree.
+
+  @retval TRUE   The node was removed.
+  @retval FALSE  The node is still there.
+**/
+BOOLEAN
+DriverXmlSnapshotIsRemoved (
+  IN DRIVER_XML_SNAPSHOT*    Snapshot,
+  IN DRIVER_XML_DATA_HEADER* Node
+  )
+{
+  DRIVER_XML_SNAPSHOT* Level;
+  XML_SNAPSHOT_EDIT*   Edit;
+
+  for (Level = Snapshot; Level != NULL; Level = Level->Parent) {
+    for (Edit = NextSnapshotEdit (Level, Node, NULL); Edit != NULL; Edit = NextSnapshotEdit (Level, Node, Edit)) {
+      if (Edit->EditType == XmlSnapshotRemoveNode) {
+        return TRUE;
+      }
+    }
+  }
+  return FALSE;
+}
+
+/**
+  Add a copy of an attribute to a tag being built by DriverXmlSnapshotToTree.
+
+  @param[in] Tag        The new tag.
+  @param[in] Position   The copy is linked in after this entry of the tag's attribute list.
+  @param[in] Name       The attribute name.
+  @param[in] Value      The attribute value.
+  @param[in] Original   The attribute in the shared tree, or NULL if the snapshot added it.
+
+  @retval EFI_SUCCESS           The attribute was added.
+  @retval EFI_OUT_OF_RESOURCES  There was not enough memory.
+**/
+EFI_STATUS
+CopySnapshotAttribute (
+  IN DRIVER_XML_TAG*       Tag,
+  IN LIST_ENTRY*           Position,
+  IN CONST CHAR8*          Name,
+  IN CONST CHAR8*          Value,
+  IN DRIVER_XML_ATTRIBUTE* Original OPTIONAL
+  )
+{
+  DRIVER_XML_ATTRIBUTE* Attribute;
+
+  Attribute = DriverXmlAllocatePool (XmlAllocAttribute, sizeof (DRIVER_XML_ATTRIBUTE));
+  if (Attribute == NULL) {
+    return EFI_OUT_OF_RESOURCES;
+  }
+  Attribute->XmlDataType = XmlAttribute;
+  Attribute->AttributeName = CopySnapshotString (Name, AsciiStrLen (Name));
+  Attribute->AttributeData = CopySnapshotString (Value, AsciiStrLen (Value));
+  if (Original != NULL) {
+    Attribute->NamespaceId = Original->NamespaceId;
+    Attribute->LocalNameId = Original->LocalNameId;
+    //
+    // A value the snapshot set is literal. One it left alone keeps the original's form.
+    //
+    if (Value == Original->AttributeData) {
+      Attribute->Flags = Original->Flags & DRIVER_XML_TEXT_RAW;
+    }
+  }
+  //
+  // Link it in first so the tree cleanup frees it even if a string copy failed.
+  //
+  InsertHeadList (Position, &Attribute->DataLink);
+  Tag->TagAttributes.ItemCount++;
+  if (Attribute->AttributeName == NULL || Attribute->AttributeData == NULL) {
+    return EFI_OUT_OF_RESOURCES;
+  }
+  return EFI_SUCCESS;
+}
+
+/**
+  Copy the attributes a tag has in a snapshot, including ones the snapshot added.
+
+  @param[in] Snapshot  The snapshot being copied.
+  @param[in] Source    The tag in the shared tree.
+  @param[in] Dest      The new tag.
+
+  @retval EFI_SUCCESS           The attributes were copied.
+  @retval EFI_OUT_OF_RESOURCES  There was not enough memory.
+**/
+EFI_STATUS
+CopySnapshotAttributes (
+  IN DRIVER_XML_SNAPSHOT* Snapshot,
+  IN DRIVER_XML_TAG*      Source,
+  IN DRIVER_XML_TAG*      Dest
+  )
+{
+  DRIVER_XML_DATA_HEADER* LocalXmlData;
+  DRIVER_XML_ATTRIBUTE*   Attribute;
+  DRIVER_XML_ATTRIBUTE*   Existing;
+  DRIVER_XML_SNAPSHOT*    Level;
+  XML_SNAPSHOT_EDIT*      Edit;
+  LIST_ENTRY*             LevelStart;
+  CONST CHAR8*            Value;
+  EFI_STATUS              Status;
+
+  if (Source->TagAttributes.ItemCount > 0) {
+    LocalXmlData = (DRIVER_XML_DATA_HEADER*)&Source->TagAttributes.ListStart;
+    while (GetNextXmlElement (&Source->TagAttributes, LocalXmlData, &LocalXmlData) == EFI_SUCCESS) {
+      Attribute = (DRIVER_XML_ATTRIBUTE*)LocalXmlData;
+      if (DriverXmlSnapshotGetAttribute (Snapshot, Source, Attribute->AttributeName, &Value) != EFI_SUCCESS) {
+        continue;
+      }
+      Status = CopySnapshotAttribute (Dest, Dest->TagAttributes.ListStart.BackLink, Attribute->AttributeName, Value, Attribute);
+      if (EFI_ERROR (Status)) {
+        return Status;
+      }
+    }
+  }
+
+  //
+  // Attributes the tree does not have. The same name can be set at several levels,
+  // so skip any already copied and let GetAttribute pick the newest value.
+  // The edits come newest first, so each one goes in ahead of those from the same
+  // level to keep the order they were made in.
+  //
+  for (Level = Snapshot; Level != NULL; Level = Level->Parent) {
+    LevelStart = Dest->TagAttributes.ListStart.BackLink;
+    for (Edit = NextSnapshotEdit (Level, (DRIVER_XML_DATA_HEADER*)Source, NULL);
+         Edit != NULL;
+         Edit = NextSnapshotEdit (Level, (DRIVER_XML_DATA_HEADER*)Source, Edit))
+    {
+      if (Edit->EditType != XmlSnapshotSetAttribute) {
+        continue;
+      }
+      if (GetXmlAttributeByName (Edit->Name, &Dest->TagAttributes, &Existing) == EFI_SUCCESS
+          || GetXmlAttributeByName (Edit->Name, &Source->TagAttributes, &Existing) == EFI_SUCCESS
+          || DriverXmlSnapshotGetAttribute (Snapshot, Source, Edit->Name, &Value) != EFI_SUCCESS)
+      {
+        continue;
+      }
+      Status = CopySnapshotAttribute (Dest, LevelStart, Edit->Name, Value, NULL);
+      if (EFI_ERROR (Status)) {
+        return Status;
+      }
+    }
+  }
+  return EFI_SUCCESS;
+}
+
+/**
+  Copy a tag as it is in a snapshot. A tag's children are added to its copy, so the copy
+  becomes the destination until CopySnapshotTagEnd.
+
+  @param[in] Element  The tag in the shared tree.
+  @param[in] Depth    Not used.
+  @param[in] Context  The XML_SNAPSHOT_COPY.
+
+  @retval EFI_SUCCESS             The tag was copied.
+  @retval DRIVER_XML_VISIT_SKIP   The tag was removed in the snapshot.
+  @retval EFI_OUT_OF_RESOURCES    There was not enough memory.
+**/
+EFI_STATUS
+CopySnapshotTag (
+  DRIVER_XML_DATA_HEADER* Element,
+  UINTN                   Depth,
+  VOID*                   Context
+  )
+{
+  XML_SNAPSHOT_COPY* Copy;
+  DRIVER_XML_TAG*    SourceTag;
+  DRIVER_XML_TAG*    NewTag;
+  EFI_STATUS         Status;
+
+  Copy = Context;
+  if (DriverXmlSnapshotIsRemoved (Copy->Snapshot, Element)) {
+    return DRIVER_XML_VISIT_SKIP;
+  }
+  SourceTag = (DRIVER_XML_TAG*)Element;
+  NewTag = DriverXmlAllocatePool (XmlAllocTag, sizeof (DRIVER_XML_TAG));
+  if (NewTag == NULL) {
+    return EFI_OUT_OF_RESOURCES;
+  }
+  NewTag->XmlDataType = SourceTag->XmlDataType;
+  NewTag->NamespaceId = SourceTag->NamespaceId;
+  NewTag->LocalNameId = SourceTag->LocalNameId;
+  NewTag->Parent = Copy->Dest;
+  InitializeListHead (&NewTag->TagAttributes.ListStart);
+  InitializeListHead (&NewTag->TagChildren.ListStart);
+  InsertTailList (&Copy->Dest->TagChildren.ListStart, &NewTag->DataLink);
+  Copy->Dest->TagChildren.ItemCount++;
+  NewTag->TagName = CopySnapshotString (SourceTag->TagName, AsciiStrLen (SourceTag->TagName));
+  if (NewTag->TagName == NULL) {
+    return EFI_OUT_OF_RESOURCES;
+  }
+  Status = CopySnapshotAttributes (Copy->Snapshot, SourceTag, NewTag);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+  if (SourceTag->XmlDataType == XmlTag) {
+    Copy->Dest = NewTag;
+  }
+  return EFI_SUCCESS;
+}
+
+/**
+  Go back to adding copies to the parent once a tag's children are copied.
+
+  @param[in] Element  The tag in the shared tree.
+  @param[in] Depth    Not used.
+  @param[in] Context  The XML_SNAPSHOT_COPY.
+
+  @retval EFI_SUCCESS  Always.
+**/
+EFI_STATUS
+CopySnapshotTagEnd (
+  DRIVER_XML_DATA_HEADER* Element,
+  UINTN                   Depth,
+  VOID*                   Context
+  )
+{
+  XML_SNAPSHOT_COPY* Copy;
+
+  Copy = Context;
+  //
+  // A removed tag was skipped without a copy, so there is nothing to leave.
+  //
+  if (!DriverXmlSnapshotIsRemoved (Copy->Snapshot, Element)) {
+    Copy->Dest = Copy->Dest->Parent;
+  }
+  return EFI_SUCCESS;
+}
+
+/**
+  Copy a char data node with the text it has in a snapshot.
+
+  @param[in] Element  The char data in the shared tree.
+  @param[in] Depth    Not used.
+  @param[in] Context  The XML_SNAPSHOT_COPY.
+
+  @retval EFI_SUCCESS           The node was copied, or it was removed in the snapshot.
+  @retval EFI_OUT_OF_RESOURCES  There was not enough memory.
+**/
+EFI_STATUS
+CopySnapshotCharData (
+  DRIVER_XML_DATA_HEADER* Element,
+  UINTN                   Depth,
+  VOID*                   Context
+  )
+{
+  XML_SNAPSHOT_COPY*    Copy;
+  DRIVER_XML_CHAR_DATA* NewCharData;
+  CONST CHAR8*          Text;
+  UINTN                 Length;
+
+  Copy = Context;
+  if (DriverXmlSnapshotGetCharData (Copy->Snapshot, (DRIVER_XML_CHAR_DATA*)Element, &Text, &Length) != EFI_SUCCESS) {
+    return EFI_SUCCESS;
+  }
+  NewCharData = DriverXmlAllocatePool (XmlAllocCharData, sizeof (DRIVER_XML_CHAR_DATA));
+  if (NewCharData == NULL) {
+    return EFI_OUT_OF_RESOURCES;
+  }
+  NewCharData->XmlDataType = XmlChar;
+  NewCharData->DataSize = Length;
+  if (Text == ((DRIVER_XML_CHAR_DATA*)Element)->CharData) {
+    NewCharData->Flags = ((DRIVER_XML_CHAR_DATA*)Element)->Flags & DRIVER_XML_TEXT_RAW;
+  }
+  InsertTailList (&Copy->Dest->TagChildren.ListStart, &NewCharData->DataLink);
+  Copy->Dest->TagChildren.ItemCount++;
+  NewCharData->CharData = CopySnapshotString (Text, Length);
+  if (NewCharData->CharData == NULL) {
+    return EFI_OUT_OF_RESOURCES;
+  }
+  return EFI_SUCCESS;
+}
+
+/**
+  Copy a processing instruction unless it was removed in the snapshot.
+
+  @param[in] Element  The processing instruction in the shared tree.
+  @param[in] Depth    Not used.
+  @param[in] Context  The XML_SNAPSHOT_COPY.
+
+  @retval EFI_SUCCESS           The node was copied, or it was removed in the snapshot.
+  @retval EFI_OUT_OF_RESOURCES  There was not enough memory.
+**/
+EFI_STATUS
+CopySnapshotPi (
+  DRIVER_XML_DATA_HEADER* Element,
+  UINTN                   Depth,
+  VOID*                   Context
+  )
+{
+  XML_SNAPSHOT_COPY*                 Copy;
+  DRIVER_XML_PROCESSING_INSTRUCTION* SourcePi;
+  DRIVER_XML_PROCESSING_INSTRUCTION* NewPi;
+
+  Copy = Context;
+  if (DriverXmlSnapshotIsRemoved (Copy->Snapshot, Element)) {
+    return EFI_SUCCESS;
+  }
+  SourcePi = (DRIVER_XML_PROCESSING_INSTRUCTION*)Element;
+  NewPi = DriverXmlAllocatePool (XmlAllocPi, sizeof (DRIVER_XML_PROCESSING_INSTRUCTION));
+  if (NewPi == NULL) {
+    return EFI_OUT_OF_RESOURCES;
+  }
+  NewPi->XmlDataType = XmlPi;
+  InsertTailList (&Copy->Dest->TagChildren.ListStart, &NewPi->DataLink);
+  Copy->Dest->TagChildren.ItemCount++;
+  if (SourcePi->PiTargetName != NULL) {
+    NewPi->PiTargetName = CopySnapshotString (SourcePi->PiTargetName, AsciiStrLen (SourcePi->PiTargetName));
+    if (NewPi->PiTargetName == NULL) {
+      return EFI_OUT_OF_RESOURCES;
+    }
+  }
+  if (SourcePi->PiTargetData != NULL) {
+    NewPi->PiTargetData = CopySnapshotString (SourcePi->PiTargetData, AsciiStrLen (SourcePi->PiTargetData));
+    if (NewPi->PiTargetData == NULL) {
+      return EFI_OUT_OF_RESOURCES;
+    }
+  }
+  return EFI_SUCCESS;
+}
+
+//
+// Copies a snapshot's view of a branch. The walk keeps its place in the shared tree
+// and XML_SNAPSHOT_COPY keeps the matching place in the new tree, so neither recurses.
+//
+CONST DRIVER_XML_VISITOR mXmlSnapshotCopier = {
+  {
+    NULL,                  // XmlNothing
+    CopySnapshotTag,       // XmlEmptyTag
+    CopySnapshotTag,       // XmlTag
+    NULL,                  // XmlCloseTag
+    NULL,                  // XmlAttribute
+    CopySnapshotCharData,  // XmlChar
+    CopySnapshotPi,        // XmlPi
+    NULL,                  // XmlDecl
+    NULL                   // XmlComment
+  },
+  {
+    NULL,                  // XmlNothing
+    NULL,                  // XmlEmptyTag
+    CopySnapshotTagEnd,    // XmlTag
+    NULL,                  // XmlCloseTag
+    NULL,                  // XmlAttribute
+    NULL,                  // XmlChar
+    NULL,                  // XmlPi
+    NULL,                  // XmlDecl
+    NULL                   // XmlComment
+  }
+};
+
+/**
+  Build an ordinary tree that has a snapshot's edits applied, for example to write a view out 
+  with PrintData. The new tree does not share anything with the snapshot.
+
+  @param[in]  Snapshot  The snapshot to copy.
+  @param[out] XmlTree   The new tree. Free it with DriverXmlFreeTree.
+
+  @retval EFI_SUCCESS            The tree was built.
+  @retval EFI_INVALID_PARAMETER  A pointer was NULL.
+  @retval EFI_OUT_OF_RESOURCES   There was not enough memory. Nothing is returned.
+**/
+EFI_STATUS
+DriverXmlSnapshotToTree (
+  IN  DRIVER_XML_SNAPSHOT*     Snapshot,
+  OUT DRIVER_XML_DATA_HEADER** XmlTree
+  )
+{
+  DRIVER_XML_TAG*   Source;
+  DRIVER_XML_TAG*   Root;
+  XML_SNAPSHOT_COPY Copy;
+  EFI_STATUS        Status;
+
+  if (Snapshot == NULL || XmlTree == NULL) {
+    return EFI_INVALID_PARAMETER;
+  }
+  Source = (DRIVER_XML_TAG*)Snapshot->Tree;
+  Root = DriverXmlAllocatePool (XmlAllocTag, sizeof (DRIVER_XML_TAG));
+  if (Root == NULL) {
+    return EFI_OUT_OF_RESOURCES;
+  }
+  Root->XmlDataType = XmlTag;
+  InitializeListHead (&Root->TagAttributes.ListStart);
+  InitializeListHead (&Root->TagChildren.ListStart);
+  Root->TagName = CopySnapshotString (Source->TagName, AsciiStrLen (Source->TagName));
+  Status = (Root->TagName == NULL) ? EFI_OUT_OF_RESOURCES : EFI_SUCCESS;
+  if (!EFI_ERROR (Status)) {
+    Status = CopySnapshotAttributes (Snapshot, Source, Root);
+  }
+  if (!EFI_ERROR (Status)) {
+    Copy.Snapshot = Snapshot;
+    Copy.Dest = Root;
+    Status = DriverXmlWalkBranch (&mXmlSnapshotCopier, &Source->TagChildren, 0, &Copy);
+  }
+  if (EFI_ERROR (Status)) {
+    DriverXmlFreeTree ((DRIVER_XML_DATA_HEADER*)Root);
+    return Status;
+  }
+  *XmlTree = (DRIVER_XML_DATA_HEADER*)Root;
+  return EFI_SUCCESS;
+}
@@ -29,12 +29,311 @@
 #include <uefi.h>
 #include <Library/DriverXmlLib.h>
 
+//
+// A namespace prefix bound by an xmlns attribute.
+// PrefixId is 0 for the default namespace. UriId is 0 when xmlns="" removes the default.
+// Depth is the parser depth the declaring element was added at.
+//
+typedef struct _XML_NAMESPACE_BINDING {
+  UINTN PrefixId;
+  UINTN UriId;
+  UINTN Depth;
+} XML_NAMESPACE_BINDING;
+
+//
+// The compiled replacement text of a general entity from the DOCTYPE internal subset.
+// Character references have already been replaced. Value is NULL for an external entity.
+//
+typedef struct _XML_ENTITY_VALUE {
+  CHAR8* Value;
+  UINTN  Length;
+} XML_ENTITY_VALUE;
+
+//
+// The parser state for one call to DriverXmlParseEx.
+// The document stream pointers are kept together with the options
+// so the tokenizer can apply them while chunks are extracted.
+//
+typedef struct _XML_PARSER_CONTEXT {
+  XML_DOCUMENT             Document;
+  //
+  // Source spans are measured from here. It is the start of Document
+  // except when part of a document is parsed again.
+  //
+  CHAR8*                   SourceBase;
+  DRIVER_XML_PARSE_OPTIONS Options;
+  //
+  // Namespace prefix bindings in scope, innermost last.
+  // Each binding is dropped when the element that declared it ends.
+  //
+  XML_NAMESPACE_BINDING*   Bindings;
+  UINTN                    BindingCount;
+  UINTN                    BindingSlots;
+  //
+  // General entities. EntityNames hashes a name to an id that indexes EntityValues.
+  // ExpandedBytes is the replacement text produced so far and is checked against
+  // MaxEntityExpansion. The limits have the defaults applied.
+  //
+  BOOLEAN                  SeenDoctype;
+  DRIVER_XML_NAME_TABLE*   EntityNames;
+  XML_ENTITY_VALUE*        EntityValues;
+  UINTN                    EntitySlots;
+  UINTN                    ExpandedBytes;
+  UINTN                    MaxEntityDepth;
+  UINTN                    MaxEntityExpansion;
+  //
+  // Usage counted against Options.Limits.
+  //
+  UINTN                    Depth;
+  UINTN                    NodeCount;
+  UINTN                    BytesUsed;
+} XML_PARSER_CONTEXT;
+
+//
+// A name read from binary tokens, still in the caller's buffer.
+//
+typedef struct _XML_BINARY_NAME {
+  CONST CHAR8* Name;
+  UINTN        Length;
+} XML_BINARY_NAME;
+
+//
+// The state of a reader of binary tokens. Next is the first byte not read yet.
+// Names is indexed by the name index minus 1.
+//
+typedef struct _XML_BINARY_DECODER {
+  CONST UINT8*     Next;
+  CONST UINT8*     End;
+  XML_BINARY_NAME* Names;
+  UINTN            NameCount;
+  UINTN            NameSlots;
+} XML_BINARY_DECODER;
+
+BOOLEAN
+IsAsciiWhitespace (
+  CHAR8 Character
+);
+
+BOOLEAN
+IsAsciiNameStartChar (
+  CHAR8 AsciiChar
+);
+
+BOOLEAN
+IsAsciiNameChar (
+  CHAR8 Character
+);
+
+UINT32
+DriverXmlHashString (
+  IN CONST CHAR8* Data,
+  IN UINTN        Length
+);
+
+EFI_STATUS
+DriverXmlResolveNamespaces (
+  XML_PARSER_CONTEXT* Context,
+  DRIVER_XML_TAG*     Tag
+);
+
+VOID
+DriverXmlPopNamespaceBindings (
+  XML_PARSER_CONTEXT* Context
+);
+
+VOID
+DriverXmlFreeNamespaceBindings (
+  XML_PARSER_CONTEXT* Context
+);
+
+EFI_STATUS
+DriverXmlParseDoctype (
+  XML_PARSER_CONTEXT* Context,
+  CHAR8*              Declaration,
+  UINTN               Length
+);
+
+EFI_STATUS
+DriverXmlExpandReferences (
+  XML_PARSER_CONTEXT* Context,
+  CONST CHAR8*        Text,
+  UINTN               Length,
+  CHAR8**             Expanded,
+  UINTN*              ExpandedLength
+);
+
+VOID
+DriverXmlFreeEntities (
+  XML_PARSER_CONTEXT* Context
+);
+
+EFI_STATUS
+ParseCharReference (
+  IN  CONST CHAR8* Reference,
+  IN  UINTN        Length,
+  OUT UINT32*      CodePoint
+);
+
+BOOLEAN
+GetPredefinedEntity (
+  IN  CONST CHAR8* Name,
+  IN  UINTN        Length,
+  OUT CHAR8*       Character
+);
+
+EFI_STATUS
+GetReferenceLength (
+  IN  CONST CHAR8* Text,
+  IN  CONST CHAR8* End,
+  OUT UINTN*       RefLength
+);
+
+UINTN
+DriverXmlEncodeUtf8 (
+  IN  UINT32 CodePoint,
+  OUT CHAR8* Encoded
+);
+
+VOID
+DriverXmlInvalidateHash (
+  DRIVER_XML_TAG* Tag
+);
+
+EFI_STATUS
+BytesToDocument (
+  CONST CHAR8*  Bytes,
+  UINTN         Length,
+  XML_DOCUMENT* OutputDocument
+);
+
+EFI_STATUS
+EscapedTextToDocument (
+  CONST CHAR8*  Text,
+  UINTN         Length,
+  BOOLEAN       IsAttribute,
+  BOOLEAN       KeepReferences,
+  XML_DOCUMENT* OutputDocument
+);
+
+VOID*
+DriverXmlAllocatePool (
+  XML_ALLOC_TYPE Type,
+  UINTN          Size
+);
+
+VOID*
+DriverXmlReallocatePool (
+  XML_ALLOC_TYPE Type,
+  VOID*          Buffer,
+  UINTN          NewSize
+);
+
+VOID
+DriverXmlFreePool (
+  VOID* Buffer
+);
+
+VOID
+DriverXmlCountCallerAllocation (
+  XML_ALLOC_TYPE Type,
+  UINTN          OldSize,
+  UINTN          NewSize
+);
+
+EFI_STATUS
+ChargeParseBudget (
+  XML_PARSER_CONTEXT* Context,
+  UINTN               Nodes,
+  UINTN               Bytes
+);
+
+EFI_STATUS
+CreateRootTag (
+  DRIVER_XML_TAG** Root
+);
+
+VOID
+InitializeParserContext (
+  XML_PARSER_CONTEXT*       Context,
+  CHAR8*                    SourceBase,
+  CHAR8*                    Text,
+  UINTN                     Size,
+  DRIVER_XML_PARSE_OPTIONS* Options
+);
+
+DRIVER_XML_TAG*
+DriverXmlCreateTag (
+  DRIVER_XML_TAG* ParentElement,
+  CHAR8*          TagName,
+  XML_DATA_TYPE   DataType
+);
+
+DRIVER_XML_TAG*
+DriverXmlCreateChildTag (
+  DRIVER_XML_TAG* ParentElement,
+  CHAR8*          ChildTagName,
+  XML_DATA_TYPE   ChildDataType
+);
+
+DRIVER_XML_ATTRIBUTE*
+DriverXmlAddAttribute (
+  DRIVER_XML_TAG* ParentElement,
+  CHAR8*          AtrributeName,
+  CHAR8*          AttributeData
+);
+
+DRIVER_XML_DATA_HEADER*
+DriverXmlAddCharData (
+  LIST_ANCHOR* ElementList,
+  CHAR8*       CharData,
+  UINTN        CharDataLen
+);
+
+EFI_STATUS
+InitializeBinaryDecoder (
+  XML_BINARY_DECODER* Decoder,
+  CONST VOID*         Buffer,
+  UINTN               Size
+);
+
+VOID
+FreeBinaryDecoder (
+  XML_BINARY_DECODER* Decoder
+);
+
+EFI_STATUS
+ReadBinaryNumber (
+  XML_BINARY_DECODER* Decoder,
+  UINTN*              Value
+);
+
+EFI_STATUS
+ReadBinaryString (
+  XML_BINARY_DECODER* Decoder,
+  CONST CHAR8**       Text,
+  UINTN*              Length
+);
+
+EFI_STATUS
+ReadBinaryOptionalString (
+  XML_BINARY_DECODER* Decoder,
+  CONST CHAR8**       Text,
+  UINTN*              Length
+);
+
+EFI_STATUS
+ReadBinaryName (
+  XML_BINARY_DECODER* Decoder,
+  CONST CHAR8**       Name,
+  UINTN*              Length
+);
 
 EFI_STATUS
 AsciiExtractMarkupOrText (
-  XML_DOCUMENT*  XmlDoc,
-  CHAR8**        XmlString,
-  XML_DATA_TYPE* ExtractedType
+  XML_PARSER_CONTEXT* Context,
+  CHAR8**             XmlString,
+  UINTN*              XmlStringLength,
+  XML_DATA_TYPE*      ExtractedType
 );
 
 EFI_STATUS
@@ -587,7 +587,7 @@ AsciiExtractPI(
   if (LocalPtr > EndOfData) {
       return EFI_END_OF_FILE;
   }
-  *XmlString = AllocateZeroPool (Length + 1);
+  *XmlString = DriverXmlAllocatePool (XmlAllocScratch, Length + 1);
   gBS->CopyMem(
          *XmlString,
          XmlDoc->OperationPtr,
@@ -646,7 +646,7 @@ AsciiExtractComment (
   if (LocalPtr > EndOfData) {
       return EFI_END_OF_FILE;
   }
-  *XmlString = AllocateZeroPool (Length + 1);
+  *XmlString = DriverXmlAllocatePool (XmlAllocScratch, Length + 1);
   gBS->CopyMem(
          *XmlString,
          XmlDoc->OperationPtr,
@@ -701,7 +701,7 @@ AsciiExtractBoxedData (
     return EFI_END_OF_FILE;
   }
   
-  *XmlString = AllocateZeroPool (Length + 1);
+  *XmlString = DriverXmlAllocatePool (XmlAllocScratch, Length + 1);
   gBS->CopyMem(
          *XmlString,
          XmlDoc->OperationPtr,
@@ -714,6 +714,8 @@ AsciiExtractBoxedData (
 /**
   Extract a declaration. These are elements that start '<!' except for comments. 
   See IsAsciiDeclaration for more info.
+  A DOCTYPE may carry an internal subset in []s holding more declarations, 
+  so '>' only ends the declaration outside of []s and quoted literals.
 
   @param[in out] XmlDoc  A housekeeping data structure for raw XML text. 
                          Pointers in the structure are updated in this call.
@@ -734,6 +736,8 @@ AsciiExtractDeclaration (
   CHAR8*     LocalPtr;
   CHAR8*     EndOfData;
   UINTN      Length;
+  UINTN      BracketDepth;
+  CHAR8      QuoteChar;
   
   EndOfData = XmlDoc->XmlDocument + XmlDoc->DocumentSize;
   StrStart = XmlDoc->OperationPtr;
@@ -762,25 +766,45 @@ AsciiExtractDeclaration (
   //
   // Extract data without []s
   //
-  LocalPtr = StrStart;
-  Length = 0;
+  LocalPtr = StrStart + 2;
+  BracketDepth = 0;
+  QuoteChar = '\0';
 
   //
   // Prevent reads beyond the EOF
   //
-  while (LocalPtr < (EndOfData - 3)) {
-    Length++;
-    LocalPtr++;
-    if (*(LocalPtr) == '>') {
-        break;
+  while (LocalPtr < EndOfData) {
+    if (QuoteChar != '\0') {
+      if (*LocalPtr == QuoteChar) {
+        QuoteChar = '\0';
+      }
+    } else if (*LocalPtr == '\"' || *LocalPtr == '\'') {
+      QuoteChar = *LocalPtr;
+    } else if (*LocalPtr == '[') {
+      BracketDepth++;
+    } else if (*LocalPtr == ']' && BracketDepth > 0) {
+      BracketDepth--;
+    } else if (BracketDepth > 0 && EndOfData - LocalPtr >= 4 && AsciiStrnCmp (LocalPtr, "<!--", 4) == 0) {
+      //
+      // Comments in the internal subset can hold quotes and brackets so step over them whole.
+      //
+      LocalPtr += 4;
+      while (LocalPtr < EndOfData - 2 && !(LocalPtr[0] == '-' && LocalPtr[1] == '-' && LocalPtr[2] == '>')) {
+        LocalPtr++;
+      }
+      LocalPtr += 2;
+    } else if (*LocalPtr == '>' && BracketDepth == 0) {
+      break;
     }
+    LocalPtr++;
   }
   
-  if (LocalPtr > EndOfData) {
+  if (LocalPtr >= EndOfData) {
       return EFI_END_OF_FILE;
   }
+  Length = LocalPtr - StrStart + 1;
   
-  *XmlString = AllocateZeroPool (Length + 1);
+  *XmlString = DriverXmlAllocatePool (XmlAllocScratch, Length + 1);
   gBS->CopyMem(
          *XmlString, 
          XmlDoc->OperationPtr, 
@@ -827,7 +851,7 @@ AsciiExtractXmlTag (
   if (LocalPtr > EndOfData) {
       return EFI_END_OF_FILE;
   }
-  *XmlString = AllocateZeroPool (Length + 1);
+  *XmlString = DriverXmlAllocatePool (XmlAllocScratch, Length + 1);
   gBS->CopyMem(
          *XmlString,
          XmlDoc->OperationPtr,
@@ -928,7 +952,7 @@ AsciiExtractAttribute (
   //
   // Copy out the attribute name string so we don't lose it. 
   //
-  LocalAttrib = AllocateZeroPool (i + 1);
+  LocalAttrib = DriverXmlAllocatePool (XmlAllocString, i + 1);
   gBS->CopyMem(
         LocalAttrib,
         StrPtr,
@@ -947,7 +971,7 @@ AsciiExtractAttribute (
   // Malformed attribute
   //
   if (StrPtr2[j] != '=') {
-    FreePool (LocalAttrib);
+    DriverXmlFreePool (LocalAttrib);
     return EFI_INVALID_PARAMETER;
   }
   j++;
@@ -965,7 +989,7 @@ AsciiExtractAttribute (
   j = 0;
 
   if (StrPtr2[j] != '\"' && StrPtr2[j] != '\'') {
-    FreePool (LocalAttrib);
+    DriverXmlFreePool (LocalAttrib);
     return EFI_INVALID_PARAMETER;
   }
   
@@ -986,14 +1010,14 @@ AsciiExtractAttribute (
     j++;
   }
   if (StrPtr2[j] != QuoteTypeChar){
-    FreePool (LocalAttrib);
+    DriverXmlFreePool (LocalAttrib);
     return EFI_INVALID_PARAMETER;
   }
   //
   // It's possible to have no data
   //
   if (j > 0) {
-    LocalAttribData = AllocateZeroPool(j + 1);
+    LocalAttribData = DriverXmlAllocatePool (XmlAllocString, j + 1);
     gBS->CopyMem(
            LocalAttribData,
            StrPtr2,
@@ -1015,48 +1039,100 @@ AsciiExtractAttribute (
 
 /**
   This extracts information that is not markup. This is the content part of the XML document.
-
-  @param[in out] XmlDoc     A housekeeping data structure for raw XML text. 
-                            Pointers in the structure are updated in this call.
-  @param[out]    XmlString  The XML substring extracted for this element.
-                            This is a copy of the string that the caller must free.
-  
-  @retval EFI_END_OF_FILE  The EOF was reached before the chunk could be extracted.
-  @retval EFI_SUCCESS      The chunk was successfully extracted and returned in XmlString.
+  The trim and normalize parse flags are applied while the data is copied out so they do not
+  cost an extra pass over the text.
+
+  @param[in out] XmlDoc           A housekeeping data structure for raw XML text. 
+                                  Pointers in the structure are updated in this call.
+  @param[in]     ParseFlags       The DRIVER_XML_PARSE_* flags in effect for this parse.
+  @param[in]     MaxLength        The longest run of char data allowed, 0 for no limit.
+                                  This is checked before anything is allocated.
+  @param[out]    XmlString        The XML substring extracted for this element.
+                                  This is a copy of the string that the caller must free.
+  @param[out]    XmlStringLength  The number of characters in XmlString, not counting the terminator.
+  
+  @retval EFI_END_OF_FILE         The EOF was reached before the chunk could be extracted.
+  @retval EFI_SECURITY_VIOLATION  The char data is longer than MaxLength.
+  @retval EFI_OUT_OF_RESOURCES    There was not enough memory for the copy.
+  @retval EFI_SUCCESS             The chunk was successfully extracted and returned in XmlString.
 **/
 EFI_STATUS
 AsciiExtractCharData (
   IN OUT XML_DOCUMENT* XmlDoc,
-  OUT CHAR8**          XmlString
+  IN     UINT32        ParseFlags,
+  IN     UINTN         MaxLength,
+  OUT    CHAR8**       XmlString,
+  OUT    UINTN*        XmlStringLength
   )
 {
-  CHAR8* LocalPtr;
-  UINTN  Length;
-  CHAR8* EndOfData;
+  CHAR8*  LocalPtr;
+  CHAR8*  DataStart;
+  CHAR8*  DataEnd;
+  CHAR8*  EndOfData;
+  CHAR8*  OutPtr;
+  BOOLEAN InWhitespace;
 
   
   EndOfData = XmlDoc->XmlDocument + XmlDoc->DocumentSize;
   LocalPtr = XmlDoc->OperationPtr;
-  Length = 0;
+  if (LocalPtr >= EndOfData) {
+    return EFI_END_OF_FILE;
+  }
 
-  while (LocalPtr < EndOfData) {
-    Length++;
+  //
+  // Char data always consumes at least one character and runs until the next markup.
+  //
+  do {
     LocalPtr++;
-    if (*LocalPtr == '<'){
-      break;
+  } while (LocalPtr < EndOfData && *LocalPtr != '<');
+
+  DataStart = XmlDoc->OperationPtr;
+  DataEnd = LocalPtr;
+  if ((ParseFlags & (DRIVER_XML_PARSE_TRIM_CHAR_DATA | DRIVER_XML_PARSE_NORMALIZE_CHAR_DATA)) != 0) {
+    while (DataStart < DataEnd && IsAsciiWhitespace (*DataStart)) {
+      DataStart++;
+    }
+    while (DataEnd > DataStart && IsAsciiWhitespace (*(DataEnd - 1))) {
+      DataEnd--;
     }
   }
-  *XmlString = AllocateZeroPool (Length + 1);
-  gBS->CopyMem(
-        *XmlString,
-        XmlDoc->OperationPtr,
-        Length
-      );
-  if (LocalPtr > EndOfData) {
-    XmlDoc->OperationPtr = EndOfData;
+
+  if (MaxLength != 0 && (UINTN)(DataEnd - DataStart) > MaxLength) {
+    DEBUG ((DEBUG_ERROR, "Char data longer than the %d character limit\n", MaxLength));
+    return EFI_SECURITY_VIOLATION;
+  }
+  *XmlString = DriverXmlAllocatePool (XmlAllocScratch, (DataEnd - DataStart) + 1);
+  if (*XmlString == NULL) {
+    return EFI_OUT_OF_RESOURCES;
+  }
+  if ((ParseFlags & DRIVER_XML_PARSE_NORMALIZE_CHAR_DATA) != 0) {
+    //
+    // Collapse each run of whitespace into a single space as we copy.
+    //
+    OutPtr = *XmlString;
+    InWhitespace = FALSE;
+    while (DataStart < DataEnd) {
+      if (IsAsciiWhitespace (*DataStart)) {
+        if (!InWhitespace) {
+          *OutPtr++ = ' ';
+        }
+        InWhitespace = TRUE;
+      } else {
+        *OutPtr++ = *DataStart;
+        InWhitespace = FALSE;
+      }
+      DataStart++;
+    }
+    *XmlStringLength = OutPtr - *XmlString;
   } else {
-    XmlDoc->OperationPtr = LocalPtr;
+    gBS->CopyMem(
+          *XmlString,
+          DataStart,
+          DataEnd - DataStart
+        );
+    *XmlStringLength = DataEnd - DataStart;
   }
+  XmlDoc->OperationPtr = LocalPtr;
   return EFI_SUCCESS;
 }
 
@@ -1065,57 +1141,84 @@ AsciiExtractCharData (
   Return that chunk to the caller.
 
 
-  @param[in out] XmlDoc      A housekeeping data structure for raw XML text. 
-                             Pointers in the structure are updated in this call.
-  @param[out] XmlString      The XML substring extracted for this element.
-                             This is a copy of the string that the caller must free.
-  @param[out] ExtractedType  The type of XML data that was extracted.
+  @param[in out] Context      The parser state. The document stream pointers are updated in this call.
+  @param[out] XmlString       The XML substring extracted for this element.
+                              This is a copy of the string that the caller must free.
+  @param[out] XmlStringLength The number of characters in XmlString, not counting the terminator.
+  @param[out] ExtractedType   The type of XML data that was extracted.
   
   @retval EFI_END_OF_FILE  The EOF was reached before the chunk could be extracted.
   @retval EFI_SUCCESS      The chunk was successfully extracted and returned in XmlString.
 **/
 EFI_STATUS
 AsciiExtractMarkupOrText(
-  IN OUT XML_DOCUMENT*  XmlDoc,
-  OUT CHAR8**           XmlString,
-  OUT XML_DATA_TYPE*    ExtractedType 
+  IN OUT XML_PARSER_CONTEXT* Context,
+  OUT CHAR8**                XmlString,
+  OUT UINTN*                 XmlStringLength,
+  OUT XML_DATA_TYPE*         ExtractedType 
   )
 {
-  UINTN      Length;
-  CHAR8*     StrStart;
-  CHAR8*     LocalPtr;
-  CHAR8*     EndOfData;
-  EFI_STATUS Status;
+  XML_DOCUMENT* XmlDoc;
+  CHAR8*        StrStart;
+  CHAR8*        EndOfData;
+  EFI_STATUS    Status;
   
+  XmlDoc = &Context->Document;
   EndOfData = XmlDoc->XmlDocument + XmlDoc->DocumentSize;
-  Length = 0;
   
   *ExtractedType = XmlNothing;
+  *XmlStringLength = 0;
   StrStart = XmlDoc->OperationPtr; 
-  if (StrStart > EndOfData) {
+  if (StrStart >= EndOfData) {
     return EFI_END_OF_FILE;
   }
   
   //
   // advance over leading whitespace
   //
-  while (IsAsciiWhitespace (*StrStart)) {
+  while (StrStart < EndOfData && IsAsciiWhitespace (*StrStart)) {
     StrStart++;
-    if (StrStart > EndOfData) {
-      return EFI_END_OF_FILE;
-    }
   }
-  
-  LocalPtr = StrStart;
-  //
-  // Check to see if this is markup
-  //
-  if (*StrStart == '<') {
+
+  if (StrStart >= EndOfData || *StrStart == '<') {
+    //
+    // This run of whitespace only separates markup (or trails the document).
+    // Unless the caller asked for it to be dropped, hand it back as char data.
+    // Trimming would leave nothing so it is dropped in that case too.
+    //
+    if (StrStart > XmlDoc->OperationPtr 
+      && (Context->Options.Flags & (DRIVER_XML_PARSE_DROP_WHITESPACE 
+                                    | DRIVER_XML_PARSE_TRIM_CHAR_DATA 
+                                    | DRIVER_XML_PARSE_NORMALIZE_CHAR_DATA)) == 0) 
+    {
+      *XmlStringLength = StrStart - XmlDoc->OperationPtr;
+      if (Context->Options.Limits.MaxTextLength != 0 
+          && *XmlStringLength > Context->Options.Limits.MaxTextLength) 
+      {
+        DEBUG ((DEBUG_ERROR, "Char data longer than the %d character limit\n", Context->Options.Limits.MaxTextLength));
+        return EFI_SECURITY_VIOLATION;
+      }
+      *XmlString = DriverXmlAllocatePool (XmlAllocScratch, *XmlStringLength + 1);
+      if (*XmlString == NULL) {
+        return EFI_OUT_OF_RESOURCES;
+      }
+      gBS->CopyMem (
+             *XmlString,
+             XmlDoc->OperationPtr,
+             *XmlStringLength
+           );
+      XmlDoc->OperationPtr = StrStart;
+      *ExtractedType = XmlChar;
+      return EFI_SUCCESS;
+    }
     //
     // Update the stream pointer to reflect consuming the whitespace.
     // Do it here because char data can have leading whitespace
     //
     XmlDoc->OperationPtr = StrStart;
+    if (StrStart >= EndOfData) {
+      return EFI_END_OF_FILE;
+    }
     
     // 
     // Is the string long enough to support being a element?
@@ -1172,10 +1275,19 @@ AsciiExtractMarkupOrText(
       *ExtractedType = XmlNothing;
       Status = AsciiExtractCharData(
                  XmlDoc,
-                 XmlString
+                 Context->Options.Flags,
+                 Context->Options.Limits.MaxTextLength,
+                 XmlString,
+                 XmlStringLength
                );
     }
     
+    if (EFI_ERROR (Status)) {
+      return Status;
+    }
+    if (*ExtractedType != XmlNothing) {
+      *XmlStringLength = AsciiStrLen (*XmlString);
+    }
     //
     // Malformed XML
     //
@@ -1191,11 +1303,6 @@ AsciiExtractMarkupOrText(
     //
     return EFI_SUCCESS;
   } 
-  while (LocalPtr < EndOfData) {
-    Length++;
-    LocalPtr++;
-    if (*(LocalPtr) == '<') break;
-  }
   //
   // We know we didn't have whitespace.
   // so assume we have char data.
@@ -1203,9 +1310,12 @@ AsciiExtractMarkupOrText(
   *ExtractedType = XmlChar;
   Status = AsciiExtractCharData (
              XmlDoc,
-             XmlString
+             Context->Options.Flags,
+             Context->Options.Limits.MaxTextLength,
+             XmlString,
+             XmlStringLength
            );
-  return EFI_SUCCESS;
+  return Status;
 }
 
 /**
@@ -1257,7 +1367,7 @@ AsciiGetTagNameFromElement (
       DEBUG ((DEBUG_ERROR, "Encountered and invalid character 0x%x\n", StrPtr[ElementLength]));
       return EFI_INVALID_PARAMETER;
     }
-    *ElementName = AllocateZeroPool (ElementLength + 1);
+    *ElementName = DriverXmlAllocatePool (XmlAllocString, ElementLength + 1);
     gBS->CopyMem(
            *ElementName, 
            StrPtr, 
@@ -1317,11 +1427,17 @@ AsciiGetPIData (
     {
       PiTargetLength++;
     }
-    if (!IsAsciiWhitespace(StrPtr[PiTargetLength]) && !IsAsciiXmlTagEndStr(&StrPtr[PiTargetLength])) {
+    //
+    // The target ends at whitespace, or at the '?>' of a PI with no data such as <?target?>.
+    //
+    if (!IsAsciiWhitespace(StrPtr[PiTargetLength]) && 
+        !IsAsciiXmlTagEndStr(&StrPtr[PiTargetLength]) &&
+        !(StrPtr[PiTargetLength] == '?' && StrPtr[PiTargetLength + 1] == '>')) 
+    {
       DEBUG((DEBUG_ERROR,"Encountered and invalid character 0x%x\n",StrPtr[PiTargetLength]));
       return EFI_INVALID_PARAMETER;
     }
-    *PiTargetName = AllocateZeroPool(PiTargetLength + 1);
+    *PiTargetName = DriverXmlAllocatePool (XmlAllocString, PiTargetLength + 1);
     gBS->CopyMem(*PiTargetName,StrPtr,PiTargetLength);
   } else {
     //
@@ -1371,7 +1487,7 @@ AsciiGetPIData (
   }
   if(PiDataLength >= 1){
 
-    *PiTargetData = AllocateZeroPool(PiDataLength + 1);
+    *PiTargetData = DriverXmlAllocatePool (XmlAllocString, PiDataLength + 1);
     gBS->CopyMem(*PiTargetData, StrPtr, PiDataLength);
   }
   return EFI_SUCCESS;
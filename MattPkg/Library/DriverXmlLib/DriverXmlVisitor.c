@@ -0,0 +1,215 @@
+/** @file
+  The tree walker shared by the printers, the searches and the code that frees trees.
+  A visitor is a table of handlers indexed by XML_DATA_TYPE, so each element costs one
+  lookup instead of a try of every handler in turn.
+  
+  Copyright (c) 2016, Matthew Lazarowitz. All rights reserved.<BR>
+  This program and the accompanying materials are licensed and made available under
+  the terms and conditions of the MIT License that accompanies this distribution.
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+**/
+#include <Uefi.h>
+#include <Library/DebugLib.h>
+#include <Library/BaseLib.h>
+#include <Library/DriverXmlLib.h>
+#include <DriverXmlStringHandlers.h>
+
+/**
+  Call the handler a visitor has for an element's type, if it has one.
+
+  @param[in] Handlers  The visitor's PreOrder or PostOrder table.
+  @param[in] Element   The element being visited.
+  @param[in] Depth     The depth of the element.
+  @param[in] Context   The caller's context.
+
+  @return The handler's status, or EFI_SUCCESS if there is no handler for the type.
+**/
+EFI_STATUS
+CallVisitHandler (
+  CONST DRIVER_XML_VISIT_HANDLER* Handlers,
+  DRIVER_XML_DATA_HEADER*         Element,
+  UINTN                           Depth,
+  VOID*                           Context
+  )
+{
+  if ((UINTN)Element->XmlDataType >= XmlDataTypeMax || Handlers[Element->XmlDataType] == NULL) {
+    return EFI_SUCCESS;
+  }
+  return Handlers[Element->XmlDataType] (Element, Depth, Context);
+}
+
+/**
+  The traversal core shared by DriverXmlWalkElement and DriverXmlWalkBranch.
+  Instead of recursing, the walk goes down through TagChildren and back up through the
+  Parent link of the tag whose children it has finished. Only tags reached through the
+  walk are climbed through, and the tree functions set Parent on every tag they add.
+  The next element is found before the post-order handler runs so the handler may free
+  the element it was given.
+
+  @param[in] Visitor   The handlers to call.
+  @param[in] TopList   The list First is on, or NULL if First is walked alone.
+  @param[in] First     The first element to visit.
+  @param[in] Depth     The depth reported for First.
+  @param[in] Context   Passed to every handler.
+
+  @retval EFI_SUCCESS  The walk finished or a handler stopped it.
+  @retval other        The error a handler returned.
+**/
+EFI_STATUS
+VisitorWalkWorker (
+  CONST DRIVER_XML_VISITOR* Visitor,
+  LIST_ANCHOR*              TopList,
+  DRIVER_XML_DATA_HEADER*   First,
+  UINTN                     Depth,
+  VOID*                     Context
+  )
+{
+  DRIVER_XML_DATA_HEADER* Element;
+  DRIVER_XML_DATA_HEADER* Next;
+  DRIVER_XML_TAG*         Tag;
+  LIST_ANCHOR*            List;
+  UINTN                   Level;
+  EFI_STATUS              Status;
+
+  Element = First;
+  List = TopList;
+  Level = 0;
+  for (;;) {
+    Status = CallVisitHandler (Visitor->PreOrder, Element, Depth + Level, Context);
+    if (Status == DRIVER_XML_VISIT_STOP) {
+      return EFI_SUCCESS;
+    }
+    if (EFI_ERROR (Status)) {
+      return Status;
+    }
+    if (Status != DRIVER_XML_VISIT_SKIP 
+        && Element->XmlDataType == XmlTag 
+        && ((DRIVER_XML_TAG*)Element)->TagChildren.ItemCount > 0) 
+    {
+      List = &((DRIVER_XML_TAG*)Element)->TagChildren;
+      Element = (DRIVER_XML_DATA_HEADER*)GetFirstNode (&List->ListStart);
+      Level++;
+      continue;
+    }
+    //
+    // Leave the element, then every ancestor whose last child it was,
+    // until there is a sibling to move on to.
+    //
+    for (;;) {
+      Next = NULL;
+      if (List != NULL && !IsNodeAtEnd (&List->ListStart, &Element->DataLink)) {
+        Next = (DRIVER_XML_DATA_HEADER*)GetNextNode (&List->ListStart, &Element->DataLink);
+      }
+      Status = CallVisitHandler (Visitor->PostOrder, Element, Depth + Level, Context);
+      if (Status == DRIVER_XML_VISIT_STOP) {
+        return EFI_SUCCESS;
+      }
+      if (EFI_ERROR (Status)) {
+        return Status;
+      }
+      if (Next != NULL) {
+        Element = Next;
+        break;
+      }
+      if (Level == 0) {
+        return EFI_SUCCESS;
+      }
+      //
+      // That was the last child. The list is the parent's TagChildren so the parent is
+      // found from it, and the parent's own list from the parent's Parent.
+      //
+      Tag = BASE_CR (List, DRIVER_XML_TAG, TagChildren);
+      Level--;
+      if (Level == 0) {
+        List = TopList;
+      } else {
+        if (Tag->Parent == NULL) {
+          DEBUG ((DEBUG_ERROR, "%a : Tag %a has no parent\n", __FUNCTION__, Tag->TagName));
+          return EFI_VOLUME_CORRUPTED;
+        }
+        List = &Tag->Parent->TagChildren;
+      }
+      Element = (DRIVER_XML_DATA_HEADER*)Tag;
+    }
+  }
+}
+
+/**
+  Walk an element and everything below it, calling the visitor's handlers in document order.
+  The walk does not recurse so it runs in the same stack space whatever the depth of the tree.
+  A post-order handler may free the element it is given; the walk does not look at it again.
+
+  @param[in] Visitor  The handlers to call.
+  @param[in] Element  The element to start from. Its siblings are not visited.
+  @param[in] Depth    The depth reported for Element.
+  @param[in] Context  Passed to every handler.
+
+  @retval EFI_SUCCESS            The walk finished or a handler stopped it.
+  @retval EFI_INVALID_PARAMETER  Visitor or Element is NULL.
+  @retval other                  The error a handler returned.
+**/
+EFI_STATUS
+DriverXmlWalkElement (
+  CONST DRIVER_XML_VISITOR* Visitor,
+  DRIVER_XML_DATA_HEADER*   Element,
+  UINTN                     Depth,
+  VOID*                     Context
+  )
+{
+  if (Visitor == NULL || Element == NULL) {
+    return EFI_INVALID_PARAMETER;
+  }
+  return VisitorWalkWorker (Visitor, NULL, Element, Depth, Context);
+}
+
+/**
+  Walk every element in a list and everything below them, calling the visitor's handlers
+  in document order.
+
+  @param[in] Visitor  The handlers to call.
+  @param[in] Branch   The list of elements, usually the TagChildren of a tag.
+  @param[in] Depth    The depth reported for the elements in Branch.
+  @param[in] Context  Passed to every handler.
+
+  @retval EFI_SUCCESS            The walk finished or a handler stopped it.
+  @retval EFI_INVALID_PARAMETER  Visitor or Branch is NULL.
+  @retval other                  The error a handler returned.
+**/
+EFI_STATUS
+DriverXmlWalkBranch (
+  CONST DRIVER_XML_VISITOR* Visitor,
+  LIST_ANCHOR*              Branch,
+  UINTN                     Depth,
+  VOID*                     Context
+  )
+{
+  if (Visitor == NULL || Branch == NULL) {
+    return EFI_INVALID_PARAMETER;
+  }
+  if (Branch->ItemCount == 0) {
+    return EFI_SUCCESS;
+  }
+  return VisitorWalkWorker (
+           Visitor,
+           Branch,
+           (DRIVER_XML_DATA_HEADER*)GetFirstNode (&Branch->ListStart),
+           Depth,
+           Context
+           );
+}
@@ -0,0 +1,350 @@
+/** @file
+  Writer for producing XML directly, without building a tree first.
+  Elements, attributes and text go to an output sink as they are written, with the
+  text escaped, so a large report costs no more memory than a small one.
+  
+  Copyright (c) 2016, Matthew Lazarowitz. All rights reserved.<BR>
+  This program and the accompanying materials are licensed and made available under
+  the terms and conditions of the MIT License that accompanies this distribution.
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+**/
+#include <uefi.h>
+#include <Library/DebugLib.h>
+#include <Library/BaseLib.h>
+#include <Library/UefiBootServicesTableLib.h>
+#include <DriverXmlStringHandlers.h>
+
+/**
+  Check that a string can be used as an element or attribute name.
+
+  @param[in] Name  The name.
+
+  @retval TRUE   Name is a valid XML name.
+  @retval FALSE  Name is empty or holds a character names can't have.
+**/
+BOOLEAN
+IsValidXmlName (
+  CONST CHAR8* Name
+  )
+{
+  if (!IsAsciiNameStartChar (*Name)) {
+    return FALSE;
+  }
+  for (Name++; *Name != '\0'; Name++) {
+    if (!IsAsciiNameChar (*Name)) {
+      return FALSE;
+    }
+  }
+  return TRUE;
+}
+
+/**
+  Remember the first error a writer hits.
+
+  @param[in out] Writer  The writer.
+  @param[in]     Status  The result of the last write.
+
+  @return Status.
+**/
+EFI_STATUS
+UpdateWriterStatus (
+  DRIVER_XML_WRITER* Writer,
+  EFI_STATUS         Status
+  )
+{
+  if (EFI_ERROR (Status)) {
+    Writer->Status = Status;
+  }
+  return Status;
+}
+
+/**
+  Close the start tag of the innermost element, if it is still open, before content is written into it.
+
+  @param[in out] Writer  The writer.
+
+  @retval EFI_SUCCESS  The start tag is closed.
+  @retval other        An error from the sink.
+**/
+EFI_STATUS
+CloseStartTag (
+  DRIVER_XML_WRITER* Writer
+  )
+{
+  if (!Writer->StartTagOpen) {
+    return EFI_SUCCESS;
+  }
+  Writer->StartTagOpen = FALSE;
+  return BytesToDocument (">", 1, &Writer->Document);
+}
+
+/**
+  Set up a writer that builds a document directly in a sink.
+
+  @param[out] Writer         The writer to set up.
+  @param[in]  Sink           Where the output goes. NULL collects it in Writer->Document
+                             the same way as PrintData, and the buffer belongs to the caller.
+  @param[in]  NameStack      The buffer the names of open elements are kept in.
+  @param[in]  NameStackSize  The size of NameStack. Each open element takes its name length plus one.
+
+  @retval EFI_SUCCESS            The writer is ready.
+  @retval EFI_INVALID_PARAMETER  Writer or NameStack is NULL, or NameStackSize is 0.
+**/
+EFI_STATUS
+DriverXmlInitWriter (
+  DRIVER_XML_WRITER*      Writer,
+  DRIVER_XML_OUTPUT_SINK* Sink,
+  CHAR8*                  NameStack,
+  UINTN                   NameStackSize
+  )
+{
+  if (Writer == NULL || NameStack == NULL || NameStackSize == 0) {
+    return EFI_INVALID_PARAMETER;
+  }
+  gBS->SetMem (Writer, sizeof (DRIVER_XML_WRITER), 0);
+  Writer->Document.Sink = Sink;
+  Writer->NameStack = NameStack;
+  Writer->NameStackSize = NameStackSize;
+  Writer->Status = EFI_SUCCESS;
+  return EFI_SUCCESS;
+}
+
+/**
+  Start an element. Its attributes can be written until something else is.
+
+  @param[in] Writer  The writer.
+  @param[in] Name    The element name.
+
+  @retval EFI_SUCCESS            The start tag was begun.
+  @retval EFI_INVALID_PARAMETER  A pointer is NULL or Name is not a valid XML name.
+  @retval EFI_BUFFER_TOO_SMALL   The name stack is full. Nothing was written.
+  @retval other                  An error from the sink, or an earlier error from this writer.
+**/
+EFI_STATUS
+DriverXmlWriterStartElement (
+  DRIVER_XML_WRITER* Writer,
+  CONST CHAR8*       Name
+  )
+{
+  UINTN      NameSize;
+  EFI_STATUS Status;
+
+  if (Writer == NULL) {
+    return EFI_INVALID_PARAMETER;
+  }
+  if (EFI_ERROR (Writer->Status)) {
+    return Writer->Status;
+  }
+  if (Name == NULL || !IsValidXmlName (Name)) {
+    return UpdateWriterStatus (Writer, EFI_INVALID_PARAMETER);
+  }
+  NameSize = AsciiStrSize (Name);
+  if (NameSize > Writer->NameStackSize - Writer->NameStackUsed) {
+    DEBUG ((DEBUG_ERROR, "No room to open %a at depth %d\n", Name, Writer->Depth));
+    return UpdateWriterStatus (Writer, EFI_BUFFER_TOO_SMALL);
+  }
+  Status = CloseStartTag (Writer);
+  if (!EFI_ERROR (Status)) {
+    Status = BytesToDocument ("<", 1, &Writer->Document);
+  }
+  if (!EFI_ERROR (Status)) {
+    Status = BytesToDocument (Name, NameSize - 1, &Writer->Document);
+  }
+  if (EFI_ERROR (Status)) {
+    return UpdateWriterStatus (Writer, Status);
+  }
+  gBS->CopyMem (&Writer->NameStack[Writer->NameStackUsed], (VOID*)Name, NameSize);
+  Writer->NameStackUsed += NameSize;
+  Writer->Depth++;
+  Writer->StartTagOpen = TRUE;
+  return EFI_SUCCESS;
+}
+
+/**
+  Add an attribute to the element that was just started. The value is escaped.
+
+  @param[in] Writer  The writer.
+  @param[in] Name    The attribute name.
+  @param[in] Value   The value.
+
+  @retval EFI_SUCCESS            The attribute was written.
+  @retval EFI_INVALID_PARAMETER  A pointer is NULL, Name is not a valid XML name,
+                                 or the start tag already has content after it.
+  @retval other                  An error from the sink, or an earlier error from this writer.
+**/
+EFI_STATUS
+DriverXmlWriterAttribute (
+  DRIVER_XML_WRITER* Writer,
+  CONST CHAR8*       Name,
+  CONST CHAR8*       Value
+  )
+{
+  EFI_STATUS Status;
+
+  if (Writer == NULL) {
+    return EFI_INVALID_PARAMETER;
+  }
+  if (EFI_ERROR (Writer->Status)) {
+    return Writer->Status;
+  }
+  if (Name == NULL || Value == NULL || !IsValidXmlName (Name)) {
+    return UpdateWriterStatus (Writer, EFI_INVALID_PARAMETER);
+  }
+  if (!Writer->StartTagOpen) {
+    DEBUG ((DEBUG_ERROR, "Attribute %a is not right after a start tag\n", Name));
+    return UpdateWriterStatus (Writer, EFI_INVALID_PARAMETER);
+  }
+  Status = BytesToDocument (" ", 1, &Writer->Document);
+  if (!EFI_ERROR (Status)) {
+    Status = BytesToDocument (Name, AsciiStrLen (Name), &Writer->Document);
+  }
+  if (!EFI_ERROR (Status)) {
+    Status = BytesToDocument ("=\"", 2, &Writer->Document);
+  }
+  if (!EFI_ERROR (Status)) {
+    Status = EscapedTextToDocument (Value, AsciiStrLen (Value), TRUE, FALSE, &Writer->Document);
+  }
+  if (!EFI_ERROR (Status)) {
+    Status = BytesToDocument ("\"", 1, &Writer->Document);
+  }
+  return UpdateWriterStatus (Writer, Status);
+}
+
+/**
+  Write char data into the current element. The text is escaped.
+
+  @param[in] Writer  The writer.
+  @param[in] Text    The text.
+  @param[in] Length  The number of characters in Text.
+
+  @retval EFI_SUCCESS            The text was written.
+  @retval EFI_INVALID_PARAMETER  A pointer is NULL.
+  @retval other                  An error from the sink, or an earlier error from this writer.
+**/
+EFI_STATUS
+DriverXmlWriterText (
+  DRIVER_XML_WRITER* Writer,
+  CONST CHAR8*       Text,
+  UINTN              Length
+  )
+{
+  EFI_STATUS Status;
+
+  if (Writer == NULL) {
+    return EFI_INVALID_PARAMETER;
+  }
+  if (EFI_ERROR (Writer->Status)) {
+    return Writer->Status;
+  }
+  if (Text == NULL) {
+    return UpdateWriterStatus (Writer, EFI_INVALID_PARAMETER);
+  }
+  if (Length == 0) {
+    return EFI_SUCCESS;
+  }
+  Status = CloseStartTag (Writer);
+  if (!EFI_ERROR (Status)) {
+    Status = EscapedTextToDocument (Text, Length, FALSE, FALSE, &Writer->Document);
+  }
+  return UpdateWriterStatus (Writer, Status);
+}
+
+/**
+  End the innermost open element. An element with no content is written as an empty tag.
+
+  @param[in] Writer  The writer.
+
+  @retval EFI_SUCCESS            The element was ended.
+  @retval EFI_INVALID_PARAMETER  Writer is NULL.
+  @retval EFI_NOT_FOUND          No element is open.
+  @retval other                  An error from the sink, or an earlier error from this writer.
+**/
+EFI_STATUS
+DriverXmlWriterEndElement (
+  DRIVER_XML_WRITER* Writer
+  )
+{
+  UINTN      NameStart;
+  EFI_STATUS Status;
+
+  if (Writer == NULL) {
+    return EFI_INVALID_PARAMETER;
+  }
+  if (EFI_ERROR (Writer->Status)) {
+    return Writer->Status;
+  }
+  if (Writer->Depth == 0) {
+    return UpdateWriterStatus (Writer, EFI_NOT_FOUND);
+  }
+  //
+  // The innermost name starts after the null of the one before it.
+  //
+  NameStart = Writer->NameStackUsed - 1;
+  while (NameStart > 0 && Writer->NameStack[NameStart - 1] != '\0') {
+    NameStart--;
+  }
+  if (Writer->StartTagOpen) {
+    Writer->StartTagOpen = FALSE;
+    Status = BytesToDocument ("/>", 2, &Writer->Document);
+  } else {
+    Status = BytesToDocument ("</", 2, &Writer->Document);
+    if (!EFI_ERROR (Status)) {
+      Status = BytesToDocument (
+                 &Writer->NameStack[NameStart],
+                 Writer->NameStackUsed - 1 - NameStart,
+                 &Writer->Document
+                 );
+    }
+    if (!EFI_ERROR (Status)) {
+      Status = BytesToDocument (">", 1, &Writer->Document);
+    }
+  }
+  Writer->NameStackUsed = NameStart;
+  Writer->Depth--;
+  return UpdateWriterStatus (Writer, Status);
+}
+
+/**
+  End every element that is still open and flush the sink.
+
+  @param[in] Writer  The writer.
+
+  @retval EFI_SUCCESS            The document is complete.
+  @retval EFI_INVALID_PARAMETER  Writer is NULL.
+  @retval other                  An error from the sink, or an earlier error from this writer.
+**/
+EFI_STATUS
+DriverXmlWriterFinish (
+  DRIVER_XML_WRITER* Writer
+  )
+{
+  EFI_STATUS Status;
+
+  if (Writer == NULL) {
+    return EFI_INVALID_PARAMETER;
+  }
+  Status = Writer->Status;
+  while (!EFI_ERROR (Status) && Writer->Depth > 0) {
+    Status = DriverXmlWriterEndElement (Writer);
+  }
+  if (!EFI_ERROR (Status) && Writer->Document.Sink != NULL) {
+    Status = Writer->Document.Sink->Flush (Writer->Document.Sink);
+  }
+  return UpdateWriterStatus (Writer, Status);
+}
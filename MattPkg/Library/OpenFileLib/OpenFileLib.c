@@ -104,31 +104,29 @@ GetDirectoryOfImage (
 }
 
 /**
-  Tries to open a file from the file system on a file system handle provided by the caller.  
+  Opens a file on a file system handle provided by the caller with the mode the caller asks for.
   The caller must also provide the full path relative to the root of the file system.
 
   @param[in]  FilePathFromRoot  The full path from the file system root.
-  @paran[in]  FileSystemHandle  The file system handle to check for the supplied file name.
-  @param[out] FileBuffer     The buffer for the file data to be returned to the caller.
-  @param[out] FileSize       The size of the file as it was read from disk.
-  
-  @retval EFI_SUCCESS        The file was found, and read into memory.
-  
+  @param[in]  FileSystemHandle  The file system handle to check for the supplied file name.
+  @param[in]  OpenMode          The EFI_FILE_MODE_* flags to open the file with.
+  @param[out] File              The opened file. The caller must close it.
+
+  @retval EFI_SUCCESS    The file was opened.
+  @retval EFI_NOT_FOUND  The file system could not be opened.
+  @return Error codes from the file protocol Open.
 **/
 EFI_STATUS
-OpenFullPathOnFileSystem (
-  CHAR16*    FilePathFromRoot,
-  EFI_HANDLE FileSystemHandle,
-  VOID**     FileBuffer,
-  UINTN*     FileSize
+OpenFileOnFileSystem (
+  CHAR16*             FilePathFromRoot,
+  EFI_HANDLE          FileSystemHandle,
+  UINT64              OpenMode,
+  EFI_FILE_PROTOCOL** File
   )
 {
   EFI_STATUS                       Status;
   EFI_SIMPLE_FILE_SYSTEM_PROTOCOL* SimpleFileSystemProtocol;
   EFI_FILE_PROTOCOL*               FileSystemRoot;
-  EFI_FILE_PROTOCOL*               RequestedFile;
-  EFI_FILE_INFO*                   RequestedFileInfo;
-  UINTN                            Size;
 
   //
   // Open the file system
@@ -162,12 +160,12 @@ OpenFullPathOnFileSystem (
   //
   Status = FileSystemRoot->Open (
                              FileSystemRoot,
-                             &RequestedFile,
+                             File,
                              FilePathFromRoot,
-                             EFI_FILE_MODE_READ,
+                             OpenMode,
                              0
                            );
-
+  FileSystemRoot->Close (FileSystemRoot);
 
   if (EFI_ERROR (Status)) {
     DEBUG ((DEBUG_ERROR, "Unable to open file (%r).\n",Status));
@@ -187,6 +185,42 @@ OpenFullPathOnFileSystem (
       default:
         DEBUG ((DEBUG_ERROR, "Invalid File Name\n"));
     }
+  }
+  return Status;
+}
+
+/**
+  Tries to open a file from the file system on a file system handle provided by the caller.  
+  The caller must also provide the full path relative to the root of the file system.
+
+  @param[in]  FilePathFromRoot  The full path from the file system root.
+  @paran[in]  FileSystemHandle  The file system handle to check for the supplied file name.
+  @param[out] FileBuffer     The buffer for the file data to be returned to the caller.
+  @param[out] FileSize       The size of the file as it was read from disk.
+  
+  @retval EFI_SUCCESS        The file was found, and read into memory.
+  
+**/
+EFI_STATUS
+OpenFullPathOnFileSystem (
+  CHAR16*    FilePathFromRoot,
+  EFI_HANDLE FileSystemHandle,
+  VOID**     FileBuffer,
+  UINTN*     FileSize
+  )
+{
+  EFI_STATUS                       Status;
+  EFI_FILE_PROTOCOL*               RequestedFile;
+  EFI_FILE_INFO*                   RequestedFileInfo;
+  UINTN                            Size;
+
+  Status = OpenFileOnFileSystem (
+             FilePathFromRoot,
+             FileSystemHandle,
+             EFI_FILE_MODE_READ,
+             &RequestedFile
+             );
+  if (EFI_ERROR (Status)) {
     return Status;
   }
     
@@ -295,30 +329,27 @@ FullPathFromImageDirectory (
 }
 
 /**
-  This function tries to figure out the path to a file specified by a user.
-  If there is a : then this assumes a map name is specified along with a complete path to a file.
-  If there is no : but there is a \ then this assumes a path is specified on the same device as the 
-  <image name>.efi file.
-  If neither of those are true, then this assumes the file must exist in the same place as <image name>.efi  
-  
-  @param [in]     FileString     the string supplied via a command line argument
-  @param [in out] FileBuffer     The opened file. Callee allocates, but caller must free.
-  @param [in out] FileSize       The size of the file buffer.
-  
-  @retval EFI_SUCCESS  The file was found, opened, and returned.
+  Work out which file system and full path a file string supplied by a user refers to.
+  The rules are the ones described for OpenFileFromArgument.
+
+  @param [in]  FileString        the string supplied via a command line argument
+  @param [out] FileSystemHandle  The file system the file is on.
+  @param [out] CompletePath      The full path from the file system root. Callee allocates, but caller must free.
+
+  @retval EFI_SUCCESS           The file system and path were found.
+  @retval EFI_NOT_FOUND         A map name was given, which is not supported.
+  @retval EFI_OUT_OF_RESOURCES  No memory could be allocated for the path.
   @return Error codes from worker functions.
 **/
-
 EFI_STATUS
-OpenFileFromArgument (
-  CHAR16* FileString,
-  CHAR8** FileBuffer,
-  UINTN*  FileSize
+ResolveFileArgument (
+  CHAR16*     FileString,
+  EFI_HANDLE* FileSystemHandle,
+  CHAR16**    CompletePath
   )
 {
   EFI_STATUS                 Status;
   EFI_LOADED_IMAGE_PROTOCOL* LoadedImageProtocol;
-  CHAR16*                    CompletePath;
   
   Status = EFI_NOT_FOUND;
   //
@@ -348,31 +379,58 @@ OpenFileFromArgument (
   // No colon, but there is a backslash. 
   // Assume this is a path on the same volume as our .efi file
   //
+  *FileSystemHandle = LoadedImageProtocol->DeviceHandle;
   if (StrStr (FileString, L"\\") !=NULL ){
-    Status = OpenFullPathOnFileSystem (
-               FileString,
-               LoadedImageProtocol->DeviceHandle,
-               FileBuffer,
-               FileSize
-             );
-    return Status;
+    *CompletePath = AllocateCopyPool (StrSize (FileString), FileString);
+    if (*CompletePath == NULL) {
+      return EFI_OUT_OF_RESOURCES;
+    }
+    return EFI_SUCCESS;
   }
   //
   // Neither the colon or backslash cases were true.
   // Assume the file is in the same place as our .efi file
   //
-  Status = FullPathFromImageDirectory (
-             LoadedImageProtocol,
-             FileString,
-             &CompletePath
-           );
+  return FullPathFromImageDirectory (
+           LoadedImageProtocol,
+           FileString,
+           CompletePath
+         );
+}
+
+/**
+  This function tries to figure out the path to a file specified by a user.
+  If there is a : then this assumes a map name is specified along with a complete path to a file.
+  If there is no : but there is a \ then this assumes a path is specified on the same device as the 
+  <image name>.efi file.
+  If neither of those are true, then this assumes the file must exist in the same place as <image name>.efi  
+  
+  @param [in]     FileString     the string supplied via a command line argument
+  @param [in out] FileBuffer     The opened file. Callee allocates, but caller must free.
+  @param [in out] FileSize       The size of the file buffer.
+  
+  @retval EFI_SUCCESS  The file was found, opened, and returned.
+  @return Error codes from worker functions.
+**/
 
+EFI_STATUS
+OpenFileFromArgument (
+  CHAR16* FileString,
+  CHAR8** FileBuffer,
+  UINTN*  FileSize
+  )
+{
+  EFI_STATUS Status;
+  EFI_HANDLE FileSystemHandle;
+  CHAR16*    CompletePath;
+
+  Status = ResolveFileArgument (FileString, &FileSystemHandle, &CompletePath);
   if (EFI_ERROR (Status)) {
     return Status;
   }
   Status = OpenFullPathOnFileSystem (
              CompletePath,
-             LoadedImageProtocol->DeviceHandle,
+             FileSystemHandle,
              FileBuffer,
              FileSize
            );
@@ -380,4 +438,51 @@ OpenFileFromArgument (
   return Status;
 }
 
+/**
+  Create a file for writing from a string specified by a user, using the same rules
+  as OpenFileFromArgument to find where it goes. A file that already exists is replaced.
+
+  @param [in]  FileString  the string supplied via a command line argument
+  @param [out] File        The created file, open for writing. The caller must close it.
+
+  @retval EFI_SUCCESS  The file was created.
+  @return Error codes from worker functions.
+**/
+EFI_STATUS
+CreateFileFromArgument (
+  CHAR16*             FileString,
+  EFI_FILE_PROTOCOL** File
+  )
+{
+  EFI_STATUS Status;
+  EFI_HANDLE FileSystemHandle;
+  CHAR16*    CompletePath;
+
+  Status = ResolveFileArgument (FileString, &FileSystemHandle, &CompletePath);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+  //
+  // Opening with create keeps the old contents of a file that is already there,
+  // so delete whatever was opened and create it again empty.
+  //
+  Status = OpenFileOnFileSystem (
+             CompletePath,
+             FileSystemHandle,
+             EFI_FILE_MODE_READ | EFI_FILE_MODE_WRITE | EFI_FILE_MODE_CREATE,
+             File
+             );
+  if (!EFI_ERROR (Status)) {
+    (*File)->Delete (*File);
+    Status = OpenFileOnFileSystem (
+               CompletePath,
+               FileSystemHandle,
+               EFI_FILE_MODE_READ | EFI_FILE_MODE_WRITE | EFI_FILE_MODE_CREATE,
+               File
+               );
+  }
+  gBS->FreePool (CompletePath);
+  return Status;
+}
+
 
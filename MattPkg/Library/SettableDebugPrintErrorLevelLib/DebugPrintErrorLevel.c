@@ -0,0 +1,66 @@
+/** @file
+  A DebugPrintErrorLevelLib that lets a module change its debug print error level at runtime.
+  The level starts as PcdDebugPrintErrorLevel until SetDebugPrintErrorLevel is called.
+  
+  Copyright (c) 2016, Matthew Lazarowitz. All rights reserved.<BR>
+  This program and the accompanying materials are licensed and made available under
+  the terms and conditions of the MIT License that accompanies this distribution.
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+**/
+#include <Base.h>
+#include <Library/PcdLib.h>
+#include <Library/DebugPrintErrorLevelLib.h>
+
+UINT32  mDebugPrintErrorLevel = 0;
+BOOLEAN mDebugPrintErrorLevelSet = FALSE;
+
+/**
+  Returns the debug print error level mask for the current module.
+
+  @return  Debug print error level mask for the current module.
+**/
+UINT32
+EFIAPI
+GetDebugPrintErrorLevel (
+  VOID
+  )
+{
+  if (!mDebugPrintErrorLevelSet) {
+    return PcdGet32 (PcdDebugPrintErrorLevel);
+  }
+  return mDebugPrintErrorLevel;
+}
+
+/**
+  Sets the global debug print error level mask for the current module.
+
+  @param[in]  ErrorLevel  Debug print error level to set for the current module.
+
+  @retval  TRUE   The debug print error level mask was set.
+**/
+BOOLEAN
+EFIAPI
+SetDebugPrintErrorLevel (
+  UINT32  ErrorLevel
+  )
+{
+  mDebugPrintErrorLevel = ErrorLevel;
+  mDebugPrintErrorLevelSet = TRUE;
+  return TRUE;
+}
@@ -0,0 +1,316 @@
+## @file
+#  Decode a DebugTraceLib trace file against the built image it came from.
+#
+#  DebugTrace only stores the address of each format string, the performance counter and
+#  the argument words. This looks the format strings up in the .efi, formats the events the
+#  way PrintLib would have, and shows the time of each one since the first.
+#
+#  Usage: DecodeDebugTrace.py <trace file> <image .efi>
+#
+#  Copyright (c) 2016, Matthew Lazarowitz. All rights reserved.<BR>
+#  This program and the accompanying materials are licensed and made available under
+#  the terms and conditions of the MIT License that accompanies this distribution.
+#
+#  Permission is hereby granted, free of charge, to any person obtaining a copy
+#  of this software and associated documentation files (the "Software"), to deal
+#  in the Software without restriction, including without limitation the rights
+#  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+#  copies of the Software, and to permit persons to whom the Software is
+#  furnished to do so, subject to the following conditions:
+#  The above copyright notice and this permission notice shall be included in all
+#  copies or substantial portions of the Software.
+#
+#  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+#  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+#  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+#  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+#  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+#  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+#  SOFTWARE.
+##
+
+import argparse
+import struct
+import sys
+
+#
+# These match DEBUG_TRACE_HEADER and DEBUG_TRACE_RECORD in DebugTraceLib.h.
+#
+TRACE_SIGNATURE = 0x43525458  # 'XTRC'
+TRACE_VERSION = 1
+HEADER_FORMAT = '<IIQQQQQQQ'
+RECORD_FORMAT = '<QQQQQ'
+
+#
+# EFI_STATUS names for %r. Errors have the top bit set.
+#
+ERROR_BIT = 1 << 63
+STATUS_NAMES = {
+  0: 'Success',
+  1: 'Warning Unknown Glyph',
+  2: 'Warning Delete Failure',
+  3: 'Warning Write Failure',
+  4: 'Warning Buffer Too Small',
+  5: 'Warning Stale Data',
+}
+ERROR_NAMES = [
+  None, 'Load Error', 'Invalid Parameter', 'Unsupported', 'Bad Buffer Size',
+  'Buffer Too Small', 'Not Ready', 'Device Error', 'Write Protected', 'Out of Resources',
+  'Volume Corrupt', 'Volume Full', 'No Media', 'Media changed', 'Not Found',
+  'Access Denied', 'No Response', 'No mapping', 'Time out', 'Not started',
+  'Already started', 'Aborted', 'ICMP Error', 'TFTP Error', 'Protocol Error',
+  'Incompatible Version', 'Security Violation', 'CRC Error', 'End of Media', 'Reserved (29)',
+  'Reserved (30)', 'End of File', 'Invalid Language', 'Compromised Data'
+]
+
+
+class PeImage:
+  """The sections of a PE/COFF image, enough to read constants by RVA."""
+
+  def __init__(self, Data):
+    self.Data = Data
+    if Data[0:2] != b'MZ':
+      raise ValueError('not a PE/COFF image')
+    PeOffset = struct.unpack_from('<I', Data, 0x3C)[0]
+    if Data[PeOffset:PeOffset + 4] != b'PE\0\0':
+      raise ValueError('not a PE/COFF image')
+    SectionCount, = struct.unpack_from('<H', Data, PeOffset + 6)
+    OptionalSize, = struct.unpack_from('<H', Data, PeOffset + 20)
+    Optional = PeOffset + 24
+    self.HeaderSize, = struct.unpack_from('<I', Data, Optional + 60)
+    self.Sections = []
+    Section = Optional + OptionalSize
+    for Index in range(SectionCount):
+      VirtualSize, VirtualAddress, RawSize, RawOffset = struct.unpack_from('<IIII', Data, Section + 8)
+      self.Sections.append((VirtualAddress, max(VirtualSize, RawSize), RawSize, RawOffset))
+      Section += 40
+
+  def Read(self, Rva, Size):
+    """Read Size bytes at Rva, or None when they are not all backed by the file."""
+    if Rva < 0:
+      return None
+    if Rva + Size <= self.HeaderSize:
+      return self.Data[Rva:Rva + Size]
+    for VirtualAddress, VirtualSize, RawSize, RawOffset in self.Sections:
+      if VirtualAddress <= Rva < VirtualAddress + VirtualSize:
+        Offset = Rva - VirtualAddress
+        if Offset + Size > RawSize:
+          return None
+        return self.Data[RawOffset + Offset:RawOffset + Offset + Size]
+    return None
+
+  def ReadAscii(self, Rva):
+    Text = bytearray()
+    while True:
+      Byte = self.Read(Rva + len(Text), 1)
+      if Byte is None:
+        return None
+      if Byte == b'\0':
+        return Text.decode('latin-1')
+      Text += Byte
+
+  def ReadUnicode(self, Rva):
+    Text = []
+    while True:
+      Char = self.Read(Rva + len(Text) * 2, 2)
+      if Char is None:
+        return None
+      Value, = struct.unpack('<H', Char)
+      if Value == 0:
+        return ''.join(Text)
+      Text.append(chr(Value))
+
+
+def StatusName(Value):
+  if Value & ERROR_BIT:
+    Code = Value & ~ERROR_BIT
+    if 0 < Code < len(ERROR_NAMES):
+      return ERROR_NAMES[Code]
+  elif Value in STATUS_NAMES:
+    return STATUS_NAMES[Value]
+  return '%08X' % Value
+
+
+def AddCommas(Digits):
+  Head = Digits[:len(Digits) % 3]
+  Groups = [Digits[Index:Index + 3] for Index in range(len(Head), len(Digits), 3)]
+  return ','.join(([Head] if Head else []) + Groups)
+
+
+def FormatEvent(Image, ImageBase, Format, Arguments):
+  """Format one event the way PrintLib would have, taking each argument as a 64 bit word."""
+  Output = []
+  Words = list(Arguments)
+
+  def NextWord():
+    return Words.pop(0) if Words else 0
+
+  def ImageString(Pointer, Unicode):
+    Text = None
+    if Pointer != 0:
+      Text = Image.ReadUnicode(Pointer - ImageBase) if Unicode else Image.ReadAscii(Pointer - ImageBase)
+    if Text is None:
+      return '<0x%X>' % Pointer if Pointer != 0 else '<null string>'
+    return Text
+
+  Index = 0
+  while Index < len(Format):
+    Char = Format[Index]
+    Index += 1
+    if Char == '\r':
+      continue
+    if Char != '%':
+      Output.append(Char)
+      continue
+    Left = Zero = Comma = Long = Sign = Blank = False
+    Width = 0
+    Precision = None
+    while Index < len(Format):
+      Char = Format[Index]
+      if Char == '-':
+        Left = True
+      elif Char == '+':
+        Sign = True
+      elif Char == ' ':
+        Blank = True
+      elif Char == ',':
+        Comma = True
+      elif Char in 'lL':
+        Long = True
+      elif Char == '0' and Width == 0 and Precision is None:
+        Zero = True
+      elif Char == '*':
+        if Precision is None:
+          Width = NextWord() & 0xFFFFFFFF
+        else:
+          Precision = NextWord() & 0xFFFFFFFF
+      elif Char.isdigit():
+        if Precision is None:
+          Width = Width * 10 + int(Char)
+        else:
+          Precision = Precision * 10 + int(Char)
+      elif Char == '.':
+        Precision = 0
+      else:
+        break
+      Index += 1
+    if Index >= len(Format):
+      break
+    Type = Format[Index]
+    Index += 1
+
+    Text = ''
+    Number = False
+    if Type == '%':
+      Text = '%'
+    elif Type == 'a':
+      Text = ImageString(NextWord(), False)
+    elif Type in 'sS':
+      Text = ImageString(NextWord(), True)
+    elif Type == 'c':
+      Text = chr(NextWord() & 0xFFFF)
+    elif Type == 'r':
+      Text = StatusName(NextWord())
+    elif Type == 'p':
+      Text = '%016X' % NextWord()
+    elif Type == 'g':
+      Guid = Image.Read(NextWord() - ImageBase, 16)
+      if Guid is None:
+        Text = '<guid>'
+      else:
+        Data1, Data2, Data3 = struct.unpack_from('<IHH', Guid)
+        Text = '%08X-%04X-%04X-%s-%s' % (Data1, Data2, Data3, Guid[8:10].hex().upper(), Guid[10:16].hex().upper())
+    elif Type in 'dixXu':
+      Number = True
+      Value = NextWord()
+      if not Long:
+        Value &= 0xFFFFFFFF
+      if Type in 'xX':
+        Zero = Zero or Type == 'X'
+        Text = '%X' % Value
+      else:
+        Negative = False
+        if Type in 'di':
+          Bits = 64 if Long else 32
+          if Value & (1 << (Bits - 1)):
+            Value -= 1 << Bits
+            Negative = True
+        Text = str(abs(Value))
+        if Comma:
+          Text = AddCommas(Text)
+        if Precision is not None and len(Text) < Precision:
+          Text = '0' * (Precision - len(Text)) + Text
+        if Negative:
+          Text = '-' + Text
+        elif Sign:
+          Text = '+' + Text
+        elif Blank:
+          Text = ' ' + Text
+    else:
+      Text = '%' + Type
+
+    if len(Text) < Width:
+      if Left:
+        Text = Text + ' ' * (Width - len(Text))
+      elif Zero and Number:
+        Prefix = Text[0] if Text[0] in '-+ ' and Type in 'di' else ''
+        Text = Prefix + '0' * (Width - len(Text)) + Text[len(Prefix):]
+      else:
+        Text = ' ' * (Width - len(Text)) + Text
+    Output.append(Text)
+  return ''.join(Output)
+
+
+def ElapsedTicks(Header, Records):
+  """Add up the ticks between records the same way DebugToConsoleLib does, so a wrapping counter still adds up."""
+  Start, End = Header['CounterStart'], Header['CounterEnd']
+  Elapsed = 0
+  Last = None
+  for Record in Records:
+    Now = Record[0]
+    if Last is not None:
+      if Start < End:
+        Elapsed += Now - Last if Now >= Last else (End - Last) + (Now - Start) + 1
+      else:
+        Elapsed += Last - Now if Now <= Last else (Last - End) + (Start - Now) + 1
+    Last = Now
+    yield Elapsed
+
+
+def main():
+  Parser = argparse.ArgumentParser(description='Decode a DebugTraceLib trace file against the image it came from.')
+  Parser.add_argument('Trace', help='the file written by DebugTraceDump')
+  Parser.add_argument('Image', help='the built .efi the trace was taken from')
+  Arguments = Parser.parse_args()
+
+  with open(Arguments.Trace, 'rb') as File:
+    Trace = File.read()
+  with open(Arguments.Image, 'rb') as File:
+    Image = PeImage(File.read())
+
+  HeaderSize = struct.calcsize(HEADER_FORMAT)
+  RecordSize = struct.calcsize(RECORD_FORMAT)
+  if len(Trace) < HeaderSize:
+    sys.exit('%s is too short to be a trace' % Arguments.Trace)
+  Names = ('Signature', 'Version', 'ImageBase', 'ImageSize', 'Frequency',
+           'CounterStart', 'CounterEnd', 'RecordCount', 'TotalRecords')
+  Header = dict(zip(Names, struct.unpack_from(HEADER_FORMAT, Trace, 0)))
+  if Header['Signature'] != TRACE_SIGNATURE or Header['Version'] != TRACE_VERSION:
+    sys.exit('%s is not a version %d trace' % (Arguments.Trace, TRACE_VERSION))
+  Count = min(Header['RecordCount'], (len(Trace) - HeaderSize) // RecordSize)
+  Records = [struct.unpack_from(RECORD_FORMAT, Trace, HeaderSize + Index * RecordSize) for Index in range(Count)]
+
+  if Header['TotalRecords'] > Count:
+    print('%d earlier events were overwritten.' % (Header['TotalRecords'] - Count))
+  Frequency = Header['Frequency'] or 1
+  for Record, Ticks in zip(Records, ElapsedTicks(Header, Records)):
+    Format = Image.ReadAscii(Record[1] - Header['ImageBase'])
+    if Format is None:
+      Text = '<unknown format at 0x%X>' % Record[1]
+    else:
+      Text = FormatEvent(Image, Header['ImageBase'], Format, Record[2:])
+    print('[%10d us] %s' % (Ticks * 1000000 // Frequency, Text.rstrip('\n')))
+
+
+if __name__ == '__main__':
+  main()
@@ -0,0 +1,1184 @@
+/** @file
+  Self checks for the XML library, run by XmlTest -u. Each check builds or parses a small
+  document, uses one part of the library on it and compares the result with the exact text
+  it should produce, so a change in behavior shows up as a failed check instead of a
+  difference someone has to spot in a dump.
+  
+  Copyright (c) 2016, Matthew Lazarowitz. All rights reserved.<BR>
+  This program and the accompanying materials are licensed and made available under
+  the terms and conditions of the MIT License that accompanies this distribution.
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+**/
+#include <Uefi.h>
+#include <Library/UefiLib.h>
+#include <Library/UefiBootServicesTableLib.h>
+#include <Library/BaseLib.h>
+#include <Library/BaseMemoryLib.h>
+#include <Library/PrintLib.h>
+#include <Library/DriverXmlLib.h>
+#ifdef XML_TEST_DEBUG_RING
+#include <Library/DebugLib.h>
+#include <Library/DebugPrintErrorLevelLib.h>
+#include <Library/DebugToConsoleLib.h>
+#endif
+
+//
+// One self check. It prints what went wrong itself and returns an error when it fails.
+//
+typedef
+EFI_STATUS
+(*XML_SELF_CHECK) (
+  VOID
+);
+
+typedef struct _XML_SELF_CHECK_ENTRY {
+  CHAR8*         Name;
+  XML_SELF_CHECK Check;
+} XML_SELF_CHECK_ENTRY;
+
+/**
+  Compare printed output with the text it should be.
+
+  @param[in] What      What was printed, for the failure message.
+  @param[in] Output    The output document.
+  @param[in] Expected  The text the output should hold.
+
+  @retval EFI_SUCCESS       The output matches.
+  @retval EFI_DEVICE_ERROR  The output is different. Both are printed.
+**/
+EFI_STATUS
+CheckOutput (
+  CHAR8*        What,
+  XML_DOCUMENT* Output,
+  CHAR8*        Expected
+  )
+{
+  UINTN Length;
+
+  Length = AsciiStrLen (Expected);
+  if (Output->RequiredSize == Length && CompareMem (Output->XmlDocument, Expected, Length) == 0) {
+    return EFI_SUCCESS;
+  }
+  AsciiPrint ("  %a is wrong\n  expected: %a\n  got:      ", What, Expected);
+  for (Length = 0; Length < Output->RequiredSize && Output->XmlDocument != NULL; Length++) {
+    AsciiPrint ("%c", Output->XmlDocument[Length]);
+  }
+  AsciiPrint ("\n");
+  return EFI_DEVICE_ERROR;
+}
+
+/**
+  Free the buffer of an output document and set it up to be written again.
+
+  @param[in out] Output  The output document.
+**/
+VOID
+ResetOutput (
+  XML_DOCUMENT* Output
+  )
+{
+  if (Output->XmlDocument != NULL) {
+    gBS->FreePool (Output->XmlDocument);
+  }
+  gBS->SetMem (Output, sizeof (XML_DOCUMENT), 0);
+}
+
+/**
+  Get the number of bytes the library holds for trees, leaving out output documents
+  since those belong to the caller.
+
+  @return The bytes in use.
+**/
+UINTN
+TreeBytesInUse (
+  VOID
+  )
+{
+  DRIVER_XML_STATS Stats;
+
+  DriverXmlGetStats (&Stats);
+  return Stats.CurrentBytes - Stats.Types[XmlAllocOutput].CurrentBytes;
+}
+
+/**
+  Find the first child of a tag that has a given data type.
+
+  @param[in] Tag       The tag to search.
+  @param[in] DataType  The type to find.
+
+  @return The child, or NULL if the tag has none of that type.
+**/
+DRIVER_XML_DATA_HEADER*
+FirstChildOfType (
+  DRIVER_XML_TAG* Tag,
+  XML_DATA_TYPE   DataType
+  )
+{
+  DRIVER_XML_DATA_HEADER* Element;
+
+  if (Tag->TagChildren.ItemCount > 0) {
+    Element = (DRIVER_XML_DATA_HEADER*)&Tag->TagChildren.ListStart;
+    while (GetNextXmlElement (&Tag->TagChildren, Element, &Element) == EFI_SUCCESS) {
+      if (Element->XmlDataType == DataType) {
+        return Element;
+      }
+    }
+  }
+  return NULL;
+}
+
+/**
+  Build a tree by hand, print it whole and incrementally, add to it and print it
+  incrementally against the first output, then free it.
+
+  @retval EFI_SUCCESS  Every step gave the expected output.
+  @retval other        The step that failed.
+**/
+EFI_STATUS
+CheckHandBuiltTree (
+  VOID
+  )
+{
+  EFI_STATUS              Status;
+  UINTN                   BytesBefore;
+  DRIVER_XML_DATA_HEADER* XmlTree;
+  DRIVER_XML_TAG*         Config;
+  DRIVER_XML_TAG*         Item;
+  DRIVER_XML_TAG*         Flag;
+  DRIVER_XML_CHAR_DATA*   Text;
+  XML_DOCUMENT            First;
+  XML_DOCUMENT            Second;
+
+  BytesBefore = TreeBytesInUse ();
+  gBS->SetMem (&First, sizeof (First), 0);
+  gBS->SetMem (&Second, sizeof (Second), 0);
+  Status = DriverXmlCreateTree (&XmlTree);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+  Status = DriverXmlAppendTag ((DRIVER_XML_TAG*)XmlTree, "Config", XmlTag, &Config);
+  if (!EFI_ERROR (Status)) {
+    Status = DriverXmlSetAttribute (Config, "Version", "1");
+  }
+  if (!EFI_ERROR (Status)) {
+    Status = DriverXmlAppendTag (Config, "Item", XmlTag, &Item);
+  }
+  if (!EFI_ERROR (Status)) {
+    Status = DriverXmlSetAttribute (Item, "Name", "a<b");
+  }
+  if (!EFI_ERROR (Status)) {
+    Status = DriverXmlAppendCharData (Item, "x & y", &Text);
+  }
+  if (!EFI_ERROR (Status)) {
+    Status = DriverXmlAppendTag (Config, "Flag", XmlEmptyTag, &Flag);
+  }
+  if (!EFI_ERROR (Status)) {
+    Status = PrintData (XmlTree, &First);
+  }
+  //
+  // PrintData writes the root too. PrintDataIncremental writes only what is below it.
+  //
+  if (!EFI_ERROR (Status)) {
+    Status = CheckOutput (
+               "PrintData",
+               &First,
+               "<Root><Config Version=\"1\"><Item Name=\"a&lt;b\">x &amp; y</Item><Flag/></Config></Root>"
+               );
+  }
+  if (!EFI_ERROR (Status)) {
+    ResetOutput (&First);
+    Status = PrintDataIncremental (XmlTree, NULL, 0, &First);
+  }
+  if (!EFI_ERROR (Status)) {
+    Status = CheckOutput (
+               "PrintDataIncremental",
+               &First,
+               "<Config Version=\"1\"><Item Name=\"a&lt;b\">x &amp; y</Item><Flag/></Config>"
+               );
+  }
+  //
+  // Config is copied between its children and only Item, which gained a child, is rendered.
+  //
+  if (!EFI_ERROR (Status)) {
+    Status = DriverXmlAppendTag (Item, "Sub", XmlEmptyTag, &Flag);
+  }
+  if (!EFI_ERROR (Status)) {
+    Status = PrintDataIncremental (XmlTree, First.XmlDocument, First.RequiredSize, &Second);
+  }
+  if (!EFI_ERROR (Status)) {
+    Status = CheckOutput (
+               "PrintDataIncremental after adding a child",
+               &Second,
+               "<Config Version=\"1\"><Item Name=\"a&lt;b\">x &amp; y<Sub/></Item><Flag/></Config>"
+               );
+  }
+  DriverXmlFreeTree (XmlTree);
+  ResetOutput (&First);
+  ResetOutput (&Second);
+  if (!EFI_ERROR (Status) && TreeBytesInUse () != BytesBefore) {
+    AsciiPrint ("  %d bytes were left after freeing the tree\n", TreeBytesInUse () - BytesBefore);
+    Status = EFI_DEVICE_ERROR;
+  }
+  return Status;
+}
+
+/**
+  Check that a document that stops inside an element is rejected, including one whose
+  open element has the same name as the parser's root.
+
+  @retval EFI_SUCCESS       Each truncated document failed with EFI_END_OF_FILE.
+  @retval EFI_DEVICE_ERROR  A truncated document was accepted or failed some other way.
+**/
+EFI_STATUS
+CheckTruncatedDocuments (
+  VOID
+  )
+{
+  STATIC CHAR8*           Documents[] = { "<ab><cd>", "<ab>text", "<ab><cd/>", "<Root><ab>" };
+  UINTN                   Index;
+  EFI_STATUS              Status;
+  DRIVER_XML_DATA_HEADER* XmlTree;
+
+  for (Index = 0; Index < ARRAY_SIZE (Documents); Index++) {
+    Status = DriverXmlParse (Documents[Index], AsciiStrLen (Documents[Index]), &XmlTree);
+    if (!EFI_ERROR (Status)) {
+      DriverXmlFreeTree (XmlTree);
+    }
+    if (Status != EFI_END_OF_FILE) {
+      AsciiPrint ("  %a parsed with %r\n", Documents[Index], Status);
+      return EFI_DEVICE_ERROR;
+    }
+  }
+  return EFI_SUCCESS;
+}
+
+/**
+  Parse a document without expanding references, then set an attribute and some text through
+  the API to values that look like references. The parsed values keep their references when
+  printed and the values that were set are escaped in full.
+
+  @retval EFI_SUCCESS  PrintData and PrintDataCanonical gave the expected output.
+  @retval other        The step that failed.
+**/
+EFI_STATUS
+CheckLiteralValuesInRawTree (
+  VOID
+  )
+{
+  CHAR8                   Document[] = "<Cfg v=\"1\" w=\"&#65;\">a &amp; b<x/>c</Cfg>";
+  EFI_STATUS              Status;
+  DRIVER_XML_DATA_HEADER* XmlTree;
+  DRIVER_XML_TAG*         Cfg;
+  DRIVER_XML_CHAR_DATA*   Text;
+  DRIVER_XML_CHAR_DATA*   NewText;
+  XML_DOCUMENT            Output;
+
+  gBS->SetMem (&Output, sizeof (Output), 0);
+  Status = DriverXmlParse (Document, AsciiStrLen (Document), &XmlTree);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+  Cfg = (DRIVER_XML_TAG*)FirstChildOfType ((DRIVER_XML_TAG*)XmlTree, XmlTag);
+  Text = (Cfg != NULL) ? (DRIVER_XML_CHAR_DATA*)FirstChildOfType (Cfg, XmlChar) : NULL;
+  if (Text == NULL) {
+    AsciiPrint ("  %a did not parse to the expected tree\n", Document);
+    Status = EFI_DEVICE_ERROR;
+  }
+  if (!EFI_ERROR (Status)) {
+    Status = PrintData (XmlTree, &Output);
+  }
+  if (!EFI_ERROR (Status)) {
+    Status = CheckOutput (
+               "PrintData of the parsed tree",
+               &Output,
+               "<Root><Cfg v=\"1\" w=\"&#65;\">a &amp; b<x/>c</Cfg></Root>"
+               );
+  }
+  if (!EFI_ERROR (Status)) {
+    Status = DriverXmlSetAttribute (Cfg, "v", "&amp;");
+  }
+  if (!EFI_ERROR (Status)) {
+    Status = DriverXmlSetCharData (Cfg, Text, "&lt;");
+  }
+  if (!EFI_ERROR (Status)) {
+    Status = DriverXmlAppendCharData (Cfg, "&#66;", &NewText);
+  }
+  if (!EFI_ERROR (Status)) {
+    ResetOutput (&Output);
+    Status = PrintData (XmlTree, &Output);
+  }
+  if (!EFI_ERROR (Status)) {
+    Status = CheckOutput (
+               "PrintData after setting values",
+               &Output,
+               "<Root><Cfg v=\"&amp;amp;\" w=\"&#65;\">&amp;lt;<x/>c&amp;#66;</Cfg></Root>"
+               );
+  }
+  //
+  // Only the untouched value is raw, so only its reference is replaced.
+  //
+  if (!EFI_ERROR (Status)) {
+    ResetOutput (&Output);
+    Status = PrintDataCanonical (XmlTree, NULL, DRIVER_XML_C14N_RAW_TEXT, &Output);
+  }
+  if (!EFI_ERROR (Status)) {
+    Status = CheckOutput (
+               "PrintDataCanonical after setting values",
+               &Output,
+               "<Cfg v=\"&amp;amp;\" w=\"A\">&amp;lt;<x></x>c&amp;#66;</Cfg>"
+               );
+  }
+  DriverXmlFreeTree (XmlTree);
+  ResetOutput (&Output);
+  return Status;
+}
+
+/**
+  Write a document with DriverXmlWriter, then check that a full name stack and an invalid name
+  each stop the writer and make DriverXmlWriterFinish fail.
+
+  @retval EFI_SUCCESS       The document was written and each bad call failed the finish.
+  @retval EFI_DEVICE_ERROR  The output was wrong or a bad call was not remembered.
+  @retval other             The step that failed.
+**/
+EFI_STATUS
+CheckWriterErrors (
+  VOID
+  )
+{
+  DRIVER_XML_WRITER Writer;
+  CHAR8             NameStack[12];
+  EFI_STATUS        Status;
+
+  Status = DriverXmlInitWriter (&Writer, NULL, NameStack, sizeof (NameStack));
+  if (!EFI_ERROR (Status)) {
+    Status = DriverXmlWriterStartElement (&Writer, "Config");
+  }
+  if (!EFI_ERROR (Status)) {
+    Status = DriverXmlWriterAttribute (&Writer, "Version", "1");
+  }
+  if (!EFI_ERROR (Status)) {
+    Status = DriverXmlWriterText (&Writer, "a&b", 3);
+  }
+  if (!EFI_ERROR (Status)) {
+    Status = DriverXmlWriterStartElement (&Writer, "Item");
+  }
+  if (!EFI_ERROR (Status)) {
+    Status = DriverXmlWriterFinish (&Writer);
+  }
+  if (!EFI_ERROR (Status)) {
+    Status = CheckOutput ("DriverXmlWriter", &Writer.Document, "<Config Version=\"1\">a&amp;b<Item/></Config>");
+  }
+  ResetOutput (&Writer.Document);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+  //
+  // "Config" and "Items" take 13 bytes of the 12 byte stack.
+  //
+  DriverXmlInitWriter (&Writer, NULL, NameStack, sizeof (NameStack));
+  DriverXmlWriterStartElement (&Writer, "Config");
+  DriverXmlWriterStartElement (&Writer, "Items");
+  DriverXmlWriterText (&Writer, "x", 1);
+  Status = DriverXmlWriterFinish (&Writer);
+  ResetOutput (&Writer.Document);
+  if (Status != EFI_BUFFER_TOO_SMALL) {
+    AsciiPrint ("  Finish after the name stack filled returned %r\n", Status);
+    return EFI_DEVICE_ERROR;
+  }
+  DriverXmlInitWriter (&Writer, NULL, NameStack, sizeof (NameStack));
+  DriverXmlWriterStartElement (&Writer, "Config");
+  DriverXmlWriterAttribute (&Writer, "1st", "x");
+  Status = DriverXmlWriterFinish (&Writer);
+  ResetOutput (&Writer.Document);
+  if (Status != EFI_INVALID_PARAMETER) {
+    AsciiPrint ("  Finish after an invalid attribute name returned %r\n", Status);
+    return EFI_DEVICE_ERROR;
+  }
+  return EFI_SUCCESS;
+}
+
+/**
+  Build a tree from a snapshot and compare it printed with the text it should be.
+
+  @param[in] What      Which snapshot, for the failure message.
+  @param[in] Snapshot  The snapshot.
+  @param[in] Expected  The text PrintData should give for it.
+
+  @retval EFI_SUCCESS  The snapshot printed as expected.
+  @retval other        The tree could not be built or printed, or the output is different.
+**/
+EFI_STATUS
+CheckSnapshotOutput (
+  CHAR8*               What,
+  DRIVER_XML_SNAPSHOT* Snapshot,
+  CHAR8*               Expected
+  )
+{
+  DRIVER_XML_DATA_HEADER* XmlTree;
+  XML_DOCUMENT            Output;
+  EFI_STATUS              Status;
+
+  gBS->SetMem (&Output, sizeof (Output), 0);
+  Status = DriverXmlSnapshotToTree (Snapshot, &XmlTree);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+  Status = PrintData (XmlTree, &Output);
+  if (!EFI_ERROR (Status)) {
+    Status = CheckOutput (What, &Output, Expected);
+  }
+  DriverXmlFreeTree (XmlTree);
+  ResetOutput (&Output);
+  return Status;
+}
+
+/**
+  Fork snapshots of a parsed tree, edit each one differently and check that every snapshot
+  sees its own edits and the ones it was forked with, but no others. A fork must keep working
+  after the snapshot it came from is released, and releasing the last one frees the tree.
+
+  @retval EFI_SUCCESS  Each snapshot printed as expected and nothing was left allocated.
+  @retval other        The step that failed.
+**/
+EFI_STATUS
+CheckSnapshots (
+  VOID
+  )
+{
+  CHAR8                   Document[] = "<Cfg mode=\"a\"><Dev id=\"1\">pci</Dev><Dev id=\"2\">usb &amp; pci</Dev></Cfg>";
+  EFI_STATUS              Status;
+  UINTN                   BytesBefore;
+  DRIVER_XML_DATA_HEADER* XmlTree;
+  DRIVER_XML_TAG*         Cfg;
+  DRIVER_XML_TAG*         Dev1;
+  DRIVER_XML_DATA_HEADER* Dev2;
+  DRIVER_XML_CHAR_DATA*   Text;
+  DRIVER_XML_SNAPSHOT*    First;
+  DRIVER_XML_SNAPSHOT*    Second;
+  DRIVER_XML_SNAPSHOT*    Third;
+
+  BytesBefore = TreeBytesInUse ();
+  Status = DriverXmlParse (Document, AsciiStrLen (Document), &XmlTree);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+  Cfg = (DRIVER_XML_TAG*)FirstChildOfType ((DRIVER_XML_TAG*)XmlTree, XmlTag);
+  Dev1 = (Cfg != NULL) ? (DRIVER_XML_TAG*)FirstChildOfType (Cfg, XmlTag) : NULL;
+  Text = (Dev1 != NULL) ? (DRIVER_XML_CHAR_DATA*)FirstChildOfType (Dev1, XmlChar) : NULL;
+  if (Text == NULL || GetNextXmlElement (&Cfg->TagChildren, (DRIVER_XML_DATA_HEADER*)Dev1, &Dev2) != EFI_SUCCESS) {
+    AsciiPrint ("  %a did not parse to the expected tree\n", Document);
+    DriverXmlFreeTree (XmlTree);
+    return EFI_DEVICE_ERROR;
+  }
+  First = NULL;
+  Second = NULL;
+  Third = NULL;
+  Status = DriverXmlCreateSnapshot (XmlTree, &First);
+  if (EFI_ERROR (Status)) {
+    DriverXmlFreeTree (XmlTree);
+    return Status;
+  }
+  Status = DriverXmlForkSnapshot (First, &Second);
+  if (!EFI_ERROR (Status)) {
+    Status = DriverXmlSnapshotSetAttribute (Second, Cfg, "mode", "b");
+  }
+  if (!EFI_ERROR (Status)) {
+    Status = DriverXmlSnapshotSetCharData (Second, Text, "nvme & sata");
+  }
+  if (!EFI_ERROR (Status)) {
+    Status = DriverXmlSnapshotSetAttribute (Second, Dev1, "bus", "0");
+  }
+  if (!EFI_ERROR (Status)) {
+    Status = DriverXmlSnapshotRemoveNode (Second, Dev2);
+  }
+  if (!EFI_ERROR (Status)) {
+    Status = DriverXmlSnapshotSetAttribute (First, Cfg, "mode", "c");
+  }
+  if (!EFI_ERROR (Status)) {
+    Status = DriverXmlForkSnapshot (Second, &Third);
+  }
+  if (!EFI_ERROR (Status)) {
+    Status = DriverXmlSnapshotSetAttribute (Third, Dev1, "id", NULL);
+  }
+  if (!EFI_ERROR (Status) && !DriverXmlSnapshotIsRemoved (Third, Dev2)) {
+    AsciiPrint ("  The fork does not see the node removed before it was made\n");
+    Status = EFI_DEVICE_ERROR;
+  }
+  //
+  // The untouched text is still raw, and the text that was set is literal.
+  //
+  if (!EFI_ERROR (Status)) {
+    Status = CheckSnapshotOutput (
+               "The first snapshot",
+               First,
+               "<Root><Cfg mode=\"c\"><Dev id=\"1\">pci</Dev><Dev id=\"2\">usb &amp; pci</Dev></Cfg></Root>"
+               );
+  }
+  if (!EFI_ERROR (Status)) {
+    Status = CheckSnapshotOutput (
+               "The second snapshot",
+               Second,
+               "<Root><Cfg mode=\"b\"><Dev id=\"1\" bus=\"0\">nvme &amp; sata</Dev></Cfg></Root>"
+               );
+  }
+  if (Second != NULL) {
+    DriverXmlReleaseSnapshot (Second);
+  }
+  if (!EFI_ERROR (Status)) {
+    Status = CheckSnapshotOutput (
+               "The fork of the released snapshot",
+               Third,
+               "<Root><Cfg mode=\"b\"><Dev bus=\"0\">nvme &amp; sata</Dev></Cfg></Root>"
+               );
+  }
+  if (Third != NULL) {
+    DriverXmlReleaseSnapshot (Third);
+  }
+  DriverXmlReleaseSnapshot (First);
+  if (!EFI_ERROR (Status) && TreeBytesInUse () != BytesBefore) {
+    AsciiPrint ("  %d bytes were left after releasing the snapshots\n", TreeBytesInUse () - BytesBefore);
+    Status = EFI_DEVICE_ERROR;
+  }
+  return Status;
+}
+
+/**
+  Change the text of one element in a parsed document and update the tree with
+  DriverXmlReparseRange. The tree must print as the new document, the element after the
+  change must be the same node with its span moved, and an incremental print against the
+  new document must copy it back unchanged.
+
+  @retval EFI_SUCCESS  The updated tree matches the new document.
+  @retval other        The step that failed.
+**/
+EFI_STATUS
+CheckReparseRange (
+  VOID
+  )
+{
+  CHAR8                   OldDocument[] = "<Cfg><Dev id=\"1\">pci</Dev><Dev id=\"2\">usb</Dev></Cfg>";
+  CHAR8                   NewDocument[] = "<Cfg><Dev id=\"1\">nvme</Dev><Dev id=\"2\">usb</Dev></Cfg>";
+  EFI_STATUS              Status;
+  DRIVER_XML_DATA_HEADER* XmlTree;
+  DRIVER_XML_TAG*         Cfg;
+  DRIVER_XML_DATA_HEADER* Dev1;
+  DRIVER_XML_DATA_HEADER* Dev2;
+  DRIVER_XML_DATA_HEADER* After;
+  XML_DOCUMENT            Output;
+
+  gBS->SetMem (&Output, sizeof (Output), 0);
+  Status = DriverXmlParse (OldDocument, AsciiStrLen (OldDocument), &XmlTree);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+  Cfg = (DRIVER_XML_TAG*)FirstChildOfType ((DRIVER_XML_TAG*)XmlTree, XmlTag);
+  Dev1 = (Cfg != NULL) ? FirstChildOfType (Cfg, XmlTag) : NULL;
+  if (Dev1 == NULL || GetNextXmlElement (&Cfg->TagChildren, Dev1, &Dev2) != EFI_SUCCESS) {
+    AsciiPrint ("  %a did not parse to the expected tree\n", OldDocument);
+    DriverXmlFreeTree (XmlTree);
+    return EFI_DEVICE_ERROR;
+  }
+  //
+  // "pci" at offset 17 became "nvme", so the second Dev moves from 26 to 27.
+  //
+  Status = DriverXmlReparseRange (NewDocument, AsciiStrLen (NewDocument), 17, 3, 4, NULL, XmlTree);
+  if (!EFI_ERROR (Status)) {
+    Status = PrintData (XmlTree, &Output);
+  }
+  if (!EFI_ERROR (Status)) {
+    Status = CheckOutput (
+               "PrintData after the reparse",
+               &Output,
+               "<Root><Cfg><Dev id=\"1\">nvme</Dev><Dev id=\"2\">usb</Dev></Cfg></Root>"
+               );
+  }
+  if (!EFI_ERROR (Status)) {
+    Dev1 = FirstChildOfType (Cfg, XmlTag);
+    if (Dev1 == NULL
+        || GetNextXmlElement (&Cfg->TagChildren, Dev1, &After) != EFI_SUCCESS
+        || After != Dev2
+        || ((DRIVER_XML_TAG*)Dev2)->SourceOffset != 27)
+    {
+      AsciiPrint ("  The element after the change was replaced or its span was not moved\n");
+      Status = EFI_DEVICE_ERROR;
+    }
+  }
+  if (!EFI_ERROR (Status)) {
+    ResetOutput (&Output);
+    Status = PrintDataIncremental (XmlTree, NewDocument, AsciiStrLen (NewDocument), &Output);
+  }
+  if (!EFI_ERROR (Status)) {
+    Status = CheckOutput ("PrintDataIncremental against the new document", &Output, NewDocument);
+  }
+  DriverXmlFreeTree (XmlTree);
+  ResetOutput (&Output);
+  return Status;
+}
+
+/**
+  Print a tree incrementally against the previous output, compare it with the text it should
+  be and make it the source for the next print.
+
+  @param[in]     What      The change that was made, for the failure message.
+  @param[in]     XmlTree   The tree.
+  @param[in out] Previous  The previous output. It is replaced by the new one.
+  @param[in]     Expected  The text the new output should hold.
+
+  @retval EFI_SUCCESS  The output is as expected.
+  @retval other        The print failed or the output is different.
+**/
+EFI_STATUS
+CheckIncrementalStep (
+  CHAR8*                  What,
+  DRIVER_XML_DATA_HEADER* XmlTree,
+  XML_DOCUMENT*           Previous,
+  CHAR8*                  Expected
+  )
+{
+  XML_DOCUMENT Output;
+  EFI_STATUS   Status;
+
+  gBS->SetMem (&Output, sizeof (Output), 0);
+  Status = PrintDataIncremental (XmlTree, Previous->XmlDocument, Previous->RequiredSize, &Output);
+  if (!EFI_ERROR (Status)) {
+    Status = CheckOutput (What, &Output, Expected);
+  }
+  ResetOutput (Previous);
+  *Previous = Output;
+  return Status;
+}
+
+/**
+  Edit a parsed document in the ways an application would and print it incrementally after
+  each edit. Only the changed elements may be rendered again; everything else, including the
+  comment and the formatting of the untouched start tags, must be copied from the last output.
+
+  @retval EFI_SUCCESS  Each print gave the expected output.
+  @retval other        The step that failed.
+**/
+EFI_STATUS
+CheckIncrementalEdits (
+  VOID
+  )
+{
+  CHAR8                   Document[] = "<Cfg><A  x='1' ><!--keep-->one</A><B>two</B><C y='2' /></Cfg>";
+  EFI_STATUS              Status;
+  DRIVER_XML_DATA_HEADER* XmlTree;
+  DRIVER_XML_TAG*         Cfg;
+  DRIVER_XML_TAG*         A;
+  DRIVER_XML_DATA_HEADER* B;
+  DRIVER_XML_DATA_HEADER* C;
+  DRIVER_XML_DATA_HEADER* Text;
+  XML_DOCUMENT            Output;
+
+  Status = DriverXmlParse (Document, AsciiStrLen (Document), &XmlTree);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+  Cfg = (DRIVER_XML_TAG*)FirstChildOfType ((DRIVER_XML_TAG*)XmlTree, XmlTag);
+  A = (Cfg != NULL) ? (DRIVER_XML_TAG*)FirstChildOfType (Cfg, XmlTag) : NULL;
+  if (A == NULL
+      || GetNextXmlElement (&Cfg->TagChildren, (DRIVER_XML_DATA_HEADER*)A, &B) != EFI_SUCCESS
+      || GetNextXmlElement (&Cfg->TagChildren, B, &C) != EFI_SUCCESS
+      || FirstChildOfType ((DRIVER_XML_TAG*)B, XmlChar) == NULL)
+  {
+    AsciiPrint ("  %a did not parse to the expected tree\n", Document);
+    DriverXmlFreeTree (XmlTree);
+    return EFI_DEVICE_ERROR;
+  }
+  gBS->SetMem (&Output, sizeof (Output), 0);
+  //
+  // Nothing changed yet, so the whole document is copied.
+  //
+  Status = PrintDataIncremental (XmlTree, Document, AsciiStrLen (Document), &Output);
+  if (!EFI_ERROR (Status)) {
+    Status = CheckOutput ("PrintDataIncremental before any change", &Output, Document);
+  }
+  if (!EFI_ERROR (Status)) {
+    Status = DriverXmlSetCharData (
+               (DRIVER_XML_TAG*)B,
+               (DRIVER_XML_CHAR_DATA*)FirstChildOfType ((DRIVER_XML_TAG*)B, XmlChar),
+               "2"
+               );
+  }
+  if (!EFI_ERROR (Status)) {
+    Status = CheckIncrementalStep (
+               "Setting the text of B",
+               XmlTree,
+               &Output,
+               "<Cfg><A  x='1' ><!--keep-->one</A><B>2</B><C y='2' /></Cfg>"
+               );
+  }
+  //
+  // DriverXmlDeleteElement does not mark anything, so the caller marks the tag.
+  //
+  if (!EFI_ERROR (Status)) {
+    Text = FirstChildOfType (A, XmlChar);
+    Status = (Text != NULL) ? DriverXmlDeleteElement (&A->TagChildren, Text) : EFI_NOT_FOUND;
+  }
+  if (!EFI_ERROR (Status)) {
+    DriverXmlMarkModified (A);
+    Status = CheckIncrementalStep (
+               "Deleting the text of A and marking it",
+               XmlTree,
+               &Output,
+               "<Cfg><A x=\"1\"></A><B>2</B><C y='2' /></Cfg>"
+               );
+  }
+  if (!EFI_ERROR (Status)) {
+    Status = DriverXmlDeleteChild ((DRIVER_XML_TAG*)B, C);
+    if (Status != EFI_NOT_FOUND) {
+      AsciiPrint ("  Deleting a node from a tag it is not under returned %r\n", Status);
+      Status = EFI_DEVICE_ERROR;
+    } else {
+      Status = DriverXmlDeleteChild (Cfg, C);
+    }
+  }
+  if (!EFI_ERROR (Status)) {
+    Status = CheckIncrementalStep (
+               "Deleting C",
+               XmlTree,
+               &Output,
+               "<Cfg><A x=\"1\"></A><B>2</B></Cfg>"
+               );
+  }
+  DriverXmlFreeTree (XmlTree);
+  ResetOutput (&Output);
+  return Status;
+}
+
+//
+// What the diff callbacks were called with, as text such as "Changed A,Removed D".
+//
+typedef struct _XML_DIFF_LOG {
+  CHAR8 Text[128];
+  UINTN Length;
+} XML_DIFF_LOG;
+
+/**
+  Add a difference to an XML_DIFF_LOG. A duplicate is written as the tag name of the repeat
+  and the name of the parent of each copy, so the copies can be told apart.
+
+  @param[in] Kind     What was found.
+  @param[in] OldTag   The tag in the old tree or the first copy, if there is one.
+  @param[in] NewTag   The tag in the new tree or the repeat, if there is one.
+  @param[in] Context  The XML_DIFF_LOG.
+**/
+VOID
+LogDifference (
+  DRIVER_XML_DIFF_KIND Kind,
+  DRIVER_XML_TAG*      OldTag,
+  DRIVER_XML_TAG*      NewTag,
+  VOID*                Context
+  )
+{
+  STATIC CONST CHAR8* KindNames[] = { "Changed", "Added", "Removed", "Duplicate" };
+  XML_DIFF_LOG*       Log;
+  CONST CHAR8*        Separator;
+
+  Log = Context;
+  Separator = (Log->Length != 0) ? "," : "";
+  if (Kind == XmlDiffDuplicate) {
+    Log->Length += AsciiSPrint (
+                     &Log->Text[Log->Length],
+                     sizeof (Log->Text) - Log->Length,
+                     "%aDuplicate %a in %a of %a",
+                     Separator,
+                     NewTag->TagName,
+                     NewTag->Parent->TagName,
+                     OldTag->Parent->TagName
+                     );
+  } else {
+    Log->Length += AsciiSPrint (
+                     &Log->Text[Log->Length],
+                     sizeof (Log->Text) - Log->Length,
+                     "%a%a %a",
+                     Separator,
+                     KindNames[Kind],
+                     (Kind == XmlDiffRemoved) ? OldTag->TagName : NewTag->TagName
+                     );
+  }
+}
+
+/**
+  Compare what the diff callbacks reported with what they should have.
+
+  @param[in] What      The function that was called, for the failure message.
+  @param[in] Log       What was reported.
+  @param[in] Expected  What should have been reported.
+
+  @retval EFI_SUCCESS       The reports match.
+  @retval EFI_DEVICE_ERROR  They are different. Both are printed.
+**/
+EFI_STATUS
+CheckDiffLog (
+  CHAR8*        What,
+  XML_DIFF_LOG* Log,
+  CHAR8*        Expected
+  )
+{
+  if (AsciiStrCmp (Log->Text, Expected) == 0) {
+    return EFI_SUCCESS;
+  }
+  AsciiPrint ("  %a is wrong\n  expected: %a\n  got:      %a\n", What, Expected, Log->Text);
+  return EFI_DEVICE_ERROR;
+}
+
+/**
+  Diff two versions of a document and search a document for repeated branches, checking
+  each difference and duplicate that is reported.
+
+  @retval EFI_SUCCESS  The reports were as expected.
+  @retval other        The step that failed.
+**/
+EFI_STATUS
+CheckDiffAndDuplicates (
+  VOID
+  )
+{
+  CHAR8                   OldDocument[] = "<Cfg><A v=\"1\"/><B><C>x</C></B><D/></Cfg>";
+  CHAR8                   NewDocument[] = "<Cfg><A v=\"2\"/><B><C>x</C></B><D/><E/></Cfg>";
+  CHAR8                   Repeats[] = "<Cfg><P><Q a=\"1\">t</Q></P><R><Q a=\"1\">t</Q></R><Q a=\"2\">t</Q></Cfg>";
+  EFI_STATUS              Status;
+  DRIVER_XML_DATA_HEADER* OldTree;
+  DRIVER_XML_DATA_HEADER* NewTree;
+  XML_DIFF_LOG            Log;
+
+  OldTree = NULL;
+  NewTree = NULL;
+  Status = DriverXmlParse (OldDocument, AsciiStrLen (OldDocument), &OldTree);
+  if (!EFI_ERROR (Status)) {
+    Status = DriverXmlParse (NewDocument, AsciiStrLen (NewDocument), &NewTree);
+  }
+  if (!EFI_ERROR (Status)) {
+    gBS->SetMem (&Log, sizeof (Log), 0);
+    Status = DriverXmlDiffTrees (OldTree, NewTree, LogDifference, &Log);
+  }
+  if (!EFI_ERROR (Status)) {
+    Status = CheckDiffLog ("DriverXmlDiffTrees", &Log, "Changed A,Added E");
+  }
+  //
+  // Diffing the other way round reports the same change and the removal.
+  //
+  if (!EFI_ERROR (Status)) {
+    gBS->SetMem (&Log, sizeof (Log), 0);
+    Status = DriverXmlDiffTrees (NewTree, OldTree, LogDifference, &Log);
+  }
+  if (!EFI_ERROR (Status)) {
+    Status = CheckDiffLog ("DriverXmlDiffTrees reversed", &Log, "Changed A,Removed E");
+  }
+  if (!EFI_ERROR (Status) && (DriverXmlTreesEqual (OldTree, NewTree) || !DriverXmlTreesEqual (OldTree, OldTree))) {
+    AsciiPrint ("  DriverXmlTreesEqual is wrong\n");
+    Status = EFI_DEVICE_ERROR;
+  }
+  if (OldTree != NULL) {
+    DriverXmlFreeTree (OldTree);
+  }
+  if (NewTree != NULL) {
+    DriverXmlFreeTree (NewTree);
+  }
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+  //
+  // The Q under R repeats the one under P. The last Q has a different attribute.
+  //
+  Status = DriverXmlParse (Repeats, AsciiStrLen (Repeats), &OldTree);
+  if (!EFI_ERROR (Status)) {
+    gBS->SetMem (&Log, sizeof (Log), 0);
+    Status = DriverXmlFindDuplicateSubtrees (OldTree, LogDifference, &Log);
+    DriverXmlFreeTree (OldTree);
+  }
+  if (!EFI_ERROR (Status)) {
+    Status = CheckDiffLog ("DriverXmlFindDuplicateSubtrees", &Log, "Duplicate Q in R of P");
+  }
+  return Status;
+}
+
+//
+// A file that keeps what is written to it in memory, for checking code that writes files.
+// It takes at most Capacity bytes and reports a short write after that. With a BlockSize
+// it also checks that everything but the last write before a flush is whole blocks.
+//
+typedef struct _XML_FAKE_FILE {
+  EFI_FILE_PROTOCOL File;
+  CHAR8             Data[64];
+  UINTN             Size;
+  UINTN             Capacity;
+  UINTN             BlockSize;
+  UINTN             Writes;
+  UINTN             Flushes;
+  BOOLEAN           PartialBlock;
+} XML_FAKE_FILE;
+
+//
+// The block size the file sink is given in CheckSinks.
+//
+#define XML_FAKE_FILE_BLOCK  8
+
+/**
+  EFI_FILE_PROTOCOL.Write for XML_FAKE_FILE. When the file has a block size, a write that is
+  not a whole number of blocks is remembered, since only the last write before a flush may be one.
+
+  @param[in]     This        The XML_FAKE_FILE.
+  @param[in out] BufferSize  The bytes to write. On output the bytes the file took.
+  @param[in]     Buffer      The data.
+
+  @retval EFI_SUCCESS       The file took what fit.
+  @retval EFI_DEVICE_ERROR  A partial block was written earlier.
+**/
+EFI_STATUS
+EFIAPI
+FakeFileWrite (
+  IN     EFI_FILE_PROTOCOL* This,
+  IN OUT UINTN*             BufferSize,
+  IN     VOID*              Buffer
+  )
+{
+  XML_FAKE_FILE* Fake;
+
+  Fake = (XML_FAKE_FILE*)This;
+  if (Fake->PartialBlock) {
+    AsciiPrint ("  The file sink wrote a partial block before the end\n");
+    return EFI_DEVICE_ERROR;
+  }
+  Fake->PartialBlock = (BOOLEAN)(Fake->BlockSize != 0 && (*BufferSize % Fake->BlockSize) != 0);
+  if (*BufferSize > Fake->Capacity - Fake->Size) {
+    *BufferSize = Fake->Capacity - Fake->Size;
+  }
+  gBS->CopyMem (&Fake->Data[Fake->Size], Buffer, *BufferSize);
+  Fake->Size += *BufferSize;
+  Fake->Writes++;
+  return EFI_SUCCESS;
+}
+
+/**
+  EFI_FILE_PROTOCOL.Flush for XML_FAKE_FILE.
+
+  @param[in] This  The XML_FAKE_FILE.
+
+  @retval EFI_SUCCESS  Always.
+**/
+EFI_STATUS
+EFIAPI
+FakeFileFlush (
+  IN EFI_FILE_PROTOCOL* This
+  )
+{
+  XML_FAKE_FILE* Fake;
+
+  Fake = (XML_FAKE_FILE*)This;
+  Fake->Flushes++;
+  Fake->PartialBlock = FALSE;
+  return EFI_SUCCESS;
+}
+
+/**
+  Set up an XML_FAKE_FILE.
+
+  @param[out] Fake       The file.
+  @param[in]  Capacity   The most it takes, up to the size of its Data.
+  @param[in]  BlockSize  The size writes should come in, or 0 for any size.
+**/
+VOID
+InitFakeFile (
+  XML_FAKE_FILE* Fake,
+  UINTN          Capacity,
+  UINTN          BlockSize
+  )
+{
+  gBS->SetMem (Fake, sizeof (XML_FAKE_FILE), 0);
+  Fake->File.Write = FakeFileWrite;
+  Fake->File.Flush = FakeFileFlush;
+  Fake->Capacity = MIN (Capacity, sizeof (Fake->Data));
+  Fake->BlockSize = BlockSize;
+}
+
+/**
+  Print a tree to the memory sink and to the file sink and check that both hold the same
+  text as PrintData gives. The file must be written in whole blocks and flushed once, and a
+  file that fills up must fail the print.
+
+  @retval EFI_SUCCESS  Both sinks held the expected output and the full file failed.
+  @retval other        The step that failed.
+**/
+EFI_STATUS
+CheckSinks (
+  VOID
+  )
+{
+  CHAR8                   Document[] = "<Cfg><Dev id=\"1\">pci &amp; usb</Dev></Cfg>";
+  CHAR8                   Expected[] = "<Root><Cfg><Dev id=\"1\">pci &amp; usb</Dev></Cfg></Root>";
+  EFI_STATUS              Status;
+  DRIVER_XML_DATA_HEADER* XmlTree;
+  DRIVER_XML_MEMORY_SINK  MemorySink;
+  DRIVER_XML_FILE_SINK    FileSink;
+  CHAR8                   Block[XML_FAKE_FILE_BLOCK];
+  XML_FAKE_FILE           Fake;
+  XML_DOCUMENT            Written;
+
+  Status = DriverXmlParse (Document, AsciiStrLen (Document), &XmlTree);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+  Status = DriverXmlInitMemorySink (&MemorySink);
+  if (!EFI_ERROR (Status)) {
+    Status = PrintDataToSink (XmlTree, &MemorySink.Sink);
+  }
+  if (!EFI_ERROR (Status)) {
+    Status = CheckOutput ("The memory sink", &MemorySink.Document, Expected);
+  }
+  ResetOutput (&MemorySink.Document);
+  InitFakeFile (&Fake, sizeof (Fake.Data), XML_FAKE_FILE_BLOCK);
+  if (!EFI_ERROR (Status)) {
+    Status = DriverXmlInitFileSink (&FileSink, &Fake.File, Block, sizeof (Block));
+  }
+  if (!EFI_ERROR (Status)) {
+    Status = PrintDataToSink (XmlTree, &FileSink.Sink);
+  }
+  if (!EFI_ERROR (Status)) {
+    gBS->SetMem (&Written, sizeof (Written), 0);
+    Written.XmlDocument = Fake.Data;
+    Written.RequiredSize = Fake.Size;
+    Status = CheckOutput ("The file sink", &Written, Expected);
+  }
+  if (!EFI_ERROR (Status) && (Fake.Flushes != 1 || Fake.Writes < 2)) {
+    AsciiPrint ("  The file sink wrote %d times and flushed %d times\n", Fake.Writes, Fake.Flushes);
+    Status = EFI_DEVICE_ERROR;
+  }
+  //
+  // A file that takes only part of a block makes the write fail.
+  //
+  if (!EFI_ERROR (Status)) {
+    InitFakeFile (&Fake, XML_FAKE_FILE_BLOCK * 2 + 1, XML_FAKE_FILE_BLOCK);
+    DriverXmlInitFileSink (&FileSink, &Fake.File, Block, sizeof (Block));
+    Status = PrintDataToSink (XmlTree, &FileSink.Sink);
+    if (Status != EFI_DEVICE_ERROR) {
+      AsciiPrint ("  Printing to a full file returned %r\n", Status);
+      Status = EFI_DEVICE_ERROR;
+    } else {
+      Status = EFI_SUCCESS;
+    }
+  }
+  DriverXmlFreeTree (XmlTree);
+  return Status;
+}
+
+#ifdef XML_TEST_DEBUG_RING
+/**
+  Send debug output to a small ring until it wraps, dump it to a file twice and check that
+  each dump holds the newest output, oldest first, and that the ring is gone once stopped.
+  The second message fills the ring by itself, so a timestamp in front of it does not
+  change what the ring ends up holding.
+
+  @retval EFI_SUCCESS  Each dump held the expected output, or a ring was already running.
+  @retval other        The step that failed.
+**/
+EFI_STATUS
+CheckDebugRing (
+  VOID
+  )
+{
+  EFI_STATUS    Status;
+  UINT32        ErrorLevel;
+  UINT64        Total;
+  XML_FAKE_FILE Fake;
+  XML_DOCUMENT  Written;
+
+  Status = DebugToConsoleStartRing (16);
+  if (Status == EFI_ALREADY_STARTED) {
+    AsciiPrint ("  A debug ring is already running, so it was left alone\n");
+    return EFI_SUCCESS;
+  }
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+  ErrorLevel = GetDebugPrintErrorLevel ();
+  SetDebugPrintErrorLevel (DEBUG_ERROR);
+  DebugPrint (DEBUG_ERROR, "first line\n");
+  DebugPrint (DEBUG_ERROR, "0123456789ABCDEF\n");
+  SetDebugPrintErrorLevel (ErrorLevel);
+  InitFakeFile (&Fake, sizeof (Fake.Data), 0);
+  Status = DebugToConsoleDumpRing (&Fake.File);
+  if (!EFI_ERROR (Status)) {
+    Status = DebugToConsoleDumpRing (&Fake.File);
+  }
+  DebugToConsoleStopRing (&Total);
+  if (!EFI_ERROR (Status)) {
+    gBS->SetMem (&Written, sizeof (Written), 0);
+    Written.XmlDocument = Fake.Data;
+    Written.RequiredSize = Fake.Size;
+    Status = CheckOutput ("The ring dumped twice", &Written, "123456789ABCDEF\n123456789ABCDEF\n");
+  }
+  if (!EFI_ERROR (Status) && Total < sizeof ("first line\n0123456789ABCDEF\n") - 1) {
+    AsciiPrint ("  The ring counted %ld characters\n", Total);
+    Status = EFI_DEVICE_ERROR;
+  }
+  if (!EFI_ERROR (Status) && DebugToConsoleDumpRing (&Fake.File) != EFI_NOT_STARTED) {
+    AsciiPrint ("  The ring could still be dumped after it was stopped\n");
+    Status = EFI_DEVICE_ERROR;
+  }
+  return Status;
+}
+#endif
+
+CONST XML_SELF_CHECK_ENTRY mXmlSelfChecks[] = {
+  { "Hand built tree",              CheckHandBuiltTree },
+  { "Truncated documents",          CheckTruncatedDocuments },
+  { "Literal values in a raw tree", CheckLiteralValuesInRawTree },
+  { "Writer errors",                CheckWriterErrors },
+  { "Snapshots and forks",          CheckSnapshots },
+  { "Reparse a range",              CheckReparseRange },
+  { "Incremental print of edits",   CheckIncrementalEdits },
+  { "Diff and duplicate branches",  CheckDiffAndDuplicates },
+  { "Memory and file sinks",        CheckSinks },
+#ifdef XML_TEST_DEBUG_RING
+  { "Debug ring",                   CheckDebugRing },
+#endif
+};
+
+/**
+  Run every self check and report each one.
+
+  @retval EFI_SUCCESS       Every check passed.
+  @retval EFI_DEVICE_ERROR  At least one check failed.
+**/
+EFI_STATUS
+RunSelfChecks (
+  VOID
+  )
+{
+  UINTN      Index;
+  UINTN      Failed;
+  EFI_STATUS Status;
+
+  Failed = 0;
+  for (Index = 0; Index < ARRAY_SIZE (mXmlSelfChecks); Index++) {
+    Status = mXmlSelfChecks[Index].Check ();
+    AsciiPrint ("%a: %a", EFI_ERROR (Status) ? "FAIL" : "pass", mXmlSelfChecks[Index].Name);
+    if (EFI_ERROR (Status)) {
+      AsciiPrint (" (%r)", Status);
+      Failed++;
+    }
+    AsciiPrint ("\n");
+  }
+  AsciiPrint ("%d of %d self checks passed\n", ARRAY_SIZE (mXmlSelfChecks) - Failed, ARRAY_SIZE (mXmlSelfChecks));
+  return (Failed == 0) ? EFI_SUCCESS : EFI_DEVICE_ERROR;
+}
@@ -29,10 +29,31 @@
 #include <Protocol/EfiShell.h>
 #include <Protocol/EfiShellParameters.h>
 #include <Library/DebugLib.h>
+#include <Library/BaseLib.h>
+#include <Library/PrintLib.h>
+#include <Library/TimerLib.h>
+#include <Library/DebugPrintErrorLevelLib.h>
+#include <Library/DebugTraceLib.h>
 #include <Library/OpenFileLib.h>
 #include <Library/DriverXmlLib.h>
 #include <Library/HexPrintLib.h>
 
+//
+// How deeply the -d benchmark nests its elements.
+//
+#define DEEP_TREE_LEVELS  100000
+
+//
+// How many devices the -g report lists, and how much of its end is kept to show.
+//
+#define REPORT_DEVICES    100000
+#define REPORT_TAIL_SIZE  256
+
+//
+// How many parser events the -r trace keeps. Older ones are overwritten.
+//
+#define XML_TEST_TRACE_RECORDS  65536
+
 EFI_SHELL_PROTOCOL*            pEfiShellProtocol;
 EFI_SHELL_PARAMETERS_PROTOCOL* pEfiShellParametersProtocol;
 
@@ -79,11 +100,348 @@ InitalizeShellInterfaces (
   return Status;
 }
 
+/**
+  Get the time since a performance counter value was read. The counter may count
+  up or down and may have wrapped once.
+
+  @param[in] Start  The value GetPerformanceCounter returned when timing started.
+
+  @return The elapsed time in nanoseconds.
+**/
+UINT64
+ElapsedNanoSeconds (
+  UINT64 Start
+  )
+{
+  UINT64 Now;
+  UINT64 CounterStart;
+  UINT64 CounterEnd;
+
+  Now = GetPerformanceCounter ();
+  GetPerformanceCounterProperties (&CounterStart, &CounterEnd);
+  if (CounterStart < CounterEnd) {
+    if (Now >= Start) {
+      return GetTimeInNanoSecond (Now - Start);
+    }
+    return GetTimeInNanoSecond ((CounterEnd - Start) + (Now - CounterStart) + 1);
+  }
+  if (Now <= Start) {
+    return GetTimeInNanoSecond (Start - Now);
+  }
+  return GetTimeInNanoSecond ((Start - CounterEnd) + (CounterStart - Now) + 1);
+}
+
 VOID
 DbgShowChars (
   UINTN NumChars,
   CHAR8* Chars
   );
+
+EFI_STATUS
+RunSelfChecks (
+  VOID
+  );
+
+/**
+  Show the namespace and local name the parser resolved for each top level tag.
+
+  @param[in] Root       The root returned by the parser.
+  @param[in] NameTable  The name table the document was parsed with.
+**/
+VOID
+PrintTopLevelNamespaces (
+  DRIVER_XML_DATA_HEADER* Root,
+  DRIVER_XML_NAME_TABLE*  NameTable
+  )
+{
+  LIST_ANCHOR*            Children;
+  DRIVER_XML_DATA_HEADER* Child;
+  DRIVER_XML_TAG*         Tag;
+  CONST CHAR8*            Uri;
+
+  Children = &((DRIVER_XML_TAG*)Root)->TagChildren;
+  if (Children->ItemCount == 0) {
+    return;
+  }
+  Child = (DRIVER_XML_DATA_HEADER*)&Children->ListStart;
+  while (GetNextXmlElement (Children, Child, &Child) == EFI_SUCCESS) {
+    if (Child->XmlDataType != XmlTag && Child->XmlDataType != XmlEmptyTag) {
+      continue;
+    }
+    Tag = (DRIVER_XML_TAG*)Child;
+    Uri = DriverXmlGetName (NameTable, Tag->NamespaceId);
+    AsciiPrint (
+      "%a -> {%a}%a\n",
+      Tag->TagName,
+      (Uri != NULL) ? Uri : "",
+      DriverXmlGetName (NameTable, Tag->LocalNameId)
+      );
+  }
+}
+
+/**
+  Show how much memory DriverXmlLib is using, split by what it was allocated for.
+
+  @param[in] Title  A line printed above the table.
+**/
+VOID
+PrintXmlStats (
+  CHAR8* Title
+  )
+{
+  DRIVER_XML_STATS Stats;
+  UINTN            Index;
+  STATIC CHAR8*    TypeNames[XmlAllocTypeMax] = {
+    "Tag", "Attribute", "CharData", "Pi", "String", "Scratch", "Table", "Output", "Snapshot"
+  };
+
+  if (EFI_ERROR (DriverXmlGetStats (&Stats))) {
+    return;
+  }
+  AsciiPrint ("%a\n", Title);
+  AsciiPrint ("  Type       Allocs    Frees  Current    Total\n");
+  for (Index = 0; Index < XmlAllocTypeMax; Index++) {
+    AsciiPrint (
+      "  %-9a %7d %8d %8d %8d\n",
+      TypeNames[Index],
+      Stats.Types[Index].Allocations,
+      Stats.Types[Index].Frees,
+      Stats.Types[Index].CurrentBytes,
+      Stats.Types[Index].TotalBytes
+      );
+  }
+  AsciiPrint (
+    "  Current %d bytes, peak %d bytes, %d transient allocations of %d bytes\n",
+    Stats.CurrentBytes,
+    Stats.PeakBytes,
+    Stats.TransientCount,
+    Stats.TransientBytes
+    );
+}
+
+/**
+  Build a document with elements nested DEEP_TREE_LEVELS deep, then time parsing it, printing it,
+  writing the canonical form and freeing the tree. Every step walks the tree without recursion
+  so this runs in the stack any shell app gets. Times are in nanoseconds.
+
+  @param[in] ParseOptions  The options from the command line.
+  @param[in] ShowStats     Show the library's memory use once the tree is built.
+
+  @retval EFI_SUCCESS           The benchmark ran.
+  @retval EFI_OUT_OF_RESOURCES  The document could not be allocated.
+  @retval other                 The status of the step that failed.
+**/
+EFI_STATUS
+RunDeepTreeBenchmark (
+  DRIVER_XML_PARSE_OPTIONS* ParseOptions,
+  BOOLEAN                   ShowStats
+  )
+{
+  EFI_STATUS              Status;
+  CHAR8*                  Document;
+  UINTN                   DocumentSize;
+  CHAR8*                  Next;
+  UINTN                   Index;
+  DRIVER_XML_DATA_HEADER* XmlTree;
+  XML_DOCUMENT            OutputDocument;
+  UINT64                  Start;
+  UINT64                  ParseTime;
+  UINT64                  PrintTime;
+  UINT64                  CanonicalTime;
+  UINT64                  FreeTime;
+
+  //
+  // <d> for each level, then the text, then </d> for each level.
+  //
+  DocumentSize = DEEP_TREE_LEVELS * 7 + 4;
+  Status = gBS->AllocatePool (EfiBootServicesData, DocumentSize, (VOID**)&Document);
+  if (EFI_ERROR (Status)) {
+    return EFI_OUT_OF_RESOURCES;
+  }
+  Next = Document;
+  for (Index = 0; Index < DEEP_TREE_LEVELS; Index++) {
+    gBS->CopyMem (Next, "<d>", 3);
+    Next += 3;
+  }
+  gBS->CopyMem (Next, "deep", 4);
+  Next += 4;
+  for (Index = 0; Index < DEEP_TREE_LEVELS; Index++) {
+    gBS->CopyMem (Next, "</d>", 4);
+    Next += 4;
+  }
+  AsciiPrint ("Deep tree benchmark, %d levels, %d bytes\n", DEEP_TREE_LEVELS, DocumentSize);
+
+  Start = GetPerformanceCounter ();
+  Status = DriverXmlParseEx (Document, DocumentSize, ParseOptions, &XmlTree);
+  ParseTime = ElapsedNanoSeconds (Start);
+  gBS->FreePool (Document);
+  if (EFI_ERROR (Status)) {
+    AsciiPrint ("Parse failed: %r\n", Status);
+    return Status;
+  }
+  if (ShowStats) {
+    PrintXmlStats ("Memory after parse:");
+  }
+
+  gBS->SetMem (&OutputDocument, sizeof (OutputDocument), 0);
+  Start = GetPerformanceCounter ();
+  Status = PrintData (XmlTree, &OutputDocument);
+  PrintTime = ElapsedNanoSeconds (Start);
+  if (!EFI_ERROR (Status)) {
+    AsciiPrint ("Printed %d bytes\n", OutputDocument.RequiredSize);
+    //
+    // Reuse the output buffer so the canonical write times the walk rather than the growth.
+    //
+    OutputDocument.RequiredSize = 0;
+    OutputDocument.OperationPtr = OutputDocument.XmlDocument;
+    Start = GetPerformanceCounter ();
+    Status = PrintDataCanonical (XmlTree, ParseOptions->NameTable, DRIVER_XML_C14N_RAW_TEXT, &OutputDocument);
+    CanonicalTime = ElapsedNanoSeconds (Start);
+  }
+  if (EFI_ERROR (Status)) {
+    AsciiPrint ("Print failed: %r\n", Status);
+    CanonicalTime = 0;
+  }
+
+  Start = GetPerformanceCounter ();
+  DriverXmlFreeTree (XmlTree);
+  FreeTime = ElapsedNanoSeconds (Start);
+  if (OutputDocument.XmlDocument != NULL) {
+    gBS->FreePool (OutputDocument.XmlDocument);
+  }
+
+  AsciiPrint ("  Parse     %16ld ns\n", ParseTime);
+  AsciiPrint ("  Print     %16ld ns\n", PrintTime);
+  AsciiPrint ("  Canonical %16ld ns\n", CanonicalTime);
+  AsciiPrint ("  Free      %16ld ns\n", FreeTime);
+  return Status;
+}
+
+/**
+  Write an inventory report with the writer API, without building a tree. The report goes to a
+  ring sink, so only its end is kept however long it gets, and the library allocates nothing.
+
+  @param[in] ShowStats  Show the library's memory use once the report is written.
+
+  @retval EFI_SUCCESS  The report was written.
+  @retval other        The error from the writer.
+**/
+EFI_STATUS
+RunWriterReport (
+  BOOLEAN ShowStats
+  )
+{
+  EFI_STATUS           Status;
+  DRIVER_XML_RING_SINK RingSink;
+  DRIVER_XML_WRITER    Writer;
+  CHAR8                Ring[REPORT_TAIL_SIZE];
+  CHAR8                Tail[REPORT_TAIL_SIZE];
+  UINTN                TailSize;
+  CHAR8                NameStack[64];
+  CHAR8                Value[24];
+  UINTN                Index;
+  UINT64               Start;
+  UINT64               Time;
+
+  DriverXmlInitRingSink (&RingSink, Ring, sizeof (Ring));
+  DriverXmlInitWriter (&Writer, &RingSink.Sink, NameStack, sizeof (NameStack));
+  Start = GetPerformanceCounter ();
+  DriverXmlWriterStartElement (&Writer, "Inventory");
+  for (Index = 0; Index < REPORT_DEVICES; Index++) {
+    DriverXmlWriterStartElement (&Writer, "Device");
+    AsciiSPrint (Value, sizeof (Value), "%d", Index);
+    DriverXmlWriterAttribute (&Writer, "Id", Value);
+    AsciiSPrint (Value, sizeof (Value), "%02x:%02x.%x", (Index >> 8) & 0xFF, (Index >> 3) & 0x1F, Index & 7);
+    DriverXmlWriterAttribute (&Writer, "Bdf", Value);
+    DriverXmlWriterStartElement (&Writer, "Class");
+    DriverXmlWriterText (&Writer, "Mass Storage & Network", 22);
+    DriverXmlWriterEndElement (&Writer);
+    DriverXmlWriterEndElement (&Writer);
+  }
+  //
+  // The writer keeps the first error, so it is enough to check once at the end.
+  //
+  Status = DriverXmlWriterFinish (&Writer);
+  Time = ElapsedNanoSeconds (Start);
+  if (EFI_ERROR (Status)) {
+    AsciiPrint ("Report failed: %r\n", Status);
+    return Status;
+  }
+  AsciiPrint ("Wrote %ld bytes for %d devices in %ld ns. The report ends:\n", RingSink.TotalBytes, REPORT_DEVICES, Time);
+  TailSize = sizeof (Tail);
+  DriverXmlReadRingSink (&RingSink, Tail, &TailSize);
+  DbgShowChars (TailSize, Tail);
+  DEBUG ((DEBUG_ERROR, "\n"));
+  if (ShowStats) {
+    PrintXmlStats ("Memory after the report:");
+  }
+  return EFI_SUCCESS;
+}
+
+/**
+  Hand a parsed tree over in the binary token format and check that the other side gets the same tree.
+  Shows the size of the tokens next to the text and the time taken to encode and decode them,
+  and to parse the text again for comparison.
+
+  @param[in] XmlTree       The parsed tree.
+  @param[in] ParseOptions  The options the text was parsed with.
+  @param[in] XmlText       The text the tree came from.
+  @param[in] TextSize      The size of XmlText.
+
+  @retval EFI_SUCCESS  The decoded tree matches.
+  @retval other        The error from encoding or decoding, or EFI_DEVICE_ERROR if the trees differ.
+**/
+EFI_STATUS
+RunBinaryExchange (
+  DRIVER_XML_DATA_HEADER*   XmlTree,
+  DRIVER_XML_PARSE_OPTIONS* ParseOptions,
+  VOID*                     XmlText,
+  UINTN                     TextSize
+  )
+{
+  EFI_STATUS              Status;
+  XML_DOCUMENT            Tokens;
+  DRIVER_XML_DATA_HEADER* Decoded;
+  DRIVER_XML_DATA_HEADER* Reparsed;
+  UINT64                  EncodeTime;
+  UINT64                  DecodeTime;
+  UINT64                  ParseTime;
+  UINT64                  Start;
+
+  gBS->SetMem (&Tokens, sizeof (Tokens), 0);
+  Start = GetPerformanceCounter ();
+  Status = DriverXmlEncodeBinary (XmlTree, &Tokens);
+  EncodeTime = ElapsedNanoSeconds (Start);
+  if (EFI_ERROR (Status)) {
+    AsciiPrint ("Binary encoding failed: %r\n", Status);
+    return Status;
+  }
+  Start = GetPerformanceCounter ();
+  Status = DriverXmlDecodeBinary (Tokens.XmlDocument, Tokens.RequiredSize, ParseOptions, &Decoded);
+  DecodeTime = ElapsedNanoSeconds (Start);
+  if (EFI_ERROR (Status)) {
+    AsciiPrint ("Binary decoding failed: %r\n", Status);
+    gBS->FreePool (Tokens.XmlDocument);
+    return Status;
+  }
+  Start = GetPerformanceCounter ();
+  Status = DriverXmlParseEx (XmlText, TextSize, ParseOptions, &Reparsed);
+  ParseTime = ElapsedNanoSeconds (Start);
+  if (!EFI_ERROR (Status)) {
+    DriverXmlFreeTree (Reparsed);
+  }
+  AsciiPrint ("Binary exchange: %d bytes of tokens for %d bytes of text\n", Tokens.RequiredSize, TextSize);
+  AsciiPrint ("  encode %ld ns, decode %ld ns, parse text %ld ns\n", EncodeTime, DecodeTime, ParseTime);
+  Status = EFI_SUCCESS;
+  if (!DriverXmlTreesEqual (XmlTree, Decoded)) {
+    AsciiPrint ("  The decoded tree is different\n");
+    Status = EFI_DEVICE_ERROR;
+  }
+  DriverXmlFreeTree (Decoded);
+  gBS->FreePool (Tokens.XmlDocument);
+  return Status;
+}
+
 EFI_STATUS
 XmlTestEntryPoint (
     IN  EFI_HANDLE        ImageHandle,
@@ -99,9 +457,40 @@ XmlTestEntryPoint (
   UINTN      FileSize;
   DRIVER_XML_DATA_HEADER* XmlTree;
   XML_DOCUMENT OutputDocument;
+  CHAR8*     OutputBuffer;
+  UINTN      OutputSize;
+  DRIVER_XML_PARSE_OPTIONS ParseOptions;
+  BOOLEAN    ShowStats;
+  BOOLEAN    ShowCanonical;
+  BOOLEAN    DeepTree;
+  BOOLEAN    WriterReport;
+  BOOLEAN    BinaryExchange;
+  BOOLEAN    ShowJson;
+  BOOLEAN    SelfChecks;
+  DRIVER_XML_CONSOLE_SINK ConsoleSink;
+  XML_DOCUMENT JsonDocument;
+  UINT32     CanonicalFlags;
+  CHAR16*    TraceArgString;
+  EFI_STATUS ParseStatus;
+  EFI_FILE_PROTOCOL* TraceFile;
   
   FileArgString = NULL;
+  TraceArgString = NULL;
+  OutputBuffer = NULL;
+  gBS->SetMem (&OutputDocument, sizeof (OutputDocument), 0);
+  ShowStats = FALSE;
+  ShowCanonical = FALSE;
+  DeepTree = FALSE;
+  WriterReport = FALSE;
+  BinaryExchange = FALSE;
+  ShowJson = FALSE;
+  SelfChecks = FALSE;
   ArgStrLen = 0;
+  ParseOptions.Flags = DRIVER_XML_PARSE_DEFAULT_FLAGS;
+  ParseOptions.NameTable = NULL;
+  ParseOptions.MaxEntityDepth = 0;
+  ParseOptions.MaxEntityExpansion = 0;
+  gBS->SetMem (&ParseOptions.Limits, sizeof (ParseOptions.Limits), 0);
   AsciiPrint("entry\n");
   DEBUG((DEBUG_ERROR,"Debug output test\n"));
   Status = InitalizeShellInterfaces (ImageHandle);
@@ -120,6 +509,115 @@ XmlTestEntryPoint (
         case 'b':
           pEfiShellProtocol->EnablePageBreak ();
           break;
+        case 'W':
+        case 'w':
+          //
+          // Keep whitespace-only char data between elements
+          //
+          ParseOptions.Flags &= ~DRIVER_XML_PARSE_DROP_WHITESPACE;
+          break;
+        case 'T':
+        case 't':
+          ParseOptions.Flags |= DRIVER_XML_PARSE_TRIM_CHAR_DATA;
+          break;
+        case 'N':
+        case 'n':
+          ParseOptions.Flags |= DRIVER_XML_PARSE_NORMALIZE_CHAR_DATA;
+          break;
+        case 'S':
+        case 's':
+          //
+          // Namespace aware parse. The name table holds the prefixes, URIs and local names.
+          //
+          if (ParseOptions.NameTable == NULL) {
+            Status = DriverXmlCreateNameTable (&ParseOptions.NameTable);
+            if (EFI_ERROR (Status)) {
+              AsciiPrint ("Unable to create a name table: %r\n", Status);
+              return Status;
+            }
+          }
+          ParseOptions.Flags |= DRIVER_XML_PARSE_NAMESPACES;
+          break;
+        case 'E':
+        case 'e':
+          //
+          // Expand entities with the default depth and size limits.
+          //
+          ParseOptions.Flags |= DRIVER_XML_PARSE_EXPAND_ENTITIES;
+          break;
+        case 'M':
+        case 'm':
+          //
+          // Report the library's memory use after the parse and after the tree is freed.
+          //
+          ShowStats = TRUE;
+          break;
+        case 'C':
+        case 'c':
+          //
+          // Also write the canonical form that would be hashed for a signature check.
+          //
+          ShowCanonical = TRUE;
+          break;
+        case 'D':
+        case 'd':
+          //
+          // Time a generated, very deep document instead of reading a file.
+          //
+          DeepTree = TRUE;
+          break;
+        case 'G':
+        case 'g':
+          //
+          // Generate a large report with the writer API instead of reading a file.
+          //
+          WriterReport = TRUE;
+          break;
+        case 'X':
+        case 'x':
+          //
+          // Round trip the tree through the binary token format.
+          //
+          BinaryExchange = TRUE;
+          break;
+        case 'J':
+        case 'j':
+          //
+          // Print the tree as JSON.
+          //
+          ShowJson = TRUE;
+          break;
+        case 'U':
+        case 'u':
+          //
+          // Run the self checks instead of reading a file.
+          //
+          SelfChecks = TRUE;
+          break;
+        case 'L':
+        case 'l':
+          //
+          // The next argument is the debug print error level in hex. 0 turns DEBUG output off.
+          //
+          if (Index + 1 >= pEfiShellParametersProtocol->Argc) {
+            AsciiPrint ("-l needs a debug level.\n");
+            return EFI_INVALID_PARAMETER;
+          }
+          Index++;
+          SetDebugPrintErrorLevel ((UINT32)StrHexToUintn (pEfiShellParametersProtocol->Argv[Index]));
+          break;
+        case 'R':
+        case 'r':
+          //
+          // The next argument is the file the parser trace is written to.
+          //
+          if (Index + 1 >= pEfiShellParametersProtocol->Argc) {
+            AsciiPrint ("-r needs a trace file.\n");
+            return EFI_INVALID_PARAMETER;
+          }
+          Index++;
+          TraceArgString = pEfiShellParametersProtocol->Argv[Index];
+          break;
         default:
           AsciiPrint("Unexpected option %S.\n",ArgStrPtr);
           return EFI_INVALID_PARAMETER;
@@ -134,6 +632,27 @@ XmlTestEntryPoint (
     }
   }//end for loop
   
+  if (SelfChecks) {
+    Status = RunSelfChecks ();
+    if (ParseOptions.NameTable != NULL) {
+      DriverXmlFreeNameTable (ParseOptions.NameTable);
+    }
+    return Status;
+  }
+  if (WriterReport) {
+    Status = RunWriterReport (ShowStats);
+    if (ParseOptions.NameTable != NULL) {
+      DriverXmlFreeNameTable (ParseOptions.NameTable);
+    }
+    return Status;
+  }
+  if (DeepTree) {
+    Status = RunDeepTreeBenchmark (&ParseOptions, ShowStats);
+    if (ParseOptions.NameTable != NULL) {
+      DriverXmlFreeNameTable (ParseOptions.NameTable);
+    }
+    return Status;
+  }
   if (FileArgString == NULL) {
     AsciiPrint("Please specify an XML file for testing\n");
     return EFI_INVALID_PARAMETER;
@@ -147,25 +666,127 @@ XmlTestEntryPoint (
     AsciiPrint ("Unable to open file %S, %r\n",FileArgString,Status);
     return EFI_INVALID_PARAMETER;
   }
-  Status = DriverXmlParse(
+  if (TraceArgString != NULL) {
+    Status = DebugTraceStart (XML_TEST_TRACE_RECORDS);
+    if (EFI_ERROR (Status)) {
+      AsciiPrint ("Unable to start the trace, %r\n", Status);
+      TraceArgString = NULL;
+    }
+  }
+  Status = DriverXmlParseEx(
              FileBuffer,
              FileSize,
+             &ParseOptions,
              &XmlTree
            );
+  if (TraceArgString != NULL) {
+    //
+    // The trace covers the parse only, so write it out before anything else runs.
+    //
+    ParseStatus = Status;
+    Status = CreateFileFromArgument (TraceArgString, &TraceFile);
+    if (!EFI_ERROR (Status)) {
+      Status = DebugTraceDump (TraceFile);
+      TraceFile->Close (TraceFile);
+    }
+    if (EFI_ERROR (Status)) {
+      AsciiPrint ("Unable to write trace file %S, %r\n", TraceArgString, Status);
+    }
+    DebugTraceStop ();
+    Status = ParseStatus;
+  }
 
   if (EFI_ERROR (Status)) {
+    AsciiPrint ("Parse failed: %r\n", Status);
+    if (ParseOptions.NameTable != NULL) {
+      DriverXmlFreeNameTable (ParseOptions.NameTable);
+    }
     return Status;
   }
+  if (ShowStats) {
+    PrintXmlStats ("Memory after parse:");
+  }
+  if (ParseOptions.NameTable != NULL) {
+    PrintTopLevelNamespaces (XmlTree, ParseOptions.NameTable);
+  }
   Status = DbgPrintData (XmlTree, TRUE, 0);
-  OutputDocument.DocumentSize = 0;
-  OutputDocument.OperationPtr = NULL;
-  OutputDocument.XmlDocument = NULL;
-  Status = PrintData (XmlTree,&OutputDocument);
+  //
+  // Measure the output, then write it into a buffer of exactly that size.
+  //
+  Status = DriverXmlMeasureData (XmlTree, &OutputSize);
+  if (!EFI_ERROR (Status)) {
+    Status = gBS->AllocatePool (EfiBootServicesData, OutputSize + 1, (VOID**)&OutputBuffer);
+  }
+  if (!EFI_ERROR (Status)) {
+    Status = PrintDataToBuffer (XmlTree, OutputBuffer, &OutputSize);
+  }
+  if (EFI_ERROR (Status)) {
+    AsciiPrint ("Print failed: %r\n", Status);
+    OutputSize = 0;
+  }
 
   AsciiPrint("\n\n");
-  DbgShowChars (OutputDocument.DocumentSize, OutputDocument.XmlDocument);
-  AsciiPrint("\n");
-  HexPrintToConsole (OutputDocument.XmlDocument,OutputDocument.DocumentSize);
+  DbgShowChars (OutputSize, OutputBuffer);
+  //
+  // The debug output goes out a line at a time, so end the line with DEBUG to
+  // keep it ahead of the console output that follows.
+  //
+  DEBUG ((DEBUG_ERROR, "\n"));
+  HexPrintToConsole (OutputBuffer, OutputSize);
   AsciiPrint("\n");
+  if (ShowCanonical) {
+    //
+    // Without entity expansion the tree still holds the references as written.
+    //
+    CanonicalFlags = 0;
+    if ((ParseOptions.Flags & DRIVER_XML_PARSE_EXPAND_ENTITIES) == 0) {
+      CanonicalFlags |= DRIVER_XML_C14N_RAW_TEXT;
+    }
+    Status = PrintDataCanonical (XmlTree, ParseOptions.NameTable, CanonicalFlags, &OutputDocument);
+    if (EFI_ERROR (Status)) {
+      AsciiPrint ("Canonicalization failed: %r\n", Status);
+    } else {
+      AsciiPrint ("Canonical form:\n");
+      DbgShowChars (OutputDocument.RequiredSize, OutputDocument.XmlDocument);
+      DEBUG ((DEBUG_ERROR, "\n"));
+    }
+  }
+  if (ShowJson) {
+    //
+    // The JSON goes straight to the console, so nothing is buffered however big the tree is.
+    //
+    DriverXmlInitConsoleSink (&ConsoleSink);
+    gBS->SetMem (&JsonDocument, sizeof (JsonDocument), 0);
+    JsonDocument.Sink = &ConsoleSink.Sink;
+    AsciiPrint ("JSON:\n");
+    Status = PrintDataJson (
+               XmlTree,
+               ((ParseOptions.Flags & DRIVER_XML_PARSE_EXPAND_ENTITIES) == 0) ? DRIVER_XML_JSON_RAW_TEXT : 0,
+               &JsonDocument
+               );
+    AsciiPrint ("\n");
+    if (EFI_ERROR (Status)) {
+      AsciiPrint ("JSON conversion failed: %r\n", Status);
+    }
+  }
+  if (BinaryExchange) {
+    RunBinaryExchange (XmlTree, &ParseOptions, FileBuffer, FileSize);
+  }
+  DriverXmlFreeTree (XmlTree);
+  if (ParseOptions.NameTable != NULL) {
+    DriverXmlFreeNameTable (ParseOptions.NameTable);
+  }
+  if (ShowStats) {
+    //
+    // Only a canonical output document should be left, and it belongs to us.
+    //
+    PrintXmlStats ("Memory after freeing the tree:");
+  }
+  if (OutputDocument.XmlDocument != NULL) {
+    gBS->FreePool (OutputDocument.XmlDocument);
+  }
+  if (OutputBuffer != NULL) {
+    gBS->FreePool (OutputBuffer);
+  }
   return EFI_SUCCESS;
 }